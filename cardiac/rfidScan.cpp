@@ -107,18 +107,28 @@
 
 #include "../comm/shmData.h"
 #include "../comm/simUtil.h"
+#include "../comm/simModule.h"
+#include "../comm/simSession.h"
 
 #define SCAN_CONFIG "/simulator/rfid.xml"
 #define PARSE_STATE_NONE	0
 #define PARSE_STATE_TAG		1
 #define PARSE_STATE_TRIM	2
 #define TAG_BUF_LEN 100
+#define RFID_TTY	1		// SIM_UART_RFID, the session channel
 
 using namespace std;
 
+#ifndef SIM_HUB
 struct shmData *shmData;
+int debug = 0;
+#else
+extern struct shmData *shmData;
+extern int debug;
+#endif
 
 struct rfidData *rfidData;
+static struct gpiod_line *detectPin;		// GPIO_PIN_RFID_DETECT
 
 int tagCheck(uint64_t newid);
 int tagParse(const char *elem,  const char *value, struct rfidTag *tag );
@@ -150,20 +160,51 @@ const char *parse_states[] =
 };
 int parseTagNum = -1;
 
-int debug = 0;
-
 struct stat configStat;
 #define LOOP_SLEEP_MS	10
 #define LOOP_SLEEP_US	(LOOP_SLEEP_MS*1000)
 #define LOOPS_PER_SEC	(1000/LOOP_SLEEP_MS)
 #define LOOPS_PER_10SEC	(10*LOOPS_PER_SEC)
 
+int ttyfd = -1;
+int state;
+int count;
+int lcount;
+
+int rfidInit(void );
+void rfidPoll(void );
+struct simModule rfidModule = { "rfidScan", SIM_MODULE_RFID, rfidInit, rfidPoll, LOOP_SLEEP_US, SIM_MODULE_NORMAL };
+
 void
 ttyPurge(int ttyfd )
 {
 	
 }
 
+/*
+ * Function: rfidRead
+ *
+ * Non-blocking read from the reader, recorded or replayed with the session.
+ *
+ * Returns: As read()
+ */
+static int
+rfidRead(char *buf, int len )
+{
+	int sts;
+
+	if ( simSessionMode == SIM_SESSION_REPLAYING )
+	{
+		return ( simSessionNext(SIM_SESSION_UART, RFID_TTY, buf, len, 0 ) );
+	}
+	sts = read(ttyfd, buf, len );
+	if ( sts > 0 )
+	{
+		simSessionRecord(SIM_SESSION_UART, RFID_TTY, buf, sts );
+	}
+	return ( sts );
+}
+
 int checkBitValidationICS(char *data)
 {
 	int bcc = data[1]^data[2]^data[3]^data[4]^data[5]^data[6]^data[7];
@@ -231,19 +272,10 @@ unsigned long cardNumberSEEED(char *data)
     return sum;
 }
 
+#ifndef SIM_HUB
 int main(int argc, char *argv[])
 {
 	int sts;
-	int i;
-	uint64_t newid;
-	uint32_t tagIndex;
-	struct termios tty;
-	int count;
-	int state;
-	int detect;
-	struct stat statCheck;
-	int lcount;
-	int ttyfd = -1;
 	
 	if ( argc > 1 )
 	{
@@ -276,37 +308,25 @@ int main(int argc, char *argv[])
 		log_message("", msgbuf );
 		exit ( -1 );
 	}
-	rfidData = (struct rfidData *)calloc(sizeof(struct rfidData ), 1 );
-	if ( ! rfidData )
-	{
-		sprintf(msgbuf, "calloc Failed - Exiting" );
-		if ( debug )
-		{
-			printf("%s\n", msgbuf );
-		}
-		log_message("", msgbuf );
-		exit ( -1 );
-	}
-	if ( debug ) 
-	{
-		printf("Reading Config\n" );
-	}
-	// Read the configuration file to find the RFID tags
-	readConfig(SCAN_CONFIG );
-
-	// Monitor the Tag Detected signal from the reader. When it goes high, we wait on 
-	// a mesage from the serial port.
-	// we wait on a serial port for the sensor to be reported.
-
-	//struct gpiod_line *detectPin;
+	struct simModule *modules[] = { &rfidModule };
+	simModuleRun(modules, 1, 0 );
+	return EXIT_FAILURE;
+}
+#endif
 
-	//detectPin = gpioPinOpen(49, GPIO_INPUT );	// P9_23
-	//gpiod_line_release(detectPin);
-    //gpiod_chip_close(gpiod_line_get_chip(detectPin));
- 
+/*
+ * Function: rfidOpenPort
+ *
+ * Open and configure the reader serial port.
+ *
+ * Returns: 0, or -1 on failure
+ */
+static int
+rfidOpenPort(void )
+{
+	struct termios tty;
+	const char *portname = SIM_UART_RFID;
 	
-	// Serial port used to read from RFID sensor
-	const char *portname = "/dev/ttyS1";
 	while ( ttyfd < 0 )
 	{
 		ttyfd = open (portname, O_RDWR | O_NOCTTY | O_NONBLOCK );
@@ -318,6 +338,10 @@ int main(int argc, char *argv[])
 				printf("%s\n", msgbuf );
 			}
 			log_message("", msgbuf );
+#ifdef SIM_HUB
+			// Do not hold up the other modules
+			return ( -1 );
+#endif
 			sleep(10 );
 		}
 		
@@ -332,7 +356,7 @@ int main(int argc, char *argv[])
 			printf("%s\n", msgbuf );
 		}
 		log_message("", msgbuf );
-		return EXIT_FAILURE;
+		return ( -1 );
     }
     tty.c_cflag |= (CLOCAL | CREAD | IGNPAR | CS8 );
 	tty.c_cflag &= ~(PARENB | PARODD | CRTSCTS | CSTOPB | CSIZE);
@@ -355,15 +379,74 @@ int main(int argc, char *argv[])
 			printf("%s\n", msgbuf );
 		}
 		log_message("", msgbuf );
-		return EXIT_FAILURE;
+		return ( -1 );
     }
+	return ( 0 );
+}
+
+/*
+ * Function: rfidDetect
+ *
+ * Read the tag detected signal, on the line held open since rfidInit, or
+ * opened for the read if that failed
+ */
+static void
+rfidDetect(int *detect )
+{
+	if ( detectPin == NULL || gpioPinGet(detectPin, detect ) != 0 )
+	{
+		gpioPinRead(GPIO_PIN_RFID_DETECT, detect );
+	}
+}
+
+/*
+ * Function: rfidInit
+ *
+ * Module init. Reads the tag configuration and opens the reader serial port.
+ *
+ * Returns: 0, or -1 on failure
+ */
+int
+rfidInit(void )
+{
+	int detect;
+	
+	rfidData = (struct rfidData *)calloc(sizeof(struct rfidData ), 1 );
+	if ( ! rfidData )
+	{
+		sprintf(msgbuf, "calloc Failed - Exiting" );
+		if ( debug )
+		{
+			printf("%s\n", msgbuf );
+		}
+		log_message("", msgbuf );
+		return ( -1 );
+	}
+	if ( debug ) 
+	{
+		printf("Reading Config\n" );
+	}
+	// Read the configuration file to find the RFID tags
+	readConfig(SCAN_CONFIG );
+
+	// Monitor the Tag Detected signal from the reader. When it goes high, we wait on 
+	// a mesage from the serial port.
+	// we wait on a serial port for the sensor to be reported.
+
+	detectPin = gpioPinOpen(GPIO_PIN_RFID_DETECT, GPIO_INPUT );
+	
+	// Serial port used to read from RFID sensor. Not used when replaying.
+	if ( simSessionMode != SIM_SESSION_REPLAYING && rfidOpenPort() != 0 )
+	{
+		return ( -1 );
+	}
 	
 	state = 0;
 	rfidData->tagDetected = 0;
 	shmData->auscultation.side = 0;
 	lcount = 0;
 
-	gpioPinRead(49, &detect );
+	rfidDetect(&detect );
 	
 	sprintf(msgbuf, "Detect Check %d", detect );
 	log_message("", msgbuf);
@@ -371,238 +454,249 @@ int main(int argc, char *argv[])
 	{
 		printf("%s\n", msgbuf );
 	}
+	return ( 0 );
+}
+
+/*
+ * Function: rfidPoll
+ *
+ * Module poll, every LOOP_SLEEP_US
+ */
+void
+rfidPoll(void )
+{
+	int sts;
+	int i;
+	uint64_t newid;
+	uint32_t tagIndex;
+	int detect;
+	struct stat statCheck;
 	
-	while ( 1 )
+	if ( lcount++ >= LOOPS_PER_10SEC )
 	{
-		if ( lcount++ >= LOOPS_PER_10SEC )
+		sts = stat(SCAN_CONFIG, &statCheck );
+		if ( statCheck.st_mtime != configStat.st_mtime )
 		{
-			sts = stat(SCAN_CONFIG, &statCheck );
-			if ( statCheck.st_mtime != configStat.st_mtime )
-			{
-				readConfig(SCAN_CONFIG );
-			}
-			lcount = 0;
+			readConfig(SCAN_CONFIG );
 		}
+		lcount = 0;
+	}
 
-		gpioPinRead(49, &detect );
+	rfidDetect(&detect );
 
-		switch ( state )
-		{
-			case 0: // Waiting for detect
-				if ( detect )
+	switch ( state )
+	{
+		case 0: // Waiting for detect
+			if ( detect )
+			{
+				state = 2;
+				count = 0;
+				tagBuffer[0] = 0;
+				sprintf(msgbuf, "Detect %d : State 2", detect );
+				if ( verbose )
 				{
-					state = 2;
-					count = 0;
-					tagBuffer[0] = 0;
-					sprintf(msgbuf, "Detect %d : State 2", detect );
-					if ( verbose )
-					{
-						log_message("", msgbuf);
-					}
-					if ( debug )
-					{
-						printf("%s\n", msgbuf );
-					}
-					
+					log_message("", msgbuf);
 				}
-				else
+				if ( debug )
 				{
-					shmData->auscultation.side = 0;
+					printf("%s\n", msgbuf );
 				}
-				break;
+				
+			}
+			else
+			{
+				shmData->auscultation.side = 0;
+			}
+			break;
 
-			case 2: // Detect Received, Reading string from reader
-				if ( ! detect )
+		case 2: // Detect Received, Reading string from reader
+			if ( ! detect )
+			{
+				if ( rfidData->tagDetected == 1 )
 				{
-					if ( rfidData->tagDetected == 1 )
+					if ( debug )
 					{
-						if ( debug )
-						{
-							printf("End\n" );
-						}
-						if ( verbose )
-						{
-							sprintf(msgbuf, "End (2)" );
-							log_message("", msgbuf);
-						}
-						rfidData->tagDetected = 0;						
+						printf("End\n" );
 					}
-					shmData->auscultation.side = 0;
 					if ( verbose )
 					{
-						sprintf(msgbuf, "Detect  0 State 2 to 0 Count %d", count );
+						sprintf(msgbuf, "End (2)" );
 						log_message("", msgbuf);
 					}
+					rfidData->tagDetected = 0;						
+				}
+				shmData->auscultation.side = 0;
+				if ( verbose )
+				{
+					sprintf(msgbuf, "Detect  0 State 2 to 0 Count %d", count );
+					log_message("", msgbuf);
+				}
+				state = 0;
+				count = 0;
+			}
+			else
+			{
+				if ( count > TAG_BUF_LEN )
+				{
+					if ( debug )
+					{
+						printf("In state 2, count %d exceeds buffer length %d\n", count, TAG_BUF_LEN );
+					}
+					
 					state = 0;
 					count = 0;
 				}
 				else
 				{
-					if ( count > TAG_BUF_LEN )
+					sts = rfidRead(&tagBuffer[count], TAG_BUF_LEN - count );
+					if ( sts > 0 )
 					{
 						if ( debug )
 						{
-							printf("In state 2, count %d exceeds buffer length %d\n", count, TAG_BUF_LEN );
+							for ( i = count ; i < ( count + sts ) ; i++ )
+							{
+								printf("%02xh  ", tagBuffer[i] );
+							}
 						}
-						
-						state = 0;
-						count = 0;
-					}
-					else
-					{
-						sts = read(ttyfd, &tagBuffer[count], TAG_BUF_LEN - count );
-						if ( sts > 0 )
+						count += sts;
+						if ( count == 5 )
 						{
-							if ( debug )
+							// Test for valid data from SEED reader
+							if ( checkBitValidationSEED(tagBuffer ) )
 							{
-								for ( i = count ; i < ( count + sts ) ; i++ )
+								newid = cardNumberSEEED(tagBuffer );
+								rfidData->tagDetected = 1;
+								
+								tagIndex = tagCheck(newid );
+								sprintf(msgbuf, "Tag %lld - %d", newid, tagIndex );
+								log_message("", msgbuf);
+								if ( debug )
 								{
-									printf("%02xh  ", tagBuffer[i] );
+									printf(" Tag %lld - %d\n", newid, tagIndex );
 								}
+								sprintf(shmData->auscultation.tag, "%lld", newid );
+								state = 3;
+								count = 0;
 							}
-							count += sts;
-							if ( count == 5 )
+						}
+						if ( count == 9 && tagBuffer[0] == 0x02 && tagBuffer[1] == 0x09 && tagBuffer[8] == 0x03 )
+						{
+							// Test for valid data from SEED reader
+							if ( checkBitValidationICS(tagBuffer ) )
 							{
-								// Test for valid data from SEED reader
-								if ( checkBitValidationSEED(tagBuffer ) )
+								newid = cardNumberICS(tagBuffer );
+								rfidData->tagDetected = 1;
+								
+								tagIndex = tagCheck(newid );
+								sprintf(msgbuf, "Tag %lld - %d", newid, tagIndex );
+								log_message("", msgbuf);
+								if ( debug )
 								{
-									newid = cardNumberSEEED(tagBuffer );
-									rfidData->tagDetected = 1;
-									
-									tagIndex = tagCheck(newid );
-									sprintf(msgbuf, "Tag %lld - %d", newid, tagIndex );
-									log_message("", msgbuf);
-									if ( debug )
-									{
-										printf(" Tag %lld - %d\n", newid, tagIndex );
-									}
-									sprintf(shmData->auscultation.tag, "%lld", newid );
-									state = 3;
-									count = 0;
+									printf(" Tag Type %02xh ID %lld Index %d\n", tagBuffer[2], newid, tagIndex );
 								}
+								sprintf(shmData->auscultation.tag, "%lld", newid );
+								state = 3;
+								count = 0;
 							}
-							if ( count == 9 && tagBuffer[0] == 0x02 && tagBuffer[1] == 0x09 && tagBuffer[8] == 0x03 )
+						}
+						if ( tagBuffer[count-1] == 0x03 )
+						{
+							// Full tag received - Report and continue looking for STX
+							if ( count >= 13 )
 							{
-								// Test for valid data from SEED reader
-								if ( checkBitValidationICS(tagBuffer ) )
+								// Find the tagID in the table and set it as active
+								rfidData->tagDetected = 1;
+								newid = 0;
+
+								for ( i = 1 ; i < 15 ; i++ )
 								{
-									newid = cardNumberICS(tagBuffer );
-									rfidData->tagDetected = 1;
-									
-									tagIndex = tagCheck(newid );
-									sprintf(msgbuf, "Tag %lld - %d", newid, tagIndex );
-									log_message("", msgbuf);
 									if ( debug )
 									{
-										printf(" Tag Type %02xh ID %lld Index %d\n", tagBuffer[2], newid, tagIndex );
-									}
-									sprintf(shmData->auscultation.tag, "%lld", newid );
-									state = 3;
-									count = 0;
-								}
-							}
-							if ( tagBuffer[count-1] == 0x03 )
-							{
-								// Full tag received - Report and continue looking for STX
-								if ( count >= 13 )
-								{
-									// Find the tagID in the table and set it as active
-									rfidData->tagDetected = 1;
-									newid = 0;
-
-									for ( i = 1 ; i < 15 ; i++ )
-									{
-										if ( debug )
+										if ( isprint(tagBuffer[i] ) )
 										{
-											if ( isprint(tagBuffer[i] ) )
-											{
-												printf("%c", tagBuffer[i] );
-											}
-											else 
-											{
-												switch ( tagBuffer[i] )
-												{
-													case 0x0A:
-													case 0x0D:
-													case 0x03:
-														break;
-													default:
-														printf(" %02xh", tagBuffer[i] );
-														break;
-												}
-											}
-
-											if ( i == 9 )
-											{
-												printf(" : " );
-											}
+											printf("%c", tagBuffer[i] );
 										}
-										if ( ( i > 2 ) && ( i < 11 ) )
+										else 
 										{
-											if ( ( tagBuffer[i] >= '0' ) && ( tagBuffer[i] <= '9' ) )
+											switch ( tagBuffer[i] )
 											{
-												newid = ( newid << 4 ) + ( tagBuffer[i] - '0' );
-											}
-											else if ( ( tagBuffer[i] >= 'A' ) && ( tagBuffer[i] <= 'F' ) )
-											{
-												newid = ( newid << 4 ) + (( tagBuffer[i] - 'A' ) + 10 );	
+												case 0x0A:
+												case 0x0D:
+												case 0x03:
+													break;
+												default:
+													printf(" %02xh", tagBuffer[i] );
+													break;
 											}
 										}
+
+										if ( i == 9 )
+										{
+											printf(" : " );
+										}
 									}
-									tagIndex = tagCheck(newid );
-									sprintf(msgbuf, "Tag %lld - %d", newid, tagIndex );
-									log_message("", msgbuf);
-									if ( debug )
+									if ( ( i > 2 ) && ( i < 11 ) )
 									{
-										printf(" Tag %lld - %d\n", newid, tagIndex );
+										if ( ( tagBuffer[i] >= '0' ) && ( tagBuffer[i] <= '9' ) )
+										{
+											newid = ( newid << 4 ) + ( tagBuffer[i] - '0' );
+										}
+										else if ( ( tagBuffer[i] >= 'A' ) && ( tagBuffer[i] <= 'F' ) )
+										{
+											newid = ( newid << 4 ) + (( tagBuffer[i] - 'A' ) + 10 );	
+										}
 									}
-									sprintf(shmData->auscultation.tag, "%lld", newid );
-									
-									state = 3;
-									count = 0;
 								}
+								tagIndex = tagCheck(newid );
+								sprintf(msgbuf, "Tag %lld - %d", newid, tagIndex );
+								log_message("", msgbuf);
+								if ( debug )
+								{
+									printf(" Tag %lld - %d\n", newid, tagIndex );
+								}
+								sprintf(shmData->auscultation.tag, "%lld", newid );
+								
+								state = 3;
+								count = 0;
 							}
 						}
 					}
 				}
-				break;
+			}
+			break;
 
-			
-			case 3: // Wait for loss of detect
-				if ( ! detect )
+		
+		case 3: // Wait for loss of detect
+			if ( ! detect )
+			{
+				if ( rfidData->tagDetected == 1 )
 				{
-					if ( rfidData->tagDetected == 1 )
+					if ( debug )
 					{
-						if ( debug )
-						{
-							printf("End\n" );
-						}
-						if ( verbose )
-						{
-							sprintf(msgbuf, "End (3)" );
-							log_message("", msgbuf);
-						}
-						rfidData->tagDetected = 0;						
+						printf("End\n" );
 					}
-					shmData->auscultation.side = 0;
 					if ( verbose )
 					{
-						sprintf(msgbuf, "Detect 0 State 3 to 0" );
+						sprintf(msgbuf, "End (3)" );
 						log_message("", msgbuf);
 					}
-					state = 0;
-					count = 0;
+					rfidData->tagDetected = 0;						
 				}
-				else
+				shmData->auscultation.side = 0;
+				if ( verbose )
 				{
-					// Just to purge any extra characters
-					sts = read(ttyfd, &tagBuffer[0], TAG_BUF_LEN );
+					sprintf(msgbuf, "Detect 0 State 3 to 0" );
+					log_message("", msgbuf);
 				}
-		}
-		usleep(LOOP_SLEEP_US); // 10 ms delay between checks.
+				state = 0;
+				count = 0;
+			}
+			else
+			{
+				// Just to purge any extra characters
+				sts = rfidRead(&tagBuffer[0], TAG_BUF_LEN );
+			}
 	}
-
-	return 0;
 }
 
 int
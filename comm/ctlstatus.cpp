@@ -20,136 +20,38 @@
  * 4.12.2023 - Removed support for Dorsal Pulses
 */
 	
-#include <cstdlib>
-#include <cstdio>
-#include <iostream>
-#include <vector>  
-#include <string>  
-#include <cstdlib>
-#include <sstream>
-#include <utility>
-#include <algorithm>
+#include <stdlib.h>
+#include <stdio.h>
 
 #include "simUtil.h"
 #include "shmData.h"
-#include "version.h"
-
-using namespace std;
-
-void makejson(ostream & output, string key, string content)
-{
-    output << "\"" << key << "\":\"" << content << "\"";
-}
+#include "simStatusJson.h"
 
 struct shmData *shmData;
-void sendStatus(void );
 
 int debug = 0;
 
+char json[SIM_STATUS_JSON_MAX];
+
 int
 main( int argc, const char* argv[] )
 {
-    char buffer[256];
 	int sts;
 
-	cout << "Content-Type: application/json\r\n\r\n";
-	cout << "{\n";
+	printf("Content-Type: application/json\r\n\r\n" );
 
 	sts = initSHM(SHM_OPEN );
-
 	if ( sts < 0 )
 	{
-		sprintf(buffer, "%d: %s", sts, "initSHM failed");
-		makejson(cout, "error", buffer );
-		cout << "\n}\n";
+		printf("{\"error\":\"%d: initSHM failed\"}\n", sts );
 		return ( 0 );
 	}
-
-
-	sendStatus();
+	if ( simStatusJson(json, sizeof(json), shmData, NULL ) < 0 )
+	{
+		printf("{\"error\":\"status too large\"}\n" );
+		return ( 0 );
+	}
+	printf("%s\n", json );
 	
 	return ( 0 );
 }
-void
-sendStatus(void )
-{
-	
-	cout << " \"auscultation\" : {\n";
-	makejson(cout, "side", itoa(shmData->auscultation.side ) );
-	cout << ",\n";
-	makejson(cout, "row", itoa(shmData->auscultation.row ) );
-	cout << ",\n";
-	makejson(cout, "col", itoa(shmData->auscultation.col ) );
-	cout << ",\n";
-	makejson(cout, "heartStrength", itoa(shmData->auscultation.heartStrength ) );
-	cout << ",\n";
-	makejson(cout, "leftLungStrength", itoa(shmData->auscultation.leftLungStrength ) );
-	cout << ",\n";
-	makejson(cout, "rightLungStrength", itoa(shmData->auscultation.rightLungStrength ) );
-	cout << ",\n";
-	makejson(cout, "tag", shmData->auscultation.tag );
-	cout << "\n},\n";
-
-	cout << " \"pulse\" : {\n";
-	makejson(cout, "right_dorsal", "0" );
-	cout << ",\n";
-	makejson(cout, "RD_AIN", "4095" );
-	cout << ",\n";
-	makejson(cout, "left_dorsal", "0" );
-	cout << ",\n";
-	makejson(cout, "LD_AIN", "4095" );
-	cout << ",\n";
-	makejson(cout, "right_femoral", itoa(shmData->pulse.right_femoral ) );
-	cout << ",\n";
-	makejson(cout, "RF_AIN", itoa(shmData->pulse.ain[2] ) );
-	cout << ",\n";
-	makejson(cout, "left_femoral", itoa(shmData->pulse.left_femoral ) );
-	cout << ",\n";
-	makejson(cout, "LF_AIN", itoa(shmData->pulse.ain[4] ) );
-	cout << "\n},\n";
-
-	cout << " \"respiration\" : {\n";
-	makejson(cout, "ain", itoa(shmData->manual_breath_ain ) );
-	cout << ",\n";
-	makejson(cout, "active", itoa(shmData->respiration.active ) );
-	cout << ",\n";
-	makejson(cout, "riseState", itoa(shmData->respiration.riseState ) );
-	cout << ",\n";
-	makejson(cout, "baseline", itoa(shmData->manual_breath_baseline ) );
-	cout << ",\n";
-	makejson(cout, "threshold", itoa(shmData->manual_breath_threshold) );
-	cout << ",\n";
-	makejson(cout, "count", itoa(shmData->manual_breath_count) );
-	cout << ",\n";
-	makejson(cout, "fallState", itoa(shmData->respiration.fallState ) );
-	cout << "\n},\n";
-	
-	cout << " \"cpr\" : {\n";
-	makejson(cout, "last", itoa(shmData->cpr.last ) );
-	cout << ",\n";
-	makejson(cout, "x", itoa(shmData->cpr.x ) );
-	cout << ",\n";
-	makejson(cout, "y", itoa(shmData->cpr.y ) );
-	cout << ",\n";
-	makejson(cout, "z", itoa(shmData->cpr.z ) );
-	cout << ",\n";
-	makejson(cout, "tof_present", itoa(shmData->cpr.tof_present ) );
-	cout << ",\n";
-	makejson(cout, "distance", itoa(shmData->cpr.distance ) );
-	cout << ",\n";
-	makejson(cout, "maxDistance", itoa(shmData->cpr.maxDistance ) );
-	cout << "\n},\n";
-	
-	cout << " \"general\" : {\n";
-	makejson(cout, "simMgrIPAddr", shmData->simMgrIPAddr );
-	cout << ",\n";
-	makejson(cout, "simMgrStatusPort", itoa(shmData->simMgrStatusPort) );
-	cout << ",\n";
-	makejson(cout, "simCtlVersion", SIMCTL_VERSION );
-	cout << "\n}\n";
-	
-	cout << "\n}\n";
-}
-
-
-
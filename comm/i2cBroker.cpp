@@ -0,0 +1,420 @@
+/*
+ * i2cBroker.cpp
+ * Single owner of the I2C bus devices. Clients submit prioritized transaction lists.
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The broker is a thread that opens /dev/i2c-N on first use and runs every
+ * I2C_RDWR transfer for the process. A client builds a list of i2c_msg (for
+ * example a register address write followed by a multi-byte read) and calls
+ * i2cTransfer(), which queues the list and blocks until the broker has run it.
+ * The whole list goes to the kernel as one ioctl, so it is a single bus
+ * transaction with repeated starts.
+ *
+ * Statistics are kept in shmData->i2c for ctlstatus.
+ *
+ * For session record/replay a transaction is identified by its bus, the address
+ * of its first message and the bytes it writes (the register), and its input is
+ * the ioctl status and the bytes read.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+
+#include "i2cBroker.h"
+#include "simUtil.h"
+#include "shmData.h"
+#include "simMetrics.h"
+#include "simSession.h"
+
+extern struct shmData *shmData;
+extern int debug;
+
+#define I2C_STATS_WINDOW_US		1000000		// Utilization is computed over one second
+
+struct i2cRequest
+{
+	int client;
+	int bus;
+	struct i2c_msg *msgs;
+	int nmsgs;
+	int status;
+	int error;
+	int done;
+	unsigned long long submitted;
+	struct i2cRequest *next;
+};
+
+static pthread_mutex_t brokerMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t brokerWork = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t brokerDone = PTHREAD_COND_INITIALIZER;
+static pthread_t brokerThread;
+static int brokerRunning = 0;
+
+static struct i2cRequest *queueHead[I2C_PRIORITIES];
+static struct i2cRequest *queueTail[I2C_PRIORITIES];
+static int clientPriority[I2C_CLIENTS_MAX];
+static int clientCount = 0;
+static int busFile[I2C_BUS_MAX] = { -1, -1, -1 };
+
+static unsigned long long windowStart;
+static unsigned long long windowBusy;
+
+static unsigned long long
+i2cNow(void )
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts );
+	return ( (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 );
+}
+
+static int
+i2cOpenBus(int bus )
+{
+	char filename[32];
+
+	if ( busFile[bus] < 0 )
+	{
+		snprintf(filename, sizeof(filename), "/dev/i2c-%d", bus );
+		busFile[bus] = open(filename, O_RDWR );
+	}
+	return ( busFile[bus] );
+}
+
+static void
+i2cUpdateWindow(unsigned long long now )
+{
+	unsigned long long elapsed = now - windowStart;
+
+	if ( elapsed >= I2C_STATS_WINDOW_US )
+	{
+		shmData->i2c.utilization = (unsigned int)( ( windowBusy * 1000 ) / elapsed );
+		windowStart = now;
+		windowBusy = 0;
+	}
+}
+
+static void
+i2cRecord(struct i2cRequest *req, unsigned long long start, unsigned long long end )
+{
+	struct i2cClient *cl = &shmData->i2c.client[req->client];
+	unsigned int latency = (unsigned int)( end - req->submitted );
+
+	windowBusy += ( end - start );
+	shmData->i2c.transactions++;
+	cl->transactions++;
+	if ( req->status < 0 )
+	{
+		cl->errors++;
+	}
+	if ( cl->latencyAvg == 0 )
+	{
+		cl->latencyAvg = latency;
+	}
+	else
+	{
+		cl->latencyAvg = ( ( cl->latencyAvg * 7 ) + latency ) / 8;
+	}
+	if ( latency > cl->latencyMax )
+	{
+		cl->latencyMax = latency;
+	}
+	i2cUpdateWindow(end );
+}
+
+static struct i2cRequest *
+i2cNextRequest(void )
+{
+	struct i2cRequest *req;
+	int pri;
+
+	for ( pri = 0 ; pri < I2C_PRIORITIES ; pri++ )
+	{
+		req = queueHead[pri];
+		if ( req )
+		{
+			queueHead[pri] = req->next;
+			if ( queueHead[pri] == NULL )
+			{
+				queueTail[pri] = NULL;
+			}
+			return ( req );
+		}
+	}
+	return ( NULL );
+}
+
+static unsigned short
+i2cSessionKey(struct i2cRequest *req )
+{
+	unsigned char head[2];
+	unsigned short key;
+	int i;
+
+	head[0] = req->bus;
+	head[1] = req->msgs[0].addr;
+	key = simSessionKey(head, sizeof(head), 0 );
+	for ( i = 0 ; i < req->nmsgs ; i++ )
+	{
+		if ( ! ( req->msgs[i].flags & I2C_M_RD ) )
+		{
+			key = simSessionKey(req->msgs[i].buf, req->msgs[i].len, key );
+		}
+	}
+	return ( key );
+}
+
+// Record the result of a transaction, or replay one in place of the ioctl
+static void
+i2cSession(struct i2cRequest *req )
+{
+	unsigned char data[SIM_SESSION_DATA_MAX];
+	int len = sizeof(int);
+	int got;
+	int i;
+
+	if ( simSessionMode == SIM_SESSION_REPLAYING )
+	{
+		got = simSessionHold(SIM_SESSION_I2C, i2cSessionKey(req ), data, sizeof(data) );
+		if ( got < (int)sizeof(int) )
+		{
+			req->status = -1;
+			req->error = ENXIO;
+			return;
+		}
+		memcpy(&req->status, data, sizeof(int) );
+		req->error = ( req->status < 0 ) ? EIO : 0;
+		for ( i = 0 ; i < req->nmsgs ; i++ )
+		{
+			if ( ( req->msgs[i].flags & I2C_M_RD ) && len + req->msgs[i].len <= got )
+			{
+				memcpy(req->msgs[i].buf, &data[len], req->msgs[i].len );
+				len += req->msgs[i].len;
+			}
+		}
+		return;
+	}
+	if ( simSessionMode != SIM_SESSION_RECORDING )
+	{
+		return;
+	}
+	memcpy(data, &req->status, sizeof(int) );
+	for ( i = 0 ; i < req->nmsgs ; i++ )
+	{
+		if ( ( req->msgs[i].flags & I2C_M_RD ) && len + req->msgs[i].len <= (int)sizeof(data) )
+		{
+			memcpy(&data[len], req->msgs[i].buf, req->msgs[i].len );
+			len += req->msgs[i].len;
+		}
+	}
+	simSessionRecord(SIM_SESSION_I2C, i2cSessionKey(req ), data, len );
+}
+
+static void *
+i2cBrokerThread(void *arg )
+{
+	struct i2cRequest *req;
+	struct i2c_rdwr_ioctl_data ioctl_data;
+	struct timespec wake;
+	unsigned long long start;
+	unsigned long long end;
+	int fd;
+
+	pthread_mutex_lock(&brokerMutex );
+	while ( 1 )
+	{
+		req = i2cNextRequest();
+		if ( req == NULL )
+		{
+			// Wake at least once a second so the utilization decays when idle
+			clock_gettime(CLOCK_REALTIME, &wake );
+			wake.tv_sec += 1;
+			pthread_cond_timedwait(&brokerWork, &brokerMutex, &wake );
+			i2cUpdateWindow(i2cNow() );
+			continue;
+		}
+		pthread_mutex_unlock(&brokerMutex );
+
+		start = i2cNow();
+		if ( simSessionMode == SIM_SESSION_REPLAYING )
+		{
+			i2cSession(req );
+		}
+		else
+		{
+			fd = i2cOpenBus(req->bus );
+			if ( fd < 0 )
+			{
+				req->status = -1;
+				req->error = errno;
+			}
+			else
+			{
+				ioctl_data.msgs = req->msgs;
+				ioctl_data.nmsgs = req->nmsgs;
+				req->status = ioctl(fd, I2C_RDWR, &ioctl_data );
+				req->error = ( req->status < 0 ) ? errno : 0;
+			}
+			i2cSession(req );
+		}
+		end = i2cNow();
+		simMetricRecord(SIM_METRIC_I2C, (unsigned int)( end - start ) );
+		if ( req->status < 0 )
+		{
+			simMetricError(SIM_METRIC_I2C );
+		}
+
+		pthread_mutex_lock(&brokerMutex );
+		i2cRecord(req, start, end );
+		req->done = 1;
+		pthread_cond_broadcast(&brokerDone );
+	}
+	return ( NULL );
+}
+
+/*
+ * Function: i2cBrokerStart
+ *
+ * Start the broker thread. Must be called once, after initSHM, before any
+ * client is registered.
+ *
+ * Returns: 0 on success, -1 on failure
+ */
+int
+i2cBrokerStart(void )
+{
+	int pri;
+
+	if ( brokerRunning )
+	{
+		return ( 0 );
+	}
+	for ( pri = 0 ; pri < I2C_PRIORITIES ; pri++ )
+	{
+		queueHead[pri] = NULL;
+		queueTail[pri] = NULL;
+	}
+	memset(&shmData->i2c, 0, sizeof(shmData->i2c) );
+	windowStart = i2cNow();
+	windowBusy = 0;
+	if ( pthread_create(&brokerThread, NULL, i2cBrokerThread, NULL ) != 0 )
+	{
+		log_message("", "i2cBrokerStart: pthread_create failed" );
+		return ( -1 );
+	}
+	brokerRunning = 1;
+	return ( 0 );
+}
+
+/*
+ * Function: i2cBrokerRegister
+ *
+ * Register a client. The name is shown in the status output and the priority
+ * is used for all of the client's transactions.
+ *
+ * Returns: client id, or -1 if the client table is full
+ */
+int
+i2cBrokerRegister(const char *name, int priority )
+{
+	int client;
+
+	pthread_mutex_lock(&brokerMutex );
+	if ( clientCount >= I2C_CLIENTS_MAX )
+	{
+		pthread_mutex_unlock(&brokerMutex );
+		log_message("", "i2cBrokerRegister: Too many clients" );
+		return ( -1 );
+	}
+	client = clientCount++;
+	if ( priority < I2C_PRIORITY_HIGH || priority > I2C_PRIORITY_LOW )
+	{
+		priority = I2C_PRIORITY_NORMAL;
+	}
+	clientPriority[client] = priority;
+	snprintf(shmData->i2c.client[client].name, sizeof(shmData->i2c.client[client].name), "%s", name );
+	pthread_mutex_unlock(&brokerMutex );
+	return ( client );
+}
+
+/*
+ * Function: i2cTransfer
+ *
+ * Run a list of messages as one I2C_RDWR transaction on /dev/i2c-<bus>. Blocks
+ * until the broker has completed it.
+ *
+ * Returns: The ioctl result (number of messages transferred), or -1 with errno
+ * set on failure.
+ */
+int
+i2cTransfer(int client, int bus, struct i2c_msg *msgs, int nmsgs )
+{
+	struct i2cRequest req;
+	int pri;
+
+	if ( ! brokerRunning || client < 0 || client >= clientCount ||
+		 bus < 0 || bus >= I2C_BUS_MAX || nmsgs < 1 || nmsgs > I2C_MSGS_MAX )
+	{
+		errno = EINVAL;
+		return ( -1 );
+	}
+	req.client = client;
+	req.bus = bus;
+	req.msgs = msgs;
+	req.nmsgs = nmsgs;
+	req.status = 0;
+	req.error = 0;
+	req.done = 0;
+	req.next = NULL;
+	req.submitted = i2cNow();
+
+	pri = clientPriority[client];
+	pthread_mutex_lock(&brokerMutex );
+	if ( queueTail[pri] )
+	{
+		queueTail[pri]->next = &req;
+	}
+	else
+	{
+		queueHead[pri] = &req;
+	}
+	queueTail[pri] = &req;
+	pthread_cond_signal(&brokerWork );
+	while ( ! req.done )
+	{
+		pthread_cond_wait(&brokerDone, &brokerMutex );
+	}
+	pthread_mutex_unlock(&brokerMutex );
+
+	if ( req.status < 0 )
+	{
+		errno = req.error;
+	}
+	return ( req.status );
+}
@@ -0,0 +1,41 @@
+/*
+ * i2cBroker.h
+ * Single owner of the I2C bus devices. Clients submit prioritized transaction lists.
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef I2CBROKER_H_
+#define I2CBROKER_H_
+
+#include <linux/i2c.h>
+
+#define I2C_BUS_MAX			3		// /dev/i2c-0 to /dev/i2c-2
+#define I2C_MSGS_MAX		42		// I2C_RDWR_IOCTL_MAX_MSGS in the kernel
+
+// Transaction priorities. Pending transactions are run highest priority first,
+// and in submit order within a priority.
+#define I2C_PRIORITY_HIGH	0
+#define I2C_PRIORITY_NORMAL	1
+#define I2C_PRIORITY_LOW	2
+#define I2C_PRIORITIES		3
+
+int i2cBrokerStart(void );
+int i2cBrokerRegister(const char *name, int priority );
+int i2cTransfer(int client, int bus, struct i2c_msg *msgs, int nmsgs );
+
+#endif /* I2CBROKER_H_ */
@@ -21,7 +21,6 @@
 #ifndef SIMDATA_H_
 #define SIMDATA_H_
 
-#include <semaphore.h>
 #include "simCtlComm.h"
 
 #define SHM_NAME	"shmData"
@@ -32,6 +31,18 @@
 #define STR_SIZE			64
 #define COMMENT_SIZE		1024
 
+// Name symbols (see comm/simSymbols.h)
+#define SIM_SYMBOLS_MAX		256
+#define SIM_SYMBOL_NONE		0	// The empty name, or one not interned
+
+struct simSymbols
+{
+	unsigned int generation;	// Raised each time simController builds the table
+	unsigned int count;			// Symbols assigned, including SIM_SYMBOL_NONE
+	unsigned int dropped;		// Names not interned, the table being full
+	char name[SIM_SYMBOLS_MAX][STR_SIZE];
+};
+
 #define LUB_DELAY (120*1000*1000) // Delay 120ms (in ns)
 #define DUB_DELAY (200*1000*1000) // Delay 200ms (in ns)
 #define PULSE_DELAY (120*1000*1000) // Delay 120ms (in ns)
@@ -61,6 +72,11 @@ struct cardiac
 	int heart_sound_volume;
 	int heart_sound_mute;
 	
+	// Symbols of the names above, set with them
+	int rhythm_id;
+	int vpc_id;
+	int pwave_id;
+	int heart_sound_id;
 };
 
 struct respiration
@@ -91,6 +107,10 @@ struct respiration
 	
 	int riseState;
 	int fallState;
+	
+	// Symbols of the lung sounds, set with them
+	int left_lung_sound_id;
+	int right_lung_sound_id;
 };
 
 struct auscultation
@@ -130,6 +150,17 @@ struct pulse
 	int touch[PULSE_POINTS_MAX];
 	int base[PULSE_POINTS_MAX];
 	int volume[PULSE_POINTS_MAX];
+	
+	// Touch events. pulse posts touchSeq (simEventPost) after any touch level
+	// change, and soundSense applies the new gain when it wakes. Times are
+	// msec_time().
+	unsigned int touchSeq;
+	unsigned int pressTime[PULSE_POINTS_MAX];	// Raw sensor first crossed the light level
+	unsigned int touchTime[PULSE_POINTS_MAX];	// Touch level changed
+	unsigned int gainTime[PULSE_POINTS_MAX];	// soundSense set the pulse gain
+	int detectLatency[PULSE_POINTS_MAX];		// Press to touch detection, msec
+	int gainLatency[PULSE_POINTS_MAX];			// Touch detection to gain set, msec
+	int latencyMax[PULSE_POINTS_MAX];			// Longest press to gain set, msec
 };
 struct cpr
 {
@@ -143,6 +174,16 @@ struct cpr
 	int tof_present;	// Set if tof sensor is found
 	int distance;		// distance in mm, used for 
 	int maxDistance;	// Fully extended distance
+	unsigned int distanceTime;	// cprScan msec time stamp of the distance sample
+	unsigned int distanceCount;	// Incremented for each new distance sample
+	
+	// CPR quality, updated at the end of each compression (see cpr/cprAnalytics.h)
+	int count;			// Compressions since cprScan started
+	int depth;			// Depth of last compression in mm
+	int rate;			// Compressions per minute
+	int recoil;			// 0 to 100% - Chest return before the next compression
+	int dutyCycle;		// 0 to 100% - Compression time as a fraction of the cycle
+	int handsOff;		// msec since the last compression ended
 };
 
 struct defibrillation
@@ -151,9 +192,140 @@ struct defibrillation
 	int energy;			// Energy in Joules of last shock
 };
 
+#define I2C_CLIENTS_MAX	4
+
+struct i2cClient
+{
+	char name[16];
+	unsigned int transactions;	// I2C_RDWR transfers completed
+	unsigned int errors;		// Transfers that failed
+	unsigned int latencyAvg;	// usec from submit to completion (smoothed)
+	unsigned int latencyMax;	// usec
+};
+
+struct i2cBus
+{
+	unsigned int transactions;	// All clients
+	unsigned int utilization;	// 0 to 1000 - Bus busy time per mille, over the last second
+	struct i2cClient client[I2C_CLIENTS_MAX];
+};
+
+// Sensor/audio modules (see comm/simModule.h). Each runs as its own daemon, or
+// all run together in simHub.
+#define SIM_MODULE_SOUND	0
+#define SIM_MODULE_PULSE	1
+#define SIM_MODULE_BREATH	2
+#define SIM_MODULE_CPR		3
+#define SIM_MODULE_RFID		4
+#define SIM_MODULES_MAX		5
+
+struct moduleStats
+{
+	char name[16];
+	int pid;					// Process running the module
+	unsigned int runs;			// Polls completed
+	unsigned int overruns;		// Periods skipped because a poll was late
+	unsigned int latencyAvg;	// usec from the due time to the start of the poll (smoothed)
+	unsigned int latencyMax;	// usec
+	unsigned int runAvg;		// usec spent in the poll (smoothed)
+	unsigned int runMax;		// usec
+};
+
+// Boot timeline (see comm/simBoot.h): ms since kernel boot each stage was
+// reached, 0 until it is
+#define SIM_BOOT_CONTROLLER		0	// simController started
+#define SIM_BOOT_PINMUX			1	// Pin mux set
+#define SIM_BOOT_SHM			2	// Shared memory set up, daemons may start
+#define SIM_BOOT_SIMMGR			3	// First sim-mgr status read
+#define SIM_BOOT_SOUND_START	4	// soundSense init started
+#define SIM_BOOT_SOUND_PORT		5	// Sound board serial port open
+#define SIM_BOOT_SOUND_BOARD	6	// Sound board answered
+#define SIM_BOOT_SOUND_READY	7	// Ready to play heart
+#define SIM_BOOT_FIRST_HEART	8	// First heart sound played
+#define SIM_BOOT_MODULE			9	// + SIM_MODULE_: module init done
+#define SIM_BOOT_STAGES			( SIM_BOOT_MODULE + SIM_MODULES_MAX )
+
+struct simBoot
+{
+	unsigned int ms[SIM_BOOT_STAGES];
+};
+
+// Latency metrics (see comm/simMetrics.h)
+#define SIM_METRIC_AIN_READ		0	// read_ain() sysfs read
+#define SIM_METRIC_CURL			1	// simController curl round trip
+#define SIM_METRIC_WAV_CMD		2	// WAV Trigger/Tsunami command write
+#define SIM_METRIC_I2C			3	// I2C broker transaction list
+#define SIM_METRIC_GPIO			4	// GPIO line set
+#define SIM_METRIC_SYNC_HEART	5	// Heart sync received to lub/dub track start
+#define SIM_METRIC_SYNC_BREATH	6	// Breath sync received to inhalation track start
+#define SIM_METRICS				7
+
+// Process slots, for the metrics and the trace rings. The daemons use their SIM_MODULE_ number.
+#define SIM_METRIC_PROC_CONTROLLER	( SIM_MODULES_MAX )
+#define SIM_METRIC_PROC_HUB			( SIM_MODULES_MAX + 1 )
+#define SIM_METRIC_PROC_OTHER		( SIM_MODULES_MAX + 2 )
+#define SIM_METRIC_PROCS			( SIM_MODULES_MAX + 3 )
+
+// Log-linear buckets, usec: 0-3 exact, then 4 per power of two up to 2^26 (67 sec)
+#define SIM_METRIC_SUB_BITS		2
+#define SIM_METRIC_MAX_POWER	26
+#define SIM_METRIC_BUCKETS		( ( 1 << SIM_METRIC_SUB_BITS ) * ( SIM_METRIC_MAX_POWER - SIM_METRIC_SUB_BITS + 1 ) + ( 1 << SIM_METRIC_SUB_BITS ) )
+
+struct simMetric
+{
+	unsigned int count;
+	unsigned int errors;
+	unsigned long long sum;		// usec
+	unsigned int max;			// usec
+	unsigned int buckets[SIM_METRIC_BUCKETS];
+};
+
+struct simMetricsProc
+{
+	char name[16];
+	int pid;
+	struct simMetric metric[SIM_METRICS];
+};
+
+// Event trace (see comm/simTrace.h)
+#define SIM_TRACE_SYNC_HEART	1	// Heart sync received. arg1: 1 for VPC
+#define SIM_TRACE_SYNC_BREATH	2	// Breath sync received
+#define SIM_TRACE_TIMER			3	// Timer fired. arg1: signal offset from SIGRTMIN
+#define SIM_TRACE_TRACK			4	// Track control. arg1: track, arg2: TRK_ code
+#define SIM_TRACE_GAIN			5	// Gain set. arg1: channel (or track + 1000), arg2: gain
+#define SIM_TRACE_GPIO			6	// GPIO set. arg1: line offset, arg2: value
+#define SIM_TRACE_SENSOR		7	// Sensor threshold crossed. arg1: SIM_TRACE_SENSOR_ id, arg2: new level
+#define SIM_TRACE_HTTP			8	// HTTP request done. arg1: duration usec, arg2: 0 read, 1 write
+#define SIM_TRACE_BREATH_TIMING	9	// Breath timeline done. arg1: latest edge error usec, arg2: breath count
+#define SIM_TRACE_CHEST			10	// Closed-loop breath done. arg1: RMS error, AIN counts, arg2: rise duty %
+#define SIM_TRACE_EVENTS		11
+
+#define SIM_TRACE_SENSOR_PULSE	0	// + pulse position
+#define SIM_TRACE_SENSOR_BREATH	10
+#define SIM_TRACE_SENSOR_CPR	11
+
+#define SIM_TRACE_RECORDS		4096	// Per process, power of 2
+
+struct simTraceRecord
+{
+	unsigned long long usec;	// CLOCK_MONOTONIC
+	unsigned int seq;			// Ring position + 1, written last
+	unsigned short event;
+	unsigned short tid;			// Thread id, low 16 bits
+	int arg1;
+	int arg2;
+};
+
+struct simTraceRing
+{
+	char name[16];
+	int pid;
+	unsigned int head;			// Records claimed
+	struct simTraceRecord rec[SIM_TRACE_RECORDS];
+};
+
 struct shmData 
 {
-	sem_t	i2c_sema;	// Mutex lock - Lock for I2C bus access
 	char simMgrIPAddr[32];
 	int simMgrStatusPort;
 	
@@ -171,6 +343,22 @@ struct shmData
 	int manual_breath_threshold;
 	int manual_breath_count;
 	int manual_breath_invert;
+	int manual_breath_noise;	// Noise floor, AIN counts
+	int manual_breath_latency;	// msec from start of the rise to detection, last breath
+	int manual_breath_peak;		// Peak pressure over the baseline, AIN counts, last breath
+	int manual_breath_volume;	// Pressure-time area, count-msec, last breath
+	int chest_control;			// 1 while the chest rise is closed-loop (see wav-trig/chestControl.h)
+	int chest_peak;				// Peak chest pressure over rest, AIN counts, last breath
+	int chest_error;			// RMS error to the target excursion, AIN counts, last breath
+	int chest_error_max;		// Largest error, AIN counts, last breath
+	int chest_rise_duty;		// Rise valve open, % of the last breath
+	int chest_fall_duty;		// Fall valve open, % of the last breath
+	struct i2cBus i2c;			// I2C broker statistics (see comm/i2cBroker.h)
+	struct moduleStats modules[SIM_MODULES_MAX];	// Poll loop statistics (see comm/simModule.h)
+	struct simMetricsProc metrics[SIM_METRIC_PROCS];	// Latency metrics, per process
+	struct simBoot boot;		// Boot timeline, cleared by simController; ahead of trace for the status snapshot
+	struct simTraceRing trace[SIM_METRIC_PROCS];		// Event trace, per process
+	struct simSymbols symbols;	// Name symbols, written by simController only
 };
 
 int cardiac_parse(const char *elem,  const char *value, struct cardiac *card );
@@ -0,0 +1,257 @@
+/*
+ * simBoard.cpp
+ * Board profile: startup check and pin mux
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "simUtil.h"
+#include "simBoard.h"
+
+extern int debug;
+
+struct simBoardAssign
+{
+	const char *name;
+	int num;
+};
+
+static const struct simBoardAssign boardGpio[] =
+{
+	{ "rise L",			GPIO_PIN_RISE_L },
+	{ "rise R",			GPIO_PIN_RISE_R },
+	{ "fall",			GPIO_PIN_FALL },
+	{ "pulse",			GPIO_PIN_PULSE },
+	{ "tank",			GPIO_PIN_TANK },
+	{ "RFID detect",	GPIO_PIN_RFID_DETECT },
+};
+
+static const struct simBoardAssign boardAin[] =
+{
+	{ "breath",			BREATH_AIN_CHANNEL },
+	{ "touch 1",		TOUCH_SENSE_AIN_CHANNEL_1 },
+	{ "air pressure",	AIR_PRESSURE_AIN_CHANNEL },
+	{ "touch 2",		TOUCH_SENSE_AIN_CHANNEL_2 },
+	{ "touch 3",		TOUCH_SENSE_AIN_CHANNEL_3 },
+	{ "touch 4",		TOUCH_SENSE_AIN_CHANNEL_4 },
+};
+
+struct simBoardUart
+{
+	const char *name;
+	const char *dev;
+	const char *oldDev;		// NULL for none
+	int required;
+};
+
+static const struct simBoardUart boardUart[] =
+{
+	{ "RFID",			SIM_UART_RFID,		NULL,					1 },
+	{ "sound",			SIM_UART_SOUND,		SIM_UART_SOUND_OLD,		1 },
+	{ "sound 2",		SIM_UART_SOUND2,	SIM_UART_SOUND2_OLD,	0 },
+};
+
+static const struct simBoardPinMux boardPinMux[] =
+{
+	SIM_BOARD_PINMUX
+};
+
+#define BOARD_COUNT(t)	( (int)( sizeof(t) / sizeof(t[0]) ) )
+
+static int
+boardProblem(const char *msg )
+{
+	char buf[256];
+
+	snprintf(buf, sizeof(buf), "Board profile: %s", msg );
+	log_message("", buf );
+	if ( debug )
+	{
+		printf("%s\n", buf );
+	}
+	return ( 1 );
+}
+
+/*
+ * Function: checkUnique
+ *
+ * Check a table of assignments for numbers out of range or used twice
+ *
+ * Returns: The number of problems
+ */
+static int
+checkUnique(const char *what, const struct simBoardAssign *tab, int count, int limit )
+{
+	char buf[128];
+	int problems = 0;
+	int i;
+	int j;
+
+	for ( i = 0 ; i < count ; i++ )
+	{
+		if ( tab[i].num < 0 || tab[i].num >= limit )
+		{
+			snprintf(buf, sizeof(buf), "%s %s is %d, out of range", what, tab[i].name, tab[i].num );
+			problems += boardProblem(buf );
+		}
+		for ( j = 0 ; j < i ; j++ )
+		{
+			if ( tab[i].num == tab[j].num )
+			{
+				snprintf(buf, sizeof(buf), "%s %d is both %s and %s", what, tab[i].num, tab[j].name, tab[i].name );
+				problems += boardProblem(buf );
+			}
+		}
+	}
+	return ( problems );
+}
+
+/*
+ * Function: simBoardCheck
+ *
+ * Check the board profile: no GPIO pin or analog input used twice or out of
+ * range. With present, also check that the GPIO chips, the required serial
+ * ports and the analog inputs are there. Each problem is logged.
+ *
+ * Returns: The number of problems
+ */
+int
+simBoardCheck(int present )
+{
+	struct stat sb;
+	char buf[128];
+	int problems = 0;
+	int chipChecked[SIM_GPIO_CHIPS] = { 0, };
+	unsigned int chip;
+	int i;
+
+	problems += checkUnique("GPIO pin", boardGpio, BOARD_COUNT(boardGpio), SIM_GPIO_PINS );
+	problems += checkUnique("AIN channel", boardAin, BOARD_COUNT(boardAin), SIM_AIN_CHANNELS );
+	if ( present )
+	{
+		for ( i = 0 ; i < BOARD_COUNT(boardGpio) ; i++ )
+		{
+			chip = SIM_GPIO_CHIP(boardGpio[i].num );
+			if ( chip >= SIM_GPIO_CHIPS || chipChecked[chip] )
+			{
+				continue;
+			}
+			chipChecked[chip] = 1;
+			snprintf(buf, sizeof(buf), "/dev/gpiochip%u", chip );
+			if ( stat(buf, &sb ) != 0 )
+			{
+				snprintf(buf, sizeof(buf), "GPIO chip %u (%s) is missing", chip, boardGpio[i].name );
+				problems += boardProblem(buf );
+			}
+		}
+		for ( i = 0 ; i < BOARD_COUNT(boardUart) ; i++ )
+		{
+			if ( ! boardUart[i].required || stat(boardUart[i].dev, &sb ) == 0 ||
+				 ( boardUart[i].oldDev && stat(boardUart[i].oldDev, &sb ) == 0 ) )
+			{
+				continue;
+			}
+			snprintf(buf, sizeof(buf), "%s serial port %s is missing", boardUart[i].name, boardUart[i].dev );
+			problems += boardProblem(buf );
+		}
+		if ( ainName(0 ) == NULL )
+		{
+			problems += boardProblem("no analog inputs found" );
+		}
+		for ( i = 0 ; i < BOARD_COUNT(boardAin) && ainName(0 ) ; i++ )
+		{
+			if ( ainName(boardAin[i].num ) == NULL || stat(ainName(boardAin[i].num ), &sb ) != 0 )
+			{
+				snprintf(buf, sizeof(buf), "AIN%d (%s) is missing", boardAin[i].num, boardAin[i].name );
+				problems += boardProblem(buf );
+			}
+		}
+	}
+	snprintf(buf, sizeof(buf), "Board profile: %s, %d problems", SIM_BOARD_NAME, problems );
+	log_message("", buf );
+	return ( problems );
+}
+
+/*
+ * Function: pinMuxWrite
+ *
+ * Set a pin's mode through its pinmux helper's state file, as config-pin
+ * does, without starting a shell
+ *
+ * Returns: 0, or -1 if the state file could not be written
+ */
+static int
+pinMuxWrite(const struct simBoardPinMux *pm )
+{
+	char path[128];
+	char pin[16];
+	FILE *fp;
+	int sts;
+	int i;
+
+	snprintf(pin, sizeof(pin), "%s", pm->pin );
+	for ( i = 0 ; pin[i] ; i++ )
+	{
+		if ( pin[i] == '.' )
+		{
+			pin[i] = '_';
+		}
+	}
+	snprintf(path, sizeof(path), SIM_BOARD_PINMUX_STATE, pin );
+	fp = fopen(path, "w" );
+	if ( fp == NULL )
+	{
+		return ( -1 );
+	}
+	sts = ( fprintf(fp, "%s\n", pm->mode ) < 0 );
+	if ( fclose(fp ) != 0 )
+	{
+		sts = 1;
+	}
+	return ( sts ? -1 : 0 );
+}
+
+/*
+ * Function: simBoardPinMux
+ *
+ * Set the pin mux of the board profile. Each pin is written to its state
+ * file directly; config-pin is run only for a pin where that fails.
+ */
+void
+simBoardPinMux(void )
+{
+	char cmd[64];
+	int i;
+
+	for ( i = 0 ; i < BOARD_COUNT(boardPinMux) ; i++ )
+	{
+		if ( pinMuxWrite(&boardPinMux[i] ) == 0 )
+		{
+			continue;
+		}
+		snprintf(cmd, sizeof(cmd), "config-pin %s %s", boardPinMux[i].pin, boardPinMux[i].mode );
+		if ( system(cmd ) != 0 && debug )
+		{
+			printf("%s failed\n", cmd );
+		}
+	}
+}
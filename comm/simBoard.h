@@ -0,0 +1,106 @@
+/*
+ * simBoard.h
+ * Board profile: GPIO pins, analog inputs and serial ports of the controller
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SIMBOARD_H_
+#define SIMBOARD_H_
+
+/*
+ * Every hardware assignment of a board is in its profile below, selected at
+ * build time with -DSIM_BOARD=<id> in CFLAGS (the default is the BeagleBone
+ * Black cape). A new hardware revision needs only a new profile block.
+ *
+ * GPIO pins are sysfs numbers, chip * 32 + line, so the chip and line of a
+ * pin are constants (SIM_GPIO_CHIP, SIM_GPIO_LINE). Serial ports have the
+ * current name and the older ttyO name some images still use. The pin mux is
+ * the list of config-pin settings simController applies at boot, written to
+ * the pinmux helpers' state files.
+ *
+ * simBoardCheck (simBoard.cpp) checks the profile once at startup: no pin or
+ * channel used twice, all in range, and optionally that the GPIO chips,
+ * serial ports and analog inputs are present.
+ */
+
+#define SIM_BOARD_BBB_CAPE		1		// BeagleBone Black with the sim-ctl cape
+
+#ifndef SIM_BOARD
+#define SIM_BOARD	SIM_BOARD_BBB_CAPE
+#endif
+
+#define SIM_GPIO_LINES_PER_CHIP	32
+#define SIM_GPIO_CHIPS			4
+#define SIM_GPIO_PINS			( SIM_GPIO_CHIPS * SIM_GPIO_LINES_PER_CHIP )
+#define SIM_GPIO_CHIP(pin)		( (unsigned int)(pin) / SIM_GPIO_LINES_PER_CHIP )
+#define SIM_GPIO_LINE(pin)		( (unsigned int)(pin) % SIM_GPIO_LINES_PER_CHIP )
+
+#define SIM_AIN_CHANNELS		7
+
+#if SIM_BOARD == SIM_BOARD_BBB_CAPE
+
+#define SIM_BOARD_NAME			"BeagleBone Black, sim-ctl cape"
+
+// GPIO
+#define GPIO_PIN_RISE_L			23		// P8_13, left chest rise valve
+#define GPIO_PIN_RISE_R			67		// P8_8, right chest rise valve
+#define GPIO_PIN_FALL			68		// P8_10, chest fall valve
+#define GPIO_PIN_PULSE			66		// P8_7, pulse
+#define GPIO_PIN_TANK			45		// P8_11, air tank (ain_air_test)
+#define GPIO_PIN_RFID_DETECT	49		// P9_23, RFID tag detected
+
+// Analog Input Assignments
+#define BREATH_AIN_CHANNEL			0
+#define TOUCH_SENSE_AIN_CHANNEL_1	1
+#define AIR_PRESSURE_AIN_CHANNEL	2
+#define TOUCH_SENSE_AIN_CHANNEL_2	3
+#define TOUCH_SENSE_AIN_CHANNEL_3	4
+#define TOUCH_SENSE_AIN_CHANNEL_4	5
+#define SIM_BOARD_ADC_NAME		"TI-am335x-adc"		// IIO device name (newer kernels add ".0.auto")
+#define SIM_BOARD_AIN_HELPER	"/sys/devices/ocp.*/helper.*/AIN0"	// Older kernels' bone_iio_helper
+
+// Serial ports
+#define SIM_UART_RFID			"/dev/ttyS1"	// UART1
+#define SIM_UART_SOUND			"/dev/ttyS2"	// UART2, WAV Trigger/Tsunami
+#define SIM_UART_SOUND_OLD		"/dev/ttyO2"
+#define SIM_UART_SOUND2			"/dev/ttyS4"	// UART4, second WAV Trigger
+#define SIM_UART_SOUND2_OLD		"/dev/ttyO4"
+
+// Pin mux: header pin, mode. Set through the pin's state file (%s is the pin
+// with '_' for '.'), or with config-pin if that fails.
+#define SIM_BOARD_PINMUX_STATE	"/sys/devices/platform/ocp/ocp:%s_pinmux/state"
+#define SIM_BOARD_PINMUX \
+	{ "P9.24", "uart" },	/* UART1 - For rfidScan */ \
+	{ "P9.26", "uart" },	/* UART1 - For rfidScan */ \
+	{ "P9.21", "uart" },	/* UART2 - For soundSense */ \
+	{ "P9.22", "uart" }		/* UART2 - For soundSense */
+
+#else
+#error "Unknown SIM_BOARD"
+#endif
+
+struct simBoardPinMux
+{
+	const char *pin;
+	const char *mode;
+};
+
+int simBoardCheck(int present );
+void simBoardPinMux(void );
+
+#endif /* SIMBOARD_H_ */
@@ -0,0 +1,190 @@
+/*
+ * simBoot.cpp
+ * Boot timeline: when each startup stage was reached, from simController to the first heart sound
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "simUtil.h"
+#include "simBoot.h"
+
+extern struct shmData *shmData;
+
+static const char *bootNames[SIM_BOOT_STAGES] =
+{
+	"controller",
+	"pinmux",
+	"shm",
+	"simmgr",
+	"sound start",
+	"sound port",
+	"sound board",
+	"sound ready",
+	"first heart",
+	"soundSense",
+	"pulse",
+	"breathSense",
+	"cprScan",
+	"rfidScan",
+};
+
+/*
+ * Function: simBootNowMs
+ *
+ * Returns: ms since the kernel booted, at least 1
+ */
+unsigned int
+simBootNowMs(void )
+{
+	struct timespec ts;
+	unsigned int ms;
+
+	clock_gettime(CLOCK_BOOTTIME, &ts );
+	ms = (unsigned int)( ts.tv_sec * 1000 + ts.tv_nsec / 1000000 );
+	return ( ms ? ms : 1 );
+}
+
+/*
+ * Function: simBootClear
+ *
+ * Start a new timeline. simController only, after initSHM().
+ */
+void
+simBootClear(void )
+{
+	unlink(SIM_BOOT_READY_FILE );
+	if ( shmData )
+	{
+		memset(&shmData->boot, 0, sizeof(struct simBoot) );
+	}
+}
+
+/*
+ * Function: simBootMarkAt
+ *
+ * Set the time of a stage, if it has none yet
+ */
+void
+simBootMarkAt(int stage, unsigned int ms )
+{
+	if ( shmData == NULL || stage < 0 || stage >= SIM_BOOT_STAGES )
+	{
+		return;
+	}
+	__sync_bool_compare_and_swap(&shmData->boot.ms[stage], 0, ms );
+}
+
+/*
+ * Function: simBootMark
+ *
+ * Mark a stage reached now, if it has not been
+ */
+void
+simBootMark(int stage )
+{
+	if ( shmData && stage >= 0 && stage < SIM_BOOT_STAGES && shmData->boot.ms[stage] == 0 )
+	{
+		simBootMarkAt(stage, simBootNowMs() );
+	}
+}
+
+const char *
+simBootStageName(int stage )
+{
+	if ( stage < 0 || stage >= SIM_BOOT_STAGES )
+	{
+		return ( "unknown" );
+	}
+	return ( bootNames[stage] );
+}
+
+/*
+ * Function: simBootFormat
+ *
+ * Format the stages reached, in time order, each as ms since kernel boot
+ * and the step from the one before
+ *
+ * Returns: The length, 0 if no stage has been reached
+ */
+int
+simBootFormat(char *buf, int size )
+{
+	unsigned int done[SIM_BOOT_STAGES] = { 0, };
+	unsigned int last = 0;
+	unsigned int ms;
+	int len = 0;
+	int next;
+	int i;
+
+	buf[0] = 0;
+	if ( shmData == NULL )
+	{
+		return ( 0 );
+	}
+	while ( len < size )
+	{
+		next = -1;
+		for ( i = 0 ; i < SIM_BOOT_STAGES ; i++ )
+		{
+			ms = shmData->boot.ms[i];
+			if ( ms && ! done[i] && ( next < 0 || ms < shmData->boot.ms[next] ) )
+			{
+				next = i;
+			}
+		}
+		if ( next < 0 )
+		{
+			break;
+		}
+		done[next] = 1;
+		ms = shmData->boot.ms[next];
+		len += snprintf(&buf[len], size - len, "%s%s %u (+%u)", len ? ", " : "",
+			bootNames[next], ms, last ? ms - last : 0 );
+		last = ms;
+	}
+	return ( len < size ? len : size - 1 );
+}
+
+/*
+ * Function: simBootReady
+ *
+ * Mark SIM_BOOT_SHM and write SIM_BOOT_READY_FILE, for the init script.
+ * simController only, once the shared memory is set up.
+ *
+ * Returns: 0, or -1 if the file could not be written
+ */
+int
+simBootReady(void )
+{
+	int fd;
+
+	simBootMark(SIM_BOOT_SHM );
+	fd = open(SIM_BOOT_READY_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+	if ( fd < 0 )
+	{
+		log_message("", "simBoot: can't write " SIM_BOOT_READY_FILE );
+		return ( -1 );
+	}
+	close(fd );
+	return ( 0 );
+}
@@ -0,0 +1,48 @@
+/*
+ * simBoot.h
+ * Boot timeline: when each startup stage was reached, from simController to the first heart sound
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SIMBOOT_H_
+#define SIMBOOT_H_
+
+/*
+ * Each process marks the startup stages it reaches (SIM_BOOT_ in shmData.h)
+ * in shmData->boot, as ms of CLOCK_BOOTTIME, so the timeline starts at the
+ * kernel boot and includes the init script. A stage is marked the first time
+ * only. simController clears the timeline when it starts, marks the stages it
+ * did before the shared memory was there, and then writes SIM_BOOT_READY_FILE;
+ * the init script waits for that file, not a fixed time, before it starts the
+ * daemons. simModuleRun marks SIM_BOOT_MODULE + id when a module's init is
+ * done. soundSense logs the timeline at the first heart sound.
+ */
+
+#include "shmData.h"
+
+#define SIM_BOOT_READY_FILE		"/dev/shm/simctlReady"
+
+unsigned int simBootNowMs(void );
+void simBootClear(void );
+void simBootMark(int stage );
+void simBootMarkAt(int stage, unsigned int ms );
+const char *simBootStageName(int stage );
+int simBootFormat(char *buf, int size );
+int simBootReady(void );
+
+#endif /* SIMBOOT_H_ */
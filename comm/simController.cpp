@@ -35,7 +35,6 @@
 #include <sys/time.h>
 #include <errno.h>
 #include <sys/mman.h>
-#include <semaphore.h>
 #include <termios.h>
 #include <syslog.h>
 #include <signal.h>
@@ -52,6 +51,11 @@
 
 #include "simUtil.h"
 #include "shmData.h"
+#include "simMetrics.h"
+#include "simTrace.h"
+#include "simSession.h"
+#include "simSymbols.h"
+#include "simBoot.h"
 
 using namespace std;
 
@@ -65,10 +69,12 @@ struct shmData *shmData;
 char msgbuf[BUF_LEN_MAX+4];
 char simctlrReadCmd[BUF_LEN_MAX+4];
 char simctlrWriteCmd[BUF_LEN_MAX+4];
+char simctlrBody[SIM_SESSION_DATA_MAX+4];
 
 int simMgrSyncTime(void);
 void simMgrRead(void );
 void simMgrWrite(void );
+void simMgrParseLine(char *line, int *section );
 void initializeSensorData(void );
 
 int debug = 0;
@@ -106,12 +112,12 @@ int main(int argc, char *argv[])
 {
 	int sts;
 	int loop_count;
+	unsigned int bootStart = simBootNowMs();
+	unsigned int bootPinMux;
 	
-	// Do GPIO Pin configurations
-	system("config-pin P9.24 uart" );	// UART1 - For rfidScan
-    system("config-pin P9.26 uart" );	// UART1 - For rfidScan
-	system("config-pin P9.21 uart" );	// UART2 - For soundSense
-	system("config-pin P9.22 uart" );	// UART2 - For soundSense
+	// Do GPIO Pin configurations (the board profile's pin mux)
+	simBoardPinMux();
+	bootPinMux = simBootNowMs();
 
 	if ( debug )
 	{
@@ -129,6 +135,18 @@ int main(int argc, char *argv[])
 		log_message("", msgbuf );
 		exit ( -1 );
 	}
+	simBootClear();
+	simBootMarkAt(SIM_BOOT_CONTROLLER, bootStart );
+	simBootMarkAt(SIM_BOOT_PINMUX, bootPinMux );
+	simMetricsInit(SIM_METRIC_PROC_CONTROLLER, "simController" );
+	simTraceInit(SIM_METRIC_PROC_CONTROLLER, "simController" );
+	if ( simSessionInit("simController" ) != 0 )
+	{
+		exit ( -1 );
+	}
+	simBoardCheck(simSessionMode != SIM_SESSION_REPLAYING );
+	simSymbolsInit();
+	simSymbolsLoad(SIM_SYMBOLS_CSV );
 
 	shmData->cardiac.rate = 80;
 	shmData->respiration.awRR = 50;
@@ -138,18 +156,17 @@ int main(int argc, char *argv[])
 	shmData->cpr.compression = 0;
 	shmData->cpr.release = 0;
 	shmData->cpr.duration = 0;
+	shmData->cpr.count = 0;
+	shmData->cpr.depth = 0;
+	shmData->cpr.rate = 0;
+	shmData->cpr.recoil = 0;
+	shmData->cpr.dutyCycle = 0;
+	shmData->cpr.handsOff = 0;
 	shmData->auscultation.heartTrim = 0;
 	shmData->auscultation.lungTrim = 0;
-	sem_init(&shmData->i2c_sema, 1, 1 ); // pshared =1, value =1
-	
-	sts = getI2CLock();
-	if ( sts )
-	{
-		log_message("", "getI2CLock returns fail");
-	}
-	releaseI2CLock();
-	
+
 	initializeSensorData();
+	simBootReady();
 	
 #ifdef DO_DEAMON_STARTS
 	// Start the other deamons
@@ -165,7 +182,7 @@ int main(int argc, char *argv[])
 	
 	while ( 1 )
 	{
-		if ( shmData->simMgrStatusPort != 0 )
+		if ( shmData->simMgrStatusPort != 0 || simSessionMode == SIM_SESSION_REPLAYING )
 		{
 			if ( ( loop_count & 1 ) == 0 )
 			{
@@ -232,6 +249,8 @@ simMgrWrite(void )
 {
 	FILE *pipe;
 	int do_send;
+	unsigned long long start;
+	
 	while ( 1 ) 
 	{
 		do_send = 0;
@@ -332,9 +351,15 @@ simMgrWrite(void )
 			do_send++;
 		}
 #endif
-		if ( do_send )
+		if ( do_send && simSessionMode == SIM_SESSION_REPLAYING )
+		{
+			// Nothing is sent when replaying; the trace shows what would have been
+			simTrace(SIM_TRACE_HTTP, 0, 1 );
+		}
+		else if ( do_send )
 		{
 			//log_message("", simctlrWriteCmd );
+			start = simSpanStart();
 			pipe = popen(simctlrWriteCmd, "r" );
 			if ( !pipe )
 			{
@@ -348,7 +373,12 @@ simMgrWrite(void )
 					// Could parse the return, but not really needed.
 					//log_message("", msgbuf );
 				}
-				pclose(pipe );
+				if ( pclose(pipe ) != 0 )
+				{
+					simMetricError(SIM_METRIC_CURL );
+				}
+				simSpanEnd(SIM_METRIC_CURL, start );
+				simTrace(SIM_TRACE_HTTP, (int)( simSpanStart() - start ), 1 );
 			}
 		}
 		else
@@ -427,6 +457,12 @@ simMgrSyncTime(void)
 	int len;
 	int i;
 
+	if ( simSessionMode == SIM_SESSION_REPLAYING )
+	{
+		// Leave the host clock alone
+		return ( 0 );
+	}
+
 	/* The simMgrIPAddr is always set via inet_ntop() and therefore contains
 	 * only digits and dots — no shell metacharacters are possible here.      */
 	snprintf(buff, sizeof(buff), "curl  %s:%d/cgi-bin/simstatus.cgi?date=1",
@@ -548,13 +584,29 @@ simMgrRead(void )
 {
 	FILE *pipe;
 	int section;
-	int i;
-	int sts;
-	char name[128];
-	char value[128];
+	int len;
+	int bodyLen = 0;
+	char *line;
+	char *save;
+	unsigned long long start;
 	
+	if ( simSessionMode == SIM_SESSION_REPLAYING )
+	{
+		len = simSessionHold(SIM_SESSION_HTTP, 0, simctlrBody, SIM_SESSION_DATA_MAX );
+		if ( len > 0 )
+		{
+			simctlrBody[len] = 0;
+			section = SEC_NONE;
+			for ( line = strtok_r(simctlrBody, "\n", &save ) ; line ; line = strtok_r(NULL, "\n", &save ) )
+			{
+				simMgrParseLine(line, &section );
+			}
+		}
+		return;
+	}
 	sprintf(simctlrReadCmd, "curl  %s:%d/cgi-bin/simstatus.cgi?simctrldata=1", shmData->simMgrIPAddr, shmData->simMgrStatusPort );
 
+	start = simSpanStart();
 	pipe = popen(simctlrReadCmd, "r" );
 	if ( !pipe )
 	{
@@ -563,72 +615,103 @@ simMgrRead(void )
 	}
 	else
 	{
-		// Super-simple parse routine
 		section = SEC_NONE;
 		while (fgets(msgbuf, BUF_LEN_MAX, pipe) != NULL)
 		{
-			for ( i = 0 ; msgbuf[i] != 0 ; i++ )
+			if ( simSessionMode == SIM_SESSION_RECORDING )
 			{
-				switch ( msgbuf[i] )
+				len = strlen(msgbuf );
+				if ( bodyLen + len <= SIM_SESSION_DATA_MAX )
 				{
-					case ':':
-					case '"':
-					case '}':
-					case '{':
-					case ',':
-						msgbuf[i] = ' ';
-						break;
+					memcpy(&simctlrBody[bodyLen], msgbuf, len );
+					bodyLen += len;
 				}
 			}
-			// Check for a data line; width limits prevent overflow into 128-byte buffers
-			sts = sscanf(msgbuf, "%127s %127s", name, value );
-			if ( sts == 1 )
-			{
-				// printf("Section: '%s'\n", name );
-				if ( strcmp(name, "cardiac" ) == 0 )
-				{
-					section = SEC_CARDIAC;
-				}
-				else if ( strcmp(name, "respiration" ) == 0 )
+			simMgrParseLine(msgbuf, &section );
+		}
+		if ( pclose(pipe ) != 0 )
+		{
+			simMetricError(SIM_METRIC_CURL );
+		}
+		else
+		{
+			simBootMark(SIM_BOOT_SIMMGR );
+		}
+		simSpanEnd(SIM_METRIC_CURL, start );
+		simTrace(SIM_TRACE_HTTP, (int)( simSpanStart() - start ), 0 );
+		simSessionRecord(SIM_SESSION_HTTP, 0, simctlrBody, bodyLen );
+	}
+}
+
+/*
+ * Function: simMgrParseLine
+ *
+ * Super-simple parse of one line of the simctrldata response. A section name
+ * on its own selects the section for the name/value lines that follow.
+ */
+void
+simMgrParseLine(char *line, int *section )
+{
+	int i;
+	int sts;
+	char name[128];
+	char value[128];
+
+	for ( i = 0 ; line[i] != 0 ; i++ )
+	{
+		switch ( line[i] )
+		{
+			case ':':
+			case '"':
+			case '}':
+			case '{':
+			case ',':
+				line[i] = ' ';
+				break;
+		}
+	}
+	// Check for a data line; width limits prevent overflow into 128-byte buffers
+	sts = sscanf(line, "%127s %127s", name, value );
+	if ( sts == 1 )
+	{
+		// printf("Section: '%s'\n", name );
+		if ( strcmp(name, "cardiac" ) == 0 )
+		{
+			*section = SEC_CARDIAC;
+		}
+		else if ( strcmp(name, "respiration" ) == 0 )
+		{
+			*section = SEC_RESPIRATION;
+		}
+		else
+		{
+			*section = SEC_NONE;
+		}
+	}
+	else if ( sts == 2 )
+	{
+		switch ( *section )
+		{
+			case SEC_NONE:
+				if ( debug > 1)
 				{
-					section = SEC_RESPIRATION;
+					printf("none: '%s', Value '%s'\n", name, value );
 				}
-				else
+				break;
+			case SEC_CARDIAC:
+				if ( debug > 1)
 				{
-					section = SEC_NONE;
+					printf("cardiac: '%s', Value '%s'\n", name, value );
 				}
-				
-			}
-			else if ( sts == 2 )
-			{
-				switch ( section )
+				cardiac_parse(name,  value, &shmData->cardiac );
+				break;
+			case SEC_RESPIRATION:
+				if ( debug > 1 )
 				{
-					case SEC_NONE:
-						if ( debug > 1)
-						{
-							printf("none: '%s', Value '%s'\n", name, value );
-						}
-						break;
-					case SEC_CARDIAC:
-						if ( debug > 1)
-						{
-							printf("cardiac: '%s', Value '%s'\n", name, value );
-						}
-						cardiac_parse(name,  value, &shmData->cardiac );
-						break;
-					case SEC_RESPIRATION:
-						if ( debug > 1 )
-						{
-							printf("respiration: '%s', Value '%s'\n", name, value );
-						}
-						respiration_parse(name,  value, &shmData->respiration );
-						break;
+					printf("respiration: '%s', Value '%s'\n", name, value );
 				}
-			}
-
+				respiration_parse(name,  value, &shmData->respiration );
+				break;
 		}
-		pclose(pipe );
 	}
 }
-
-	
@@ -49,6 +49,7 @@
 
 #include "simCtlComm.h"
 #include "simUtil.h"
+#include "simSession.h"
 #include "version.h"
 
 #define BUF_MAX	4096
@@ -150,6 +151,18 @@ simCtlComm::openListen(int active )
 
 	commFD = -1;
 	
+	if ( simSessionMode == SIM_SESSION_REPLAYING )
+	{
+		// The SimMgr found when the session was recorded
+		sts = simSessionNext(SIM_SESSION_SYNC, 1, msgbuf, 127, 1 );
+		if ( sts > 0 )
+		{
+			msgbuf[sts] = 0;
+			sscanf(msgbuf, "%31s %d", simMgrIPAddr, &simMgrStatusPort );
+		}
+		connectState = TRUE;
+		return ( 0 );
+	}
 	// Find our local IPV4 subnet address
 	sts = -1;
 	while ( sts )
@@ -305,6 +318,11 @@ simCtlComm::openListen(int active )
 			return ( -1 );
 		}
 	}
+	if ( simSessionMode == SIM_SESSION_RECORDING )
+	{
+		sprintf(msgbuf, "%s %d", simMgrIPAddr, simMgrStatusPort );
+		simSessionRecord(SIM_SESSION_SYNC, 1, msgbuf, strlen(msgbuf) );
+	}
 	return ( 0 );
 }
 
@@ -319,7 +337,18 @@ simCtlComm::wait(void )
 	while ( 1 )
 	{
 		memset(buffer, 0, SM_BUF_MAX );
-		len = read(commFD, buffer, SM_BUF_MAX-1 );
+		if ( simSessionMode == SIM_SESSION_REPLAYING )
+		{
+			len = simSessionNext(SIM_SESSION_SYNC, 0, buffer, SM_BUF_MAX-1, 1 );
+		}
+		else
+		{
+			len = read(commFD, buffer, SM_BUF_MAX-1 );
+			if ( len > 0 )
+			{
+				simSessionRecord(SIM_SESSION_SYNC, 0, buffer, len );
+			}
+		}
 		if ( len > 0 )
 		{
 			if ( debug > 1 )
@@ -355,7 +384,10 @@ simCtlComm::wait(void )
 			{
 				// Write back the version
 				sprintf(buffer, "%s", SIMCTL_VERSION );
-				len = write(commFD, buffer, strlen(buffer) );
+				if ( commFD >= 0 )
+				{
+					len = write(commFD, buffer, strlen(buffer) );
+				}
 			}
 			if ( syncState != SYNC_NONE )
 			{
@@ -20,7 +20,7 @@
  * GPIO implementation updated to use libgpiod in place of the legacy
  * sysfs /sys/class/gpio interface.
  *
- * BeagleBone GPIO numbering convention:
+ * BeagleBone GPIO numbering convention (see simBoard.h):
  *   sysfs pin  =  chip * 32 + line_offset
  *   e.g. pin 49  ->  chip 1, line 17  (/dev/gpiochip1, offset 17)
  *
@@ -34,9 +34,13 @@
 #include <string.h>
 #include <syslog.h>
 #include <gpiod.h>
+#include <pthread.h>
 
 #include "simUtil.h"
 #include "shmData.h"
+#include "simMetrics.h"
+#include "simTrace.h"
+#include "simSession.h"
 
 // GPIO Access (kept for callers that test direction)
 #define GPIO_TURN_ON	1
@@ -48,18 +52,96 @@
 
 extern int debug;
 
+#define GPIO_PINS		SIM_GPIO_PINS
+#define GPIO_LINES_MAX	16
+
+/*
+ * Lines opened with gpioPinOpen, so a line can be traced and recorded by pin.
+ * When replaying no chip is opened and the line handed out is the address of
+ * its entry here.
+*/
+struct gpioLine
+{
+	struct gpiod_line *line;
+	int pin;
+	int value;
+};
+static struct gpioLine gpioLines[GPIO_LINES_MAX];
+static int gpioLineCount;
+static pthread_mutex_t gpioLineLock = PTHREAD_MUTEX_INITIALIZER;	// Module inits may run on several threads
+static int gpioLastRead[GPIO_PINS];
+static int gpioLastValid[GPIO_PINS];
+
+static struct gpioLine *
+gpioLineFind(struct gpiod_line *line )
+{
+	int i;
+
+	if ( simSessionMode == SIM_SESSION_REPLAYING )
+	{
+		return ( (struct gpioLine *)line );
+	}
+	for ( i = 0 ; i < gpioLineCount ; i++ )
+	{
+		if ( gpioLines[i].line == line )
+		{
+			return ( &gpioLines[i] );
+		}
+	}
+	return ( NULL );
+}
+
+static struct gpioLine *
+gpioLineAdd(int pin )
+{
+	struct gpioLine *gl = NULL;
+
+	pthread_mutex_lock(&gpioLineLock );
+	if ( gpioLineCount < GPIO_LINES_MAX )
+	{
+		gl = &gpioLines[gpioLineCount];
+		gl->line = NULL;
+		gl->pin = pin;
+		gl->value = 0;
+		gpioLineCount++;
+	}
+	pthread_mutex_unlock(&gpioLineLock );
+	return ( gl );
+}
+
+// Record an input when it changes, or replay it
+static int
+gpioSession(int pin, int value )
+{
+	if ( pin < 0 || pin >= GPIO_PINS )
+	{
+		return ( value );
+	}
+	if ( simSessionMode == SIM_SESSION_REPLAYING )
+	{
+		simSessionHold(SIM_SESSION_GPIO, pin, &value, sizeof(value) );
+	}
+	else if ( ! gpioLastValid[pin] || gpioLastRead[pin] != value )
+	{
+		gpioLastRead[pin] = value;
+		gpioLastValid[pin] = 1;
+		simSessionRecord(SIM_SESSION_GPIO, pin, &value, sizeof(value) );
+	}
+	return ( value );
+}
+
 /**
  * pin_to_chip_line
  *
  * Convert a legacy sysfs GPIO pin number to a libgpiod chip number and
- * line offset using the BeagleBone convention: chip = pin / 32,
- * line_offset = pin % 32.
+ * line offset using the board's convention (SIM_GPIO_CHIP, SIM_GPIO_LINE).
+ * Pins are constants from the board profile, so this folds at compile time.
 */
-static void
+static inline void
 pin_to_chip_line(int pin, unsigned int *chip_num, unsigned int *line_offset)
 {
-	*chip_num    = (unsigned int)(pin / 32);
-	*line_offset = (unsigned int)(pin % 32);
+	*chip_num    = SIM_GPIO_CHIP(pin);
+	*line_offset = SIM_GPIO_LINE(pin);
 }
 
 /**
@@ -80,6 +162,7 @@ gpioPinOpen(int pin, int direction)
 	unsigned int chip_num, line_offset;
 	struct gpiod_chip *chip;
 	struct gpiod_line *line;
+	struct gpioLine *gl;
 	int ret;
 
 	if ( debug )
@@ -87,6 +170,11 @@ gpioPinOpen(int pin, int direction)
 		printf("gpioPinOpen(%d, %d)\n", pin, direction);
 	}
 
+	if ( simSessionMode == SIM_SESSION_REPLAYING )
+	{
+		return ( (struct gpiod_line *)gpioLineAdd(pin ) );
+	}
+
 	pin_to_chip_line(pin, &chip_num, &line_offset);
 
 	chip = gpiod_chip_open_by_number(chip_num);
@@ -118,6 +206,11 @@ gpioPinOpen(int pin, int direction)
 		return NULL;
 	}
 
+	gl = gpioLineAdd(pin );
+	if ( gl )
+	{
+		gl->line = line;
+	}
 	return line;
 }
 
@@ -129,14 +222,28 @@ gpioPinOpen(int pin, int direction)
 void
 gpioPinSet(struct gpiod_line *line, int val)
 {
+	struct gpioLine *gl;
+	unsigned long long start;
+
 	if (val != 0) {
 		val = 1;
 	}
 
+	if ( simSessionMode == SIM_SESSION_REPLAYING )
+	{
+		gl = (struct gpioLine *)line;
+		gl->value = val;
+		simTrace(SIM_TRACE_GPIO, gl->pin % 32, val);
+		return;
+	}
+	start = simSpanStart();
 	if (gpiod_line_set_value(line, val) < 0) {
+		simMetricError(SIM_METRIC_GPIO);
 		fprintf(stderr, "gpioPinSet: gpiod_line_set_value(%d) failed: %s\n",
 		        val, strerror(errno));
 	}
+	simSpanEnd(SIM_METRIC_GPIO, start);
+	simTrace(SIM_TRACE_GPIO, gpiod_line_offset(line), val);
 }
 
 /**
@@ -154,6 +261,12 @@ gpioPinRead(int pin, int *value)
 	struct gpiod_line *line;
 	int ret;
 
+	if ( simSessionMode == SIM_SESSION_REPLAYING )
+	{
+		*value = gpioSession(pin, 0 );
+		return 0;
+	}
+
 	pin_to_chip_line(pin, &chip_num, &line_offset);
 
 	chip = gpiod_chip_open_by_number(chip_num);
@@ -190,7 +303,7 @@ gpioPinRead(int pin, int *value)
 		return -1;
 	}
 
-	*value = ret;
+	*value = gpioSession(pin, ret );
 	return 0;
 }
 
@@ -203,12 +316,20 @@ gpioPinRead(int pin, int *value)
 int
 gpioPinGet(struct gpiod_line *line, int *value)
 {
-	int ret = gpiod_line_get_value(line);
+	struct gpioLine *gl = gpioLineFind(line);
+	int ret;
+
+	if ( simSessionMode == SIM_SESSION_REPLAYING )
+	{
+		*value = gpioSession(gl->pin, gl->value );
+		return 0;
+	}
+	ret = gpiod_line_get_value(line);
 	if (ret < 0) {
 		fprintf(stderr, "gpioPinGet: gpiod_line_get_value failed: %s\n",
 		        strerror(errno));
 		return -1;
 	}
-	*value = ret;
+	*value = gl ? gpioSession(gl->pin, ret ) : ret;
 	return 0;
 }
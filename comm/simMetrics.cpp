@@ -0,0 +1,190 @@
+/*
+ * simMetrics.cpp
+ * Shared memory latency histograms and counters
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "simMetrics.h"
+
+extern struct shmData *shmData;
+
+static const char *metricNames[SIM_METRICS] =
+{
+	"ain_read",
+	"curl",
+	"wav_cmd",
+	"i2c",
+	"gpio",
+	"sync_heart",
+	"sync_breath",
+};
+
+static struct simMetricsProc localMetrics;
+static struct simMetricsProc *metricsProc = &localMetrics;
+
+/*
+ * Function: simMetricsInit
+ *
+ * Select the shared memory slot for this process and clear it. Call after
+ * initSHM().
+ */
+void
+simMetricsInit(int proc, const char *name )
+{
+	if ( shmData == NULL || proc < 0 || proc >= SIM_METRIC_PROCS )
+	{
+		return;
+	}
+	metricsProc = &shmData->metrics[proc];
+	memset(metricsProc, 0, sizeof(struct simMetricsProc) );
+	snprintf(metricsProc->name, sizeof(metricsProc->name), "%s", name );
+	metricsProc->pid = getpid();
+}
+
+const char *
+simMetricName(int metric )
+{
+	if ( metric < 0 || metric >= SIM_METRICS )
+	{
+		return ( "" );
+	}
+	return ( metricNames[metric] );
+}
+
+/*
+ * Function: simMetricBucket
+ *
+ * Returns: The histogram bucket for a value
+ */
+int
+simMetricBucket(unsigned int usec )
+{
+	int power;
+
+	if ( usec < ( 1 << SIM_METRIC_SUB_BITS ) )
+	{
+		return ( usec );
+	}
+	power = 31 - __builtin_clz(usec );
+	if ( power > SIM_METRIC_MAX_POWER )
+	{
+		return ( SIM_METRIC_BUCKETS - 1 );
+	}
+	return ( ( 1 << SIM_METRIC_SUB_BITS ) +
+			 ( ( power - SIM_METRIC_SUB_BITS ) << SIM_METRIC_SUB_BITS ) +
+			 ( ( usec >> ( power - SIM_METRIC_SUB_BITS ) ) & ( ( 1 << SIM_METRIC_SUB_BITS ) - 1 ) ) );
+}
+
+/*
+ * Function: simMetricBucketLow
+ *
+ * Returns: The lowest value in a bucket
+ */
+unsigned int
+simMetricBucketLow(int bucket )
+{
+	int power;
+	int sub;
+
+	if ( bucket < ( 1 << SIM_METRIC_SUB_BITS ) )
+	{
+		return ( bucket );
+	}
+	bucket -= ( 1 << SIM_METRIC_SUB_BITS );
+	power = ( bucket >> SIM_METRIC_SUB_BITS ) + SIM_METRIC_SUB_BITS;
+	sub = bucket & ( ( 1 << SIM_METRIC_SUB_BITS ) - 1 );
+	return ( ( ( 1 << SIM_METRIC_SUB_BITS ) + sub ) << ( power - SIM_METRIC_SUB_BITS ) );
+}
+
+/*
+ * Function: simMetricRecord
+ *
+ * Add one value to a metric of this process.
+ */
+void
+simMetricRecord(int metric, unsigned int usec )
+{
+	struct simMetric *m;
+	unsigned int max;
+
+	if ( metric < 0 || metric >= SIM_METRICS )
+	{
+		return;
+	}
+	m = &metricsProc->metric[metric];
+	__sync_fetch_and_add(&m->buckets[simMetricBucket(usec )], 1 );
+	__sync_fetch_and_add(&m->sum, (unsigned long long)usec );
+	__sync_fetch_and_add(&m->count, 1 );
+	max = m->max;
+	while ( usec > max )
+	{
+		if ( __sync_bool_compare_and_swap(&m->max, max, usec ) )
+		{
+			break;
+		}
+		max = m->max;
+	}
+}
+
+void
+simMetricError(int metric )
+{
+	if ( metric < 0 || metric >= SIM_METRICS )
+	{
+		return;
+	}
+	__sync_fetch_and_add(&metricsProc->metric[metric].errors, 1 );
+}
+
+/*
+ * Function: simMetricPercentile
+ *
+ * Returns: The lower bound of the bucket holding the given percentile, usec
+ */
+unsigned int
+simMetricPercentile(struct simMetric *m, int percent )
+{
+	unsigned long long target;
+	unsigned long long seen = 0;
+	unsigned long long total = 0;
+	int b;
+
+	for ( b = 0 ; b < SIM_METRIC_BUCKETS ; b++ )
+	{
+		total += m->buckets[b];
+	}
+	if ( total == 0 )
+	{
+		return ( 0 );
+	}
+	target = ( total * percent + 99 ) / 100;
+	for ( b = 0 ; b < SIM_METRIC_BUCKETS ; b++ )
+	{
+		seen += m->buckets[b];
+		if ( seen >= target )
+		{
+			break;
+		}
+	}
+	return ( simMetricBucketLow(b < SIM_METRIC_BUCKETS ? b : SIM_METRIC_BUCKETS - 1 ) );
+}
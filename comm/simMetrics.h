@@ -0,0 +1,67 @@
+/*
+ * simMetrics.h
+ * Shared memory latency histograms and counters
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SIMMETRICS_H_
+#define SIMMETRICS_H_
+
+/*
+ * Each process records into its own slot of shmData->metrics, chosen with
+ * simMetricsInit() after initSHM(). Updates are atomic adds, so the threads of a
+ * process can record without a lock and readers (ctlstatus) never block a
+ * writer. Before simMetricsInit, or without shared memory, records go to a
+ * local slot and are not seen.
+ *
+ * A span is timed with:
+ *
+ *	unsigned long long start = simSpanStart();
+ *	...
+ *	simSpanEnd(SIM_METRIC_AIN_READ, start );
+*/
+
+#include <time.h>
+#include "shmData.h"
+
+void simMetricsInit(int proc, const char *name );
+void simMetricRecord(int metric, unsigned int usec );
+void simMetricError(int metric );
+const char *simMetricName(int metric );
+int simMetricBucket(unsigned int usec );
+unsigned int simMetricBucketLow(int bucket );
+unsigned int simMetricPercentile(struct simMetric *m, int percent );
+
+static inline unsigned long long
+simSpanStart(void )
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts );
+	return ( (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 );
+}
+
+static inline void
+simSpanEnd(int metric, unsigned long long start )
+{
+	unsigned long long now = simSpanStart();
+
+	simMetricRecord(metric, now > start ? (unsigned int)( now - start ) : 0 );
+}
+
+#endif /* SIMMETRICS_H_ */
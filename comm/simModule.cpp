@@ -0,0 +1,588 @@
+/*
+ * simModule.cpp
+ * Periodic poll loop shared by the sensor/audio daemons and simHub
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Each module gets a periodic timerfd, and one epoll_wait() per loop sleeps until
+ * any of them is due. Due modules are polled SIM_MODULE_RT first. The time from the due
+ * time to the start of the poll, and the time spent in the poll, are kept in
+ * shmData->modules for ctlstatus and test/hub_compare.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+#include "simModule.h"
+#include "simUtil.h"
+#include "shmData.h"
+#include "simMetrics.h"
+#include "simTrace.h"
+#include "simSession.h"
+#include "simBoot.h"
+
+extern struct shmData *shmData;
+
+// A file descriptor in a loop's epoll set. data.ptr is NULL for the init
+// threads' eventfd.
+#define MODULE_WATCH_TIMER	0
+#define MODULE_WATCH_KICK	1
+
+struct moduleWatch
+{
+	int kind;					// MODULE_WATCH_
+	struct moduleState *ms;
+};
+
+struct moduleState
+{
+	struct simModule *module;
+	int fd;
+	unsigned long long due;		// usec, CLOCK_MONOTONIC
+	struct moduleWatch timer;
+	struct moduleWatch kick;
+};
+
+// A SIM_MODULE_NORMAL init run on its own thread (simHub)
+struct moduleInitJob
+{
+	struct simModule *module;
+	pthread_t thread;
+	int efd;					// Signalled when the init is done
+	volatile int done;
+	int sts;
+};
+
+// One poll loop: an epoll set and the modules in it. simHub runs the
+// SIM_MODULE_NORMAL modules in a loop of their own (simModuleRun).
+struct moduleLoop
+{
+	struct simModule *modules[SIM_MODULES_MAX];
+	int count;
+	int rtPriority;			// SCHED_FIFO for the RT inits and the loop, 0 for none
+	int threadInits;		// Run the NORMAL inits on threads of their own
+	int epfd;
+	struct moduleState state[SIM_MODULES_MAX];
+	int active;
+	struct moduleInitJob jobs[SIM_MODULES_MAX];
+	int jobCount;
+	int pending;			// Init threads still running
+	int efd;				// Init threads done, -1 if none
+};
+
+// Used when the daemon runs without shared memory (pulse -D)
+static struct moduleStats localStats[SIM_MODULES_MAX];
+
+// eventfd of each module with an event function, -1 for none. Set up by
+// simModuleRun.
+static int moduleKickFd[SIM_MODULES_MAX];
+
+static struct moduleStats *
+moduleStatsFor(int id )
+{
+	return ( shmData ? &shmData->modules[id] : &localStats[id] );
+}
+
+static unsigned long long
+moduleNow(void )
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts );
+	return ( (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 );
+}
+
+static void
+moduleRecord(struct moduleStats *st, unsigned int latency, unsigned int run )
+{
+	st->runs++;
+	if ( st->runs == 1 )
+	{
+		st->latencyAvg = latency;
+		st->runAvg = run;
+	}
+	else
+	{
+		st->latencyAvg = ( ( st->latencyAvg * 7 ) + latency ) / 8;
+		st->runAvg = ( ( st->runAvg * 7 ) + run ) / 8;
+	}
+	if ( latency > st->latencyMax )
+	{
+		st->latencyMax = latency;
+	}
+	if ( run > st->runMax )
+	{
+		st->runMax = run;
+	}
+}
+
+static int
+moduleInit(struct simModule *mod )
+{
+	struct moduleStats *st = moduleStatsFor(mod->id );
+	char buf[128];
+
+	memset(st, 0, sizeof(struct moduleStats) );
+	snprintf(st->name, sizeof(st->name), "%s", mod->name );
+	st->pid = getpid();
+	if ( mod->init() != 0 )
+	{
+		snprintf(buf, sizeof(buf), "simModule: %s did not start", mod->name );
+		log_message("", buf );
+		st->pid = 0;
+		return ( -1 );
+	}
+	simBootMark(SIM_BOOT_MODULE + mod->id );
+	return ( 0 );
+}
+
+static void *
+moduleInitThread(void *arg )
+{
+	struct moduleInitJob *job = (struct moduleInitJob *)arg;
+	uint64_t one = 1;
+
+	job->sts = moduleInit(job->module );
+	__sync_synchronize();
+	job->done = 1;
+	if ( write(job->efd, &one, sizeof(one ) ) != sizeof(one ) )
+	{
+		log_message("", "simModuleRun: init signal failed" );
+	}
+	return ( NULL );
+}
+
+/*
+ * Function: moduleAdd
+ *
+ * Start the period timer of a module whose init is done, and add it and its
+ * kick eventfd, if any, to the loop
+ *
+ * Returns: 0, or -1 if the timer could not be made
+ */
+static int
+moduleAdd(struct moduleLoop *lp, struct simModule *mod )
+{
+	struct moduleState *ms = &lp->state[lp->active];
+	struct epoll_event ev;
+	struct itimerspec its;
+
+	if ( lp->active >= SIM_MODULES_MAX )
+	{
+		return ( -1 );
+	}
+	ms->module = mod;
+	ms->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK );
+	if ( ms->fd < 0 )
+	{
+		log_message("", "simModuleRun: timerfd_create failed" );
+		return ( -1 );
+	}
+	its.it_interval.tv_sec = mod->periodUs / 1000000;
+	its.it_interval.tv_nsec = ( mod->periodUs % 1000000 ) * 1000;
+	its.it_value = its.it_interval;
+	ms->due = moduleNow() + mod->periodUs;
+	timerfd_settime(ms->fd, 0, &its, NULL );
+	ms->timer.kind = MODULE_WATCH_TIMER;
+	ms->timer.ms = ms;
+	ev.events = EPOLLIN;
+	ev.data.ptr = &ms->timer;
+	epoll_ctl(lp->epfd, EPOLL_CTL_ADD, ms->fd, &ev );
+	if ( moduleKickFd[mod->id] >= 0 )
+	{
+		ms->kick.kind = MODULE_WATCH_KICK;
+		ms->kick.ms = ms;
+		ev.data.ptr = &ms->kick;
+		epoll_ctl(lp->epfd, EPOLL_CTL_ADD, moduleKickFd[mod->id], &ev );
+	}
+	lp->active++;
+	return ( 0 );
+}
+
+/*
+ * Function: moduleJoin
+ *
+ * Add the modules whose init thread has finished to the loop
+ *
+ * Returns: The number of init threads still running
+ */
+static int
+moduleJoin(struct moduleLoop *lp )
+{
+	uint64_t n;
+	int pending = 0;
+	int i;
+
+	if ( read(lp->efd, &n, sizeof(n ) ) != sizeof(n ) && errno != EAGAIN )
+	{
+		log_message("", "simModuleRun: init signal read failed" );
+	}
+	for ( i = 0 ; i < lp->jobCount ; i++ )
+	{
+		if ( lp->jobs[i].module == NULL )
+		{
+			continue;
+		}
+		if ( ! lp->jobs[i].done )
+		{
+			pending++;
+			continue;
+		}
+		pthread_join(lp->jobs[i].thread, NULL );
+		if ( lp->jobs[i].sts == 0 )
+		{
+			moduleAdd(lp, lp->jobs[i].module );
+		}
+		lp->jobs[i].module = NULL;
+	}
+	return ( pending );
+}
+
+/*
+ * Function: loopStart
+ *
+ * Initialize the modules of a loop: SIM_MODULE_NORMAL first, then, after the
+ * switch to SCHED_FIFO if the loop has an rtPriority, SIM_MODULE_RT. With
+ * threadInits, the NORMAL inits each run on a thread of their own and their
+ * modules join the loop as they finish.
+ *
+ * Returns: 0, or -1 on failure
+ */
+static int
+loopStart(struct moduleLoop *lp )
+{
+	struct epoll_event ev;
+	struct sched_param param;
+	struct simModule *mod;
+	char buf[128];
+	int pass;
+	int i;
+
+	lp->efd = -1;
+	lp->epfd = epoll_create1(0 );
+	if ( lp->epfd < 0 )
+	{
+		log_message("", "simModuleRun: epoll_create1 failed" );
+		return ( -1 );
+	}
+	if ( lp->threadInits )
+	{
+		lp->efd = eventfd(0, EFD_NONBLOCK );
+		if ( lp->efd >= 0 )
+		{
+			ev.events = EPOLLIN;
+			ev.data.ptr = NULL;		// Not a module: init threads done
+			epoll_ctl(lp->epfd, EPOLL_CTL_ADD, lp->efd, &ev );
+		}
+	}
+	for ( i = 0 ; i < lp->count ; i++ )
+	{
+		// Made before the init, so threads it starts can kick the module
+		if ( lp->modules[i]->event )
+		{
+			moduleKickFd[lp->modules[i]->id] = eventfd(0, EFD_NONBLOCK );
+		}
+	}
+	for ( pass = SIM_MODULE_NORMAL ; pass <= SIM_MODULE_RT ; pass++ )
+	{
+		if ( pass == SIM_MODULE_RT && lp->rtPriority > 0 )
+		{
+			param.sched_priority = lp->rtPriority;
+			if ( sched_setscheduler(0, SCHED_FIFO, &param ) != 0 )
+			{
+				snprintf(buf, sizeof(buf), "simModuleRun: SCHED_FIFO %d failed: %s", lp->rtPriority, strerror(errno ) );
+				log_message("", buf );
+			}
+		}
+		for ( i = 0 ; i < lp->count ; i++ )
+		{
+			mod = lp->modules[i];
+			if ( ( mod->priority == SIM_MODULE_RT ) != ( pass == SIM_MODULE_RT ) )
+			{
+				continue;
+			}
+			if ( lp->efd >= 0 && pass == SIM_MODULE_NORMAL )
+			{
+				lp->jobs[lp->jobCount].module = mod;
+				lp->jobs[lp->jobCount].efd = lp->efd;
+				lp->jobs[lp->jobCount].done = 0;
+				if ( pthread_create(&lp->jobs[lp->jobCount].thread, NULL, moduleInitThread, &lp->jobs[lp->jobCount] ) == 0 )
+				{
+					lp->jobCount++;
+					lp->pending++;
+					continue;
+				}
+			}
+			if ( moduleInit(mod ) != 0 )
+			{
+				continue;
+			}
+			if ( moduleAdd(lp, mod ) != 0 )
+			{
+				return ( -1 );
+			}
+		}
+	}
+	if ( lp->efd >= 0 && lp->jobCount == 0 )
+	{
+		close(lp->efd );		// No module init on a thread
+		lp->efd = -1;
+	}
+	return ( 0 );
+}
+
+/*
+ * Function: loopRun
+ *
+ * Poll the modules of a loop as they come due, RT modules first, and run the
+ * event function of a module that has been kicked
+ *
+ * Returns: Only on failure, -1
+ */
+static int
+loopRun(struct moduleLoop *lp )
+{
+	struct epoll_event events[SIM_MODULES_MAX + 1];
+	struct moduleState *ready[SIM_MODULES_MAX];
+	struct moduleWatch *w;
+	struct moduleStats *st;
+	struct simModule *mod;
+	unsigned long long now;
+	unsigned long long start;
+	uint64_t expirations;
+	int nready;
+	int pass;
+	int n;
+	int i;
+	int j;
+
+	while ( 1 )
+	{
+		if ( lp->active == 0 && lp->pending == 0 )
+		{
+			log_message("", "simModuleRun: No modules running" );
+			return ( -1 );
+		}
+		n = epoll_wait(lp->epfd, events, SIM_MODULES_MAX + 1, -1 );
+		if ( n < 0 )
+		{
+			if ( errno == EINTR )
+			{
+				continue;
+			}
+			log_message("", "simModuleRun: epoll_wait failed" );
+			return ( -1 );
+		}
+		for ( i = 0 ; i < n ; i++ )
+		{
+			w = (struct moduleWatch *)events[i].data.ptr;
+			if ( w == NULL )
+			{
+				lp->pending = moduleJoin(lp );
+				if ( lp->pending == 0 )
+				{
+					epoll_ctl(lp->epfd, EPOLL_CTL_DEL, lp->efd, NULL );
+					close(lp->efd );
+					lp->efd = -1;
+				}
+			}
+			else if ( w->kind == MODULE_WATCH_KICK )
+			{
+				// Events go ahead of the polls due at the same time
+				if ( read(moduleKickFd[w->ms->module->id], &expirations, sizeof(expirations) ) == sizeof(expirations) )
+				{
+					w->ms->module->event();
+				}
+			}
+		}
+		// RT modules first, then in table order
+		nready = 0;
+		for ( pass = SIM_MODULE_RT ; pass >= SIM_MODULE_NORMAL ; pass-- )
+		{
+			for ( i = 0 ; i < n ; i++ )
+			{
+				w = (struct moduleWatch *)events[i].data.ptr;
+				if ( w && w->kind == MODULE_WATCH_TIMER && w->ms->module->priority == pass )
+				{
+					ready[nready++] = w->ms;
+				}
+			}
+		}
+		for ( j = 0 ; j < nready ; j++ )
+		{
+			struct moduleState *ms = ready[j];
+			mod = ms->module;
+			st = moduleStatsFor(mod->id );
+			if ( read(ms->fd, &expirations, sizeof(expirations) ) != sizeof(expirations) )
+			{
+				continue;
+			}
+			if ( expirations > 1 )
+			{
+				st->overruns += (unsigned int)( expirations - 1 );
+				ms->due += ( expirations - 1 ) * mod->periodUs;
+			}
+			start = moduleNow();
+			mod->poll();
+			now = moduleNow();
+			moduleRecord(st, start > ms->due ? (unsigned int)( start - ms->due ) : 0, (unsigned int)( now - start ) );
+			ms->due += mod->periodUs;
+		}
+	}
+	return ( -1 );
+}
+
+static void *
+normalLoopThread(void *arg )
+{
+	struct moduleLoop *lp = (struct moduleLoop *)arg;
+
+	if ( loopStart(lp ) == 0 )
+	{
+		loopRun(lp );
+	}
+	return ( NULL );
+}
+
+/*
+ * Function: simModuleRun
+ *
+ * Initialize the modules and run the poll loop. Modules whose init fails are
+ * left out. If rtPriority is non-zero, the SIM_MODULE_RT modules are initialized
+ * after the thread is set to SCHED_FIFO at that priority, so threads they create
+ * are also real-time; the others keep normal scheduling for their threads.
+ * With several modules (simHub), the SIM_MODULE_NORMAL modules run in a second
+ * loop on a SCHED_OTHER thread, so a slow sensor read or serial exchange there
+ * never holds up an RT poll, and the RT loop can't starve them. Their inits each
+ * run on a thread of their own, so no module waits for another's hardware
+ * probe; a module joins its loop when its init is done. A session being
+ * recorded or replayed keeps the inits in order, one after another.
+ * A daemon running its own module records metrics and trace events in that
+ * module's slot of shmData->metrics/trace; simHub uses SIM_METRIC_PROC_HUB.
+ * Session record/replay (simSession.h) is started here, under the same name.
+ *
+ * Returns: Only on failure, -1
+ */
+int
+simModuleRun(struct simModule *modules[], int count, int rtPriority )
+{
+	static struct moduleLoop mainLoop;
+	static struct moduleLoop normalLoop;
+	struct moduleLoop *lp;
+	struct sched_param param;
+	pthread_attr_t attr;
+	pthread_t normalThread;
+	int normalRunning = 0;
+	int sts;
+	int i;
+
+	if ( count == 1 )
+	{
+		simMetricsInit(modules[0]->id, modules[0]->name );
+		simTraceInit(modules[0]->id, modules[0]->name );
+		sts = simSessionInit(modules[0]->name );
+	}
+	else
+	{
+		simMetricsInit(SIM_METRIC_PROC_HUB, "simHub" );
+		simTraceInit(SIM_METRIC_PROC_HUB, "simHub" );
+		sts = simSessionInit("simHub" );
+	}
+	if ( sts != 0 )
+	{
+		return ( -1 );
+	}
+	for ( i = 0 ; i < SIM_MODULES_MAX ; i++ )
+	{
+		moduleKickFd[i] = -1;
+	}
+	memset(&mainLoop, 0, sizeof(mainLoop) );
+	memset(&normalLoop, 0, sizeof(normalLoop) );
+	mainLoop.rtPriority = rtPriority;
+	for ( i = 0 ; i < count && i < SIM_MODULES_MAX ; i++ )
+	{
+		lp = ( count > 1 && modules[i]->priority == SIM_MODULE_NORMAL ) ? &normalLoop : &mainLoop;
+		lp->modules[lp->count++] = modules[i];
+	}
+	if ( normalLoop.count > 0 )
+	{
+		normalLoop.threadInits = ( normalLoop.count > 1 && simSessionMode == SIM_SESSION_OFF );
+		pthread_attr_init(&attr );
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED );
+		pthread_attr_setschedpolicy(&attr, SCHED_OTHER );
+		param.sched_priority = 0;
+		pthread_attr_setschedparam(&attr, &param );
+		if ( pthread_create(&normalThread, &attr, normalLoopThread, &normalLoop ) == 0 )
+		{
+			normalRunning = 1;
+		}
+		else
+		{
+			log_message("", "simModuleRun: no thread for the normal loop, running one loop" );
+			for ( i = 0 ; i < normalLoop.count ; i++ )
+			{
+				mainLoop.modules[mainLoop.count++] = normalLoop.modules[i];
+			}
+		}
+		pthread_attr_destroy(&attr );
+	}
+	if ( mainLoop.count > 0 && loopStart(&mainLoop ) == 0 )
+	{
+		loopRun(&mainLoop );
+	}
+	if ( normalRunning )
+	{
+		pthread_join(normalThread, NULL );
+	}
+	return ( -1 );
+}
+
+/*
+ * Function: simModuleKick
+ *
+ * Have the loop running module id call its event function. Safe from any
+ * thread of the process; kicks made before the event runs are merged.
+ *
+ * Returns: 0, or -1 if the module has no event function
+ */
+int
+simModuleKick(int id )
+{
+	uint64_t one = 1;
+
+	if ( id < 0 || id >= SIM_MODULES_MAX || moduleKickFd[id] < 0 )
+	{
+		return ( -1 );
+	}
+	if ( write(moduleKickFd[id], &one, sizeof(one ) ) != sizeof(one ) )
+	{
+		return ( -1 );
+	}
+	return ( 0 );
+}
@@ -0,0 +1,56 @@
+/*
+ * simModule.h
+ * Periodic poll loop shared by the sensor/audio daemons and simHub
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SIMMODULE_H_
+#define SIMMODULE_H_
+
+/*
+ * A module is one daemon's work split into an init function and a poll function
+ * that does one pass of what used to be the daemon's while(1) loop. The daemon's
+ * main() parses its options, daemonizes, opens the shared memory and calls
+ * simModuleRun() with its own module. simHub does the same with all of them, so
+ * they share one process: the SIM_MODULE_RT modules on the SCHED_FIFO loop, the
+ * SIM_MODULE_NORMAL ones on a second loop thread with normal scheduling.
+ *
+ * Poll functions must not block for long; the other modules in the same loop
+ * wait for them.
+*/
+
+#define SIM_MODULE_NORMAL		0
+#define SIM_MODULE_RT			1	// Audio/heart timing. Polled first when several are due.
+
+#define SIM_HUB_RT_PRIORITY		40	// SCHED_FIFO priority of the simHub RT loop
+
+struct simModule
+{
+	const char *name;
+	int id;						// SIM_MODULE_ index, for shmData->modules
+	int (*init)(void );			// Called after initSHM. Returns 0, or -1 if the module cannot run.
+	void (*poll)(void );
+	int periodUs;
+	int priority;				// SIM_MODULE_NORMAL or SIM_MODULE_RT
+	void (*event)(void );		// Optional. Run on the loop thread after simModuleKick().
+};
+
+int simModuleRun(struct simModule *modules[], int count, int rtPriority );
+int simModuleKick(int id );
+
+#endif /* SIMMODULE_H_ */
@@ -27,6 +27,7 @@
 #include <stdbool.h>
 
 #include "shmData.h"
+#include "simSymbols.h"
 
 extern int debug;
 
@@ -50,6 +51,7 @@ cardiac_parse(const char *elem,  const char *value, struct cardiac *card )
 				printf("Cardiac rhythm: %s (old %s)\n", value, card->rhythm );
 			}
 			snprintf(card->rhythm, STR_SIZE, "%s", value );
+			card->rhythm_id = simSymbolIntern(card->rhythm );
 		}
 	}
 	else if ( strcmp(elem, ("vpc" ) ) == 0 )
@@ -61,6 +63,7 @@ cardiac_parse(const char *elem,  const char *value, struct cardiac *card )
 				printf("Cardiac vpc: %s\n", value );
 			}
 			snprintf(card->vpc, STR_SIZE, "%s", value );
+			card->vpc_id = simSymbolIntern(card->vpc );
 		}
 	}
 	else if ( strcmp(elem, ("pea" ) ) == 0 )
@@ -105,6 +108,7 @@ cardiac_parse(const char *elem,  const char *value, struct cardiac *card )
 				printf("Cardiac pwave: %s\n", value );
 			}
 			snprintf(card->pwave, STR_SIZE, "%s", value );
+			card->pwave_id = simSymbolIntern(card->pwave );
 		}
 	}
 	else if ( strcmp(elem, ("rate" ) ) == 0 )
@@ -229,8 +233,9 @@ cardiac_parse(const char *elem,  const char *value, struct cardiac *card )
 			{
 				printf("Cardiac heart_sound: %s\n", value );
 			}
+			snprintf(card->heart_sound, STR_SIZE, "%s", value );
+			card->heart_sound_id = simSymbolIntern(card->heart_sound );
 		}
-		snprintf(card->heart_sound, STR_SIZE, "%s", value );
 	}
 	else if ( strcmp(elem, ("right_dorsal_pulse_strength" ) ) == 0 )
 	{
@@ -452,6 +457,7 @@ respiration_parse(const char *elem,  const char *value, struct respiration *resp
 				printf("Respiration left_lung_sound: %s\n", value );
 			}
 			snprintf(resp->left_lung_sound, STR_SIZE, "%s", value );
+			resp->left_lung_sound_id = simSymbolIntern(resp->left_lung_sound );
 		}
 	}
 	else if ( strcmp(elem, "right_lung_sound" ) == 0 )
@@ -463,6 +469,7 @@ respiration_parse(const char *elem,  const char *value, struct respiration *resp
 				printf("Respiration right_lung_sound: %s\n", value );
 			}
 			snprintf(resp->right_lung_sound, STR_SIZE, "%s", value );
+			resp->right_lung_sound_id = simSymbolIntern(resp->right_lung_sound );
 		}
 	}
 	else if ( strcmp(elem, "rate" ) == 0 )
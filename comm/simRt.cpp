@@ -0,0 +1,389 @@
+/*
+ * simRt.cpp
+ * Real-time scheduling profile and timing jitter histograms
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * A daemon with timing critical threads loads a profile (simRtLoad), applies the
+ * process wide part once (simRtProcess) and creates its threads with
+ * simRtThreadAttr. Each thread calls simRtThreadStart first thing, which sets its
+ * scheduling, name and timer slack and touches its stack, so the first pass
+ * through the timing path does not take page faults.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+#include <malloc.h>
+#include <sched.h>
+#include <alloca.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+
+#include "simRt.h"
+#include "simUtil.h"
+
+static const int simRtJitterLimits[SIM_RT_JITTER_BINS - 1] =
+{
+	50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000
+};
+
+/*
+ * Function: simRtDefaults
+ *
+ * Set the profile to the defaults (disabled) with the given thread priorities.
+ */
+void
+simRtDefaults(struct simRtProfile *p, const struct simRtThread *threads, int count )
+{
+	int i;
+
+	memset(p, 0, sizeof(struct simRtProfile) );
+	p->lockMemory = 1;
+	p->stackSize = SIM_RT_DEFAULT_STACK;
+	p->prefault = SIM_RT_DEFAULT_PREFAULT;
+	p->timerSlackNs = SIM_RT_DEFAULT_SLACK;
+	for ( i = 0 ; i < count && i < SIM_RT_THREADS_MAX ; i++ )
+	{
+		p->threads[i] = threads[i];
+	}
+	p->threadCount = i;
+}
+
+/*
+ * Function: simRtLoad
+ *
+ * Read a profile file over the current settings. Priorities for threads not
+ * already in the profile are added.
+ *
+ * Returns: 0 if the file was read, -1 if not
+ */
+int
+simRtLoad(struct simRtProfile *p, const char *file )
+{
+	FILE *fp;
+	char line[256];
+	char key[32];
+	char name[SIM_RT_NAME_LENGTH];
+	int val;
+	int i;
+
+	fp = fopen(file, "r" );
+	if ( fp == NULL )
+	{
+		return ( -1 );
+	}
+	while ( fgets(line, sizeof(line), fp ) )
+	{
+		if ( line[0] == '#' )
+		{
+			continue;
+		}
+		if ( sscanf(line, "priority %15s %d", name, &val ) == 2 )
+		{
+			if ( val < 0 || val > sched_get_priority_max(SCHED_FIFO ) )
+			{
+				continue;
+			}
+			for ( i = 0 ; i < p->threadCount ; i++ )
+			{
+				if ( strcmp(p->threads[i].name, name ) == 0 )
+				{
+					break;
+				}
+			}
+			if ( i == p->threadCount )
+			{
+				if ( i == SIM_RT_THREADS_MAX )
+				{
+					continue;
+				}
+				snprintf(p->threads[i].name, SIM_RT_NAME_LENGTH, "%s", name );
+				p->threadCount++;
+			}
+			p->threads[i].priority = val;
+			continue;
+		}
+		if ( sscanf(line, "%31s %d", key, &val ) != 2 )
+		{
+			continue;
+		}
+		if ( strcmp(key, "enable" ) == 0 )
+		{
+			p->enabled = val;
+		}
+		else if ( strcmp(key, "lock" ) == 0 )
+		{
+			p->lockMemory = val;
+		}
+		else if ( strcmp(key, "stack" ) == 0 && val >= PTHREAD_STACK_MIN )
+		{
+			p->stackSize = val;
+		}
+		else if ( strcmp(key, "prefault" ) == 0 && val >= 0 )
+		{
+			p->prefault = val;
+		}
+		else if ( strcmp(key, "slack" ) == 0 && val >= 0 )
+		{
+			p->timerSlackNs = val;
+		}
+	}
+	fclose(fp );
+	return ( 0 );
+}
+
+/*
+ * Function: simRtPriority
+ *
+ * Returns: The SCHED_FIFO priority of the named thread, or 0
+ */
+int
+simRtPriority(struct simRtProfile *p, const char *name )
+{
+	int i;
+
+	for ( i = 0 ; i < p->threadCount ; i++ )
+	{
+		if ( strcmp(p->threads[i].name, name ) == 0 )
+		{
+			return ( p->threads[i].priority );
+		}
+	}
+	return ( 0 );
+}
+
+// Touch the next 'bytes' of the stack, one write per page
+static void
+simRtPrefault(int bytes )
+{
+	volatile char *buf;
+	long page = sysconf(_SC_PAGESIZE );
+	int i;
+
+	if ( bytes <= 0 )
+	{
+		return;
+	}
+	buf = (volatile char *)alloca(bytes );
+	for ( i = 0 ; i < bytes ; i += page )
+	{
+		buf[i] = 0;
+	}
+}
+
+static void
+simRtSlack(struct simRtProfile *p )
+{
+	if ( p->timerSlackNs > 0 )
+	{
+		prctl(PR_SET_TIMERSLACK, (unsigned long)p->timerSlackNs, 0, 0, 0 );
+	}
+}
+
+/*
+ * Function: simRtProcess
+ *
+ * Apply the process wide settings: lock memory, keep the heap from shrinking
+ * (so freed memory does not have to be faulted in again), and set up the calling
+ * thread's slack and stack. Does nothing if the profile is not enabled.
+ *
+ * Returns: 0 on success, -1 if memory could not be locked
+ */
+int
+simRtProcess(struct simRtProfile *p )
+{
+	char buf[128];
+	int rval = 0;
+
+	if ( ! p->enabled )
+	{
+		return ( 0 );
+	}
+	if ( p->lockMemory )
+	{
+		mallopt(M_TRIM_THRESHOLD, -1 );
+		mallopt(M_MMAP_MAX, 0 );
+		if ( mlockall(MCL_CURRENT | MCL_FUTURE ) != 0 )
+		{
+			snprintf(buf, sizeof(buf), "simRtProcess: mlockall failed: %s", strerror(errno ) );
+			log_message("", buf );
+			rval = -1;
+		}
+	}
+	simRtSlack(p );
+	simRtPrefault(p->prefault );
+	return ( rval );
+}
+
+/*
+ * Function: simRtThreadAttr
+ *
+ * Initialize attr for a thread under the profile. With the profile enabled the
+ * stack size is set, as mlockall() would otherwise lock the full default stack.
+ */
+void
+simRtThreadAttr(struct simRtProfile *p, pthread_attr_t *attr )
+{
+	pthread_attr_init(attr );
+	if ( p->enabled && p->stackSize > 0 )
+	{
+		pthread_attr_setstacksize(attr, p->stackSize );
+	}
+}
+
+/*
+ * Function: simRtThreadStart
+ *
+ * Called by a thread when it starts. Names the thread and, with the profile
+ * enabled, sets its priority (a thread without one gets SCHED_OTHER even if it
+ * was created from a SCHED_FIFO thread), its timer slack and touches its stack.
+ *
+ * Returns: 0 on success, -1 if the scheduling could not be set
+ */
+int
+simRtThreadStart(struct simRtProfile *p, const char *name )
+{
+	struct sched_param param;
+	char buf[128];
+	int priority;
+	int sts;
+
+	pthread_setname_np(pthread_self(), name );
+	if ( ! p->enabled )
+	{
+		return ( 0 );
+	}
+	priority = simRtPriority(p, name );
+	param.sched_priority = priority;
+	sts = pthread_setschedparam(pthread_self(), priority > 0 ? SCHED_FIFO : SCHED_OTHER, &param );
+	if ( sts != 0 )
+	{
+		snprintf(buf, sizeof(buf), "simRtThreadStart: %s priority %d failed: %s", name, priority, strerror(sts ) );
+		log_message("", buf );
+	}
+	simRtSlack(p );
+	if ( p->prefault < p->stackSize / 2 )
+	{
+		simRtPrefault(p->prefault );
+	}
+	else
+	{
+		simRtPrefault(p->stackSize / 2 );
+	}
+	return ( sts == 0 ? 0 : -1 );
+}
+
+/*
+ * Function: simRtNowUs
+ *
+ * Returns: usec from CLOCK_MONOTONIC
+ */
+unsigned long long
+simRtNowUs(void )
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts );
+	return ( (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 );
+}
+
+void
+simRtJitterReset(struct simRtJitter *j, const char *name )
+{
+	memset(j, 0, sizeof(struct simRtJitter) );
+	j->name = name;
+}
+
+/*
+ * Function: simRtJitterAdd
+ *
+ * Add one event. A scheduled time of 0 means the event had no reference time
+ * and is not counted.
+ */
+void
+simRtJitterAdd(struct simRtJitter *j, unsigned long long scheduledUs, unsigned long long actualUs )
+{
+	int late;
+	int bin;
+
+	if ( scheduledUs == 0 )
+	{
+		return;
+	}
+	late = (int)( (long long)actualUs - (long long)scheduledUs );
+	if ( j->count == 0 || late < j->min )
+	{
+		j->min = late;
+	}
+	if ( j->count == 0 || late > j->max )
+	{
+		j->max = late;
+	}
+	j->count++;
+	j->sum += late;
+	if ( late < 0 )
+	{
+		j->early++;
+		late = 0;
+	}
+	for ( bin = 0 ; bin < SIM_RT_JITTER_BINS - 1 ; bin++ )
+	{
+		if ( late < simRtJitterLimits[bin] )
+		{
+			break;
+		}
+	}
+	j->bins[bin]++;
+}
+
+void
+simRtJitterPrint(struct simRtJitter *j )
+{
+	int bin;
+
+	if ( j->count == 0 )
+	{
+		printf("%-12s no events\n", j->name );
+		return;
+	}
+	printf("%-12s count %u  min %d us  avg %lld us  max %d us  early %u\n",
+		j->name, j->count, j->min, j->sum / j->count, j->max, j->early );
+	for ( bin = 0 ; bin < SIM_RT_JITTER_BINS ; bin++ )
+	{
+		if ( j->bins[bin] == 0 )
+		{
+			continue;
+		}
+		if ( bin < SIM_RT_JITTER_BINS - 1 )
+		{
+			printf("    < %6d us %8u  %5.1f%%\n", simRtJitterLimits[bin], j->bins[bin],
+				( 100.0 * j->bins[bin] ) / j->count );
+		}
+		else
+		{
+			printf("   >= %6d us %8u  %5.1f%%\n", simRtJitterLimits[bin - 1], j->bins[bin],
+				( 100.0 * j->bins[bin] ) / j->count );
+		}
+	}
+}
@@ -0,0 +1,93 @@
+/*
+ * simRt.h
+ * Real-time scheduling profile and timing jitter histograms
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SIMRT_H_
+#define SIMRT_H_
+
+#include <pthread.h>
+
+/*
+ * The profile file has one setting per line, # for comments:
+ *
+ *	enable 1				Apply the profile (the -r option of a daemon also enables it)
+ *	lock 1					mlockall() and keep freed heap memory mapped
+ *	stack 262144			Thread stack size, bytes
+ *	prefault 65536			Stack bytes touched at thread start
+ *	slack 1					Timer slack, nsec (the kernel takes 0 as "default")
+ *	priority <thread> <n>	SCHED_FIFO priority of a named thread, 0 for SCHED_OTHER
+*/
+#define SIM_RT_PROFILE_FILE		"/simulator/rtProfile.txt"
+
+#define SIM_RT_THREADS_MAX		8
+#define SIM_RT_NAME_LENGTH		16
+
+#define SIM_RT_DEFAULT_STACK	( 256 * 1024 )
+#define SIM_RT_DEFAULT_PREFAULT	( 64 * 1024 )
+#define SIM_RT_DEFAULT_SLACK	1
+
+struct simRtThread
+{
+	char name[SIM_RT_NAME_LENGTH];
+	int priority;
+};
+
+struct simRtProfile
+{
+	int enabled;
+	int lockMemory;
+	int stackSize;
+	int prefault;
+	int timerSlackNs;
+	int threadCount;
+	struct simRtThread threads[SIM_RT_THREADS_MAX];
+};
+
+void simRtDefaults(struct simRtProfile *p, const struct simRtThread *threads, int count );
+int simRtLoad(struct simRtProfile *p, const char *file );
+int simRtPriority(struct simRtProfile *p, const char *name );
+int simRtProcess(struct simRtProfile *p );
+void simRtThreadAttr(struct simRtProfile *p, pthread_attr_t *attr );
+int simRtThreadStart(struct simRtProfile *p, const char *name );
+
+unsigned long long simRtNowUs(void );
+
+/*
+ * Jitter histogram: lateness of an event against its scheduled time. Bin upper
+ * limits are in simRtJitterLimits (usec); the last bin takes everything later.
+*/
+#define SIM_RT_JITTER_BINS		12
+
+struct simRtJitter
+{
+	const char *name;
+	unsigned int count;
+	unsigned int early;			// Events before the scheduled time, counted in bin 0
+	long long sum;				// usec
+	int min;
+	int max;
+	unsigned int bins[SIM_RT_JITTER_BINS];
+};
+
+void simRtJitterReset(struct simRtJitter *j, const char *name );
+void simRtJitterAdd(struct simRtJitter *j, unsigned long long scheduledUs, unsigned long long actualUs );
+void simRtJitterPrint(struct simRtJitter *j );
+
+#endif /* SIMRT_H_ */
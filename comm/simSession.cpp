@@ -0,0 +1,423 @@
+/*
+ * simSession.cpp
+ * Record and replay of the hardware and network inputs of a session
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Recording appends each input to the file as it is read, under a mutex, and
+ * flushes at most every SESSION_FLUSH_US. Replay loads the whole file and splits
+ * it into one list per source and channel, so a lookup only looks at its own
+ * inputs and the order within a list is the recorded order.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <vector>
+#include <map>
+
+#include "simSession.h"
+#include "simUtil.h"
+
+using namespace std;
+
+#define SESSION_FLUSH_US	100000
+#define SESSION_END_US		2000000		// Replay runs this long after the last record
+
+struct sessionEntry
+{
+	unsigned long long usec;
+	unsigned int offset;		// In sessionData
+	unsigned int len;
+};
+
+struct sessionStream
+{
+	vector<struct sessionEntry> entries;
+	unsigned int next;
+};
+
+int simSessionMode = SIM_SESSION_OFF;
+
+static pthread_mutex_t sessionMutex = PTHREAD_MUTEX_INITIALIZER;
+static char sessionName[256];
+static unsigned long long sessionStart;
+static double sessionSpeed = 1.0;
+
+// Recording
+static FILE *sessionFile;
+static unsigned long long lastFlush;
+
+// Replay
+static vector<unsigned char> sessionData;
+static map<unsigned int, struct sessionStream> sessionStreams;
+static unsigned long long sessionEnd;
+
+static unsigned long long
+sessionMono(void )
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts );
+	return ( (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 );
+}
+
+// Session time: usec from simSessionInit, scaled by the replay speed
+static unsigned long long
+sessionNow(void )
+{
+	return ( (unsigned long long)( ( sessionMono() - sessionStart ) * sessionSpeed ) );
+}
+
+static void
+sessionClose(void )
+{
+	pthread_mutex_lock(&sessionMutex );
+	if ( sessionFile )
+	{
+		fclose(sessionFile );
+		sessionFile = NULL;
+	}
+	pthread_mutex_unlock(&sessionMutex );
+}
+
+static void *
+sessionEndThread(void *arg )
+{
+	char buf[512];
+	unsigned long long wait;
+
+	wait = (unsigned long long)( ( sessionEnd + SESSION_END_US ) / sessionSpeed );
+	while ( sessionMono() - sessionStart < wait )
+	{
+		usleep(100000 );
+	}
+	snprintf(buf, sizeof(buf), "simSession: Replay of %s complete", sessionName );
+	log_message("", buf );
+	exit ( 0 );
+	return ( NULL );
+}
+
+static int
+sessionLoad(void )
+{
+	struct simSessionFileHeader header;
+	struct simSessionRecord rec;
+	struct sessionEntry entry;
+	struct sessionStream *stream;
+	char buf[512];
+	FILE *fp;
+	int count = 0;
+
+	fp = fopen(sessionName, "r" );
+	if ( fp == NULL )
+	{
+		snprintf(buf, sizeof(buf), "simSession: %s: %s", sessionName, strerror(errno ) );
+		log_message("", buf );
+		return ( -1 );
+	}
+	if ( fread(&header, sizeof(header), 1, fp ) != 1 ||
+		 strncmp(header.magic, SIM_SESSION_FILE_MAGIC, sizeof(header.magic) ) != 0 ||
+		 header.version != SIM_SESSION_FILE_VERSION )
+	{
+		snprintf(buf, sizeof(buf), "simSession: %s: Not a session file of this version", sessionName );
+		log_message("", buf );
+		fclose(fp );
+		return ( -1 );
+	}
+	while ( fread(&rec, sizeof(rec), 1, fp ) == 1 )
+	{
+		if ( rec.len > SIM_SESSION_DATA_MAX )
+		{
+			break;
+		}
+		entry.usec = rec.usec;
+		entry.offset = sessionData.size();
+		entry.len = rec.len;
+		sessionData.resize(entry.offset + rec.len );
+		if ( rec.len > 0 && fread(&sessionData[entry.offset], rec.len, 1, fp ) != 1 )
+		{
+			// Cut short, as when the recording process was killed
+			sessionData.resize(entry.offset );
+			break;
+		}
+		stream = &sessionStreams[( rec.source << 16 ) | rec.chan];
+		stream->entries.push_back(entry );
+		if ( rec.usec > sessionEnd )
+		{
+			sessionEnd = rec.usec;
+		}
+		count++;
+	}
+	fclose(fp );
+	snprintf(buf, sizeof(buf), "simSession: Replaying %s, %d inputs, %.1f sec at speed %.2f",
+		sessionName, count, sessionEnd / 1000000.0, sessionSpeed );
+	log_message("", buf );
+	return ( 0 );
+}
+
+/*
+ * Function: simSessionInit
+ *
+ * Start recording or replaying, as set in the environment. Call once, after
+ * initSHM(), before any input is read.
+ *
+ * Returns: 0, or -1 if the session file could not be opened
+ */
+int
+simSessionInit(const char *name )
+{
+	struct simSessionFileHeader header;
+	struct timespec ts;
+	pthread_t thread;
+	const char *dir;
+	const char *speed;
+	char buf[512];
+
+	if ( simSessionMode != SIM_SESSION_OFF )
+	{
+		return ( 0 );
+	}
+	if ( ( dir = getenv(SIM_SESSION_REPLAY_ENV ) ) != NULL && dir[0] )
+	{
+		snprintf(sessionName, sizeof(sessionName), "%s/%s.ses", dir, name );
+		speed = getenv(SIM_SESSION_SPEED_ENV );
+		if ( speed && atof(speed ) > 0 )
+		{
+			sessionSpeed = atof(speed );
+		}
+		if ( sessionLoad() != 0 )
+		{
+			return ( -1 );
+		}
+		sessionStart = sessionMono();
+		simSessionMode = SIM_SESSION_REPLAYING;
+		if ( pthread_create(&thread, NULL, sessionEndThread, NULL ) == 0 )
+		{
+			pthread_detach(thread );
+		}
+		return ( 0 );
+	}
+	if ( ( dir = getenv(SIM_SESSION_RECORD_ENV ) ) != NULL && dir[0] )
+	{
+		snprintf(sessionName, sizeof(sessionName), "%s/%s.ses", dir, name );
+		sessionFile = fopen(sessionName, "w" );
+		if ( sessionFile == NULL )
+		{
+			snprintf(buf, sizeof(buf), "simSession: %s: %s", sessionName, strerror(errno ) );
+			log_message("", buf );
+			return ( -1 );
+		}
+		memset(&header, 0, sizeof(header) );
+		memcpy(header.magic, SIM_SESSION_FILE_MAGIC, sizeof(SIM_SESSION_FILE_MAGIC) );
+		header.version = SIM_SESSION_FILE_VERSION;
+		clock_gettime(CLOCK_REALTIME, &ts );
+		header.realUsec = (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+		fwrite(&header, sizeof(header), 1, sessionFile );
+		sessionStart = sessionMono();
+		lastFlush = sessionStart;
+		simSessionMode = SIM_SESSION_RECORDING;
+		atexit(sessionClose );
+		snprintf(buf, sizeof(buf), "simSession: Recording to %s", sessionName );
+		log_message("", buf );
+	}
+	return ( 0 );
+}
+
+/*
+ * Function: simSessionRecord
+ *
+ * Append an input to the recording. Does nothing unless recording.
+ */
+void
+simSessionRecord(int source, int chan, const void *data, int len )
+{
+	struct simSessionRecord rec;
+	unsigned long long now;
+
+	if ( simSessionMode != SIM_SESSION_RECORDING )
+	{
+		return;
+	}
+	if ( len < 0 )
+	{
+		len = 0;
+	}
+	else if ( len > SIM_SESSION_DATA_MAX )
+	{
+		len = SIM_SESSION_DATA_MAX;
+	}
+	pthread_mutex_lock(&sessionMutex );
+	if ( sessionFile )
+	{
+		now = sessionMono();
+		rec.usec = now - sessionStart;
+		rec.source = source;
+		rec.chan = chan;
+		rec.len = len;
+		fwrite(&rec, sizeof(rec), 1, sessionFile );
+		if ( len > 0 )
+		{
+			fwrite(data, len, 1, sessionFile );
+		}
+		if ( now - lastFlush > SESSION_FLUSH_US )
+		{
+			fflush(sessionFile );
+			lastFlush = now;
+		}
+	}
+	pthread_mutex_unlock(&sessionMutex );
+}
+
+static int
+sessionCopy(struct sessionEntry *e, void *data, int maxLen )
+{
+	int len = (int)e->len;
+
+	if ( len > maxLen )
+	{
+		len = maxLen;
+	}
+	if ( len > 0 )
+	{
+		memcpy(data, &sessionData[e->offset], len );
+	}
+	return ( len );
+}
+
+/*
+ * Function: simSessionNext
+ *
+ * Take the next input of a stream source. Without wait, returns 0 if the next
+ * input is not yet due. With wait, sleeps until it is; at the end of the stream
+ * it sleeps until the replay ends the process.
+ *
+ * Returns: The length copied to data, 0 if nothing is due, or -1 if not
+ * replaying or the stream has ended
+ */
+int
+simSessionNext(int source, int chan, void *data, int maxLen, int wait )
+{
+	map<unsigned int, struct sessionStream>::iterator it;
+	struct sessionStream *stream;
+	struct sessionEntry *e;
+	unsigned long long now;
+	int len;
+
+	if ( simSessionMode != SIM_SESSION_REPLAYING )
+	{
+		return ( -1 );
+	}
+	pthread_mutex_lock(&sessionMutex );
+	it = sessionStreams.find(( source << 16 ) | chan );
+	stream = ( it == sessionStreams.end() ) ? NULL : &it->second;
+	while ( 1 )
+	{
+		if ( stream == NULL || stream->next >= stream->entries.size() )
+		{
+			pthread_mutex_unlock(&sessionMutex );
+			while ( wait )
+			{
+				sleep(1 );
+			}
+			return ( -1 );
+		}
+		e = &stream->entries[stream->next];
+		now = sessionNow();
+		if ( e->usec <= now )
+		{
+			break;
+		}
+		if ( ! wait )
+		{
+			pthread_mutex_unlock(&sessionMutex );
+			return ( 0 );
+		}
+		pthread_mutex_unlock(&sessionMutex );
+		usleep((useconds_t)( ( e->usec - now ) / sessionSpeed ) + 1 );
+		pthread_mutex_lock(&sessionMutex );
+	}
+	len = sessionCopy(e, data, maxLen );
+	stream->next++;
+	pthread_mutex_unlock(&sessionMutex );
+	return ( len );
+}
+
+/*
+ * Function: simSessionHold
+ *
+ * Take the latest input of a held source at or before the current replay time.
+ * Before the first one is due, the first one is returned.
+ *
+ * Returns: The length copied to data, or -1 if not replaying or nothing was
+ * recorded for the source and channel
+ */
+int
+simSessionHold(int source, int chan, void *data, int maxLen )
+{
+	map<unsigned int, struct sessionStream>::iterator it;
+	struct sessionStream *stream;
+	unsigned long long now;
+	int len;
+
+	if ( simSessionMode != SIM_SESSION_REPLAYING )
+	{
+		return ( -1 );
+	}
+	pthread_mutex_lock(&sessionMutex );
+	it = sessionStreams.find(( source << 16 ) | chan );
+	if ( it == sessionStreams.end() || it->second.entries.size() == 0 )
+	{
+		pthread_mutex_unlock(&sessionMutex );
+		return ( -1 );
+	}
+	stream = &it->second;
+	now = sessionNow();
+	while ( stream->next < stream->entries.size() && stream->entries[stream->next].usec <= now )
+	{
+		stream->next++;
+	}
+	len = sessionCopy(&stream->entries[stream->next > 0 ? stream->next - 1 : 0], data, maxLen );
+	pthread_mutex_unlock(&sessionMutex );
+	return ( len );
+}
+
+/*
+ * Function: simSessionKey
+ *
+ * Fold bytes into a 16 bit channel key (FNV-1a), starting from key. Used to
+ * tell apart I2C transactions by bus, address and register.
+ */
+unsigned short
+simSessionKey(const unsigned char *data, int len, unsigned short key )
+{
+	unsigned int h = 2166136261u ^ key;
+	int i;
+
+	for ( i = 0 ; i < len ; i++ )
+	{
+		h ^= data[i];
+		h *= 16777619u;
+	}
+	return ( (unsigned short)( h ^ ( h >> 16 ) ) );
+}
@@ -0,0 +1,89 @@
+/*
+ * simSession.h
+ * Record and replay of the hardware and network inputs of a session
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SIMSESSION_H_
+#define SIMSESSION_H_
+
+/*
+ * Set in the environment of the daemons (and simController) before they start:
+ *
+ *	SIM_SESSION_RECORD=<dir>	Record every input to <dir>/<process>.ses
+ *	SIM_SESSION_REPLAY=<dir>	Take every input from <dir>/<process>.ses
+ *	SIM_SESSION_SPEED=<n>		Replay n times faster than recorded (default 1)
+ *
+ * <process> is the module name of a daemon, "simHub" or "simController", so a
+ * recording made with simHub must be replayed with simHub.
+ *
+ * When replaying, no hardware or network is used: the inputs come from the file
+ * at the time they were recorded (relative to simSessionInit), GPIO outputs only
+ * go to the trace, the WAV Trigger/Tsunami is a stub (wavTrigger::startStub),
+ * nothing is sent to the SimMgr and the clock is not set. The process exits when
+ * the recording ends. Compare the simTraceDump output of the replay with that of
+ * the recording, or of an earlier replay.
+*/
+
+#define SIM_SESSION_RECORD_ENV	"SIM_SESSION_RECORD"
+#define SIM_SESSION_REPLAY_ENV	"SIM_SESSION_REPLAY"
+#define SIM_SESSION_SPEED_ENV	"SIM_SESSION_SPEED"
+
+#define SIM_SESSION_FILE_MAGIC		"SIMSESS"
+#define SIM_SESSION_FILE_VERSION	1
+#define SIM_SESSION_DATA_MAX		16384
+
+#define SIM_SESSION_OFF			0
+#define SIM_SESSION_RECORDING	1
+#define SIM_SESSION_REPLAYING	2
+
+// Input sources. Replayed either as a stream (each record returned once, in
+// order) or held (the latest record at or before the current time).
+#define SIM_SESSION_SYNC		1	// Stream. Chan 0: sync socket bytes, chan 1: "<addr> <statusPort>" from openListen
+#define SIM_SESSION_HTTP		2	// Held. simctrldata body
+#define SIM_SESSION_AIN			3	// Held. Chan is the AIN channel, data an int
+#define SIM_SESSION_UART		4	// Stream. Chan is the tty number, data the bytes read
+#define SIM_SESSION_I2C			5	// Held. Chan is simSessionKey() of the bus, address and bytes written, data the int status and the bytes read
+#define SIM_SESSION_GPIO		6	// Held. Chan is the pin, data an int. Recorded on change.
+
+// simSession file: this header, then records, each followed by its data
+struct simSessionFileHeader
+{
+	char magic[8];
+	unsigned int version;
+	unsigned int reserved;
+	unsigned long long realUsec;	// CLOCK_REALTIME at simSessionInit
+};
+
+struct simSessionRecord
+{
+	unsigned long long usec;	// From simSessionInit
+	unsigned short source;
+	unsigned short chan;
+	unsigned int len;
+};
+
+extern int simSessionMode;
+
+int simSessionInit(const char *name );
+void simSessionRecord(int source, int chan, const void *data, int len );
+int simSessionNext(int source, int chan, void *data, int maxLen, int wait );
+int simSessionHold(int source, int chan, void *data, int maxLen );
+unsigned short simSessionKey(const unsigned char *data, int len, unsigned short key );
+
+#endif /* SIMSESSION_H_ */
@@ -0,0 +1,528 @@
+/*
+ * simStatus.cpp
+ * Status server for the web diagnostics. Replaces polling of ctlstatus.cgi.
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * A single long-running process that keeps the shmData mapping open and
+ * answers, on 127.0.0.1:SIM_STATUS_PORT (proxied by nginx):
+ *
+ *	GET /status			One JSON snapshot, the same as ctlstatus.cgi
+ *	GET /status/events	Server-Sent Events. A snapshot on connect, then a
+ *						"delta" event with the fields that changed, each
+ *						tick in which anything did (see simStatusJson.h).
+ *
+ * The delta is built once per tick for all of the SSE clients, so the cost
+ * does not grow with the number of open status pages. ctlstatus.cgi is kept for
+ * browsers without EventSource and for scripts.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <string>
+
+#include "simUtil.h"
+#include "shmData.h"
+#include "simStatusJson.h"
+
+using namespace std;
+
+#define SIM_STATUS_PORT				8091
+#define SIM_STATUS_CLIENTS			16
+#define SIM_STATUS_TICK_MSEC		20		// The web chart draws a point per sample
+#define SIM_STATUS_KEEPALIVE_MSEC	15000
+#define SIM_STATUS_REQUEST_MAX		4096
+#define SIM_STATUS_OUT_MAX			(256 * 1024)	// Drop a client that falls this far behind
+
+struct statusClient
+{
+	int fd;
+	int events;			// Set once the client has asked for /status/events
+	string in;
+	string out;
+	unsigned int lastSend;
+};
+
+struct shmData *shmData;
+int debug = 0;
+char msgbuf[2048];
+
+struct statusClient clients[SIM_STATUS_CLIENTS];
+int listenFD = -1;
+struct simStatusSnap snap;	// Last snapshot sent on the event streams
+char json[SIM_STATUS_JSON_MAX];
+
+int openStatusListen(int port );
+void acceptClient(void );
+void closeClient(struct statusClient *cl );
+void readClient(struct statusClient *cl );
+void writeClient(struct statusClient *cl );
+void queueClient(struct statusClient *cl, const string &data );
+void handleRequest(struct statusClient *cl );
+void sendEvents(unsigned int now );
+
+int main(int argc, char *argv[])
+{
+	int c;
+	int i;
+	int n;
+	int sts;
+	int port = SIM_STATUS_PORT;
+	int tick = SIM_STATUS_TICK_MSEC;
+	unsigned int now;
+	unsigned int nextTick;
+	struct pollfd fds[SIM_STATUS_CLIENTS+1];
+	struct statusClient *polled[SIM_STATUS_CLIENTS+1];
+
+	opterr = 0;
+	while (( c = getopt(argc, argv, "hDi:p:" ) ) != -1 )
+	{
+		switch ( c )
+		{
+			case 'D':
+				debug++;
+				break;
+
+			case 'i':
+				tick = atoi(optarg );
+				if ( tick < 5 )
+				{
+					tick = 5;
+				}
+				break;
+
+			case 'p':
+				port = atoi(optarg );
+				break;
+
+			case 'h':
+				printf("Usage: %s [-D] [-i <msec>] [-p <port>]\n", argv[0] );
+				printf("\t-D : Enable debug\n" );
+				printf("\t-i <msec> : Event interval (default %d)\n", SIM_STATUS_TICK_MSEC );
+				printf("\t-p <port> : Port on 127.0.0.1 (default %d)\n", SIM_STATUS_PORT );
+				exit ( 0 );
+				break;
+
+			case '?':
+				if (isprint (optopt))
+				  fprintf (stderr, "Unknown option `-%c'.\n", optopt);
+				else
+				  fprintf (stderr,
+						   "Unknown option character `\\x%x'.\n",
+						   optopt);
+				return 1;
+
+			 default:
+				fprintf (stderr, "Unhandled option `-%c'.\n", c);
+				abort ();
+		}
+	}
+	if ( debug )
+	{
+		catchFaults();
+	}
+	else
+	{
+		daemonize();
+	}
+	signal(SIGPIPE, SIG_IGN );
+
+	// simController creates the shared memory. Wait for it.
+	for ( i = 0 ; ( sts = initSHM(SHM_OPEN ) ) != 0 ; i++ )
+	{
+		if ( i == 0 )
+		{
+			log_message("", "simStatus: Waiting for SHM" );
+		}
+		sleep(1 );
+	}
+	listenFD = openStatusListen(port );
+	if ( listenFD < 0 )
+	{
+		exit ( -1 );
+	}
+	for ( i = 0 ; i < SIM_STATUS_CLIENTS ; i++ )
+	{
+		clients[i].fd = -1;
+	}
+	snprintf(msgbuf, sizeof(msgbuf), "simStatus: Listening on 127.0.0.1:%d, interval %d ms", port, tick );
+	log_message("", msgbuf );
+
+	nextTick = msec_time() + tick;
+	while ( 1 )
+	{
+		n = 0;
+		fds[n].fd = listenFD;
+		fds[n].events = POLLIN;
+		polled[n++] = NULL;
+		for ( i = 0 ; i < SIM_STATUS_CLIENTS ; i++ )
+		{
+			if ( clients[i].fd >= 0 )
+			{
+				fds[n].fd = clients[i].fd;
+				fds[n].events = POLLIN | ( clients[i].out.empty() ? 0 : POLLOUT );
+				polled[n++] = &clients[i];
+			}
+		}
+		now = msec_time();
+		sts = poll(fds, n, ( (int)( nextTick - now ) > 0 ) ? (int)( nextTick - now ) : 0 );
+		if ( sts < 0 && errno != EINTR )
+		{
+			snprintf(msgbuf, sizeof(msgbuf), "simStatus: poll: %s", strerror(errno ) );
+			log_message("", msgbuf );
+			sleep(1 );
+		}
+		else if ( sts > 0 )
+		{
+			for ( i = 1 ; i < n ; i++ )
+			{
+				if ( fds[i].revents & ( POLLERR | POLLHUP | POLLNVAL ) )
+				{
+					closeClient(polled[i] );
+					continue;
+				}
+				if ( fds[i].revents & POLLIN )
+				{
+					readClient(polled[i] );
+				}
+				if ( polled[i]->fd >= 0 && ( fds[i].revents & POLLOUT ) )
+				{
+					writeClient(polled[i] );
+				}
+			}
+			if ( fds[0].revents & POLLIN )
+			{
+				acceptClient();
+			}
+		}
+		now = msec_time();
+		if ( (int)( now - nextTick ) >= 0 )
+		{
+			sendEvents(now );
+			nextTick += tick;
+			if ( (int)( now - nextTick ) >= 0 )
+			{
+				nextTick = now + tick;	// Fell behind. Don't try to catch up.
+			}
+		}
+	}
+	return ( 0 );
+}
+
+/*
+ * Function: openStatusListen
+ *
+ * Open the non-blocking listen socket on the loopback address. Only nginx
+ * connects to it.
+ *
+ * Parameters: port
+ *
+ * Returns: The socket, or -1 on failure
+ */
+int
+openStatusListen(int port )
+{
+	int fd;
+	int on = 1;
+	struct sockaddr_in addr;
+
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+	if ( fd < 0 )
+	{
+		snprintf(msgbuf, sizeof(msgbuf), "simStatus: socket: %s", strerror(errno ) );
+		log_message("", msgbuf );
+		return ( -1 );
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on) );
+	memset(&addr, 0, sizeof(addr) );
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK );
+	addr.sin_port = htons(port );
+	if ( bind(fd, (struct sockaddr *)&addr, sizeof(addr) ) < 0 || listen(fd, SIM_STATUS_CLIENTS ) < 0 )
+	{
+		snprintf(msgbuf, sizeof(msgbuf), "simStatus: bind/listen port %d: %s", port, strerror(errno ) );
+		log_message("", msgbuf );
+		close(fd );
+		return ( -1 );
+	}
+	return ( fd );
+}
+
+void
+acceptClient(void )
+{
+	int fd;
+	int i;
+	int on = 1;
+
+	while ( ( fd = accept4(listenFD, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC ) ) >= 0 )
+	{
+		for ( i = 0 ; i < SIM_STATUS_CLIENTS ; i++ )
+		{
+			if ( clients[i].fd < 0 )
+			{
+				break;
+			}
+		}
+		if ( i == SIM_STATUS_CLIENTS )
+		{
+			log_message("", "simStatus: Too many clients" );
+			close(fd );
+			continue;
+		}
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on) );
+		clients[i].fd = fd;
+		clients[i].events = 0;
+		clients[i].in.clear();
+		clients[i].out.clear();
+		clients[i].lastSend = msec_time();
+	}
+}
+
+void
+closeClient(struct statusClient *cl )
+{
+	if ( cl->fd >= 0 )
+	{
+		close(cl->fd );
+	}
+	cl->fd = -1;
+	cl->events = 0;
+	cl->in.clear();
+	cl->out.clear();
+}
+
+void
+readClient(struct statusClient *cl )
+{
+	char buf[1024];
+	int len;
+
+	len = read(cl->fd, buf, sizeof(buf) );
+	if ( len == 0 || ( len < 0 && errno != EAGAIN && errno != EINTR ) )
+	{
+		closeClient(cl );
+		return;
+	}
+	if ( len < 0 || cl->events )
+	{
+		return;		// Nothing more is expected from an event stream
+	}
+	cl->in.append(buf, len );
+	if ( cl->in.find("\r\n\r\n" ) != string::npos || cl->in.find("\n\n" ) != string::npos )
+	{
+		handleRequest(cl );
+	}
+	else if ( cl->in.size() > SIM_STATUS_REQUEST_MAX )
+	{
+		closeClient(cl );
+	}
+}
+
+/*
+ * Function: writeClient
+ *
+ * Send as much of the pending output as the socket takes. A one-shot response
+ * is closed once it has all been sent.
+ */
+void
+writeClient(struct statusClient *cl )
+{
+	int len;
+
+	while ( ! cl->out.empty() )
+	{
+		len = write(cl->fd, cl->out.data(), cl->out.size() );
+		if ( len < 0 )
+		{
+			if ( errno != EAGAIN && errno != EINTR )
+			{
+				closeClient(cl );
+			}
+			return;
+		}
+		cl->out.erase(0, len );
+	}
+	if ( ! cl->events )
+	{
+		closeClient(cl );
+	}
+}
+
+void
+queueClient(struct statusClient *cl, const string &data )
+{
+	if ( cl->out.size() + data.size() > SIM_STATUS_OUT_MAX )
+	{
+		log_message("", "simStatus: Client too slow, dropped" );
+		closeClient(cl );
+		return;
+	}
+	cl->out.append(data );
+	writeClient(cl );
+}
+
+/*
+ * Function: handleRequest
+ *
+ * Only the request line is used. Anything other than a GET of /status or
+ * /status/events gets a 404.
+ *
+ * A new event stream starts with the snapshot the other streams' deltas are
+ * based on, as an unnamed event. The deltas follow as "delta" events.
+ */
+void
+handleRequest(struct statusClient *cl )
+{
+	char method[16];
+	char path[256];
+	char head[256];
+	char *cp;
+	int len;
+
+	if ( sscanf(cl->in.c_str(), "%15s %255s", method, path ) != 2 )
+	{
+		closeClient(cl );
+		return;
+	}
+	cp = strchr(path, '?' );
+	if ( cp )
+	{
+		*cp = 0;
+	}
+	cl->in.clear();
+	if ( strcmp(method, "GET" ) == 0 && strcmp(path, "/status/events" ) == 0 )
+	{
+		if ( snap.valid )
+		{
+			len = simStatusJson(json, sizeof(json), simStatusLast(&snap ), NULL );
+		}
+		else
+		{
+			len = simStatusSnapshot(&snap, shmData, json, sizeof(json), SIM_STATUS_FULL );
+		}
+		if ( len < 0 )
+		{
+			log_message("", "simStatus: Snapshot too large" );
+			closeClient(cl );
+			return;
+		}
+		cl->events = 1;
+		cl->lastSend = msec_time();
+		queueClient(cl, string("HTTP/1.1 200 OK\r\n"
+						"Content-Type: text/event-stream\r\n"
+						"Cache-Control: no-cache\r\n"
+						"X-Accel-Buffering: no\r\n"
+						"Connection: keep-alive\r\n"
+						"\r\n"
+						"retry: 2000\n\n"
+						"data: " ) + string(json, len ) + "\n\n" );
+	}
+	else if ( strcmp(method, "GET" ) == 0 && strcmp(path, "/status" ) == 0 )
+	{
+		len = simStatusJson(json, sizeof(json), shmData, NULL );
+		if ( len < 0 )
+		{
+			queueClient(cl, "HTTP/1.1 500 Internal Server Error\r\n"
+							"Content-Length: 0\r\n"
+							"Connection: close\r\n"
+							"\r\n" );
+			return;
+		}
+		snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\n"
+									 "Content-Type: application/json\r\n"
+									 "Cache-Control: no-cache\r\n"
+									 "Content-Length: %d\r\n"
+									 "Connection: close\r\n"
+									 "\r\n", len );
+		queueClient(cl, head + string(json, len ) );
+	}
+	else
+	{
+		queueClient(cl, "HTTP/1.1 404 Not Found\r\n"
+						"Content-Length: 0\r\n"
+						"Connection: close\r\n"
+						"\r\n" );
+	}
+}
+
+/*
+ * Function: sendEvents
+ *
+ * Called each tick. If any client is on the event stream, take one snapshot and
+ * send what changed since the last one to all of them. Idle streams get a
+ * comment line as a keepalive, so proxies don't time them out.
+ */
+void
+sendEvents(unsigned int now )
+{
+	int i;
+	int len;
+	int streams = 0;
+	string event;
+
+	for ( i = 0 ; i < SIM_STATUS_CLIENTS ; i++ )
+	{
+		if ( clients[i].fd >= 0 && clients[i].events )
+		{
+			streams++;
+		}
+	}
+	if ( streams == 0 )
+	{
+		snap.valid = 0;
+		return;
+	}
+	len = simStatusSnapshot(&snap, shmData, json, sizeof(json), SIM_STATUS_DELTA );
+	if ( len > 0 )
+	{
+		event = "event: delta\ndata: ";
+		event.append(json, len );
+		event.append("\n\n" );
+	}
+	for ( i = 0 ; i < SIM_STATUS_CLIENTS ; i++ )
+	{
+		if ( clients[i].fd < 0 || ! clients[i].events )
+		{
+			continue;
+		}
+		if ( ! event.empty() )
+		{
+			clients[i].lastSend = now;
+			queueClient(&clients[i], event );
+		}
+		else if ( now - clients[i].lastSend >= SIM_STATUS_KEEPALIVE_MSEC )
+		{
+			clients[i].lastSend = now;
+			queueClient(&clients[i], ": \n\n" );
+		}
+	}
+}
@@ -0,0 +1,793 @@
+/*
+ * simStatusJson.cpp
+ * Status of the sensors and daemons as JSON, for ctlstatus.cgi and simStatus
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2019-2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "simUtil.h"
+#include "shmData.h"
+#include "simMetrics.h"
+#include "simStatusJson.h"
+#include "version.h"
+
+#define SJ_INT		1	// int
+#define SJ_UINT		2	// unsigned int
+#define SJ_STR		3	// char[count]
+#define SJ_INTS		4	// int[count]
+#define SJ_UINTS	5	// unsigned int[count]
+#define SJ_CALC		6	// calc() of the whole shmData
+
+struct simStatusField
+{
+	const char *key;
+	int type;
+	size_t offset;		// From the start of the struct the table describes
+	int count;
+	int (*calc)(const struct shmData *sd );
+};
+
+struct simStatusSection
+{
+	const char *name;
+	const struct simStatusField *fields;
+	int count;
+};
+
+#define SJ_FIELD(key, type, member )		{ key, type, offsetof(struct shmData, member ), 1, NULL }
+#define SJ_ARRAY(key, type, member )		{ key, type, offsetof(struct shmData, member ), (int)( sizeof(((struct shmData *)0)->member ) / sizeof(int) ), NULL }
+#define SJ_STRING(key, member )				{ key, SJ_STR, offsetof(struct shmData, member ), (int)sizeof(((struct shmData *)0)->member ), NULL }
+#define SJ_DERIVED(key, calc )				{ key, SJ_CALC, 0, 1, calc }
+#define SJ_COUNT(table )					(int)( sizeof(table ) / sizeof(struct simStatusField ) )
+
+static int
+rfLatency(const struct shmData *sd )
+{
+	return ( sd->pulse.detectLatency[PULSE_RIGHT_FEMORAL] + sd->pulse.gainLatency[PULSE_RIGHT_FEMORAL] );
+}
+
+static int
+lfLatency(const struct shmData *sd )
+{
+	return ( sd->pulse.detectLatency[PULSE_LEFT_FEMORAL] + sd->pulse.gainLatency[PULSE_LEFT_FEMORAL] );
+}
+
+static int
+latencyMax(const struct shmData *sd )
+{
+	int i;
+	int max = 0;
+
+	for ( i = 1 ; i < PULSE_POINTS_MAX ; i++ )
+	{
+		if ( sd->pulse.latencyMax[i] > max )
+		{
+			max = sd->pulse.latencyMax[i];
+		}
+	}
+	return ( max );
+}
+
+static const struct simStatusField auscultationFields[] =
+{
+	SJ_FIELD("side", SJ_INT, auscultation.side ),
+	SJ_FIELD("row", SJ_INT, auscultation.row ),
+	SJ_FIELD("col", SJ_INT, auscultation.col ),
+	SJ_FIELD("heartStrength", SJ_INT, auscultation.heartStrength ),
+	SJ_FIELD("leftLungStrength", SJ_INT, auscultation.leftLungStrength ),
+	SJ_FIELD("rightLungStrength", SJ_INT, auscultation.rightLungStrength ),
+	SJ_STRING("tag", auscultation.tag ),
+	SJ_FIELD("heartTrim", SJ_INT, auscultation.heartTrim ),
+	SJ_FIELD("lungTrim", SJ_INT, auscultation.lungTrim ),
+};
+
+// The arrays are indexed by PULSE_ position (0 is not used). The single
+// values before them are kept for the web page.
+static const struct simStatusField pulseFields[] =
+{
+	SJ_FIELD("right_dorsal", SJ_INT, pulse.right_dorsal ),
+	SJ_FIELD("RD_AIN", SJ_INT, pulse.ain[PULSE_RIGHT_DORSAL] ),
+	SJ_FIELD("left_dorsal", SJ_INT, pulse.left_dorsal ),
+	SJ_FIELD("LD_AIN", SJ_INT, pulse.ain[PULSE_LEFT_DORSAL] ),
+	SJ_FIELD("right_femoral", SJ_INT, pulse.right_femoral ),
+	SJ_FIELD("RF_AIN", SJ_INT, pulse.ain[PULSE_RIGHT_FEMORAL] ),
+	SJ_FIELD("left_femoral", SJ_INT, pulse.left_femoral ),
+	SJ_FIELD("LF_AIN", SJ_INT, pulse.ain[PULSE_LEFT_FEMORAL] ),
+	SJ_DERIVED("RF_latency", rfLatency ),
+	SJ_DERIVED("LF_latency", lfLatency ),
+	SJ_DERIVED("latency_max", latencyMax ),
+	SJ_ARRAY("ain", SJ_INTS, pulse.ain ),
+	SJ_ARRAY("touch", SJ_INTS, pulse.touch ),
+	SJ_ARRAY("base", SJ_INTS, pulse.base ),
+	SJ_ARRAY("volume", SJ_INTS, pulse.volume ),
+	SJ_FIELD("touchSeq", SJ_UINT, pulse.touchSeq ),
+	SJ_ARRAY("pressTime", SJ_UINTS, pulse.pressTime ),
+	SJ_ARRAY("touchTime", SJ_UINTS, pulse.touchTime ),
+	SJ_ARRAY("gainTime", SJ_UINTS, pulse.gainTime ),
+	SJ_ARRAY("detectLatency", SJ_INTS, pulse.detectLatency ),
+	SJ_ARRAY("gainLatency", SJ_INTS, pulse.gainLatency ),
+	SJ_ARRAY("latencyMax", SJ_INTS, pulse.latencyMax ),
+};
+
+static const struct simStatusField respirationFields[] =
+{
+	SJ_FIELD("ain", SJ_INT, manual_breath_ain ),
+	SJ_FIELD("active", SJ_INT, respiration.active ),
+	SJ_FIELD("riseState", SJ_INT, respiration.riseState ),
+	SJ_FIELD("baseline", SJ_INT, manual_breath_baseline ),
+	SJ_FIELD("threshold", SJ_INT, manual_breath_threshold ),
+	SJ_FIELD("count", SJ_INT, manual_breath_count ),
+	SJ_FIELD("noise", SJ_INT, manual_breath_noise ),
+	SJ_FIELD("latency", SJ_INT, manual_breath_latency ),
+	SJ_FIELD("peak", SJ_INT, manual_breath_peak ),
+	SJ_FIELD("volume", SJ_INT, manual_breath_volume ),
+	SJ_FIELD("chest_control", SJ_INT, chest_control ),
+	SJ_FIELD("chest_peak", SJ_INT, chest_peak ),
+	SJ_FIELD("chest_error", SJ_INT, chest_error ),
+	SJ_FIELD("chest_error_max", SJ_INT, chest_error_max ),
+	SJ_FIELD("chest_rise_duty", SJ_INT, chest_rise_duty ),
+	SJ_FIELD("chest_fall_duty", SJ_INT, chest_fall_duty ),
+	SJ_FIELD("fallState", SJ_INT, respiration.fallState ),
+	SJ_FIELD("invert", SJ_INT, manual_breath_invert ),
+	SJ_FIELD("manual_breath", SJ_INT, respiration.manual_breath ),
+	SJ_FIELD("chest_movement", SJ_INT, respiration.chest_movement ),
+	SJ_FIELD("rate", SJ_INT, respiration.rate ),
+	SJ_FIELD("awRR", SJ_INT, respiration.awRR ),
+	SJ_FIELD("inhalation_duration", SJ_INT, respiration.inhalation_duration ),
+	SJ_FIELD("exhalation_duration", SJ_INT, respiration.exhalation_duration ),
+	SJ_STRING("left_lung_sound", respiration.left_lung_sound ),
+	SJ_FIELD("left_lung_sound_volume", SJ_INT, respiration.left_lung_sound_volume ),
+	SJ_FIELD("left_lung_sound_mute", SJ_INT, respiration.left_lung_sound_mute ),
+	SJ_STRING("right_lung_sound", respiration.right_lung_sound ),
+	SJ_FIELD("right_lung_sound_volume", SJ_INT, respiration.right_lung_sound_volume ),
+	SJ_FIELD("right_lung_sound_mute", SJ_INT, respiration.right_lung_sound_mute ),
+};
+
+static const struct simStatusField cardiacFields[] =
+{
+	SJ_STRING("rhythm", cardiac.rhythm ),
+	SJ_STRING("vpc", cardiac.vpc ),
+	SJ_FIELD("vpc_freq", SJ_INT, cardiac.vpc_freq ),
+	SJ_STRING("vfib_amplitude", cardiac.vfib_amplitude ),
+	SJ_FIELD("pea", SJ_INT, cardiac.pea ),
+	SJ_FIELD("rate", SJ_INT, cardiac.rate ),
+	SJ_STRING("pwave", cardiac.pwave ),
+	SJ_FIELD("pr_interval", SJ_INT, cardiac.pr_interval ),
+	SJ_FIELD("qrs_interval", SJ_INT, cardiac.qrs_interval ),
+	SJ_FIELD("bps_sys", SJ_INT, cardiac.bps_sys ),
+	SJ_FIELD("bps_dia", SJ_INT, cardiac.bps_dia ),
+	SJ_FIELD("nibp_rate", SJ_INT, cardiac.nibp_rate ),
+	SJ_FIELD("nibp_read", SJ_INT, cardiac.nibp_read ),
+	SJ_FIELD("nibp_freq", SJ_INT, cardiac.nibp_freq ),
+	SJ_FIELD("right_dorsal_pulse_strength", SJ_INT, cardiac.right_dorsal_pulse_strength ),
+	SJ_FIELD("right_femoral_pulse_strength", SJ_INT, cardiac.right_femoral_pulse_strength ),
+	SJ_FIELD("left_dorsal_pulse_strength", SJ_INT, cardiac.left_dorsal_pulse_strength ),
+	SJ_FIELD("left_femoral_pulse_strength", SJ_INT, cardiac.left_femoral_pulse_strength ),
+	SJ_STRING("heart_sound", cardiac.heart_sound ),
+	SJ_FIELD("heart_sound_volume", SJ_INT, cardiac.heart_sound_volume ),
+	SJ_FIELD("heart_sound_mute", SJ_INT, cardiac.heart_sound_mute ),
+};
+
+static const struct simStatusField cprFields[] =
+{
+	SJ_FIELD("last", SJ_INT, cpr.last ),
+	SJ_FIELD("x", SJ_INT, cpr.x ),
+	SJ_FIELD("y", SJ_INT, cpr.y ),
+	SJ_FIELD("z", SJ_INT, cpr.z ),
+	SJ_FIELD("tof_present", SJ_INT, cpr.tof_present ),
+	SJ_FIELD("distance", SJ_INT, cpr.distance ),
+	SJ_FIELD("maxDistance", SJ_INT, cpr.maxDistance ),
+	SJ_FIELD("distanceCount", SJ_UINT, cpr.distanceCount ),
+	SJ_FIELD("distanceTime", SJ_UINT, cpr.distanceTime ),
+	SJ_FIELD("compression", SJ_INT, cpr.compression ),
+	SJ_FIELD("release", SJ_INT, cpr.release ),
+	SJ_FIELD("duration", SJ_INT, cpr.duration ),
+	SJ_FIELD("count", SJ_INT, cpr.count ),
+	SJ_FIELD("depth", SJ_INT, cpr.depth ),
+	SJ_FIELD("rate", SJ_INT, cpr.rate ),
+	SJ_FIELD("recoil", SJ_INT, cpr.recoil ),
+	SJ_FIELD("dutyCycle", SJ_INT, cpr.dutyCycle ),
+	SJ_FIELD("handsOff", SJ_INT, cpr.handsOff ),
+};
+
+static const struct simStatusField defibrillationFields[] =
+{
+	SJ_FIELD("last", SJ_INT, defibrillation.last ),
+	SJ_FIELD("energy", SJ_INT, defibrillation.energy ),
+};
+
+// Startup stages, ms since kernel boot, 0 until reached (SIM_BOOT_ in shmData.h)
+static const struct simStatusField bootFields[] =
+{
+	SJ_ARRAY("ms", SJ_UINTS, boot.ms ),
+};
+
+static const struct simStatusField generalFields[] =
+{
+	SJ_STRING("simMgrIPAddr", simMgrIPAddr ),
+	SJ_FIELD("simMgrStatusPort", SJ_INT, simMgrStatusPort ),
+};
+
+static const struct simStatusSection sections[] =
+{
+	{ "auscultation", auscultationFields, SJ_COUNT(auscultationFields ) },
+	{ "pulse", pulseFields, SJ_COUNT(pulseFields ) },
+	{ "respiration", respirationFields, SJ_COUNT(respirationFields ) },
+	{ "cardiac", cardiacFields, SJ_COUNT(cardiacFields ) },
+	{ "cpr", cprFields, SJ_COUNT(cprFields ) },
+	{ "defibrillation", defibrillationFields, SJ_COUNT(defibrillationFields ) },
+	{ "boot", bootFields, SJ_COUNT(bootFields ) },
+};
+#define SJ_SECTIONS	(int)( sizeof(sections ) / sizeof(struct simStatusSection ) )
+
+// Tables for the entries of the named arrays. Offsets are from the entry.
+#define SJ_ENTRY(key, type, st, member )	{ key, type, offsetof(struct st, member ), 1, NULL }
+
+static const struct simStatusField i2cClientFields[] =
+{
+	SJ_ENTRY("transactions", SJ_UINT, i2cClient, transactions ),
+	SJ_ENTRY("errors", SJ_UINT, i2cClient, errors ),
+	SJ_ENTRY("latencyAvg", SJ_UINT, i2cClient, latencyAvg ),
+	SJ_ENTRY("latencyMax", SJ_UINT, i2cClient, latencyMax ),
+};
+
+static const struct simStatusField moduleFields[] =
+{
+	SJ_ENTRY("pid", SJ_INT, moduleStats, pid ),
+	SJ_ENTRY("runs", SJ_UINT, moduleStats, runs ),
+	SJ_ENTRY("overruns", SJ_UINT, moduleStats, overruns ),
+	SJ_ENTRY("latencyAvg", SJ_UINT, moduleStats, latencyAvg ),
+	SJ_ENTRY("latencyMax", SJ_UINT, moduleStats, latencyMax ),
+	SJ_ENTRY("runAvg", SJ_UINT, moduleStats, runAvg ),
+	SJ_ENTRY("runMax", SJ_UINT, moduleStats, runMax ),
+};
+
+/*
+ * Output buffer. On overflow p stops at end and the result is -1. A delta
+ * writes an object's key before knowing if anything in it changed, and moves
+ * p back to the mark when nothing did.
+ */
+struct jsonOut
+{
+	char *p;
+	char *end;
+	int overflow;
+};
+
+static inline void
+putChar(struct jsonOut *o, char c )
+{
+	if ( o->p < o->end )
+	{
+		*o->p++ = c;
+	}
+	else
+	{
+		o->overflow = 1;
+	}
+}
+
+static inline void
+putRaw(struct jsonOut *o, const char *s )
+{
+	while ( *s )
+	{
+		putChar(o, *s++ );
+	}
+}
+
+static void
+putUint(struct jsonOut *o, unsigned long long v )
+{
+	char tmp[24];
+	int n = 0;
+
+	do
+	{
+		tmp[n++] = '0' + ( v % 10 );
+		v /= 10;
+	} while ( v );
+	while ( n )
+	{
+		putChar(o, tmp[--n] );
+	}
+}
+
+static void
+putInt(struct jsonOut *o, long long v )
+{
+	if ( v < 0 )
+	{
+		putChar(o, '-' );
+		putUint(o, (unsigned long long)( -( v + 1 ) ) + 1 );
+	}
+	else
+	{
+		putUint(o, v );
+	}
+}
+
+// A quoted string of at most len chars
+static void
+putString(struct jsonOut *o, const char *s, int len )
+{
+	static const char hex[] = "0123456789abcdef";
+	int i;
+	unsigned char c;
+
+	putChar(o, '"' );
+	for ( i = 0 ; i < len && s[i] ; i++ )
+	{
+		c = s[i];
+		if ( c == '"' || c == '\\' )
+		{
+			putChar(o, '\\' );
+			putChar(o, c );
+		}
+		else if ( c < 0x20 )
+		{
+			putRaw(o, "\\u00" );
+			putChar(o, hex[c >> 4] );
+			putChar(o, hex[c & 0xf] );
+		}
+		else
+		{
+			putChar(o, c );
+		}
+	}
+	putChar(o, '"' );
+}
+
+// "key": with the comma for all but the first member of the object
+static void
+putKey(struct jsonOut *o, int *members, const char *key, int len )
+{
+	if ( (*members)++ )
+	{
+		putChar(o, ',' );
+	}
+	putString(o, key, len );
+	putChar(o, ':' );
+}
+
+static void
+putField(struct jsonOut *o, const struct simStatusField *f, const char *base, const struct shmData *sd )
+{
+	int i;
+
+	switch ( f->type )
+	{
+		case SJ_INT:
+			putInt(o, *(const int *)( base + f->offset ) );
+			break;
+		case SJ_UINT:
+			putUint(o, *(const unsigned int *)( base + f->offset ) );
+			break;
+		case SJ_STR:
+			putString(o, base + f->offset, f->count );
+			break;
+		case SJ_INTS:
+		case SJ_UINTS:
+			putChar(o, '[' );
+			for ( i = 0 ; i < f->count ; i++ )
+			{
+				if ( i )
+				{
+					putChar(o, ',' );
+				}
+				if ( f->type == SJ_INTS )
+				{
+					putInt(o, ((const int *)( base + f->offset ))[i] );
+				}
+				else
+				{
+					putUint(o, ((const unsigned int *)( base + f->offset ))[i] );
+				}
+			}
+			putChar(o, ']' );
+			break;
+		case SJ_CALC:
+			putInt(o, f->calc(sd ) );
+			break;
+	}
+}
+
+static int
+fieldChanged(const struct simStatusField *f, const char *base, const char *prevBase, const struct shmData *sd, const struct shmData *prev )
+{
+	switch ( f->type )
+	{
+		case SJ_CALC:
+			return ( f->calc(sd ) != f->calc(prev ) );
+		case SJ_STR:
+			return ( strncmp(base + f->offset, prevBase + f->offset, f->count ) != 0 );
+		default:
+			return ( memcmp(base + f->offset, prevBase + f->offset, f->count * sizeof(int) ) != 0 );
+	}
+}
+
+/*
+ * Function: putFields
+ *
+ * The members of one object from a field table. With prevBase, only those that
+ * changed. Returns the number written.
+ */
+static int
+putFields(struct jsonOut *o, const struct simStatusField *fields, int count, const char *base, const char *prevBase, const struct shmData *sd, const struct shmData *prev )
+{
+	int i;
+	int members = 0;
+
+	for ( i = 0 ; i < count ; i++ )
+	{
+		if ( prevBase && ! fieldChanged(&fields[i], base, prevBase, sd, prev ) )
+		{
+			continue;
+		}
+		putKey(o, &members, fields[i].key, 256 );
+		putField(o, &fields[i], base, sd );
+	}
+	return ( members );
+}
+
+/*
+ * Function: putObject
+ *
+ * "key":{fields}. In a delta, nothing is written if no field changed.
+ */
+static void
+putObject(struct jsonOut *o, int *members, const char *key, int keyLen, const struct simStatusField *fields, int count, const char *base, const char *prevBase, const struct shmData *sd, const struct shmData *prev )
+{
+	char *mark = o->p;
+	int overflow = o->overflow;
+
+	putKey(o, members, key, keyLen );
+	putChar(o, '{' );
+	if ( putFields(o, fields, count, base, prevBase, sd, prev ) == 0 && prevBase )
+	{
+		o->p = mark;
+		o->overflow = overflow;
+		(*members)--;
+		return;
+	}
+	putChar(o, '}' );
+}
+
+/*
+ * Function: sameEntry
+ *
+ * The previous entry of a named array (i2cClient, moduleStats: the name is the
+ * first member), for a delta, or NULL if the slot was empty or had another
+ * name, so the entry is sent whole.
+ */
+static const char *
+sameEntry(const char *name, const char *prevEntry )
+{
+	if ( prevEntry == NULL || strncmp(name, prevEntry, 16 ) != 0 )
+	{
+		return ( NULL );
+	}
+	return ( prevEntry );
+}
+
+/*
+ * Function: putMetric
+ *
+ * One latency histogram. Times are usec. Percentiles are bucket lower bounds,
+ * so within 25% of the true value. "buckets" lists [lower bound, count] for
+ * the buckets in use.
+ */
+static void
+putMetric(struct jsonOut *o, const struct simMetric *m )
+{
+	struct simMetric *mm = (struct simMetric *)m;
+	int members = 0;
+	int first = 1;
+	int b;
+
+	putChar(o, '{' );
+	putKey(o, &members, "count", 5 );
+	putUint(o, m->count );
+	putKey(o, &members, "errors", 6 );
+	putUint(o, m->errors );
+	putKey(o, &members, "avg", 3 );
+	putUint(o, m->count ? m->sum / m->count : 0 );
+	putKey(o, &members, "p50", 3 );
+	putUint(o, simMetricPercentile(mm, 50 ) );
+	putKey(o, &members, "p90", 3 );
+	putUint(o, simMetricPercentile(mm, 90 ) );
+	putKey(o, &members, "p99", 3 );
+	putUint(o, simMetricPercentile(mm, 99 ) );
+	putKey(o, &members, "max", 3 );
+	putUint(o, m->max );
+	putKey(o, &members, "buckets", 7 );
+	putChar(o, '[' );
+	for ( b = 0 ; b < SIM_METRIC_BUCKETS ; b++ )
+	{
+		if ( m->buckets[b] == 0 )
+		{
+			continue;
+		}
+		if ( ! first )
+		{
+			putChar(o, ',' );
+		}
+		first = 0;
+		putChar(o, '[' );
+		putUint(o, simMetricBucketLow(b ) );
+		putChar(o, ',' );
+		putUint(o, m->buckets[b] );
+		putChar(o, ']' );
+	}
+	putRaw(o, "]}" );
+}
+
+/*
+ * Function: putMetrics
+ *
+ * "metrics":{process:{pid, metric...}}. In a delta, only the processes and
+ * metrics that changed.
+ */
+static void
+putMetrics(struct jsonOut *o, int *members, const struct shmData *sd, const struct shmData *prev )
+{
+	int p;
+	int i;
+	int procs = 0;
+	int procMembers;
+	char *mark;
+	char *procMark;
+	int overflow;
+	int procOverflow;
+	const struct simMetricsProc *pp;
+
+	mark = o->p;
+	overflow = o->overflow;
+	putKey(o, members, "metrics", 7 );
+	putChar(o, '{' );
+	for ( p = 0 ; p < SIM_METRIC_PROCS ; p++ )
+	{
+		const struct simMetricsProc *mp = &sd->metrics[p];
+
+		if ( mp->pid == 0 || ( prev && memcmp(mp, &prev->metrics[p], sizeof(*mp) ) == 0 ) )
+		{
+			continue;
+		}
+		// A process that restarted, or took over the slot, is sent whole
+		pp = prev ? &prev->metrics[p] : NULL;
+		if ( pp && ( mp->pid != pp->pid || strncmp(mp->name, pp->name, sizeof(mp->name ) ) != 0 ) )
+		{
+			pp = NULL;
+		}
+		procMark = o->p;
+		procOverflow = o->overflow;
+		putKey(o, &procs, mp->name, sizeof(mp->name ) );
+		putChar(o, '{' );
+		procMembers = 0;
+		if ( ! pp )
+		{
+			putKey(o, &procMembers, "pid", 3 );
+			putInt(o, mp->pid );
+		}
+		for ( i = 0 ; i < SIM_METRICS ; i++ )
+		{
+			if ( mp->metric[i].count == 0 && mp->metric[i].errors == 0 )
+			{
+				continue;
+			}
+			if ( pp && memcmp(&mp->metric[i], &pp->metric[i], sizeof(struct simMetric) ) == 0 )
+			{
+				continue;
+			}
+			putKey(o, &procMembers, simMetricName(i ), 256 );
+			putMetric(o, &mp->metric[i] );
+		}
+		if ( procMembers == 0 )
+		{
+			o->p = procMark;
+			o->overflow = procOverflow;
+			procs--;
+			continue;
+		}
+		putChar(o, '}' );
+	}
+	if ( prev && procs == 0 )
+	{
+		o->p = mark;
+		o->overflow = overflow;
+		(*members)--;
+		return;
+	}
+	putChar(o, '}' );
+}
+
+/*
+ * Function: simStatusJson
+ *
+ * Write the status of all sensors and daemons as one JSON object, on one line.
+ * With prev, only what changed since prev ("{}" if nothing did).
+ *
+ * sd and prev may be shmData itself or simStatusSnap copies.
+ *
+ * Returns: The length (also NUL terminated), or -1 if buf is too small
+ */
+int
+simStatusJson(char *buf, int size, const struct shmData *sd, const struct shmData *prev )
+{
+	struct jsonOut out;
+	struct jsonOut *o = &out;
+	const char *base = (const char *)sd;
+	const char *prevBase = (const char *)prev;
+	int members = 0;
+	int entries;
+	int i;
+	int overflow;
+	char *mark;
+
+	if ( size < 3 )
+	{
+		return ( -1 );
+	}
+	o->p = buf;
+	o->end = buf + size - 1;
+	o->overflow = 0;
+
+	putChar(o, '{' );
+	for ( i = 0 ; i < SJ_SECTIONS ; i++ )
+	{
+		putObject(o, &members, sections[i].name, 256, sections[i].fields, sections[i].count, base, prevBase, sd, prev );
+	}
+
+	// i2c: the bus totals and an object per client
+	mark = o->p;
+	overflow = o->overflow;
+	putKey(o, &members, "i2c", 3 );
+	putChar(o, '{' );
+	entries = 0;
+	if ( ! prev || sd->i2c.transactions != prev->i2c.transactions )
+	{
+		putKey(o, &entries, "transactions", 12 );
+		putUint(o, sd->i2c.transactions );
+	}
+	if ( ! prev || sd->i2c.utilization != prev->i2c.utilization )
+	{
+		putKey(o, &entries, "utilization", 11 );
+		putUint(o, sd->i2c.utilization );
+	}
+	for ( i = 0 ; i < I2C_CLIENTS_MAX ; i++ )
+	{
+		const struct i2cClient *cl = &sd->i2c.client[i];
+
+		if ( cl->name[0] == 0 )
+		{
+			continue;
+		}
+		putObject(o, &entries, cl->name, sizeof(cl->name ), i2cClientFields, SJ_COUNT(i2cClientFields ),
+				  (const char *)cl, sameEntry(cl->name, prev ? (const char *)&prev->i2c.client[i] : NULL ), sd, prev );
+	}
+	if ( prev && entries == 0 )
+	{
+		o->p = mark;
+		o->overflow = overflow;
+		members--;
+	}
+	else
+	{
+		putChar(o, '}' );
+	}
+
+	// modules: an object per module in use
+	mark = o->p;
+	overflow = o->overflow;
+	putKey(o, &members, "modules", 7 );
+	putChar(o, '{' );
+	entries = 0;
+	for ( i = 0 ; i < SIM_MODULES_MAX ; i++ )
+	{
+		const struct moduleStats *ms = &sd->modules[i];
+
+		if ( ms->name[0] == 0 )
+		{
+			continue;
+		}
+		putObject(o, &entries, ms->name, sizeof(ms->name ), moduleFields, SJ_COUNT(moduleFields ),
+				  (const char *)ms, sameEntry(ms->name, prev ? (const char *)&prev->modules[i] : NULL ), sd, prev );
+	}
+	if ( prev && entries == 0 )
+	{
+		o->p = mark;
+		o->overflow = overflow;
+		members--;
+	}
+	else
+	{
+		putChar(o, '}' );
+	}
+
+	putMetrics(o, &members, sd, prev );
+
+	// general: the version only goes in a full snapshot, as it never changes
+	mark = o->p;
+	overflow = o->overflow;
+	putKey(o, &members, "general", 7 );
+	putChar(o, '{' );
+	entries = putFields(o, generalFields, SJ_COUNT(generalFields ), base, prevBase, sd, prev );
+	if ( ! prev )
+	{
+		putKey(o, &entries, "simCtlVersion", 13 );
+		putString(o, SIMCTL_VERSION, 256 );
+	}
+	if ( prev && entries == 0 )
+	{
+		o->p = mark;
+		o->overflow = overflow;
+		members--;
+	}
+	else
+	{
+		putChar(o, '}' );
+	}
+	putChar(o, '}' );
+
+	*o->p = 0;
+	if ( o->overflow )
+	{
+		return ( -1 );
+	}
+	return ( o->p - buf );
+}
+
+/*
+ * Function: simStatusSnapshot
+ *
+ * Copy shmData (up to the trace rings) to the next snapshot of ss and write it
+ * as JSON: the whole of it for SIM_STATUS_FULL, or the changes from the
+ * previous snapshot for SIM_STATUS_DELTA. The first delta is a full snapshot.
+ *
+ * Returns: The length, 0 for a delta with no changes, or -1 if buf is too small
+ */
+int
+simStatusSnapshot(struct simStatusSnap *ss, const struct shmData *sd, char *buf, int size, int mode )
+{
+	int next = ss->last ^ 1;
+	const struct shmData *cur = (const struct shmData *)ss->snap[next];
+	const struct shmData *prev = NULL;
+	int len;
+
+	memcpy(ss->snap[next], sd, SIM_STATUS_SNAP_SIZE );
+	if ( mode == SIM_STATUS_DELTA && ss->valid )
+	{
+		prev = simStatusLast(ss );
+	}
+	len = simStatusJson(buf, size, cur, prev );
+	if ( len < 0 )
+	{
+		return ( -1 );		// Keep the previous snapshot, so no change is lost
+	}
+	ss->last = next;
+	ss->valid = 1;
+	if ( prev && len == 2 )
+	{
+		buf[0] = 0;
+		return ( 0 );
+	}
+	return ( len );
+}
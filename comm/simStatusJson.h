@@ -0,0 +1,61 @@
+/*
+ * simStatusJson.h
+ * Status of the sensors and daemons as JSON, for ctlstatus.cgi and simStatus
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2019-2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SIMSTATUSJSON_H_
+#define SIMSTATUSJSON_H_
+
+#include <stddef.h>
+#include "shmData.h"
+
+/*
+ * The JSON is written straight into the caller's buffer from a table of field
+ * descriptors (section, key, type, offset in shmData), with no allocation.
+ * Values are JSON numbers, except the strings (tag, sound names, addresses).
+ *
+ * A delta holds only the fields that differ from a previous snapshot: sections
+ * and objects with no changes are left out, and an array is sent whole if any
+ * element changed. Merging a delta into the previous snapshot gives the new one.
+ * Entries that disappear (a module or I2C client slot cleared) are not removed
+ * by a delta; the next full snapshot drops them.
+ *
+ * The snapshots are copies of shmData up to the trace rings, so a writer
+ * changing a field while the JSON is built can't make a delta miss it.
+*/
+
+#define SIM_STATUS_JSON_MAX		(128 * 1024)	// Holds a full snapshot with every metric bucket in use
+#define SIM_STATUS_SNAP_SIZE	offsetof(struct shmData, trace )
+
+#define SIM_STATUS_FULL			0
+#define SIM_STATUS_DELTA		1
+
+struct simStatusSnap
+{
+	int valid;		// snap[last] holds the previous snapshot
+	int last;
+	unsigned long long snap[2][( SIM_STATUS_SNAP_SIZE + 7 ) / 8];
+};
+
+#define simStatusLast(ss )	( (const struct shmData *)(ss)->snap[(ss)->last] )
+
+int simStatusJson(char *buf, int size, const struct shmData *sd, const struct shmData *prev );
+int simStatusSnapshot(struct simStatusSnap *ss, const struct shmData *sd, char *buf, int size, int mode );
+
+#endif /* SIMSTATUSJSON_H_ */
@@ -0,0 +1,208 @@
+/*
+ * simSymbols.cpp
+ * Name symbols: small integer IDs for the rhythm, VPC and sound names in shmData
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "simUtil.h"
+#include "simSymbols.h"
+
+extern struct shmData *shmData;
+extern int debug;
+
+/*
+ * Function: simSymbolsInit
+ *
+ * Clear the table, leaving only SIM_SYMBOL_NONE (the empty name), and give
+ * the names already in shared memory (from a simController run before this
+ * one) their IDs again. The generation is raised, so readers drop the IDs they
+ * hold. Called by simController after initSHM(), before the parser runs.
+ */
+void
+simSymbolsInit(void )
+{
+	struct cardiac *card;
+	struct respiration *resp;
+	unsigned int generation;
+
+	if ( shmData == NULL )
+	{
+		return;
+	}
+	generation = shmData->symbols.generation;
+	memset(&shmData->symbols, 0, sizeof(struct simSymbols) );
+	shmData->symbols.count = 1;
+	__sync_synchronize();
+	shmData->symbols.generation = generation + 1;
+
+	card = &shmData->cardiac;
+	resp = &shmData->respiration;
+	card->rhythm_id = simSymbolIntern(card->rhythm );
+	card->vpc_id = simSymbolIntern(card->vpc );
+	card->pwave_id = simSymbolIntern(card->pwave );
+	card->heart_sound_id = simSymbolIntern(card->heart_sound );
+	resp->left_lung_sound_id = simSymbolIntern(resp->left_lung_sound );
+	resp->right_lung_sound_id = simSymbolIntern(resp->right_lung_sound );
+}
+
+/*
+ * Function: simSymbolFind
+ *
+ * Returns: The ID of name, or SIM_SYMBOL_NONE if it has none
+ */
+int
+simSymbolFind(const char *name )
+{
+	unsigned int count;
+	unsigned int id;
+
+	if ( shmData == NULL || name == NULL || name[0] == 0 )
+	{
+		return ( SIM_SYMBOL_NONE );
+	}
+	count = shmData->symbols.count;
+	if ( count > SIM_SYMBOLS_MAX )
+	{
+		count = SIM_SYMBOLS_MAX;
+	}
+	for ( id = 1 ; id < count ; id++ )
+	{
+		if ( strcmp(shmData->symbols.name[id], name ) == 0 )
+		{
+			return ( id );
+		}
+	}
+	return ( SIM_SYMBOL_NONE );
+}
+
+/*
+ * Function: simSymbolIntern
+ *
+ * Give name an ID, a new one if it has none. simController only.
+ *
+ * Returns: The ID, or SIM_SYMBOL_NONE for the empty name or a full table
+ */
+int
+simSymbolIntern(const char *name )
+{
+	struct simSymbols *sym;
+	char buf[128];
+	int id;
+
+	id = simSymbolFind(name );
+	if ( id != SIM_SYMBOL_NONE || shmData == NULL || name == NULL || name[0] == 0 )
+	{
+		return ( id );
+	}
+	sym = &shmData->symbols;
+	if ( sym->count == 0 )
+	{
+		sym->count = 1;
+	}
+	if ( sym->count >= SIM_SYMBOLS_MAX )
+	{
+		if ( sym->dropped++ == 0 )
+		{
+			snprintf(buf, sizeof(buf), "Symbols: table full (%d), \"%.40s\" and later names have no ID", SIM_SYMBOLS_MAX, name );
+			log_message("", buf );
+		}
+		return ( SIM_SYMBOL_NONE );
+	}
+	id = sym->count;
+	snprintf(sym->name[id], STR_SIZE, "%s", name );
+	__sync_synchronize();		// The name before the count that publishes it
+	sym->count = id + 1;
+	if ( debug > 1 )
+	{
+		printf("Symbol %d: %s\n", id, name );
+	}
+	return ( id );
+}
+
+/*
+ * Function: simSymbolName
+ *
+ * Returns: The name of id, "" for SIM_SYMBOL_NONE or an ID not assigned
+ */
+const char *
+simSymbolName(int id )
+{
+	if ( shmData == NULL || id <= SIM_SYMBOL_NONE || id >= SIM_SYMBOLS_MAX || (unsigned int)id >= shmData->symbols.count )
+	{
+		return ( "" );
+	}
+	return ( shmData->symbols.name[id] );
+}
+
+/*
+ * Function: simSymbolsLoad
+ *
+ * Intern the names of the heart, heartref and lung entries of a sound list
+ * CSV (type, track, name, low, high). The name is taken as soundCatalog reads
+ * it: tabs, semicolons and commas separate, spaces become underscores, and
+ * it is cut at 31 characters.
+ *
+ * Returns: The number of entries read, -1 if the file could not be opened
+ */
+int
+simSymbolsLoad(const char *csvName )
+{
+	FILE *fp;
+	char line[256];
+	char type[16];
+	char name[STR_SIZE];
+	char buf[128];
+	int entries = 0;
+	int i;
+
+	fp = fopen(csvName, "r" );
+	if ( fp == NULL )
+	{
+		return ( -1 );
+	}
+	while ( fgets(line, sizeof(line), fp ) )
+	{
+		for ( i = 0 ; line[i] ; i++ )
+		{
+			if ( line[i] == '\t' || line[i] == ';' || line[i] == ',' )
+			{
+				line[i] = ' ';
+			}
+			else if ( line[i] == ' ' )
+			{
+				line[i] = '_';
+			}
+		}
+		if ( sscanf(line, "%15s %*d %31s", type, name ) != 2 )		// 31: SOUND_NAME_LENGTH
+		{
+			continue;
+		}
+		if ( strcmp(type, "heart" ) == 0 || strcmp(type, "heartref" ) == 0 || strcmp(type, "lung" ) == 0 )
+		{
+			simSymbolIntern(name );
+			entries++;
+		}
+	}
+	fclose(fp );
+	snprintf(buf, sizeof(buf), "Symbols: %d sound entries from %s, %u symbols", entries, csvName, shmData ? shmData->symbols.count - 1 : 0 );
+	log_message("", buf );
+	return ( entries );
+}
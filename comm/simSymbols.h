@@ -0,0 +1,53 @@
+/*
+ * simSymbols.h
+ * Name symbols: small integer IDs for the rhythm, VPC and sound names in shmData
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SIMSYMBOLS_H_
+#define SIMSYMBOLS_H_
+
+/*
+ * The names the sim-mgr sends for cardiac.rhythm, vpc, pwave, heart_sound and
+ * respiration.left/right_lung_sound are interned in shmData->symbols, and
+ * each name field has an _id field beside it. Readers compare and index by
+ * the ID, and get the name back with simSymbolName.
+ *
+ * simController is the only writer. At startup it clears the table and
+ * interns the heart and lung names of soundList.csv, so the catalog names have
+ * IDs before the sim-mgr sends any; the parser interns any other name when it
+ * first sees it. A symbol's name is written before count is raised, and an ID
+ * is never reassigned while simController runs, so a reader needs no lock. A
+ * reader that keeps IDs checks the generation, which a simController restart
+ * raises.
+ *
+ * When the table is full, a name gets SIM_SYMBOL_NONE (its string is still
+ * set) and the loss is logged once.
+ */
+
+#include "shmData.h"
+
+#define SIM_SYMBOLS_CSV		"/simulator/soundList.csv"	// soundSense's SOUND_CATALOG_CSV
+
+void simSymbolsInit(void );
+int simSymbolsLoad(const char *csvName );
+int simSymbolIntern(const char *name );
+int simSymbolFind(const char *name );
+const char *simSymbolName(int id );
+
+#endif /* SIMSYMBOLS_H_ */
@@ -0,0 +1,110 @@
+/*
+ * simTrace.cpp
+ * Binary event trace ring in shared memory
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <sys/syscall.h>
+
+#include "simTrace.h"
+
+extern struct shmData *shmData;
+
+static const char *traceNames[SIM_TRACE_EVENTS] =
+{
+	"",
+	"sync_heart",
+	"sync_breath",
+	"timer",
+	"track",
+	"gain",
+	"gpio",
+	"sensor",
+	"http",
+	"breath_timing",
+	"chest",
+};
+
+// Until simTraceInit, or without shared memory, records go to a ring no one reads
+static struct simTraceRing localTrace;
+static struct simTraceRing *traceRing = &localTrace;
+static __thread unsigned short traceTid;
+
+/*
+ * Function: simTraceInit
+ *
+ * Select the shared memory ring for this process and clear it. Call after
+ * initSHM().
+ */
+void
+simTraceInit(int proc, const char *name )
+{
+	if ( shmData == NULL || proc < 0 || proc >= SIM_METRIC_PROCS )
+	{
+		return;
+	}
+	traceRing = &shmData->trace[proc];
+	memset(traceRing, 0, sizeof(struct simTraceRing) );
+	snprintf(traceRing->name, sizeof(traceRing->name), "%s", name );
+	traceRing->pid = getpid();
+}
+
+const char *
+simTraceName(int event )
+{
+	if ( event <= 0 || event >= SIM_TRACE_EVENTS )
+	{
+		return ( "unknown" );
+	}
+	return ( traceNames[event] );
+}
+
+/*
+ * Function: simTrace
+ *
+ * Add a record. Safe to call from a signal handler.
+ */
+void
+simTrace(int event, int arg1, int arg2 )
+{
+	struct simTraceRecord *r;
+	struct timespec ts;
+	unsigned int pos;
+
+	if ( traceTid == 0 )
+	{
+		traceTid = (unsigned short)syscall(SYS_gettid );
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts );
+	pos = __sync_fetch_and_add(&traceRing->head, 1 );
+	r = &traceRing->rec[pos & ( SIM_TRACE_RECORDS - 1 )];
+	r->seq = 0;
+	__sync_synchronize();
+	r->usec = (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	r->event = event;
+	r->tid = traceTid;
+	r->arg1 = arg1;
+	r->arg2 = arg2;
+	__sync_synchronize();
+	r->seq = pos + 1;
+}
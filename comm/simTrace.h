@@ -0,0 +1,58 @@
+/*
+ * simTrace.h
+ * Binary event trace ring in shared memory
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SIMTRACE_H_
+#define SIMTRACE_H_
+
+/*
+ * Each process writes fixed size records (struct simTraceRecord) to its own ring,
+ * shmData->trace[slot], using the same slot as its metrics. A writer claims a
+ * position with one atomic add and writes the record's seq last, so any thread,
+ * or a signal handler, can trace without a lock, and a reader can tell a
+ * complete record from one being written. The ring is always on; the oldest
+ * records are overwritten.
+ *
+ * simTraceDump copies the rings to a file and decodes them to Chrome trace JSON
+ * (chrome://tracing or ui.perfetto.dev).
+*/
+
+#include "shmData.h"
+
+#define SIM_TRACE_FILE_MAGIC	"SIMTRACE"
+#define SIM_TRACE_FILE_VERSION	1
+
+// simTraceDump file: this header, then SIM_METRIC_PROCS struct simTraceRing
+struct simTraceFileHeader
+{
+	char magic[8];
+	unsigned int version;
+	unsigned int rings;
+	unsigned int records;		// SIM_TRACE_RECORDS
+	unsigned int recordSize;	// sizeof(struct simTraceRecord)
+	unsigned long long monoUsec;	// CLOCK_MONOTONIC when the copy was made
+	unsigned long long realUsec;	// CLOCK_REALTIME at the same time
+};
+
+void simTraceInit(int proc, const char *name );
+void simTrace(int event, int arg1, int arg2 );
+const char *simTraceName(int event );
+
+#endif /* SIMTRACE_H_ */
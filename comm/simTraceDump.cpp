@@ -0,0 +1,398 @@
+/*
+ * simTraceDump.cpp
+ * Save the event trace rings and decode them to a timeline
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Usage:
+ *	simTraceDump -o <file>		Save the rings from shared memory (on the simulator)
+ *	simTraceDump -j [<file>]	Chrome trace JSON to stdout
+ *	simTraceDump -t [<file>]	Text timeline to stdout
+ *	-s <sec>					Only the last <sec> seconds
+ *
+ * Without a file, -j and -t read shared memory directly. The save is a plain
+ * copy, so it is quick enough to run as soon as something goes wrong; decoding
+ * can be done later on any Linux machine.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+
+#include "simUtil.h"
+#include "shmData.h"
+#include "simTrace.h"
+
+using namespace std;
+
+struct shmData *shmData;
+int debug = 0;
+
+struct event
+{
+	int ring;
+	struct simTraceRecord rec;
+};
+
+static struct simTraceFileHeader header;
+static struct simTraceRing rings[SIM_METRIC_PROCS];
+static vector<struct event> events;
+
+// wav-trig/wavTrigger.h TRK_ codes
+static const char *trackCodes[] =
+{
+	"play_solo", "play_poly", "pause", "resume", "stop", "loop_on", "loop_off", "load"
+};
+
+static unsigned long long
+clockUsec(clockid_t clk )
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts );
+	return ( (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 );
+}
+
+static int
+readShm(void )
+{
+	if ( initSHM(SHM_OPEN ) )
+	{
+		fprintf(stderr, "initSHM failed. Is simController running?\n" );
+		return ( -1 );
+	}
+	memcpy(header.magic, SIM_TRACE_FILE_MAGIC, sizeof(header.magic) );
+	header.version = SIM_TRACE_FILE_VERSION;
+	header.rings = SIM_METRIC_PROCS;
+	header.records = SIM_TRACE_RECORDS;
+	header.recordSize = sizeof(struct simTraceRecord);
+	header.monoUsec = clockUsec(CLOCK_MONOTONIC );
+	header.realUsec = clockUsec(CLOCK_REALTIME );
+	memcpy(rings, shmData->trace, sizeof(rings) );
+	return ( 0 );
+}
+
+static int
+readFile(const char *name )
+{
+	FILE *fp;
+	int sts = -1;
+
+	fp = fopen(name, "r" );
+	if ( fp == NULL )
+	{
+		perror(name );
+		return ( -1 );
+	}
+	if ( fread(&header, sizeof(header), 1, fp ) != 1 ||
+		 memcmp(header.magic, SIM_TRACE_FILE_MAGIC, sizeof(header.magic) ) != 0 )
+	{
+		fprintf(stderr, "%s: Not a trace file\n", name );
+	}
+	else if ( header.version != SIM_TRACE_FILE_VERSION || header.rings != SIM_METRIC_PROCS ||
+			  header.records != SIM_TRACE_RECORDS || header.recordSize != sizeof(struct simTraceRecord) )
+	{
+		fprintf(stderr, "%s: Trace file is from a different version (%u, %u rings of %u)\n",
+			name, header.version, header.rings, header.records );
+	}
+	else if ( fread(rings, sizeof(rings), 1, fp ) != 1 )
+	{
+		fprintf(stderr, "%s: Short file\n", name );
+	}
+	else
+	{
+		sts = 0;
+	}
+	fclose(fp );
+	return ( sts );
+}
+
+static int
+writeFile(const char *name )
+{
+	FILE *fp;
+	char tmpName[256];
+
+	snprintf(tmpName, sizeof(tmpName), "%s.tmp", name );
+	fp = fopen(tmpName, "w" );
+	if ( fp == NULL )
+	{
+		perror(tmpName );
+		return ( -1 );
+	}
+	if ( fwrite(&header, sizeof(header), 1, fp ) != 1 || fwrite(rings, sizeof(rings), 1, fp ) != 1 )
+	{
+		perror(tmpName );
+		fclose(fp );
+		return ( -1 );
+	}
+	fclose(fp );
+	return ( rename(tmpName, name ) );
+}
+
+static bool
+eventBefore(const struct event &a, const struct event &b )
+{
+	return ( a.rec.usec < b.rec.usec );
+}
+
+// Collect the complete records of every ring, oldest first
+static void
+collect(int seconds )
+{
+	struct simTraceRing *ring;
+	struct event ev;
+	unsigned int first;
+	unsigned int pos;
+	int r;
+
+	for ( r = 0 ; r < SIM_METRIC_PROCS ; r++ )
+	{
+		ring = &rings[r];
+		if ( ring->pid == 0 )
+		{
+			continue;
+		}
+		first = ring->head > SIM_TRACE_RECORDS ? ring->head - SIM_TRACE_RECORDS : 0;
+		for ( pos = first ; pos != ring->head ; pos++ )
+		{
+			ev.ring = r;
+			ev.rec = ring->rec[pos & ( SIM_TRACE_RECORDS - 1 )];
+			if ( ev.rec.seq != pos + 1 )
+			{
+				// Overwritten, or being written when the copy was made
+				continue;
+			}
+			if ( seconds > 0 && ev.rec.usec + (unsigned long long)seconds * 1000000 < header.monoUsec )
+			{
+				continue;
+			}
+			events.push_back(ev );
+		}
+	}
+	stable_sort(events.begin(), events.end(), eventBefore );
+}
+
+// Event detail, as JSON members
+static void
+describe(const struct simTraceRecord *rec, char *buf, int len )
+{
+	switch ( rec->event )
+	{
+		case SIM_TRACE_SYNC_HEART:
+			snprintf(buf, len, "\"vpc\":%d,\"count\":%d", rec->arg1, rec->arg2 );
+			break;
+		case SIM_TRACE_SYNC_BREATH:
+			snprintf(buf, len, "\"count\":%d", rec->arg2 );
+			break;
+		case SIM_TRACE_TIMER:
+			snprintf(buf, len, "\"signal\":\"SIGRTMIN+%d\"", rec->arg1 );
+			break;
+		case SIM_TRACE_TRACK:
+			snprintf(buf, len, "\"track\":%d,\"code\":\"%s\"", rec->arg1,
+				( rec->arg2 >= 0 && rec->arg2 < (int)( sizeof(trackCodes) / sizeof(trackCodes[0]) ) ) ? trackCodes[rec->arg2] : "?" );
+			break;
+		case SIM_TRACE_GAIN:
+			if ( rec->arg1 >= 1000 )
+			{
+				snprintf(buf, len, "\"track\":%d,\"gain\":%d", rec->arg1 - 1000, rec->arg2 );
+			}
+			else if ( rec->arg1 < 0 )
+			{
+				snprintf(buf, len, "\"master\":1,\"gain\":%d", rec->arg2 );
+			}
+			else
+			{
+				snprintf(buf, len, "\"channel\":%d,\"gain\":%d", rec->arg1, rec->arg2 );
+			}
+			break;
+		case SIM_TRACE_GPIO:
+			snprintf(buf, len, "\"line\":%d,\"value\":%d", rec->arg1, rec->arg2 );
+			break;
+		case SIM_TRACE_SENSOR:
+			if ( rec->arg1 == SIM_TRACE_SENSOR_BREATH )
+			{
+				snprintf(buf, len, "\"sensor\":\"breath\",\"level\":%d", rec->arg2 );
+			}
+			else if ( rec->arg1 == SIM_TRACE_SENSOR_CPR )
+			{
+				snprintf(buf, len, "\"sensor\":\"cpr\",\"level\":%d", rec->arg2 );
+			}
+			else
+			{
+				snprintf(buf, len, "\"sensor\":\"pulse %d\",\"level\":%d", rec->arg1 - SIM_TRACE_SENSOR_PULSE, rec->arg2 );
+			}
+			break;
+		case SIM_TRACE_HTTP:
+			snprintf(buf, len, "\"request\":\"%s\",\"usec\":%d", rec->arg2 ? "write" : "read", rec->arg1 );
+			break;
+		case SIM_TRACE_BREATH_TIMING:
+			snprintf(buf, len, "\"latest_edge_usec\":%d,\"count\":%d", rec->arg1, rec->arg2 );
+			break;
+		case SIM_TRACE_CHEST:
+			snprintf(buf, len, "\"error_rms\":%d,\"rise_duty\":%d", rec->arg1, rec->arg2 );
+			break;
+		default:
+			snprintf(buf, len, "\"arg1\":%d,\"arg2\":%d", rec->arg1, rec->arg2 );
+			break;
+	}
+}
+
+static void
+writeJson(void )
+{
+	char args[128];
+	unsigned long long base;
+	unsigned long long ts;
+	int first = 1;
+	int r;
+
+	base = events.size() ? events[0].rec.usec : 0;
+	printf("{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dumpRealtimeUsec\":%llu,\"dumpMonotonicUsec\":%llu,\"baseMonotonicUsec\":%llu},\n",
+		header.realUsec, header.monoUsec, base );
+	printf("\"traceEvents\":[\n" );
+	for ( r = 0 ; r < SIM_METRIC_PROCS ; r++ )
+	{
+		if ( rings[r].pid == 0 )
+		{
+			continue;
+		}
+		printf("%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}}",
+			first ? "" : ",\n", rings[r].pid, rings[r].name );
+		first = 0;
+	}
+	for ( unsigned int i = 0 ; i < events.size() ; i++ )
+	{
+		struct simTraceRecord *rec = &events[i].rec;
+
+		describe(rec, args, sizeof(args) );
+		ts = rec->usec - base;
+		if ( rec->event == SIM_TRACE_HTTP )
+		{
+			// Recorded at the end, with the duration
+			ts = ( ts > (unsigned long long)rec->arg1 ) ? ts - rec->arg1 : 0;
+			printf("%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%d,\"pid\":%d,\"tid\":%u,\"args\":{%s}}",
+				first ? "" : ",\n", simTraceName(rec->event ), ts, rec->arg1,
+				rings[events[i].ring].pid, rec->tid, args );
+		}
+		else
+		{
+			printf("%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"%s\",\"ts\":%llu,\"pid\":%d,\"tid\":%u,\"args\":{%s}}",
+				first ? "" : ",\n", simTraceName(rec->event ),
+				( rec->event == SIM_TRACE_SYNC_HEART || rec->event == SIM_TRACE_SYNC_BREATH ) ? "p" : "t",
+				ts, rings[events[i].ring].pid, rec->tid, args );
+		}
+		first = 0;
+	}
+	printf("\n]}\n" );
+}
+
+static void
+writeText(void )
+{
+	char args[128];
+	char when[64];
+	time_t t;
+	struct tm tm;
+	unsigned long long last = 0;
+	long long ago;
+
+	t = (time_t)( header.realUsec / 1000000 );
+	localtime_r(&t, &tm );
+	strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm );
+	printf("Trace saved %s, %d events\n", when, (int)events.size() );
+	printf("%12s %9s  %-14s %6s  %-12s %s\n", "sec before", "delta ms", "process", "tid", "event", "detail" );
+	for ( unsigned int i = 0 ; i < events.size() ; i++ )
+	{
+		struct simTraceRecord *rec = &events[i].rec;
+
+		describe(rec, args, sizeof(args) );
+		ago = (long long)header.monoUsec - (long long)rec->usec;
+		printf("%12.6f %9.3f  %-14s %6u  %-12s %s\n", ago / 1000000.0,
+			last ? ( rec->usec - last ) / 1000.0 : 0.0,
+			rings[events[i].ring].name, rec->tid, simTraceName(rec->event ), args );
+		last = rec->usec;
+	}
+}
+
+int
+main(int argc, char *argv[] )
+{
+	const char *outFile = NULL;
+	int mode = 0;
+	int seconds = 0;
+	int c;
+
+	while (( c = getopt(argc, argv, "o:jts:h" ) ) != -1 )
+	{
+		switch ( c )
+		{
+			case 'o':
+				outFile = optarg;
+				mode = 'o';
+				break;
+			case 'j':
+			case 't':
+				mode = c;
+				break;
+			case 's':
+				seconds = atoi(optarg );
+				break;
+			default:
+				mode = 0;
+				break;
+		}
+	}
+	if ( mode == 0 )
+	{
+		printf("Usage: %s -o <file> | -j [<file>] | -t [<file>] [-s <seconds>]\n", argv[0] );
+		return ( 1 );
+	}
+	if ( mode == 'o' )
+	{
+		if ( readShm() != 0 )
+		{
+			return ( 1 );
+		}
+		return ( writeFile(outFile ) == 0 ? 0 : 1 );
+	}
+	if ( optind < argc )
+	{
+		if ( readFile(argv[optind] ) != 0 )
+		{
+			return ( 1 );
+		}
+	}
+	else if ( readShm() != 0 )
+	{
+		return ( 1 );
+	}
+	collect(seconds );
+	if ( mode == 'j' )
+	{
+		writeJson();
+	}
+	else
+	{
+		writeText();
+	}
+	return ( 0 );
+}
@@ -32,16 +32,23 @@
 #include <time.h>
 #include <errno.h>
 #include <sys/mman.h>
-#include <semaphore.h>
 #include <termios.h>
 #include <syslog.h>
 #include <signal.h>
 #include <execinfo.h>
 #include <string.h>
 #include <libgen.h>
+#include <glob.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 #include "simUtil.h"
 #include "shmData.h"
+#include "simMetrics.h"
+#include "simSession.h"
 
 extern int debug;
 int findAINPath(void );
@@ -310,99 +317,184 @@ initSHM(int create )
 	return ( 0 );
 }
 
-#define PATH_MAX	512
-char ain_path[PATH_MAX];
+#define SIM_PATH_MAX	512
+#define NAME_LEN (SIM_PATH_MAX+32)
+#define SIM_IIO_DEVICES	"/sys/bus/iio/devices"
+char ain_path[SIM_PATH_MAX];
 int ain_path_found = 0;
 int ain_new_names = 0;
+static char ainNames[SIM_AIN_CHANNELS][NAME_LEN];	// Set once the path is found
+static pthread_mutex_t ainPathLock = PTHREAD_MUTEX_INITIALIZER;
 
-int findAINPath(void )
+static void
+ainSetNames(void )
 {
-	FILE *fp;
-	struct stat sb;
-	int sts;
+	int chan;
 	
-	fp = popen("find /sys/devices -name AIN0", "r" );
-	if ( fp == NULL )
+	for ( chan = 0 ; chan < SIM_AIN_CHANNELS ; chan++ )
 	{
-		syslog(LOG_DAEMON | LOG_ERR, "findAINPath: popen failed: %s", strerror(errno));
-		return ( -1 );
+		if ( ain_new_names )
+		{
+			snprintf(ainNames[chan], NAME_LEN, "%s/in_voltage%d_raw", ain_path, chan );
+		}
+		else
+		{
+			snprintf(ainNames[chan], NAME_LEN, "%s/AIN%d", ain_path, chan);
+		}
 	}
+}
 
-	while ( fgets(ain_path, PATH_MAX, fp) != NULL)
+/*
+ * Function: ainName
+ *
+ * Returns: The file for an analog input channel, or NULL if there is no AIN
+ * path or no such channel
+ */
+const char *
+ainName(int chan )
+{
+	if ( ain_path_found == 0 )
 	{
-		snprintf(ain_path, PATH_MAX, "%s", dirname(ain_path ) );	// Return the directory
-		if ( debug > 1 )
+		// Module inits may run on several threads (simModuleRun)
+		pthread_mutex_lock(&ainPathLock );
+		if ( ain_path_found == 0 )
 		{
-			printf("%s\n", ain_path);
+			findAINPath();
 		}
+		pthread_mutex_unlock(&ainPathLock );
 	}
-	pclose(fp );
-	
-	if ( strlen(ain_path ) > 0 )
+	if ( ain_path_found == 0 || chan < 0 || chan >= SIM_AIN_CHANNELS )
 	{
-		ain_path_found = 1;
-		if ( debug )
-		{
-			printf("AIN Path is %s\n", ain_path );
-		}
+		return ( NULL );
 	}
-	else
+	return ( ainNames[chan] );
+}
+
+/*
+ * Function: findIIOByName
+ *
+ * Find the IIO device whose name starts with the board's ADC name, by reading
+ * the name of each device in /sys/bus/iio/devices
+ *
+ * Returns: 0 with its directory in ain_path, or -1
+ */
+static int
+findIIOByName(void )
+{
+	DIR *dir;
+	struct dirent *de;
+	struct stat sb;
+	char path[SIM_PATH_MAX];
+	char name[64];
+	FILE *fp;
+	int found = 0;
+
+	dir = opendir(SIM_IIO_DEVICES );
+	if ( dir == NULL )
+	{
+		return ( -1 );
+	}
+	while ( ! found && ( de = readdir(dir ) ) != NULL )
 	{
-		// Check for the 'newer' path to the  in_voltageN_raw devices
-		sts = stat("/sys/bus/iio/devices/iio:device0/in_voltage0_raw", &sb );
-		if ( sts == 0 )
+		if ( strncmp(de->d_name, "iio:device", 10 ) != 0 )
 		{
-			snprintf(ain_path, PATH_MAX, "%s", "/sys/bus/iio/devices/iio:device0" );	// Return the directory
-			if ( debug > 1 )
-			{
-				printf("%s\n", ain_path);
-			}
+			continue;
 		}
-		if ( strlen(ain_path ) > 0 )
+		snprintf(path, SIM_PATH_MAX, "%s/%s/name", SIM_IIO_DEVICES, de->d_name );
+		fp = fopen(path, "r" );
+		if ( fp == NULL )
 		{
-			ain_path_found = 1;
-			ain_new_names = 1;
-			if ( debug )
+			continue;
+		}
+		if ( fgets(name, sizeof(name), fp ) != NULL &&
+			 strncmp(name, SIM_BOARD_ADC_NAME, strlen(SIM_BOARD_ADC_NAME ) ) == 0 )
+		{
+			snprintf(path, SIM_PATH_MAX, "%s/%s/in_voltage0_raw", SIM_IIO_DEVICES, de->d_name );
+			if ( stat(path, &sb ) == 0 )
 			{
-				printf("AIN Path is %s\n", ain_path );
+				snprintf(ain_path, SIM_PATH_MAX, "%s/%s", SIM_IIO_DEVICES, de->d_name );
+				found = 1;
 			}
 		}
-		else
+		fclose(fp );
+	}
+	closedir(dir );
+	return ( found ? 0 : -1 );
+}
+
+/*
+ * Function: findAINPath
+ *
+ * Find the analog inputs: the older helper's AIN0 files (a glob of the
+ * board's helper path, not a walk of /sys/devices), else the IIO device of
+ * the board's ADC, found by name, else iio:device0.
+ *
+ * Returns: 0
+ */
+int findAINPath(void )
+{
+	glob_t gl;
+	struct stat sb;
+	char dir[SIM_PATH_MAX];
+
+	ain_path[0] = 0;
+	memset(&gl, 0, sizeof(gl) );
+	if ( glob(SIM_BOARD_AIN_HELPER, 0, NULL, &gl ) == 0 && gl.gl_pathc > 0 )
+	{
+		snprintf(dir, SIM_PATH_MAX, "%s", gl.gl_pathv[0] );
+		snprintf(ain_path, SIM_PATH_MAX, "%s", dirname(dir ) );	// Return the directory
+		ain_new_names = 0;
+	}
+	else if ( findIIOByName() == 0 )
+	{
+		ain_new_names = 1;
+	}
+	else if ( stat(SIM_IIO_DEVICES "/iio:device0/in_voltage0_raw", &sb ) == 0 )
+	{
+		// No device with the ADC's name, but an IIO device with the inputs
+		snprintf(ain_path, SIM_PATH_MAX, "%s", SIM_IIO_DEVICES "/iio:device0" );
+		ain_new_names = 1;
+	}
+	globfree(&gl );
+
+	if ( strlen(ain_path ) > 0 )
+	{
+		ainSetNames();
+		__sync_synchronize();		// The names before the flag that publishes them
+		ain_path_found = 1;
+		if ( debug )
 		{
-			printf("No AIN Path Found\n" );
+			printf("AIN Path is %s\n", ain_path );
 		}
 	}
+	else
+	{
+		printf("No AIN Path Found\n" );
+	}
 	return ( 0 );
 }
-	
-#define NAME_LEN (PATH_MAX+32)
 
 int
 read_ain(int chan )
 {
 	int fd;
 	int val = 0;
-	char name[NAME_LEN];
+	const char *name;
 	int sts;
 	char buf[8];
 	FILE *fp;
 	size_t bytes;
+	unsigned long long start;
 	
-	if ( ain_path_found == 0 )
+	if ( simSessionMode == SIM_SESSION_REPLAYING )
 	{
-		findAINPath();
+		simSessionHold(SIM_SESSION_AIN, chan, &val, sizeof(val) );
+		return ( val );
 	}
-	if ( ain_path_found == 1 )
+	name = ainName(chan );
+	if ( name )
 	{
-		if ( ain_new_names )
-		{
-			snprintf(name, NAME_LEN, "%s/in_voltage%d_raw", ain_path, chan );
-		}
-		else
-		{
-			snprintf(name, NAME_LEN, "%s/AIN%d", ain_path, chan);
-		}
-		
+		start = simSpanStart();
 		fp = fopen (name, "r" );
 		
 		if ( ! fp )
@@ -437,6 +529,7 @@ read_ain(int chan )
 		bytes = fread(buf, 1, 4, fp );
 		if ( bytes < 1 )
 		{
+			simMetricError(SIM_METRIC_AIN_READ );
 			if ( debug )
 			{
 				printf("fread failed for AIN%d, bytes %d, Error %s\n", chan, bytes, strerror(errno));
@@ -451,11 +544,95 @@ read_ain(int chan )
 			val = atoi(buf );
 		}
 		fclose(fp);
+		simSpanEnd(SIM_METRIC_AIN_READ, start );
+		simSessionRecord(SIM_SESSION_AIN, chan, &val, sizeof(val) );
+	}
+
+	return ( val );
+}
+
+/*
+ * Function: ainOpen
+ *
+ * Open an analog input to be sampled with ainRead. The file is kept open, so
+ * a sample is one pread rather than the open, select and close of read_ain.
+ *
+ * Returns: 0, or -1 if there is no AIN path or the open failed
+ */
+int
+ainOpen(struct ainHandle *ah, int chan )
+{
+	const char *name;
+
+	ah->chan = chan;
+	ah->fd = -1;
+	if ( simSessionMode == SIM_SESSION_REPLAYING )
+	{
+		return ( 0 );
 	}
+	name = ainName(chan );
+	if ( name == NULL )
+	{
+		return ( -1 );
+	}
+	ah->fd = open(name, O_RDONLY );
+	if ( ah->fd < 0 )
+	{
+		syslog(LOG_DAEMON | LOG_ERR, "ainOpen: %s: %s", name, strerror(errno) );
+		return ( -1 );
+	}
+	return ( 0 );
+}
 
+/*
+ * Function: ainRead
+ *
+ * Sample an analog input opened with ainOpen. Sessions are recorded and
+ * replayed as for read_ain.
+ *
+ * Returns: The value, or -1 if the read failed
+ */
+int
+ainRead(struct ainHandle *ah )
+{
+	char buf[8];
+	int val = -1;
+	ssize_t bytes;
+	unsigned long long start;
+
+	if ( simSessionMode == SIM_SESSION_REPLAYING )
+	{
+		simSessionHold(SIM_SESSION_AIN, ah->chan, &val, sizeof(val) );
+		return ( val );
+	}
+	if ( ah->fd < 0 )
+	{
+		return ( -1 );
+	}
+	start = simSpanStart();
+	bytes = pread(ah->fd, buf, sizeof(buf) - 1, 0 );
+	if ( bytes < 1 )
+	{
+		simMetricError(SIM_METRIC_AIN_READ );
+		return ( -1 );
+	}
+	buf[bytes] = 0;
+	val = atoi(buf );
+	simSpanEnd(SIM_METRIC_AIN_READ, start );
+	simSessionRecord(SIM_SESSION_AIN, ah->chan, &val, sizeof(val) );
 	return ( val );
 }
 
+void
+ainClose(struct ainHandle *ah )
+{
+	if ( ah->fd >= 0 )
+	{
+		close(ah->fd );
+		ah->fd = -1;
+	}
+}
+
 /**
  * cleanString
  *
@@ -507,42 +684,60 @@ cleanString(char *strIn )
 	}
 }
 
-//#define NO_I2C_LOCK	1
-int
-getI2CLock(void )
+// Implementation of itoa()
+// Uses snprintf to avoid the out-of-bounds write in the hand-rolled version.
+char itoaString[34] = { 0, };
+
+char* itoa(int num)
 {
-#ifndef NO_I2C_LOCK
-	int trycount = 0;
-	int sts;
+	snprintf(itoaString, sizeof(itoaString), "%d", num);
+	return itoaString;
+}
+/*
+ * Function: msec_time
+ *
+ * Milliseconds from CLOCK_MONOTONIC. The clock is system wide, so time stamps
+ * from different processes (in shmData) can be compared.
+ *
+ * Returns: msec time, wraps after about 49 days
+ */
+unsigned int
+msec_time(void )
+{
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts );
+	return ( (unsigned int)( ( (unsigned long long)ts.tv_sec * 1000 ) + ( ts.tv_nsec / 1000000 ) ) );
+}
 
-	while ( ( sts = sem_trywait(&shmData->i2c_sema) ) != 0 )
+/*
+ * Function: simEventWait
+ *
+ * Sleep until the event counter at seq moves on from last. The counter is
+ * in shmData, so the futex is a shared one and works between processes.
+ *
+ * Returns: The new counter value
+ */
+unsigned int
+simEventWait(unsigned int *seq, unsigned int last )
+{
+	unsigned int now;
+	
+	while ( ( now = __atomic_load_n(seq, __ATOMIC_ACQUIRE ) ) == last )
 	{
-		if ( trycount++ > 200 )
-		{
-			// Could not get lock soon enough. Try again next time.
-			log_message("", "Failed to take i2c_sema");
-			return ( -1 );
-		}
-		usleep(10000 );
+		syscall(SYS_futex, seq, FUTEX_WAIT, last, NULL, NULL, 0 );
 	}
-#endif
-	return ( 0 );
+	return ( now );
 }
 
+/*
+ * Function: simEventPost
+ *
+ * Step the event counter at seq and wake every simEventWait() on it.
+ */
 void
-releaseI2CLock(void )
+simEventPost(unsigned int *seq )
 {
-#ifndef NO_I2C_LOCK
-	sem_post(&shmData->i2c_sema);
-#endif
+	__atomic_add_fetch(seq, 1, __ATOMIC_RELEASE );
+	syscall(SYS_futex, seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0 );
 }
-
-// Implementation of itoa()
-// Uses snprintf to avoid the out-of-bounds write in the hand-rolled version.
-char itoaString[34] = { 0, };
-
-char* itoa(int num)
-{
-	snprintf(itoaString, sizeof(itoaString), "%d", num);
-	return itoaString;
-}
\ No newline at end of file
@@ -29,19 +29,28 @@ void catchFaults(void );
 
 int initSHM(int create );
 
-// Analog Input Assignments
-#define BREATH_AIN_CHANNEL			0
-#define TOUCH_SENSE_AIN_CHANNEL_1	1
-#define AIR_PRESSURE_AIN_CHANNEL	2
-#define TOUCH_SENSE_AIN_CHANNEL_2	3
-#define TOUCH_SENSE_AIN_CHANNEL_3	4
-#define TOUCH_SENSE_AIN_CHANNEL_4	5
+// Analog input channels, GPIO pins and serial ports are in the board profile
+#include "simBoard.h"
 
 int read_ain(int chan );		// Read Analog Input Channel
-int getI2CLock(void );
-void releaseI2CLock(void );
+const char *ainName(int chan );
+
+// Analog input kept open for sampling at a high rate
+struct ainHandle
+{
+	int chan;
+	int fd;
+};
+int ainOpen(struct ainHandle *ah, int chan );
+int ainRead(struct ainHandle *ah );
+void ainClose(struct ainHandle *ah );
 void cleanString(char *strIn );
 char* itoa(int num );
+unsigned int msec_time(void );	// CLOCK_MONOTONIC msec
+
+// Event counters in shmData, with a futex wakeup
+unsigned int simEventWait(unsigned int *seq, unsigned int last );
+void simEventPost(unsigned int *seq );
 
 // GPIO Access
 #define GPIO_TURN_ON	1
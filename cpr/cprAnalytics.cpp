@@ -0,0 +1,301 @@
+/*
+ * cprAnalytics.cpp
+ * Streaming CPR quality analysis: compression depth, rate, recoil and duty cycle
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Each accelerometer sample is processed in integer arithmetic only:
+ *
+ * 1: A slow IIR filter tracks gravity (the Z reading with the chest at rest). It is
+ *    only updated while the chest is still.
+ * 2: The deviation from gravity is smoothed with a short IIR filter and converted
+ *    to mm/s^2 (1g = 16384 counts = 9810 mm/s^2, so 613/1024 mm/s^2 per count).
+ * 3: The acceleration is integrated to velocity (um/s) and displacement (um) by leaky
+ *    integrators, so offset errors decay instead of accumulating.
+ * 4: Each compression is measured from the top of the stroke to the bottom and back,
+ *    so only the peak to peak displacement matters.
+ * 5: When the VL6180X is present, its distance is used for depth and recoil in place
+ *    of the integrated displacement.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "cprAnalytics.h"
+
+#define CPR_BASE_SHIFT		6	// zBase time constant, in samples (1 << 6)
+#define CPR_FILT_SHIFT		1	// zFilt time constant, in samples (1 << 1)
+#define CPR_LEAK_SHIFT		6	// Integrator leak, in samples (1 << 6)
+
+cprAnalytics::cprAnalytics(void )
+{
+	reset();
+}
+
+void
+cprAnalytics::reset(void )
+{
+	state = CPR_STATE_IDLE;
+	zBase = 0;
+	zFilt = 0;
+	onsetSign = 1;
+	quietCount = 0;
+	velocity = 0;
+	displacement = 0;
+	top = 0;
+	bottom = 0;
+	tofTop = 0;
+	tofBottom = 0;
+	tofLast = 0;
+	tofRest = 0;
+	lastSample = 0;
+	compressStart = 0;
+	compressTime = 0;
+	topTime = 0;
+	releaseTime = 0;
+	lastStroke = 0;
+	lastBottom = 0;
+	lastTofBottom = 0;
+	recoilPending = 0;
+	primed = 0;
+
+	count = 0;
+	last = 0;
+	compressing = 0;
+	depth = 0;
+	rate = 0;
+	recoil = 0;
+	dutyCycle = 0;
+	duration = 0;
+	handsOff = 0;
+}
+
+void
+cprAnalytics::startCompression(unsigned int msec, int distance )
+{
+	unsigned int interval;
+	int newRate;
+
+	if ( count > 0 )
+	{
+		interval = msec - compressStart;
+		if ( interval > 0 && interval < CPR_MAX_INTERVAL_MS )
+		{
+			newRate = 60000 / interval;
+			if ( rate == 0 )
+			{
+				rate = newRate;
+			}
+			else
+			{
+				rate = ( ( rate * 3 ) + newRate ) / 4;
+			}
+			dutyCycle = ( compressTime * 100 ) / interval;
+		}
+		else
+		{
+			rate = 0;
+		}
+	}
+	state = CPR_STATE_COMPRESS;
+	compressing = 1;
+	compressStart = msec;
+	last = msec;
+	onsetSign = ( zFilt < 0 ) ? -1 : 1;
+	quietCount = 0;
+	top = displacement;
+	bottom = displacement;
+	topTime = msec;
+	tofTop = distance;
+	tofBottom = distance;
+	handsOff = 0;
+}
+
+void
+cprAnalytics::setRecoil(int stroke, int returned )
+{
+	recoil = ( stroke > 0 ) ? ( returned * 100 ) / stroke : 0;
+	if ( recoil < 0 )
+	{
+		recoil = 0;
+	}
+	else if ( recoil > 100 )
+	{
+		recoil = 100;
+	}
+}
+
+void
+cprAnalytics::endCompression(unsigned int msec )
+{
+	if ( state == CPR_STATE_COMPRESS )
+	{
+		compressTime = msec - topTime;
+	}
+	if ( tofTop > 0 && tofLast > 0 && tofBottom != tofTop )
+	{
+		lastStroke = abs(tofBottom - tofTop );
+		setRecoil(lastStroke, abs(tofBottom - tofLast ) );
+		depth = lastStroke;
+	}
+	else
+	{
+		lastStroke = ( bottom - top ) * onsetSign;
+		setRecoil(lastStroke, ( bottom - displacement ) * onsetSign );
+		depth = lastStroke / 1000;
+	}
+	lastBottom = bottom;
+	lastTofBottom = tofBottom;
+	duration = compressTime;
+	count++;
+	state = CPR_STATE_IDLE;
+	compressing = 0;
+	recoilPending = 0;
+	tofRest = 0;
+	releaseTime = msec;
+}
+
+/*
+ * addSample
+ *
+ * Process one Z axis reading. msec is a monotonic time stamp for the sample.
+ * distance is the ToF reading in mm, or 0 when no ToF sensor is available.
+ *
+ * Returns 1 when a compression has completed and the results are updated, 0 otherwise.
+*/
+int
+cprAnalytics::addSample(int z, unsigned int msec, int distance )
+{
+	int dev;
+	int accel;
+	int dt;
+	int rval = 0;
+
+	if ( ! primed )
+	{
+		zBase = z << 4;
+		lastSample = msec;
+		releaseTime = msec;
+		primed = 1;
+		return ( 0 );
+	}
+	dt = (int)( msec - lastSample );
+	lastSample = msec;
+	if ( dt > CPR_MAX_DT_MS )
+	{
+		dt = CPR_MAX_DT_MS;
+	}
+
+	dev = z - ( zBase >> 4 );
+	zFilt += ( dev - zFilt ) >> CPR_FILT_SHIFT;
+	if ( abs(zFilt ) < CPR_QUIET_COUNTS )
+	{
+		quietCount++;
+	}
+	else
+	{
+		quietCount = 0;
+	}
+
+	accel = ( zFilt * 613 ) >> 10;					// mm/s^2
+	velocity += ( accel * dt ) - ( velocity >> CPR_LEAK_SHIFT );	// um/s
+	displacement += ( ( velocity * dt ) / 1000 ) - ( displacement >> CPR_LEAK_SHIFT );	// um
+
+	tofLast = distance;
+	switch ( state )
+	{
+		case CPR_STATE_IDLE:
+			if ( quietCount >= CPR_QUIET_SAMPLES )
+			{
+				zBase += ( ( z << 4 ) - zBase ) >> CPR_BASE_SHIFT;
+			}
+			handsOff = msec - releaseTime;
+			if ( distance > 0 && tofRest == 0 )
+			{
+				tofRest = distance;
+			}
+			if ( ( abs(zFilt ) > CPR_ONSET_COUNTS ) ||
+				 ( distance > 0 && abs(distance - tofRest ) > CPR_TOF_ONSET_MM ) )
+			{
+				startCompression(msec, distance );
+			}
+			break;
+
+		case CPR_STATE_COMPRESS:
+			// The onset is detected on rising acceleration, a little before the top of the stroke
+			if ( ( displacement - top ) * onsetSign < 0 )
+			{
+				top = displacement;
+				bottom = displacement;
+				topTime = msec;
+				tofTop = distance;
+				tofBottom = distance;
+			}
+			if ( ( displacement - bottom ) * onsetSign > 0 )
+			{
+				bottom = displacement;
+			}
+			if ( distance > 0 && abs(distance - tofTop ) > abs(tofBottom - tofTop ) )
+			{
+				tofBottom = distance;
+			}
+			if ( ( ( bottom - displacement ) * onsetSign > CPR_REVERSE_UM ) ||
+				 ( msec - compressStart > CPR_MAX_COMPRESS_MS ) )
+			{
+				compressTime = msec - topTime;
+				state = CPR_STATE_RECOIL;
+				if ( recoilPending )
+				{
+					if ( tofTop > 0 && lastTofBottom > 0 )
+					{
+						setRecoil(lastStroke, abs(lastTofBottom - tofTop ) );
+					}
+					else
+					{
+						setRecoil(lastStroke, ( lastBottom - top ) * onsetSign );
+					}
+					recoilPending = 0;
+				}
+			}
+			break;
+
+		case CPR_STATE_RECOIL:
+			if ( ( msec - topTime - compressTime > CPR_MIN_RECOIL_MS ) &&
+				 ( zFilt * onsetSign > CPR_ONSET_COUNTS ) )
+			{
+				// Next compression started before the chest came to rest. The recoil is
+				// refined once the top of the next stroke is found.
+				endCompression(msec );
+				startCompression(msec, distance );
+				recoilPending = 1;
+				rval = 1;
+			}
+			else if ( ( quietCount >= CPR_QUIET_SAMPLES && abs(velocity ) < CPR_QUIET_VELOCITY ) ||
+					  ( msec - compressStart > CPR_MAX_CYCLE_MS ) )
+			{
+				endCompression(msec );
+				rval = 1;
+			}
+			break;
+	}
+	return ( rval );
+}
+
+cprAnalytics::~cprAnalytics()
+{
+}
@@ -0,0 +1,93 @@
+/*
+ * cprAnalytics.h
+ * Streaming CPR quality analysis: compression depth, rate, recoil and duty cycle
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CPRANALYTICS_H_
+#define CPRANALYTICS_H_
+
+// Compression cycle states
+#define CPR_STATE_IDLE			0	// Hands off, or chest fully released
+#define CPR_STATE_COMPRESS		1	// Moving down
+#define CPR_STATE_RECOIL		2	// Moving back up
+
+// Detection limits. Accelerometer values are raw LIS3DH counts (+/-2g, 16384 counts per g)
+#define CPR_ONSET_COUNTS		2000	// Filtered Z deviation that starts a compression
+#define CPR_QUIET_COUNTS		800		// Filtered Z deviation considered "still"
+#define CPR_QUIET_SAMPLES		3		// Consecutive still samples that end a recoil
+#define CPR_QUIET_VELOCITY		20000	// um/s, chest speed considered "still"
+#define CPR_TOF_ONSET_MM		5		// ToF movement that starts a compression
+#define CPR_REVERSE_UM			2000	// Travel back from the peak that marks the end of the down stroke
+#define CPR_MIN_RECOIL_MS		100		// Shortest recoil before a new compression may start
+#define CPR_MAX_COMPRESS_MS		600		// Longest allowed down stroke
+#define CPR_MAX_CYCLE_MS		1500	// Longest allowed compression cycle
+#define CPR_MAX_INTERVAL_MS		2000	// Onset intervals longer than this do not count towards the rate
+#define CPR_MAX_DT_MS			100		// Clamp on sample spacing, for integration
+
+class cprAnalytics {
+
+private:
+	int state;
+	int zBase;				// Gravity/DC estimate, Q4 fixed point
+	int zFilt;				// Low-passed deviation from zBase
+	int onsetSign;
+	int quietCount;
+	int velocity;			// um/s
+	int displacement;		// um
+	int top;				// um, displacement at the top of the current stroke
+	int bottom;				// um, displacement at the bottom of the current stroke
+	int tofTop;				// mm, ToF distance at the top of the current stroke
+	int tofBottom;			// mm, ToF distance furthest from tofTop
+	int tofLast;			// mm, most recent ToF distance
+	int tofRest;			// mm, ToF distance with the chest at rest
+	unsigned int lastSample;
+	unsigned int compressStart;
+	unsigned int compressTime;
+	unsigned int topTime;
+	unsigned int releaseTime;
+	int lastStroke;			// um (or mm with ToF), stroke of the last compression
+	int lastBottom;
+	int lastTofBottom;
+	int recoilPending;		// Set when the recoil of the last compression is waiting on the next top
+	int primed;
+
+	void setRecoil(int stroke, int returned );
+	void startCompression(unsigned int msec, int distance );
+	void endCompression(unsigned int msec );
+
+public:
+	cprAnalytics(void );
+	void reset(void );
+	int addSample(int z, unsigned int msec, int distance );
+
+	// Results. All are integers so they can be copied straight into shmData
+	unsigned int count;		// Compressions detected
+	unsigned int last;		// msec time of the start of the last compression
+	int compressing;		// Set while a compression is in progress
+	int depth;				// Depth of the last compression in mm
+	int rate;				// Compressions per minute (smoothed)
+	int recoil;				// 0 to 100% - Return towards the start position before the next compression
+	int dutyCycle;			// 0 to 100% - Down stroke time as a fraction of the cycle
+	int duration;			// msec - Down stroke time of the last compression
+	int handsOff;			// msec since the last compression ended
+
+	virtual ~cprAnalytics();
+};
+
+#endif /* CPRANALYTICS_H_ */
@@ -30,8 +30,10 @@
 #include <iostream>
 #include <math.h>
 #include <string.h>
+#include <errno.h>
 #include "../comm/simUtil.h"
 #include "../comm/shmData.h"
+#include "../comm/i2cBroker.h"
 extern int debug;
 
 /* Linux I2C remote I/O error (slave NACK'd the transfer).
@@ -48,6 +50,7 @@ using namespace std;
 cprI2C::cprI2C(int dummy )
 {
 	present = 0;
+	I2CClient = i2cBrokerRegister("lis3dh", I2C_PRIORITY_HIGH );
 	
 	(void)scanForSensor();
 }
@@ -59,75 +62,62 @@ int cprI2C::scanForSensor(void )
 
 	for ( I2CBus = 1 ; I2CBus < 3 ; I2CBus++ )
 	{
-		snprintf(I2Cnamebuf, sizeof(I2Cnamebuf), "/dev/i2c-%d", I2CBus);
-		if ((I2Cfile = open(I2Cnamebuf, O_RDWR)) < 0)
-		{
-			continue;
-		}
 		for ( I2CAddr = CPR_BASE_ADDR ; I2CAddr <= CPR_MAX_ADDR ; I2CAddr++ )
 		{
-			if ( ioctl(I2Cfile, I2C_SLAVE, I2CAddr ) >= 0 )
+			// The broker opens the bus device. A missing bus shows up as a read error.
+			cc = readRegister(WHO_AM_I );
+			if ( cc < 0 )
+			{
+				// Error on read
+				continue;
+			}
+			if ( debug )
+			{
+				printf("WHO_AM_I returns 0x%x\n", cc );
+			}
+			if ( cc != 0x33 )
 			{
-				cc = readRegister(WHO_AM_I );
-				if ( cc < 0 )
-				{
-					// Error on read
-					continue;
-				}
 				if ( debug )
 				{
-					printf("WHO_AM_I returns 0x%x\n", cc );
+					printf("Device is not LIS3DH\n" );
 				}
-				if ( cc != 0x33 )
+				present = 0;
+			}
+			else
+			{
+				// Found! Reset device
+				cc = writeRegister(CTRL_REG5, CTRL_REG5 );
+
+				// Wait 5 msec (or more)
+				usleep(20000 );
+
+				// Set mode
+				reg = ( CR1_ODR_100Hz << 4 )  | CR1_ZEN | CR1_YEN | CR1_XEN;
+				cc = writeRegister(CTRL_REG1, reg );
+
+				// Read back to see if it took
+				cc = readRegister(CTRL_REG1 );
+				if ( cc != (int)reg )
 				{
-					if ( debug )
-					{
-						printf("Device is not LIS3DH\n" );
-					}
-					/* readRegister() already released the I2C lock; don't double-release */
+					printf("write to CTRL_REG1 failed\n" );
 					present = 0;
 				}
 				else
 				{
-					// Found! Reset device
-					cc = writeRegister(CTRL_REG5, CTRL_REG5 );
-
-					// Wait 5 msec (or more)
-					usleep(20000 );
+					present = 1;
 
-					// Set mode
-					reg = ( CR1_ODR_100Hz << 4 )  | CR1_ZEN | CR1_YEN | CR1_XEN;
-					cc = writeRegister(CTRL_REG1, reg );
+					// Enable Block Data Update
+					reg = ( CR4_BDU );
+					cc = writeRegister(CTRL_REG4, reg );
 
-					// Read back to see if it took
-					cc = readRegister(CTRL_REG1 );
-					if ( cc != (int)reg )
-					{
-						printf("write to CTRL_REG1 failed\n" );
-						present = 0;
-					}
-					else
-					{
-						present = 1;
-
-						// Enable Block Data Update
-						reg = ( CR4_BDU );
-						cc = writeRegister(CTRL_REG4, reg );
-
-						// Enable Temp
-						//reg = (TEMP_ADC_PD | TEMP_TEMP_EN );
-						//cc = writeRegister(TEMP_CFG_REG, reg );
-						//temperature = -1;
-						return ( present );
-						/* I2Cfile intentionally kept open — used by readSensor() */
-					}
+					// Enable Temp
+					//reg = (TEMP_ADC_PD | TEMP_TEMP_EN );
+					//cc = writeRegister(TEMP_CFG_REG, reg );
+					//temperature = -1;
+					return ( present );
 				}
 			}
 		}
-		/* Sensor not found on this bus; close before trying the next one.
-		 * Without this, every failed bus iteration leaks a file descriptor. */
-		close(I2Cfile);
-		I2Cfile = -1;
 	}
 	return ( present );
 }
@@ -136,15 +126,8 @@ int cprI2C::readRegister(int reg )
 {
 	int status;
 	struct i2c_msg i2cMsg[2];
-	struct i2c_rdwr_ioctl_data ioctl_data;
 	__u8 in_buf[4];
 	__u8 out_buf[4];
-	int sts;
-	
-	//struct i2c_rdwr_ioctl_data {
-	//	struct i2c_msg *msgs;  /* ptr to array of simple messages */
-	//	int nmsgs;             /* number of messages to exchange */
-	//}
 
 	out_buf[0] = reg;
     i2cMsg[0].addr = I2CAddr;
@@ -155,16 +138,7 @@ int cprI2C::readRegister(int reg )
 	i2cMsg[1].flags = I2C_M_RD;
 	i2cMsg[1].len = 1;
 	i2cMsg[1].buf = in_buf;
-	ioctl_data.nmsgs = 2;
-	ioctl_data.msgs = &i2cMsg[0];
-	sts = getI2CLock();
-	if ( sts )
-	{
-		printf("cprI2C::readRegister: Could not get I2C Lock\n" );
-		return ( -1 );
-	}
-	status = ioctl(I2Cfile, I2C_RDWR, &ioctl_data );
-	releaseI2CLock();
+	status = i2cTransfer(I2CClient, I2CBus, i2cMsg, 2 );
 	if ( status < 0 )
 	{
 		//sprintf(errbuf, "cprI2C::readRegister: ioctl error %d : %s", errno, strerror(errno) );
@@ -181,18 +155,11 @@ int cprI2C::readRegister16(int reg )
 {
 	int status;
 	struct i2c_msg i2cMsg[2];
-	struct i2c_rdwr_ioctl_data ioctl_data;
 	__u8 in_buf[4];
 	__u8 out_buf[4];
-	int sts;
-	
-	//struct i2c_rdwr_ioctl_data {
-	//	struct i2c_msg *msgs;  /* ptr to array of simple messages */
-	//	int nmsgs;             /* number of messages to exchange */
-	//}
 
-	out_buf[0] = reg;
-    i2cMsg[0].addr = I2CAddr | 0x80; // Set bit x80 for Auto increment
+	out_buf[0] = reg | 0x80;	// Set bit x80 for Auto increment
+    i2cMsg[0].addr = I2CAddr;
 	i2cMsg[0].flags = 0;
 	i2cMsg[0].len = 1;
 	i2cMsg[0].buf = out_buf;
@@ -200,15 +167,7 @@ int cprI2C::readRegister16(int reg )
 	i2cMsg[1].flags = I2C_M_RD;
 	i2cMsg[1].len = 2;
 	i2cMsg[1].buf = in_buf;
-	ioctl_data.nmsgs = 2;
-	ioctl_data.msgs = &i2cMsg[0];
-	sts = getI2CLock();
-	if ( sts )
-	{
-		return ( -1 );
-	}
-	status = ioctl(I2Cfile, I2C_RDWR, &ioctl_data );
-	releaseI2CLock();
+	status = i2cTransfer(I2CClient, I2CBus, i2cMsg, 2 );
 	if ( status < 0 )
 	{
 		//sprintf(errbuf, "cprI2C::readRegister16: ioctl error %d : %s", errno, strerror(errno) );
@@ -225,9 +184,7 @@ int cprI2C::writeRegister(int reg, unsigned char val )
 {
 	int status;
 	struct i2c_msg i2cMsg[1];
-	struct i2c_rdwr_ioctl_data ioctl_data;
 	__u8 out_buf[4];
-	int sts;
 	
 	out_buf[0] = (__u8)reg;
 	out_buf[1] = val;
@@ -235,15 +192,7 @@ int cprI2C::writeRegister(int reg, unsigned char val )
 	i2cMsg[0].flags = 0;
 	i2cMsg[0].len = 2;
 	i2cMsg[0].buf = out_buf;
-	ioctl_data.nmsgs = 1;
-	ioctl_data.msgs = &i2cMsg[0];
-	sts = getI2CLock();
-	if ( sts )
-	{
-		return ( -1 );
-	}
-	status = ioctl(I2Cfile, I2C_RDWR, &ioctl_data );
-	releaseI2CLock();
+	status = i2cTransfer(I2CClient, I2CBus, i2cMsg, 1 );
 	
 	if ( status < 0 )
 	{
@@ -258,60 +207,58 @@ int cprI2C::writeRegister(int reg, unsigned char val )
 	return ( 0 );
 }
 
-int cprI2C::readSensor()
+// Read len consecutive registers starting at reg in one transaction
+int cprI2C::readBlock(int reg, unsigned char *buf, int len )
 {
 	int status;
-	unsigned int value;
-	short reading;
+	struct i2c_msg i2cMsg[2];
+	__u8 out_buf[4];
 
-	//float degreeC;
-	//float degreeF;
-	
-	status = readRegister(STATUS_REG_AUX );
+	out_buf[0] = reg | 0x80;	// Set bit x80 for Auto increment
+    i2cMsg[0].addr = I2CAddr;
+	i2cMsg[0].flags = 0;
+	i2cMsg[0].len = 1;
+	i2cMsg[0].buf = out_buf;
+    i2cMsg[1].addr = I2CAddr;
+	i2cMsg[1].flags = I2C_M_RD;
+	i2cMsg[1].len = len;
+	i2cMsg[1].buf = buf;
+	status = i2cTransfer(I2CClient, I2CBus, i2cMsg, 2 );
 	if ( status < 0 )
 	{
-		return ( status );
-	}
-	if ( ( status & (SRA_3DA) ) == (SRA_3DA) )
-	{
-		value = readRegister(OUT_ADC3_L );
-		value |= ( readRegister(OUT_ADC3_H ) << 8 );
-		reading = (short)value;
-		// Assuming temp is degrees C, convert to F
-		//degreeC = (float)reading / 100;
-		//degreeF = ( (degreeC * 9 )/5 ) + 32;
-		//temperature = degreeF;
+		if ( errno == EREMOTEIO )
+		{
+			present = 0;
+		}
+		return ( -2 );
 	}
-	
-	// See if Data is present
-	status = readRegister(STATUS_REG );
+	return ( len );
+}
+
+int cprI2C::readSensor()
+{
+	int status;
+	unsigned char buf[OUT_Z_H - STATUS_REG + 1];
+
+	// Status and all three axes in one transaction. With Block Data Update set
+	// the axis registers are not updated until this read completes.
+	status = readBlock(STATUS_REG, buf, sizeof(buf) );
 	if ( status < 0 )
 	{
 		return ( status );
 	}
+	status = buf[0];
 	if ( ( status & (SR_ZDA|SR_YDA|SR_XDA) ) != (SR_ZDA|SR_YDA|SR_XDA) )
 	{
 		return ( 0 );
 	}
-	value = readRegister(OUT_X_L );
-	value |= ( readRegister(OUT_X_H ) << 8 );
-	reading = (short)value;
-	readingX = reading;
-	
-	value = readRegister(OUT_Y_L );
-	value |= ( readRegister(OUT_Y_H ) << 8 );
-	reading = (short)value;
-	readingY = reading;
-	
-	value = readRegister(OUT_Z_L );
-	value |= ( readRegister(OUT_Z_H ) << 8 );
-	reading = (short)value;
-	readingZ = reading;
+	readingX = (short)( buf[OUT_X_L - STATUS_REG] | ( buf[OUT_X_H - STATUS_REG] << 8 ) );
+	readingY = (short)( buf[OUT_Y_L - STATUS_REG] | ( buf[OUT_Y_H - STATUS_REG] << 8 ) );
+	readingZ = (short)( buf[OUT_Z_L - STATUS_REG] | ( buf[OUT_Z_H - STATUS_REG] << 8 ) );
 	
 	return ( status );
 }
 
 cprI2C::~cprI2C()
 {
-	close(I2Cfile);
 }
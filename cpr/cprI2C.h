@@ -32,8 +32,7 @@ class cprI2C {
 private:
 	int I2CBus;;
 	char I2CdataBuffer[CPR_I2C_BUFFER];
-	char I2Cnamebuf[MAX_BUS];
-	int I2Cfile;
+	int I2CClient;		// i2cBroker client id
 	int I2CAddr;
 public:
 	cprI2C(int dummy);
@@ -41,6 +40,7 @@ public:
 	int readRegister(int reg );
 	int readRegister16(int reg );
 	int writeRegister(int reg, unsigned char val );
+	int readBlock(int reg, unsigned char *buf, int len );
 	int readSensor(void );
 	int present;
 
@@ -21,6 +21,7 @@
 #include <string>
 #include <unistd.h>
 #include "cprI2C.h"
+#include "cprAnalytics.h"
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -42,15 +43,19 @@
 #ifdef SUPPORT_TOF
 
 #include "vl6180x.h"
-#include <linux/i2c-dev.h>
-#include <sys/ioctl.h>
+#include <pthread.h>
 
 #define ADDRESS_DEFAULT 0x29
+#define TOF_I2C_BUS			2
+#define TOF_PERIOD_MS		20		// Continuous ranging period (50 Hz)
+#define TOF_CONVERGENCE_MS	15		// Max convergence time, must fit within the period
+#define TOF_POLL_MS			2		// Poll interval while waiting for a result
+#define TOF_TIMEOUT_MS		500		// No result in this time counts as a timeout
+#define TOF_STALE_MS		100		// Samples older than this are not used for analytics
 
 void startTOF(void);
-void runTOF(void);
+void *runTOF(void *arg);
 int tofGetModel(int *model, int *revision);
-int file_i2c;
 VL6180X tof;
 
 #endif
@@ -58,31 +63,49 @@ VL6180X tof;
 #include "../comm/simCtlComm.h"
 #include "../comm/simUtil.h"
 #include "../comm/shmData.h"
+#include "../comm/i2cBroker.h"
+#include "../comm/simModule.h"
+#include "../comm/simTrace.h"
 
 
 using namespace std;
 
+#ifndef SIM_HUB
 struct shmData *shmData;
+int debug = 0;
+#else
+extern struct shmData *shmData;
+extern int debug;
+#endif
 
 char msgbuf[2048];
 
-int debug = 0;
 #define Z_IDLE		16000
 #define Z_COMPRESS	19000
 #define Z_RELEASE	5000
 #define X_Y_LIMIT	10000
-#define CPR_HOLD	20
+#define CPR_HOLD	40	// Samples at 100Hz
+#define CPR_SAMPLE_US	10000	// LIS3DH runs at 100Hz
+#define CPR_RESCAN_POLLS	1000	// Look for a missing sensor every 10 seconds
+
+cprI2C *cprSense;
+cprAnalytics analytics;
+int lastZ, diffZ;
+int lastX, lastY;
+int cummZ;
+int count = 0;
+int compressed = 0;
+int loop = 0;
+int rescan = 0;
 
+int cprInit(void );
+void cprPoll(void );
+struct simModule cprModule = { "cprScan", SIM_MODULE_CPR, cprInit, cprPoll, CPR_SAMPLE_US, SIM_MODULE_NORMAL };
+
+#ifndef SIM_HUB
 int main(int argc, char *argv[])
 {
 	int sts;
-	int newData;
-	int lastZ, diffZ;
-	int lastX, lastY;
-	int cummZ;
-	int count = 0;
-	int compressed = 0;
-	int loop = 0;
 	
 	if ( ! debug )
 	{
@@ -99,162 +122,181 @@ int main(int argc, char *argv[])
 		log_message("", msgbuf );
 		exit ( -1 );
 	}
+	struct simModule *modules[] = { &cprModule };
+	simModuleRun(modules, 1, 0 );
+	
+	// No sensor. We loop here to keep the daemon open. Makes for a cleaner shutdown.
+	while ( 1 )
+	{
+		sleep(60);
+	}
+	return 0;
+}
+#endif
+
+/*
+ * Function: cprInit
+ *
+ * Module init. Starts the I2C broker and the ToF thread and finds the accelerometer.
+ *
+ * Returns: 0, or -1 if there is no accelerometer
+ */
+int
+cprInit(void )
+{
+	// All I2C access in cprScan goes through the broker thread
+	if ( i2cBrokerStart() )
+	{
+		return ( -1 );
+	}
 #ifdef SUPPORT_TOF
 	startTOF();
 #endif
-	cprI2C cprSense(0 );
-	if ( cprSense.present == 0 )
+	cprSense = new cprI2C(0 );
+	if ( cprSense->present == 0 )
 	{
 		log_message("","No cprSense Found on bus - Waiting" );
-		while ( 1 )
-		{
-			// We loop here to keep the daemon open. Makes for a cleaner shutdown.
-			sleep(60);
-		}
-		/* unreachable — loop above has no exit condition */
+		return ( -1 );
 	}
 	
-	// shmData->present = cprSense.present;
-	newData = cprSense.readSensor();
-	diffZ = cprSense.readingZ;
-	lastX = cprSense.readingX;
-	lastY = cprSense.readingY;
-	lastZ = cprSense.readingZ;
+	// shmData->present = cprSense->present;
+	(void)cprSense->readSensor();
+	diffZ = cprSense->readingZ;
+	lastX = cprSense->readingX;
+	lastY = cprSense->readingY;
+	lastZ = cprSense->readingZ;
 	cummZ = 0;
 	
 	//printf("%3d:\t%05d:\t%05d\t%05d\t: %05d  %d\n", count, loop, lastZ, diffZ, cummZ, compressed );
 	printf("%05d\t%05d\t%05d\t%05d  %d\n", loop, lastX, lastY, lastZ, compressed );
-	usleep(10000);
-	while ( 1 )
+	return ( 0 );
+}
+
+/*
+ * Function: cprPoll
+ *
+ * Module poll, every CPR_SAMPLE_US
+ */
+void
+cprPoll(void )
+{
+	int newData;
+	int distance;
+	unsigned int now;
+	
+	if ( cprSense->present == 0 )
+	{
+		if ( ++rescan >= CPR_RESCAN_POLLS )
+		{
+			rescan = 0;
+			cprSense->scanForSensor();
+		}
+		return;
+	}
+	newData = cprSense->readSensor();
+	if ( newData <= 0 )
 	{
-		if ( cprSense.present == 0 )
+		return;
+	}
+	loop++;
+	diffZ = cprSense->readingZ - lastZ;
+	lastZ = cprSense->readingZ;
+	lastX = cprSense->readingX;
+	lastY = cprSense->readingY;
+	cummZ += diffZ;
+	/*
+	if ( ( abs(lastX ) > X_Y_LIMIT ) || ( abs(lastY ) > X_Y_LIMIT ) )
+	{
+		// Large X or Y displacement indication moving the mannequin rather than possible compression
+	}
+	else if ( abs(lastZ) > Z_COMPRESS  )
+		*/
+	if ( ( abs(lastX ) > X_Y_LIMIT ) || ( abs(lastY ) > X_Y_LIMIT ) ||  abs(lastZ) > Z_COMPRESS )
+	{
+		if ( ! compressed )
 		{
-			usleep(10000000);	// Delay for 10 seconds
-			cprSense.scanForSensor();
+			simTrace(SIM_TRACE_SENSOR, SIM_TRACE_SENSOR_CPR, 1 );
 		}
-		else
+		compressed = 1;
+		shmData->cpr.compression = 1;
+		shmData->cpr.release = 0;
+		count = 0;
+	}
+	else
+	{
+		// If we are short of the Z_COMPRESS threshold, limit the compression to 200 ms.
+		count++;
+		if ( count > CPR_HOLD )
 		{
-			newData = cprSense.readSensor();
-			if ( newData <= 0 )
-			{
-				continue;
-			}
-			//while ( ! ( newData = cprSense.readSensor() ) )
-			//{
-			//	usleep(5000);
-			//}
-		//}
-		//if ( newData )
-		//{
-			loop++;
-			diffZ = cprSense.readingZ - lastZ;
-			lastZ = cprSense.readingZ;
-			lastX = cprSense.readingX;
-			lastY = cprSense.readingY;
-			cummZ += diffZ;
-#if 0
 			if ( compressed )
 			{
-				count++;
-				if ( count > CPR_HOLD )
-				{
-					compressed = 0;
-					shmData->cpr.compression = 0;
-					shmData->cpr.release = 0;
-				}
-				/*
-				if ( lastZ < Z_RELEASE )
-				{
-					// released
-					compressed = 0;
-					shmData->cpr.compression = 0;
-					shmData->cpr.release = 100;
-				} */
-			}
-			else
-#endif
-			{
-				/*
-				if ( ( abs(lastX ) > X_Y_LIMIT ) || ( abs(lastY ) > X_Y_LIMIT ) )
-				{
-					// Large X or Y displacement indication moving the mannequin rather than possible compression
-				}
-				else if ( abs(lastZ) > Z_COMPRESS  )
-					*/
-				if ( ( abs(lastX ) > X_Y_LIMIT ) || ( abs(lastY ) > X_Y_LIMIT ) ||  abs(lastZ) > Z_COMPRESS )
-				{
-					compressed = 1;
-					shmData->cpr.compression = 1;
-					shmData->cpr.release = 0;
-					count = 0;
-				}
-				else
-				{
-					// If we are short of the Z_COMPRESS threshold, limit the compression to 200 ms.
-					count++;
-					if ( count > CPR_HOLD )
-					{
-						compressed = 0;
-						shmData->cpr.compression = 0;
-						shmData->cpr.release = 50;
-					}
-				}
-			}
-			if (  debug &&  ( compressed || ( abs(diffZ) > 1000 ) ) )
-			{
-				//printf("%3d:\t%05d:\t%05d\t%05d\t: %05d  %d\n", count, loop, lastZ, diffZ, cummZ, compressed );
-				printf("%05d\t%05d\t%05d\t%05d  %d\n", loop, lastX, lastY, lastZ, compressed );
+				simTrace(SIM_TRACE_SENSOR, SIM_TRACE_SENSOR_CPR, 0 );
 			}
-			shmData->cpr.x = lastX;
-			shmData->cpr.y = lastY;
-			shmData->cpr.z = lastZ;
+			compressed = 0;
+			shmData->cpr.compression = 0;
+			shmData->cpr.release = 50;
 		}
-		usleep(20000);
 	}
-
-	return 0;
+	if (  debug &&  ( compressed || ( abs(diffZ) > 1000 ) ) )
+	{
+		//printf("%3d:\t%05d:\t%05d\t%05d\t: %05d  %d\n", count, loop, lastZ, diffZ, cummZ, compressed );
+		printf("%05d\t%05d\t%05d\t%05d  %d\n", loop, lastX, lastY, lastZ, compressed );
+	}
+	shmData->cpr.x = lastX;
+	shmData->cpr.y = lastY;
+	shmData->cpr.z = lastZ;
+	
+	// CPR quality. The ToF distance is only used while the sensor is responding.
+	now = millis();
+	distance = 0;
+	if ( shmData->cpr.tof_present == 1 && ( now - shmData->cpr.distanceTime ) < TOF_STALE_MS )
+	{
+		distance = shmData->cpr.distance;
+	}
+	if ( analytics.addSample(lastZ, now, distance ) )
+	{
+		shmData->cpr.depth = analytics.depth;
+		shmData->cpr.rate = analytics.rate;
+		shmData->cpr.recoil = analytics.recoil;
+		shmData->cpr.dutyCycle = analytics.dutyCycle;
+		shmData->cpr.duration = analytics.duration;
+		shmData->cpr.last = analytics.last;
+		shmData->cpr.count = analytics.count;
+		if ( debug )
+		{
+			printf("CPR %d: depth %d rate %d recoil %d duty %d\n",
+				analytics.count, analytics.depth, analytics.rate, analytics.recoil, analytics.dutyCycle );
+		}
+	}
+	shmData->cpr.handsOff = analytics.handsOff;
 }
 
 #ifdef SUPPORT_TOF
 void
 startTOF(void)
 {
-	char filename[32];
 	int model = 0;
 	int revision = 0;
-	int sts;
+	int client;
+	pthread_t tid;
 	
 	shmData->cpr.tof_present = 0;
-	sprintf(filename,"/dev/i2c-%d", 2);
 	
-	sts = getI2CLock();
-	if ( sts )
+	client = i2cBrokerRegister("vl6180x", I2C_PRIORITY_NORMAL );
+	if ( client < 0 )
 	{
-		releaseI2CLock();
-		printf("runTOF::readRegister: Could not get I2C Lock\n" );
 		return;
 	}
-	if ((file_i2c = open(filename, O_RDWR)) < 0)
+	tof.setBroker(client, TOF_I2C_BUS );
+	tof.setAddress((uint8_t)ADDRESS_DEFAULT );
+	revision = tof.readReg32Bit((uint16_t)0x0001);
+	model = tof.readReg((uint16_t)0x000 );
+	if ( tof.last_status )
 	{
 		// No ToF Found
-		releaseI2CLock();
-		return;
-	}
-	if (ioctl(file_i2c, I2C_SLAVE, ADDRESS_DEFAULT) < 0)
-	{
-		fprintf(stderr, "Failed to acquire bus access or talk to slave\n");
-		releaseI2CLock();
-		close(file_i2c);
-		file_i2c = -1;
 		return;
 	}
 	
-	tof.setDev(file_i2c );
-	tof.setAddress((uint8_t)ADDRESS_DEFAULT );
-	revision = tof.readReg32Bit((uint16_t)0x0001);
-	model = tof.readReg((uint16_t)0x000 );
-	releaseI2CLock();
-	
 	sprintf(msgbuf, "VL63L0X: Model %02xh Revision %02xh", model, revision );
 	log_message("", msgbuf );
 	
@@ -268,60 +310,71 @@ startTOF(void)
 	shmData->cpr.tof_present = 1;
 	shmData->cpr.distance = 0;
 	shmData->cpr.maxDistance = 0;
+	shmData->cpr.distanceTime = 0;
+	shmData->cpr.distanceCount = 0;
 	
-	pid_t pid = fork(); /* Create a child process */
-
-	switch (pid) {
-		case -1: /* Error */
-			exit(1);
-			
-		case 0: /* Child process */
-			runTOF();
-			break;
-			
-		default: /* Parent process */
-			break;
+	millis();	// Start the time base before the thread, so both threads share it
+	if ( pthread_create(&tid, NULL, runTOF, NULL ) != 0 )
+	{
+		log_message("", "startTOF: pthread_create failed" );
+		shmData->cpr.tof_present = 0;
 	}
 }
 
-void
-runTOF(void)
+/*
+ * runTOF
+ *
+ * The sensor runs in continuous ranging mode and is polled with a batched read of
+ * the status and range registers. After a sample the poll sleeps for most of a
+ * period, so the bus is only busy when a result is due. Each sample is time
+ * stamped with millis() so cprAnalytics can line it up with the accelerometer.
+*/
+void *
+runTOF(void *arg)
 {
-	int distance;
+	uint8_t range;
+	uint8_t rangeStatus;
+	unsigned int now;
+	unsigned int lastSample;
 	int sts;
 
 	usleep(100000);
-	sts = getI2CLock();
 	tof.init();
 	tof.configureDefault();
 	tof.setPtpOffset(22);
 	tof.setTimeout(500);
-	releaseI2CLock();
+	tof.writeReg(VL6180X::SYSRANGE__MAX_CONVERGENCE_TIME, TOF_CONVERGENCE_MS );
+	tof.startRangeContinuous(TOF_PERIOD_MS );
 	
-	while ( 1 ) // read values 20 times a second
+	lastSample = millis();
+	while ( 1 )
 	{
-		sts = getI2CLock();
-		if ( sts == 0 )
+		sts = tof.readRangeBatch(&range, &rangeStatus );
+		now = millis();
+		if ( sts > 0 )
 		{
-			distance = tof.readRangeSingle();
-			releaseI2CLock();
-			if ( tof.timeoutOccurred() )
-			{
-				shmData->cpr.tof_present += 1;
-			}
-			else
+			lastSample = now;
+			if ( rangeStatus == 0 )	// No range error
 			{
-				//if (distance > 0 && distance < 255) // valid range?
+				shmData->cpr.distance = range;
+				if ( range > shmData->cpr.maxDistance )
 				{
-					shmData->cpr.distance = distance;
-					if ( distance > shmData->cpr.maxDistance )
-					{
-						shmData->cpr.maxDistance = distance;
-					}
+					shmData->cpr.maxDistance = range;
 				}
+				shmData->cpr.distanceTime = now;
+				shmData->cpr.distanceCount++;
 			}
+			// The next result is not due for a full period
+			usleep((TOF_PERIOD_MS - TOF_POLL_MS ) * 1000 );
+			continue;
 		}
-		usleep(50000); // 50ms
+		else if ( now - lastSample > TOF_TIMEOUT_MS )
+		{
+			shmData->cpr.tof_present += 1;
+			lastSample = now;
+		}
+		usleep(TOF_POLL_MS * 1000 );
 	}
-} 
+	return ( NULL );
+}
 #endif
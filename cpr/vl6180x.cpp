@@ -7,7 +7,9 @@
 #include <sys/ioctl.h>
 #include <time.h>
 #include <linux/i2c-dev.h>
+#include <linux/i2c.h>
 #include "vl6180x.h"
+#include "../comm/i2cBroker.h"
 
 /*
  * Based on code from https://github.com/pololu/vl6180x-arduino
@@ -46,6 +48,28 @@ static uint16_t const ScalerValues[] = {0, 253, 127, 84};
 
 VL6180X::VL6180X()
 {
+	file_i2c = -1;
+	client = -1;
+	bus = 0;
+}
+
+// Run a list of messages as one transaction, through the broker when one is set
+int VL6180X::transfer(struct i2c_msg *msgs, int nmsgs)
+{
+	struct i2c_rdwr_ioctl_data xfer;
+	int i;
+
+	for ( i = 0 ; i < nmsgs ; i++ )
+	{
+		msgs[i].addr = address;
+	}
+	if ( client >= 0 )
+	{
+		return ( i2cTransfer(client, bus, msgs, nmsgs ) );
+	}
+	xfer.msgs = msgs;
+	xfer.nmsgs = nmsgs;
+	return ( ioctl(file_i2c, I2C_RDWR, &xfer ) );
 }
 
 
@@ -175,13 +199,15 @@ void VL6180X::configureDefault()
 void VL6180X::writeReg(uint16_t reg, uint8_t value)
 {
 	unsigned char ucTemp[4];
-	ssize_t rc;
+	struct i2c_msg msgs[1];
 
 	ucTemp[0] = reg >> 8;
 	ucTemp[1] = (unsigned char)reg;
 	ucTemp[2] = value;
-	rc = write(file_i2c, ucTemp, 3);
-	if ( rc != 3 )
+	msgs[0].flags = 0;
+	msgs[0].len = 3;
+	msgs[0].buf = ucTemp;
+	if ( transfer(msgs, 1) < 0 )
 	{
 		last_status = 1;
 	}
@@ -191,14 +217,16 @@ void VL6180X::writeReg(uint16_t reg, uint8_t value)
 void VL6180X::writeReg16Bit(uint16_t reg, uint16_t value)
 {
 	unsigned char ucTemp[4];
-	ssize_t rc;
+	struct i2c_msg msgs[1];
 
 	ucTemp[0] = reg >> 8;
 	ucTemp[1] = (unsigned char)reg;
 	ucTemp[2] = (unsigned char)(value >> 8); // MSB first
 	ucTemp[3] = (unsigned char)value;
-	rc = write(file_i2c, ucTemp, 4);
-	if ( rc != 4 )
+	msgs[0].flags = 0;
+	msgs[0].len = 4;
+	msgs[0].buf = ucTemp;
+	if ( transfer(msgs, 1) < 0 )
 	{
 		last_status = 1;
 	}
@@ -208,7 +236,7 @@ void VL6180X::writeReg16Bit(uint16_t reg, uint16_t value)
 void VL6180X::writeReg32Bit(uint16_t reg, uint32_t value)
 {
 	unsigned char ucTemp[8];
-	ssize_t rc;
+	struct i2c_msg msgs[1];
 
 	ucTemp[0] = reg >> 8;
 	ucTemp[1] = (unsigned char)reg;
@@ -216,30 +244,32 @@ void VL6180X::writeReg32Bit(uint16_t reg, uint32_t value)
 	ucTemp[3] = (unsigned char)(value >> 16);
 	ucTemp[4] = (unsigned char)(value >> 8);
 	ucTemp[5] = (unsigned char)value;
-	rc = write(file_i2c, ucTemp, 6);
-	if ( rc != 6 )
+	msgs[0].flags = 0;
+	msgs[0].len = 6;
+	msgs[0].buf = ucTemp;
+	if ( transfer(msgs, 1) < 0 )
 	{
 		last_status = 1;
 	}
 }
 
-// Reads an 8-bit register
+// Reads an 8-bit register. The register address write and the read are one
+// transaction (repeated start), so no other client can get in between.
 uint8_t VL6180X::readReg(uint16_t reg)
 {
-	unsigned char ucTemp[8];
-	ssize_t rc;
-
-	ucTemp[0] = (unsigned char)((reg & 0xFF00) >> 8);
-	ucTemp[1] = (unsigned char)(reg & 0xFF);
-	/* Note: pass ucTemp (pointer to first element), not &ucTemp (pointer to array) */
-	rc = write(file_i2c, ucTemp, 2);
-	if ( rc != 2 )
-	{
-		last_status = 1;
-		return 0;
-	}
-	rc = read(file_i2c, ucTemp, 1);
-	if ( rc != 1 )
+	unsigned char addr[2];
+	unsigned char ucTemp[1];
+	struct i2c_msg msgs[2];
+
+	addr[0] = (unsigned char)((reg & 0xFF00) >> 8);
+	addr[1] = (unsigned char)(reg & 0xFF);
+	msgs[0].flags = 0;
+	msgs[0].len = 2;
+	msgs[0].buf = addr;
+	msgs[1].flags = I2C_M_RD;
+	msgs[1].len = 1;
+	msgs[1].buf = ucTemp;
+	if ( transfer(msgs, 2) < 0 )
 	{
 		last_status = 1;
 		return 0;
@@ -250,22 +280,19 @@ uint8_t VL6180X::readReg(uint16_t reg)
 // Reads a 16-bit register
 uint16_t VL6180X::readReg16Bit(uint16_t reg)
 {
+	unsigned char addr[2];
 	unsigned char ucTemp[2];
-	ssize_t rc;
-
-	ucTemp[0] = (unsigned char)((reg & 0xFF00) >> 8);
-	ucTemp[1] = (unsigned char)(reg & 0xFF);
-	rc = write(file_i2c, ucTemp, 2);
-	if ( rc == 2 )
-	{
-		rc = read(file_i2c, ucTemp, 2);
-		if ( rc != 2 )
-		{
-			last_status = 1;
-			return 0;
-		}
-	}
-	else
+	struct i2c_msg msgs[2];
+
+	addr[0] = (unsigned char)((reg & 0xFF00) >> 8);
+	addr[1] = (unsigned char)(reg & 0xFF);
+	msgs[0].flags = 0;
+	msgs[0].len = 2;
+	msgs[0].buf = addr;
+	msgs[1].flags = I2C_M_RD;
+	msgs[1].len = 2;
+	msgs[1].buf = ucTemp;
+	if ( transfer(msgs, 2) < 0 )
 	{
 		last_status = 1;
 		return 0;
@@ -276,20 +303,19 @@ uint16_t VL6180X::readReg16Bit(uint16_t reg)
 // Reads a 32-bit register
 uint32_t VL6180X::readReg32Bit(uint16_t reg)
 {
-	unsigned char ucTemp[8];
-	ssize_t rc;
-
-	ucTemp[0] = (unsigned char)((reg & 0xFF00) >> 8);
-	ucTemp[1] = (unsigned char)(reg & 0xFF);
-	/* Note: pass ucTemp (pointer to first element), not &ucTemp (pointer to array) */
-	rc = write(file_i2c, ucTemp, 2);
-	if ( rc != 2 )
-	{
-		last_status = 1;
-		return 0;
-	}
-	rc = read(file_i2c, ucTemp, 4);
-	if ( rc != 4 )
+	unsigned char addr[2];
+	unsigned char ucTemp[4];
+	struct i2c_msg msgs[2];
+
+	addr[0] = (unsigned char)((reg & 0xFF00) >> 8);
+	addr[1] = (unsigned char)(reg & 0xFF);
+	msgs[0].flags = 0;
+	msgs[0].len = 2;
+	msgs[0].buf = addr;
+	msgs[1].flags = I2C_M_RD;
+	msgs[1].len = 4;
+	msgs[1].buf = ucTemp;
+	if ( transfer(msgs, 2) < 0 )
 	{
 		last_status = 1;
 		return 0;
@@ -460,6 +486,52 @@ uint16_t VL6180X::readAmbientContinuous()
   return ambient;
 }
 
+// Non-blocking range read for continuous mode. The status, interrupt and range
+// registers (0x04D to 0x062) are read in one combined I2C_RDWR transaction, and
+// the interrupt is only cleared when a new range is ready.
+//
+// Returns 1 with the range (and RESULT__RANGE_STATUS error code) set when a new
+// sample was read, 0 when no sample is ready and -1 on a bus error.
+int VL6180X::readRangeBatch(uint8_t *range, uint8_t *rangeStatus)
+{
+	unsigned char addr[2];
+	unsigned char result[RESULT__RANGE_VAL - RESULT__RANGE_STATUS + 1];
+	unsigned char clear[3];
+	struct i2c_msg msgs[2];
+
+	addr[0] = (unsigned char)(RESULT__RANGE_STATUS >> 8);
+	addr[1] = (unsigned char)(RESULT__RANGE_STATUS & 0xFF);
+	msgs[0].flags = 0;
+	msgs[0].len = 2;
+	msgs[0].buf = addr;
+	msgs[1].flags = I2C_M_RD;
+	msgs[1].len = sizeof(result);
+	msgs[1].buf = result;
+	if ( transfer(msgs, 2 ) < 0 )
+	{
+		last_status = 1;
+		return ( -1 );
+	}
+	if ( ( result[RESULT__INTERRUPT_STATUS_GPIO - RESULT__RANGE_STATUS] & 0x04 ) == 0 )
+	{
+		return ( 0 );
+	}
+	*range = result[RESULT__RANGE_VAL - RESULT__RANGE_STATUS];
+	*rangeStatus = result[0] >> 4;
+
+	clear[0] = (unsigned char)(SYSTEM__INTERRUPT_CLEAR >> 8);
+	clear[1] = (unsigned char)(SYSTEM__INTERRUPT_CLEAR & 0xFF);
+	clear[2] = 0x01;
+	msgs[0].len = 3;
+	msgs[0].buf = clear;
+	if ( transfer(msgs, 1 ) < 0 )
+	{
+		last_status = 1;
+		return ( -1 );
+	}
+	return ( 1 );
+}
+
 // Did a timeout occur in one of the read functions since the last call to
 // timeoutOccurred()?
 bool VL6180X::timeoutOccurred()
@@ -1,6 +1,9 @@
 #ifndef VL6180X_h
 #define VL6180X_h
 
+#include <stdint.h>
+#include <linux/i2c.h>
+
 class VL6180X
 {
   public:
@@ -85,6 +88,7 @@ class VL6180X
 	
     void setDev(int dev) { this->file_i2c = dev; }
     int getDev() { return file_i2c; }
+    void setBroker(int client, int bus) { this->client = client; this->bus = bus; }
 
     void setAddress(uint8_t new_addr);
     uint8_t getAddress() { return address; }
@@ -117,6 +121,7 @@ class VL6180X
     uint8_t readRangeContinuous();
     inline uint16_t readRangeContinuousMillimeters() { return (uint16_t)scaling * readRangeContinuous(); }
     uint16_t readAmbientContinuous();
+    int readRangeBatch(uint8_t *range, uint8_t *rangeStatus);
 
     inline void setTimeout(uint16_t timeout) { io_timeout = timeout; }
     inline uint16_t getTimeout() { return io_timeout; }
@@ -125,6 +130,9 @@ class VL6180X
   private:
     uint8_t address;
 	int file_i2c;
+	int client;		// i2cBroker client id, or -1 to use file_i2c directly
+	int bus;
+	int transfer(struct i2c_msg *msgs, int nmsgs);
     uint8_t scaling;
     uint8_t ptp_offset;
     uint16_t io_timeout;
@@ -0,0 +1,133 @@
+/*
+ * simHub.cpp
+ *
+ * Runs soundSense, pulse, breathSense, cprScan and rfidScan as modules of one
+ * process with one event loop, in place of the five daemons.
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Each daemon source is compiled with -DSIM_HUB, which leaves out its main(),
+ * shmData and debug. The makefile links each daemon's objects into one
+ * relocatable object and makes its symbols local, except the simModule, so the
+ * daemons' other globals (msgbuf, state, ...) do not collide.
+ *
+ * soundSense and pulse (SIM_MODULE_RT) run on a loop at SCHED_FIFO
+ * SIM_HUB_RT_PRIORITY. breathSense, cprScan and rfidScan run on a second loop
+ * thread with normal scheduling, as do the threads they start (the cprScan I2C
+ * broker and ToF threads). simController, which does
+ * the HTTP sync with the sim-mgr, stays a separate process and is started at a
+ * background nice level by the init script.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "../comm/simUtil.h"
+#include "../comm/shmData.h"
+#include "../comm/simModule.h"
+
+using namespace std;
+
+struct shmData *shmData;
+int debug = 0;
+char msgbuf[2048];		// For simCtlComm. Each module has its own.
+
+extern struct simModule soundModule;
+extern struct simModule pulseModule;
+extern struct simModule breathModule;
+extern struct simModule cprModule;
+extern struct simModule rfidModule;
+
+struct simModule *hubModules[] =
+{
+	&soundModule,
+	&pulseModule,
+	&breathModule,
+	&cprModule,
+	&rfidModule
+};
+#define HUB_MODULES	(int)(sizeof(hubModules) / sizeof(struct simModule *))
+
+int main(int argc, char *argv[])
+{
+	int c;
+	int sts;
+	int rtPriority = SIM_HUB_RT_PRIORITY;
+	
+	opterr = 0;
+	while (( c = getopt(argc, argv, "hDnp:" ) ) != -1 )
+	{
+		switch ( c )
+		{
+			case 'D':
+				debug++;
+				break;
+				
+			case 'n':
+				rtPriority = 0;
+				break;
+				
+			case 'p':
+				rtPriority = atoi(optarg );
+				break;
+				
+			case 'h':
+				printf("Usage: %s [-D] [-n] [-p <priority>]\n", argv[0] );
+				printf("\t-D : Enable debug\n" );
+				printf("\t-n : No real-time scheduling\n" );
+				printf("\t-p <priority> : SCHED_FIFO priority of the loop (default %d)\n", SIM_HUB_RT_PRIORITY );
+				exit ( 0 );
+				break;
+				
+			case '?':
+				if (isprint (optopt))
+				  fprintf (stderr, "Unknown option `-%c'.\n", optopt);
+				else
+				  fprintf (stderr,
+						   "Unknown option character `\\x%x'.\n",
+						   optopt);
+				return 1;
+				
+			 default:
+				fprintf (stderr, "Unhandled option `-%c'.\n", c);
+				abort ();
+		}
+	}
+	if ( debug )
+	{
+		catchFaults();
+	}
+	else
+	{
+		daemonize();
+	}
+	sts = initSHM(SHM_OPEN );
+	if ( sts )
+	{
+		log_message("", "simHub: SHM Failed - Exiting" );
+		exit ( -1 );
+	}
+	log_message("", "simHub: Starting" );
+	simModuleRun(hubModules, HUB_MODULES, rtPriority );
+	log_message("", "simHub: Exited" );
+	return ( -1 );
+}
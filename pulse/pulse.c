@@ -24,6 +24,8 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  *
  * 4.12.2023 - Removed support for Dorsal Pulses
+ * 10.19.2026 - Sample at 100 Hz with median/IIR filtering, per-channel calibration
+ *				stored in /simulator/pulseCal.txt, support for all four pulse points
 */
 
  
@@ -49,33 +51,56 @@
 //#include "../comm/simCtlComm.h"
 #include "../comm/simUtil.h"
 #include "../comm/shmData.h"
+#include "../comm/simModule.h"
+#include "../comm/simTrace.h"
 
 
 
 using namespace std;
 
+#ifndef SIM_HUB
 struct shmData *shmData;
+int debug = 0;
+#else
+extern struct shmData *shmData;
+extern int debug;
+#endif
+
+int pulseInit(void );
+void pulsePoll(void );
 
 void init_touch_sensors(void );
 void read_touch_sensors(void );
 void read_touch_sensor(int chan );
+int load_calibration(void );
+int save_calibration(void );
+void calibrate_touch_sensors(void );
 
 char msgbuf[2048];
 
 int type = 0;
-int debug = 0;
 int isDaemon = 0;
 
 /*
- * Auto Calibration for Pulse Touch Sensors
+ * Pulse Touch Sensors
  *
- * 1: At startup, the initial reading of the Touch Sensor is used as a baseline.
- * 2: The Sensor reading decreases as pressure increases.
- * 3: An excessive touch is detected as a reading that is SENSE_EXCESS less than the baseline
- * 4: A heavy touch is detected as a reading that is SENSE_HI less than the baseline
- * 5: A normal touch is detected as reading that is SENSE_MID less than the baseline
- * 6: A light touch is detected as reading that is SENSE_LO less than the baseline
- * 7: The baseline is adjusted by 1 every sample, to track any shifts in the baseline
+ * 1: Each channel is sampled every PULSE_SAMPLE_US. A median of the last SENSE_MEDIAN
+ *    readings removes single bad reads, and a short IIR filter smooths the result.
+ * 2: The Sensor reading decreases as pressure increases. The difference from the
+ *    no-touch baseline is the pressure.
+ * 3: The pressure is compared to the SENSE_ levels, scaled by the channel gain. The
+ *    gain is the pressure of a firm press on that channel, relative to SENSE_HI.
+ * 4: A level must be crossed by SENSE_HYSTERESIS (scaled) to change, so a press
+ *    held near a boundary does not flicker.
+ * 5: The baseline follows any rise at once, and drifts down by 1 count every
+ *    SENSE_DRIFT_SAMPLES samples to track any shifts.
+ * 6: The baseline and gain of each channel are kept in PULSE_CAL_FILE, so no
+ *    "no-touch" boot is needed. Run "pulse -c" to calibrate. Without a file, the
+ *    first reading is used as the baseline as before.
+ * 7: A level change is posted as a touch event (shmData->pulse.touchSeq), which
+ *    wakes soundSense at once to gate the pulse channel. The time the
+ *    unfiltered reading first reached the new level is posted with it, so the
+ *    press-to-feel latency can be measured ("soundSense -m").
 */
 
 #define SENSE_EXCESS		1200
@@ -83,31 +108,60 @@ int isDaemon = 0;
 #define SENSE_MID			500
 #define SENSE_LO			250
 #define SENSE_OFFSET_ADJUST	20
+#define SENSE_HYSTERESIS	40
+#define SENSE_DRIFT_SAMPLES	4		// 25 counts/sec, as with the old 5 Hz loop
+#define SENSE_MEDIAN		5
+#define SENSE_IIR_SHIFT		1
+
+#define PULSE_SAMPLE_US		10000	// 100 Hz
+#define PULSE_CAL_FILE		"/simulator/pulseCal.txt"
+#define PULSE_CAL_SAVE_SEC	600		// Save a drifted baseline at most this often
+#define PULSE_CAL_SAVE_DIFF	50		// Baseline drift that is worth saving
 
 struct senseChans
 {
 	int ainChannel;
 	int position;
+	int enabled;
 	int last;
 	int ain;
 	int baseline;
+	int gain;				// % - Firm press pressure relative to SENSE_HI
+	int savedBaseline;
+	int filtered;			// Q4
+	int driftCount;
+	int history[SENSE_MEDIAN];
+	int histIdx;
+	int histCount;
+	unsigned int rawTime;	// When the unfiltered reading first went to a new level
 };
 
+// Dorsal points are off unless enabled in the calibration file
 struct senseChans senseChannels [] =
 {
-	{ TOUCH_SENSE_AIN_CHANNEL_1, PULSE_LEFT_FEMORAL,  0, 0, 0 },
-	{ TOUCH_SENSE_AIN_CHANNEL_2, PULSE_RIGHT_FEMORAL, 0, 0, 0 } 
+	{ TOUCH_SENSE_AIN_CHANNEL_1, PULSE_LEFT_FEMORAL,  1, 0, 0, 0, 100, 0, 0, 0, { 0, }, 0, 0, 0 },
+	{ TOUCH_SENSE_AIN_CHANNEL_2, PULSE_RIGHT_FEMORAL, 1, 0, 0, 0, 100, 0, 0, 0, { 0, }, 0, 0, 0 },
+	{ TOUCH_SENSE_AIN_CHANNEL_3, PULSE_LEFT_DORSAL,   0, 0, 0, 0, 100, 0, 0, 0, { 0, }, 0, 0, 0 },
+	{ TOUCH_SENSE_AIN_CHANNEL_4, PULSE_RIGHT_DORSAL,  0, 0, 0, 0, 100, 0, 0, 0, { 0, }, 0, 0, 0 }
 };
+#define SENSE_CHANNELS	(int)(sizeof(senseChannels) / sizeof(struct senseChans))
+
+int calibrationLoaded = 0;
+time_t lastSave = 0;
+int debugLoops = 0;
+
+struct simModule pulseModule = { "pulse", SIM_MODULE_PULSE, pulseInit, pulsePoll, PULSE_SAMPLE_US, SIM_MODULE_RT };
 
+#ifndef SIM_HUB
 int main(int argc, char *argv[])
 {
 	int sts;
 	int c;
-	int loops;
+	int calibrate = 0;
 	
 	opterr = 0;
 	
-	while (( c = getopt(argc, argv, "hD" ) ) != -1 )
+	while (( c = getopt(argc, argv, "hDc" ) ) != -1 )
 	{
 		switch ( c )
 		{
@@ -115,9 +169,14 @@ int main(int argc, char *argv[])
 				debug++;
 				break;
 				
+			case 'c':
+				calibrate = 1;
+				break;
+				
 			case 'h':
-				printf("Usage: %s [-D]\n", argv[0] );
+				printf("Usage: %s [-D] [-c]\n", argv[0] );
 				printf("\t-D : Enable debug\n" );
+				printf("\t-c : Calibrate the touch sensors and save to %s\n", PULSE_CAL_FILE );
 				exit ( 0 );
 				break;
 				
@@ -138,6 +197,12 @@ int main(int argc, char *argv[])
 		}	
 	}
 	
+	if ( calibrate )
+	{
+		(void)load_calibration();
+		calibrate_touch_sensors();
+		return ( 0 );
+	}
 	if ( ! debug )
 	{
 		daemonize();
@@ -151,33 +216,14 @@ int main(int argc, char *argv[])
 			return (-1 );
 		}
 	}
-	init_touch_sensors();
-	
 	if ( debug )
 	{
 		printf("Starting Loop\n");
 	}
 	
-	while ( 1 )
-	{
-		read_touch_sensors();
-
-		if ( debug && ( loops++ >= 10 ) )
-		{
-			sprintf(msgbuf, "sense %d %d %d %d", 
-					senseChannels[0].ain,
-					senseChannels[1].ain,
-					senseChannels[0].last,
-					senseChannels[1].last );
-			if ( debug )
-				printf("%s\n", msgbuf );
-			else
-				log_message("", msgbuf );
+	struct simModule *modules[] = { &pulseModule };
+	simModuleRun(modules, 1, 0 );
 	
-			loops = 0;
-		}
-		usleep(200000 );
-	}
 	if ( isDaemon )
 	{
 		sprintf(msgbuf, "Exited Loop: %s\n", strerror(errno ) );
@@ -186,6 +232,233 @@ int main(int argc, char *argv[])
 	printf("Exited Loop: %s\n", strerror(errno ) );
 	return 0;
 }
+#endif
+
+/*
+ * Function: pulseInit
+ *
+ * Module init. Loads the calibration and takes the first readings.
+ *
+ * Returns: 0
+ */
+int
+pulseInit(void )
+{
+	calibrationLoaded = ( load_calibration() == 0 );
+	init_touch_sensors();
+	return ( 0 );
+}
+
+/*
+ * Function: pulsePoll
+ *
+ * Module poll, every PULSE_SAMPLE_US
+ */
+void
+pulsePoll(void )
+{
+	int chan;
+	
+	read_touch_sensors();
+
+	if ( debug && ( debugLoops++ >= 50 ) )
+	{
+		msgbuf[0] = 0;
+		for ( chan = 0 ; chan < SENSE_CHANNELS ; chan++ )
+		{
+			if ( senseChannels[chan].enabled )
+			{
+				sprintf(&msgbuf[strlen(msgbuf)], "%d: %4d %4d %d  ", 
+					chan, senseChannels[chan].ain, senseChannels[chan].baseline,
+					senseChannels[chan].last );
+			}
+		}
+		printf("sense %s\n", msgbuf );
+		debugLoops = 0;
+	}
+}
+
+/*
+ * Function: load_calibration
+ *
+ * Read PULSE_CAL_FILE. Each line is:
+ *		<ain channel> <enabled> <baseline> <gain>
+ * Lines starting with # are comments.
+ *
+ * Returns: 0 if the file was read, -1 if not
+ */
+int
+load_calibration(void )
+{
+	FILE *fp;
+	char line[256];
+	int ainChan;
+	int enabled;
+	int base;
+	int gain;
+	int chan;
+	
+	fp = fopen(PULSE_CAL_FILE, "r" );
+	if ( fp == NULL )
+	{
+		return ( -1 );
+	}
+	while ( fgets(line, sizeof(line), fp ) )
+	{
+		if ( line[0] == '#' )
+		{
+			continue;
+		}
+		if ( sscanf(line, "%d %d %d %d", &ainChan, &enabled, &base, &gain ) != 4 )
+		{
+			continue;
+		}
+		for ( chan = 0 ; chan < SENSE_CHANNELS ; chan++ )
+		{
+			if ( senseChannels[chan].ainChannel == ainChan )
+			{
+				senseChannels[chan].enabled = enabled;
+				senseChannels[chan].baseline = base;
+				senseChannels[chan].savedBaseline = base;
+				if ( gain >= 10 && gain <= 400 )
+				{
+					senseChannels[chan].gain = gain;
+				}
+			}
+		}
+	}
+	fclose(fp );
+	return ( 0 );
+}
+
+/*
+ * Function: save_calibration
+ *
+ * Write PULSE_CAL_FILE. The file is written to a temporary name and renamed, so
+ * a power loss cannot leave a partial file.
+ *
+ * Returns: 0 on success, -1 on failure
+ */
+int
+save_calibration(void )
+{
+	FILE *fp;
+	char tmpName[128];
+	int chan;
+	
+	snprintf(tmpName, sizeof(tmpName), "%s.tmp", PULSE_CAL_FILE );
+	fp = fopen(tmpName, "w" );
+	if ( fp == NULL )
+	{
+		sprintf(msgbuf, "Cannot write %s: %s", tmpName, strerror(errno ) );
+		log_message("", msgbuf );
+		return ( -1 );
+	}
+	fprintf(fp, "# Pulse touch sensor calibration\n" );
+	fprintf(fp, "# ain enabled baseline gain(%%)\n" );
+	for ( chan = 0 ; chan < SENSE_CHANNELS ; chan++ )
+	{
+		fprintf(fp, "%d %d %d %d\n",
+			senseChannels[chan].ainChannel,
+			senseChannels[chan].enabled,
+			senseChannels[chan].baseline,
+			senseChannels[chan].gain );
+		senseChannels[chan].savedBaseline = senseChannels[chan].baseline;
+	}
+	fclose(fp );
+	if ( rename(tmpName, PULSE_CAL_FILE ) < 0 )
+	{
+		return ( -1 );
+	}
+	lastSave = time(NULL );
+	return ( 0 );
+}
+
+// Average of count readings, PULSE_SAMPLE_US apart
+static int
+average_ain(int ainChan, int count )
+{
+	int i;
+	int sum = 0;
+	
+	for ( i = 0 ; i < count ; i++ )
+	{
+		sum += read_ain(ainChan );
+		usleep(PULSE_SAMPLE_US );
+	}
+	return ( sum / count );
+}
+
+/*
+ * Function: calibrate_touch_sensors
+ *
+ * Interactive calibration. Records the no-touch baseline and a firm press on each
+ * channel, then saves the result.
+ */
+void
+calibrate_touch_sensors(void )
+{
+	int chan;
+	int i;
+	int sensor;
+	int minimum;
+	int span;
+	char answer[16];
+	
+	for ( chan = 0 ; chan < SENSE_CHANNELS ; chan++ )
+	{
+		printf("AIN %d (pulse point %d): use this channel [%c]? ",
+			senseChannels[chan].ainChannel, senseChannels[chan].position,
+			senseChannels[chan].enabled ? 'y' : 'n' );
+		fflush(stdout );
+		if ( fgets(answer, sizeof(answer), stdin ) && ( answer[0] == 'y' || answer[0] == 'n' ) )
+		{
+			senseChannels[chan].enabled = ( answer[0] == 'y' );
+		}
+		if ( ! senseChannels[chan].enabled )
+		{
+			continue;
+		}
+		printf("  Do not touch the sensor, then press ENTER " );
+		fflush(stdout );
+		(void)fgets(answer, sizeof(answer), stdin );
+		senseChannels[chan].baseline = average_ain(senseChannels[chan].ainChannel, 50 );
+		printf("  Baseline %d\n", senseChannels[chan].baseline );
+		
+		printf("  Press ENTER, then press the sensor firmly for 3 seconds " );
+		fflush(stdout );
+		(void)fgets(answer, sizeof(answer), stdin );
+		minimum = senseChannels[chan].baseline;
+		for ( i = 0 ; i < 300 ; i++ )
+		{
+			sensor = read_ain(senseChannels[chan].ainChannel );
+			if ( sensor > 0 && sensor < minimum )
+			{
+				minimum = sensor;
+			}
+			usleep(PULSE_SAMPLE_US );
+		}
+		span = senseChannels[chan].baseline - minimum;
+		if ( span < SENSE_LO )
+		{
+			printf("  Press too light (%d), gain not changed\n", span );
+		}
+		else
+		{
+			senseChannels[chan].gain = ( span * 100 ) / SENSE_HI;
+			printf("  Firm press %d, gain %d%%\n", span, senseChannels[chan].gain );
+		}
+	}
+	if ( save_calibration() == 0 )
+	{
+		printf("Saved %s\n", PULSE_CAL_FILE );
+	}
+	else
+	{
+		printf("Failed to save %s\n", PULSE_CAL_FILE );
+	}
+}
+
 void 
 init_touch_sensors(void )
 {
@@ -193,29 +466,35 @@ init_touch_sensors(void )
 	int sensor;
 	int position;
 	
-	for ( chan = 0 ; chan < 2 ; chan++ )
+	for ( chan = 0 ; chan < SENSE_CHANNELS ; chan++ )
 	{
 		sensor = read_ain(senseChannels[chan].ainChannel );
 		position = senseChannels[chan].position;
-		if ( ! debug )
+		
+		// A stored baseline is used unless the sensor now reads higher (less pressure)
+		if ( ! calibrationLoaded || sensor > senseChannels[chan].baseline )
 		{
 			senseChannels[chan].baseline = sensor;
-			shmData->pulse.base[position] = sensor;
+		}
+		senseChannels[chan].filtered = sensor << 4;
+		senseChannels[chan].histCount = 0;
+		senseChannels[chan].histIdx = 0;
+		if ( ! debug )
+		{
+			shmData->pulse.base[position] = senseChannels[chan].baseline;
 			shmData->pulse.ain[position] = sensor;
 			shmData->pulse.touch[position] = 0;
 		}
 		if ( debug )
 		{
-			printf("Chan %d, Baseline %d\n",
-				chan, senseChannels[chan].baseline );
+			printf("Chan %d, AIN %d, %s, Baseline %d, Gain %d%%\n",
+				chan, senseChannels[chan].ainChannel,
+				senseChannels[chan].enabled ? "enabled" : "disabled",
+				senseChannels[chan].baseline, senseChannels[chan].gain );
 		}
 	}
+	lastSave = time(NULL );
 }
-const char *positions[] = {
-	"None",
-	"Left Dorsal",
-	"Left Femoral" 
-};
 
 const char *touches[] = {
 	"None",
@@ -230,9 +509,14 @@ read_touch_sensors(void )
 {
 	int chan;
 	int pressure;
+	int save = 0;
 	
-	for ( chan = 0 ; chan < 2 ; chan++ )
+	for ( chan = 0 ; chan < SENSE_CHANNELS ; chan++ )
 	{
+		if ( ! senseChannels[chan].enabled )
+		{
+			continue;
+		}
 		read_touch_sensor(chan );
 	
 		pressure = senseChannels[chan].last;
@@ -246,81 +530,165 @@ read_touch_sensors(void )
 				case PULSE_LEFT_FEMORAL:
 					shmData->pulse.left_femoral = pressure;
 					break;
+				case PULSE_RIGHT_DORSAL:
+					shmData->pulse.right_dorsal = pressure;
+					break;
+				case PULSE_LEFT_DORSAL:
+					shmData->pulse.left_dorsal = pressure;
+					break;
 				default:
 					break;
 			}
 		}
+		if ( abs(senseChannels[chan].baseline - senseChannels[chan].savedBaseline ) > PULSE_CAL_SAVE_DIFF )
+		{
+			save = 1;
+		}
+	}
+	if ( save && ! debug && ( time(NULL ) - lastSave ) > PULSE_CAL_SAVE_SEC )
+	{
+		(void)save_calibration();
+	}
+}
+
+// Median of the channel history
+static int
+median_ain(struct senseChans *sc )
+{
+	int sorted[SENSE_MEDIAN];
+	int i;
+	int j;
+	int v;
+	int n = sc->histCount;
+	
+	for ( i = 0 ; i < n ; i++ )
+	{
+		v = sc->history[i];
+		for ( j = i ; j > 0 && sorted[j-1] > v ; j-- )
+		{
+			sorted[j] = sorted[j-1];
+		}
+		sorted[j] = v;
+	}
+	return ( sorted[n / 2] );
+}
+
+// Touch level for a pressure, given the current level (for hysteresis)
+static int
+touch_level(int diff, int current, int gain )
+{
+	static const int levels[] = { 0, SENSE_LO, SENSE_MID, SENSE_HI, SENSE_EXCESS };
+	int on = PULSE_TOUCH_NONE;
+	int limit;
+	int i;
+	
+	for ( i = PULSE_TOUCH_EXCESSIVE ; i > PULSE_TOUCH_NONE ; i-- )
+	{
+		limit = ( levels[i] * gain ) / 100;
+		if ( i > current )
+		{
+			limit += ( SENSE_HYSTERESIS * gain ) / 100;		// Going up
+		}
+		else
+		{
+			limit -= ( SENSE_HYSTERESIS * gain ) / 100;		// Staying or going down
+		}
+		if ( diff > limit )
+		{
+			on = i;
+			break;
+		}
 	}
+	return ( on );
 }
+
 void
 read_touch_sensor(int chan )
 {
 	int sensor;
 	int diff;
-	int on;
-	int ainChan = senseChannels[chan].ainChannel ;
-	int position = senseChannels[chan].position ;
+	struct senseChans *sc = &senseChannels[chan];
+	int ainChan = sc->ainChannel ;
+	int position = sc->position ;
+	int raw;
+	int level;
+	unsigned int now;
 	
 	sensor = read_ain(ainChan );
-	senseChannels[chan].ain = sensor;
+	now = msec_time();
+	raw = sensor;
 	
-	if ( ! debug )
-	{
-		shmData->pulse.ain[position] = sensor;
-	}
-	if ( ( sensor > 4096 ) || ( sensor < 0 ) )
+	if ( ( sensor > 4096 ) || ( sensor <= 0 ) )
 	{
 		sprintf(msgbuf, "bad sensor read %d", sensor );
 		if ( debug )
 		{
 			printf("%s\n", msgbuf );
 		}
-
-		senseChannels[chan].last = PULSE_TOUCH_NONE;
+		return;
 	}
-	else
+	sc->history[sc->histIdx] = sensor;
+	sc->histIdx = ( sc->histIdx + 1 ) % SENSE_MEDIAN;
+	if ( sc->histCount < SENSE_MEDIAN )
 	{
-		// Adjustments to the baseline
-		if ( sensor > senseChannels[chan].baseline )
-		{
-			senseChannels[chan].baseline = sensor;
-		}
-		else if ( sensor < ( senseChannels[chan].baseline - SENSE_OFFSET_ADJUST ) )
-		{
-			senseChannels[chan].baseline -= 5;
-		}
-		
-		diff = senseChannels[chan].baseline - sensor;
-
-		if ( diff > SENSE_EXCESS )	// Excessive touch
-		{
-			on = PULSE_TOUCH_EXCESSIVE;
-		}
-		else if ( diff > SENSE_HI )		// Heavy touch
-		{
-			on = PULSE_TOUCH_HEAVY ;
-		}
-		else if ( diff > SENSE_MID  )	// Good touch
-		{
-			on = PULSE_TOUCH_NORMAL;
-		}
-		else if (  diff > SENSE_LO )	// light touch
+		sc->histCount++;
+	}
+	sc->filtered += ( ( median_ain(sc ) << 4 ) - sc->filtered ) >> SENSE_IIR_SHIFT;
+	sensor = sc->filtered >> 4;
+	sc->ain = sensor;
+	
+	if ( ! debug )
+	{
+		shmData->pulse.ain[position] = sensor;
+	}
+	
+	// Adjustments to the baseline
+	if ( sensor > sc->baseline )
+	{
+		sc->baseline = sensor;
+		sc->driftCount = 0;
+	}
+	else if ( sensor < ( sc->baseline - SENSE_OFFSET_ADJUST ) )
+	{
+		if ( ++sc->driftCount >= SENSE_DRIFT_SAMPLES )
 		{
-			on = PULSE_TOUCH_LIGHT;
+			sc->baseline -= 1;
+			sc->driftCount = 0;
 		}
-		else	// No touch
+	}
+	
+	// Time stamp the raw press, ahead of the filter delay
+	if ( touch_level(sc->baseline - raw, sc->last, sc->gain ) != sc->last )
+	{
+		if ( sc->rawTime == 0 )
 		{
-			on = PULSE_TOUCH_NONE;
+			sc->rawTime = now;
 		}
-		senseChannels[chan].last = on;
+	}
+	else
+	{
+		sc->rawTime = 0;
+	}
 	
-		if ( ! debug )
+	diff = sc->baseline - sensor;
+	level = touch_level(diff, sc->last, sc->gain );
+
+	if ( ! debug )
+	{
+		shmData->pulse.base[position] = sc->baseline;
+		if ( level != sc->last )
 		{
-			shmData->pulse.base[position] = senseChannels[chan].baseline;
+			shmData->pulse.pressTime[position] = sc->rawTime ? sc->rawTime : now;
+			shmData->pulse.touchTime[position] = now;
+			shmData->pulse.detectLatency[position] = (int)( now - shmData->pulse.pressTime[position] );
+			shmData->pulse.touch[position] = level;
+			simEventPost(&shmData->pulse.touchSeq );
+			simTrace(SIM_TRACE_SENSOR, SIM_TRACE_SENSOR_PULSE + position, level );
 		}
 	}
-	if ( ! debug )
+	if ( level != sc->last )
 	{
-		shmData->pulse.touch[position] = senseChannels[chan].last;
+		sc->rawTime = 0;
 	}
+	sc->last = level;
 }
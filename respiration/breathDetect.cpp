@@ -0,0 +1,306 @@
+/*
+ * breathDetect.cpp
+ * Manual breath (bagging) detection on the breath pressure sample stream
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * All filtering is integer, with the signal held in Q8 (AIN counts * 256):
+ *
+ * 1: A short IIR low-pass removes sample noise.
+ * 2: The baseline follows the filtered signal slowly while idle, faster while
+ *    the signal is close to it, and drops immediately if the signal goes below it.
+ * 3: The noise floor is the mean absolute deviation from the baseline while idle.
+ *    The onset threshold is a multiple of it, but never below minThreshold.
+ * 4: Onset needs the signal over the threshold and rising (slope over the last
+ *    BREATH_SLOPE_SAMPLES) for BREATH_ONSET_SAMPLES samples in a row. A signal over
+ *    twice the threshold is accepted at once.
+ * 5: The breath ends when the signal stays under hysteresis % of the threshold
+ *    for BREATH_END_MS.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "breathDetect.h"
+
+#define BREATH_Q				8	// Fixed point fraction bits
+#define BREATH_LP_SHIFT			2	// Low-pass time constant, in samples (1 << 2)
+#define BREATH_BASE_SHIFT		8	// Baseline time constant near the baseline
+#define BREATH_DRIFT_SHIFT		11	// Baseline time constant away from the baseline
+#define BREATH_NOISE_SHIFT		7	// Noise floor time constant
+#define BREATH_MAX_DT_MS		50
+
+breathDetect::breathDetect(void )
+{
+	minThreshold = BREATH_MIN_THRESHOLD;
+	hysteresis = BREATH_HYSTERESIS;
+	minSlope = BREATH_MIN_SLOPE;
+	reset();
+}
+
+void
+breathDetect::reset(void )
+{
+	lp = 0;
+	base = 0;
+	noise = 0;
+	memset(hist, 0, sizeof(hist) );
+	histIdx = 0;
+	onsetCount = 0;
+	active = 0;
+	primed = 0;
+	lastSample = 0;
+	riseStart = 0;
+	belowStart = 0;
+	area = 0;
+
+	baseline = 0;
+	signal = 0;
+	noiseFloor = 0;
+	threshold = minThreshold;
+
+	count = 0;
+	onsetTime = 0;
+	latency = 0;
+	peak = 0;
+	volume = 0;
+	duration = 0;
+}
+
+/*
+ * addSample
+ *
+ * Process one AIN reading. msec is a monotonic time stamp for the sample.
+ *
+ * Returns BREATH_ONSET when a breath starts, BREATH_END when it is complete
+ * (results updated), BREATH_NONE otherwise.
+*/
+int
+breathDetect::addSample(int ain, unsigned int msec )
+{
+	int x;
+	int s;
+	int slope;
+	int dt;
+	int onQ;
+	int offQ;
+	int i;
+	int rval = BREATH_NONE;
+
+	if ( ain <= 0 )
+	{
+		// Failed read
+		return ( BREATH_NONE );
+	}
+	x = ain << BREATH_Q;
+	if ( ! primed )
+	{
+		lp = x;
+		base = x;
+		for ( i = 0 ; i < BREATH_SLOPE_SAMPLES ; i++ )
+		{
+			hist[i] = x;
+		}
+		lastSample = msec;
+		riseStart = msec;
+		primed = 1;
+		baseline = ain;
+		return ( BREATH_NONE );
+	}
+	dt = (int)( msec - lastSample );
+	lastSample = msec;
+	if ( dt > BREATH_MAX_DT_MS )
+	{
+		dt = BREATH_MAX_DT_MS;
+	}
+
+	lp += ( x - lp ) >> BREATH_LP_SHIFT;
+	slope = lp - hist[histIdx];
+	hist[histIdx] = lp;
+	histIdx = ( histIdx + 1 ) % BREATH_SLOPE_SAMPLES;
+
+	if ( lp < base )
+	{
+		base = lp;
+	}
+	s = lp - base;
+
+	onQ = noise * BREATH_NOISE_FACTOR;
+	if ( onQ < ( minThreshold << BREATH_Q ) )
+	{
+		onQ = minThreshold << BREATH_Q;
+	}
+	offQ = ( onQ * hysteresis ) / 100;
+
+	if ( ! active )
+	{
+		if ( s < onQ / 2 )
+		{
+			base += ( lp - base ) >> BREATH_BASE_SHIFT;
+			noise += ( abs(s ) - noise ) >> BREATH_NOISE_SHIFT;
+		}
+		else
+		{
+			base += ( lp - base ) >> BREATH_DRIFT_SHIFT;
+		}
+		if ( s <= ( noise * 2 ) || slope <= 0 )
+		{
+			riseStart = msec;
+		}
+		if ( s > onQ && slope > ( minSlope << BREATH_Q ) )
+		{
+			onsetCount++;
+		}
+		else
+		{
+			onsetCount = 0;
+		}
+		if ( onsetCount >= BREATH_ONSET_SAMPLES || s > ( onQ * 2 ) )
+		{
+			active = 1;
+			onsetCount = 0;
+			onsetTime = msec;
+			latency = msec - riseStart;
+			peak = 0;
+			area = 0;
+			belowStart = 0;
+			rval = BREATH_ONSET;
+		}
+	}
+	else
+	{
+		if ( s > 0 )
+		{
+			area += (long long)s * dt;
+		}
+		if ( ( s >> BREATH_Q ) > peak )
+		{
+			peak = s >> BREATH_Q;
+		}
+		if ( s < offQ )
+		{
+			if ( belowStart == 0 )
+			{
+				belowStart = msec;
+			}
+		}
+		else
+		{
+			belowStart = 0;
+		}
+		if ( ( belowStart && ( msec - belowStart >= BREATH_END_MS ) ) ||
+			 ( msec - onsetTime > BREATH_MAX_MS ) )
+		{
+			if ( msec - onsetTime > BREATH_MAX_MS )
+			{
+				// Held pressure. Take it as the new baseline rather than one long breath.
+				base = lp;
+			}
+			active = 0;
+			duration = msec - onsetTime;
+			volume = (int)( area >> BREATH_Q );
+			count++;
+			riseStart = msec;
+			rval = BREATH_END;
+		}
+	}
+	baseline = base >> BREATH_Q;
+	signal = s >> BREATH_Q;
+	noiseFloor = noise >> BREATH_Q;
+	threshold = onQ >> BREATH_Q;
+
+	return ( rval );
+}
+
+breathDetect::~breathDetect()
+{
+}
+
+breathLegacy::breathLegacy(void )
+{
+	reset(0 );
+}
+
+void
+breathLegacy::reset(int ain )
+{
+	sense = 0;
+	senseCount = 0;
+	activeLoops = 0;
+	baselineLoopCount = 0;
+	baseline = ain;
+	threshold = BREATH_LEGACY_THRESHOLD;
+	count = 0;
+}
+
+int
+breathLegacy::addSample(int ain )
+{
+	int rval = BREATH_NONE;
+
+	if ( ain == 0 )
+	{
+		senseCount = 0;
+		count = 0;
+		return ( BREATH_NONE );
+	}
+	if ( ain < baseline )
+	{
+		baseline = ain - 10;
+	}
+	switch ( sense )
+	{
+		case 0:
+			if ( ain > ( baseline + threshold ) )
+			{
+				senseCount++;
+				if ( senseCount >= 100 )
+				{
+					sense = 1;
+					senseCount = 0;
+					rval = BREATH_ONSET;
+				}
+			}
+			else if ( senseCount )
+			{
+				senseCount -= 1;
+			}
+			break;
+		case 1:
+			if ( ( ain < ( baseline + 2 ) ) ||
+				 ( activeLoops++ > 100 ) )
+			{
+				sense = 0;
+				senseCount = 0;
+				activeLoops = 0;
+				rval = BREATH_END;
+			}
+			break;
+	}
+	if ( ( baselineLoopCount++ > 100 ) && ( ain > ( baseline + 15 ) ) )
+	{
+		baseline += 1;
+		baselineLoopCount = 0;
+	}
+	count = senseCount;
+	return ( rval );
+}
+
+breathLegacy::~breathLegacy()
+{
+}
@@ -0,0 +1,109 @@
+/*
+ * breathDetect.h
+ * Manual breath (bagging) detection on the breath pressure sample stream
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BREATHDETECT_H_
+#define BREATHDETECT_H_
+
+// Return values from addSample()
+#define BREATH_NONE				0
+#define BREATH_ONSET			1	// Inflation detected
+#define BREATH_END				2	// Breath complete, results updated
+
+// Defaults. Values are in AIN counts unless noted.
+#define BREATH_MIN_THRESHOLD	20		// Lowest onset threshold above the baseline
+#define BREATH_NOISE_FACTOR		4		// Onset threshold is this many times the noise floor
+#define BREATH_HYSTERESIS		50		// End threshold, in % of the onset threshold
+#define BREATH_MIN_SLOPE		4		// Rise over BREATH_SLOPE_SAMPLES samples needed for onset
+#define BREATH_SLOPE_SAMPLES	8
+#define BREATH_ONSET_SAMPLES	3		// Consecutive samples over threshold and slope
+#define BREATH_END_MS			20		// Time below the end threshold that ends a breath
+#define BREATH_MAX_MS			4000	// Longest breath
+
+class breathDetect {
+
+private:
+	int lp;					// Low-pass filtered input, Q8
+	int base;				// Baseline (DC) estimate, Q8
+	int noise;				// Mean absolute deviation while idle, Q8
+	int hist[BREATH_SLOPE_SAMPLES];	// lp history, for the slope
+	int histIdx;
+	int onsetCount;
+	int active;
+	int primed;
+	unsigned int lastSample;
+	unsigned int riseStart;	// msec time the signal left the noise floor
+	unsigned int belowStart;
+	long long area;			// Q8 counts * msec
+
+public:
+	breathDetect(void );
+	void reset(void );
+	int addSample(int ain, unsigned int msec );
+
+	// Configuration
+	int minThreshold;
+	int hysteresis;
+	int minSlope;
+
+	// State
+	int baseline;			// Counts
+	int signal;				// Filtered counts over the baseline
+	int noiseFloor;			// Counts
+	int threshold;			// Current onset threshold, counts
+
+	// Results
+	unsigned int count;		// Breaths detected
+	unsigned int onsetTime;	// msec time of the last onset detection
+	int latency;			// msec from the start of the rise to onset detection
+	int peak;				// Peak pressure over the baseline, counts
+	int volume;				// Pressure-time area of the breath, count-msec
+	int duration;			// msec
+
+	virtual ~breathDetect();
+};
+
+/*
+ * The original breathSense algorithm, kept for comparison (breath_bench) and
+ * as a fallback (breathSense -L).
+*/
+#define BREATH_LEGACY_THRESHOLD	50
+
+class breathLegacy {
+
+private:
+	int sense;
+	int senseCount;
+	int activeLoops;
+	int baselineLoopCount;
+
+public:
+	breathLegacy(void );
+	void reset(int ain );
+	int addSample(int ain );
+
+	int baseline;
+	int threshold;
+	int count;				// Debounce count
+
+	virtual ~breathLegacy();
+};
+
+#endif /* BREATHDETECT_H_ */
@@ -41,30 +41,53 @@
 #include <string.h>
 #include "../comm/simUtil.h"
 #include "../comm/shmData.h"
+#include "../comm/simModule.h"
+#include "../comm/simTrace.h"
+#include "breathDetect.h"
 
 using namespace std;
 
+#ifndef SIM_HUB
 struct shmData *shmData;
+int debug = 0;
+#else
+extern struct shmData *shmData;
+extern int debug;
+#endif
 
 char msgbuf[2048];
 
 int type = 0;
-int debug = 0;
 int isDaemon = 0;
 int baseline = 0;
 int monitor = 0;
+int legacy = 0;
+FILE *record = NULL;
+breathDetect detect;
+breathLegacy old;
+
+#define BREATH_SAMPLE_US	2000
+
+int breathInit(void );
+void breathPoll(void );
+struct simModule breathModule = { "breathSense", SIM_MODULE_BREATH, breathInit, breathPoll, BREATH_SAMPLE_US, SIM_MODULE_NORMAL };
+
+unsigned int
+breathMsec(void )
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts );
+	return ( (unsigned int)( ts.tv_sec * 1000 + ts.tv_nsec / 1000000 ) );
+}
 
+#ifndef SIM_HUB
 int main(int argc, char *argv[])
 {
 	int c;
-	int ain;
-	int sense = 0;
-	int activeLoops;
-	int senseCount = 0;
 	opterr = 0;
-	int baselineLoopCount = 0;
 	
-	while (( c = getopt(argc, argv, "vDm" ) ) != -1 )
+	while (( c = getopt(argc, argv, "vDmLt:H:r:" ) ) != -1 )
 	{
 		switch ( c )
 		{
@@ -75,6 +98,11 @@ int main(int argc, char *argv[])
 			case 'v':
 				printf("Usage: %s\n", argv[0] );
 				printf("\t-D : Enable debug\n" );
+				printf("\t-m : Monitor\n" );
+				printf("\t-L : Use the original (legacy) detection\n" );
+				printf("\t-t <counts> : Minimum onset threshold (default %d)\n", BREATH_MIN_THRESHOLD );
+				printf("\t-H <percent> : End threshold as %% of onset threshold (default %d)\n", BREATH_HYSTERESIS );
+				printf("\t-r <file> : Record the AIN samples to a file (for breath_bench)\n" );
 				exit ( 0 );
 				break;
 				
@@ -83,6 +111,27 @@ int main(int argc, char *argv[])
 				debug = 1;
 				break;
 				
+			case 'L':
+				legacy = 1;
+				break;
+				
+			case 't':
+				detect.minThreshold = atoi(optarg );
+				break;
+				
+			case 'H':
+				detect.hysteresis = atoi(optarg );
+				break;
+				
+			case 'r':
+				record = fopen(optarg, "w" );
+				if ( record == NULL )
+				{
+					fprintf(stderr, "Cannot open %s: %s\n", optarg, strerror(errno) );
+					return 1;
+				}
+				break;
+				
 			case '?':
 				if (isprint (optopt))
 				  fprintf (stderr, "Unknown option `-%c'.\n", optopt);
@@ -109,79 +158,122 @@ int main(int argc, char *argv[])
 		while ( 1 )
 		{
 			usleep(250000 );
-			printf("AIN %d, Base %d, Manual %d\n",
+			printf("AIN %d, Base %d, Thresh %d, Noise %d, Manual %d, Latency %d, Peak %d, Volume %d\n",
 				shmData->manual_breath_ain,
 				shmData->manual_breath_baseline,
-				shmData->respiration.manual_breath );
+				shmData->manual_breath_threshold,
+				shmData->manual_breath_noise,
+				shmData->respiration.manual_breath,
+				shmData->manual_breath_latency,
+				shmData->manual_breath_peak,
+				shmData->manual_breath_volume );
 		}
 	}
+	struct simModule *modules[] = { &breathModule };
+	simModuleRun(modules, 1, 0 );
+	return ( 1 );
+}
+#endif
+
+/*
+ * Function: breathInit
+ *
+ * Module init. Takes the starting baseline and clears the results.
+ *
+ * Returns: 0
+ */
+int
+breathInit(void )
+{
 	while ( baseline == 0 )
 	{
 		baseline = read_ain(BREATH_AIN_CHANNEL );
 	}
-	sprintf(msgbuf, "Breath baseline: %d", baseline );
+	sprintf(msgbuf, "Breath baseline: %d%s", baseline, legacy ? " (legacy detection)" : "" );
 	log_message("", msgbuf); 
 	shmData->manual_breath_baseline = baseline;
+	old.reset(baseline );
+	
+	shmData->manual_breath_threshold = legacy ? old.threshold : detect.minThreshold;
+	shmData->manual_breath_count = 0;
+	shmData->manual_breath_noise = 0;
+	shmData->manual_breath_latency = 0;
+	shmData->manual_breath_peak = 0;
+	shmData->manual_breath_volume = 0;
+	
+	return ( 0 );
+}
+
+/*
+ * Function: breathPoll
+ *
+ * Module poll, every BREATH_SAMPLE_US
+ */
+void
+breathPoll(void )
+{
+	int ain;
+	int sts;
+	unsigned int now;
 	
-#define DEFAULT_THRESHOLD 50
-	shmData->manual_breath_threshold = DEFAULT_THRESHOLD;
-	shmData->manual_breath_count = senseCount;
+	ain = read_ain(BREATH_AIN_CHANNEL );
+	now = breathMsec();
+	shmData->manual_breath_ain = ain;
+	if ( record )
+	{
+		fprintf(record, "%u %d\n", now, ain );
+	}
+	if ( legacy )
+	{
+		sts = old.addSample(ain );
+		baseline = old.baseline;
+		shmData->manual_breath_count = old.count;
+	}
+	else
+	{
+		sts = detect.addSample(ain, now );
+		baseline = detect.baseline;
+	}
+	switch ( sts )
+	{
+		case BREATH_ONSET:
+			simTrace(SIM_TRACE_SENSOR, SIM_TRACE_SENSOR_BREATH, 1 );
+			shmData->respiration.active = 1;
+			if ( debug && ! legacy )
+			{
+				printf("Onset: latency %d ms, threshold %d, noise %d\n",
+					detect.latency, detect.threshold, detect.noiseFloor );
+			}
+			break;
+			
+		case BREATH_END:
+			simTrace(SIM_TRACE_SENSOR, SIM_TRACE_SENSOR_BREATH, 0 );
+			shmData->respiration.manual_breath = 1;
+			shmData->respiration.active = 0;
+			if ( ! legacy )
+			{
+				shmData->manual_breath_count = detect.count;
+				shmData->manual_breath_latency = detect.latency;
+				shmData->manual_breath_peak = detect.peak;
+				shmData->manual_breath_volume = detect.volume;
+			}
+			break;
+	}
 	
-	while ( 1 )
+	// Only write shared values when they change
+	if ( shmData->manual_breath_baseline != baseline )
 	{
-		usleep(2000 );	
-		ain = read_ain(BREATH_AIN_CHANNEL );
-		shmData->manual_breath_ain = ain;
-		if ( ain == 0 )
-		{
-			senseCount = 0;
-			continue;
-		}
-		if ( ain < baseline ) 
-		{
-			baseline = ain - 10;
-			shmData->manual_breath_baseline = baseline;
-		}
-		switch ( sense )
+		shmData->manual_breath_baseline = baseline;
+	}
+	if ( ! legacy )
+	{
+		if ( shmData->manual_breath_threshold != detect.threshold )
 		{
-			case 0:
-				if ( ain > (baseline + shmData->manual_breath_threshold ) )
-				{
-					senseCount++;
-					if ( senseCount >= 100 )
-					{
-						sense = 1;
-						shmData->respiration.active = 1;
-						senseCount = 0;
-					}
-				}
-				else if ( senseCount )
-				{
-					senseCount -= 1;
-				}
-				break;
-			case 1:
-				if ( (ain < ( baseline+2 )) || 
-					(activeLoops++ > 100) )
-				{
-					shmData->respiration.manual_breath = 1;
-					//sprintf(msgbuf, "Breath: %d, Baseline %d", ain, baseline );
-					//log_message("", msgbuf); 
-					sense = 0;
-					shmData->respiration.active = 0;
-					senseCount = 0;
-					activeLoops = 0;
-				}
-				break;
+			shmData->manual_breath_threshold = detect.threshold;
 		}
-		if ( (baselineLoopCount++ > 100) && (ain > (baseline+15)) )
+		if ( shmData->manual_breath_noise != detect.noiseFloor )
 		{
-			baseline += 1;
-			baselineLoopCount = 0;
-			shmData->manual_breath_baseline = baseline;
+			shmData->manual_breath_noise = detect.noiseFloor;
 		}
-
-		shmData->manual_breath_threshold = DEFAULT_THRESHOLD;
-		shmData->manual_breath_count = senseCount;
 	}
 }
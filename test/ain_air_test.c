@@ -93,10 +93,10 @@ int main(int argc, char *argv[])
 	}
 	
 	// Controls for Chest Rise/Fall
-	tankPin = gpioPinOpen(45, GPIO_OUTPUT );
-	riseLPin = gpioPinOpen(23, GPIO_OUTPUT );
-	riseRPin = gpioPinOpen(67, GPIO_OUTPUT );
-	fallPin = gpioPinOpen(68, GPIO_OUTPUT );
+	tankPin = gpioPinOpen(GPIO_PIN_TANK, GPIO_OUTPUT );
+	riseLPin = gpioPinOpen(GPIO_PIN_RISE_L, GPIO_OUTPUT );
+	riseRPin = gpioPinOpen(GPIO_PIN_RISE_R, GPIO_OUTPUT );
+	fallPin = gpioPinOpen(GPIO_PIN_FALL, GPIO_OUTPUT );
 
 	while ( 1 )
 	{
@@ -0,0 +1,348 @@
+/*
+ * beat_bench.cpp
+ *
+ * Check the beat engine (wav-trig/beatEngine.cpp) on simulated sim-mgr syncs
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Usage:
+ *	beat_bench [-v]
+ *
+ * Runs the engine as soundSense does, a tick every SOUND_LOOP_DELAY with the
+ * syncs received since the last tick passed in order, over a simulated
+ * timeline for each case: phase matching to a sim-mgr running late, holdover
+ * when the syncs stop, the compensatory pause after a VPC (local and from the
+ * sim-mgr), and couplets and triplets. -v lists the beats. Exits 0 if every
+ * check passed.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "../wav-trig/beatEngine.h"
+
+using namespace std;
+
+#define TICK_US			20000		// soundSense loop period
+#define RATE			60
+#define RR_US			( 60000000LL / RATE )
+#define START_US		1000000ULL	// Clear of 0, which the engine takes as "never"
+
+struct sync
+{
+	unsigned long long atUs;
+	int vpc;
+};
+
+struct beat
+{
+	unsigned long long atUs;
+	int type;
+};
+
+static int verbose = 0;
+static int failed = 0;
+
+/*
+ * Function: run
+ *
+ * Tick the engine from START_US to endUs, passing each sync at the first tick
+ * after it, as runBeats does: the clock first, then the syncs, stopping at one
+ * that plays a beat.
+ */
+static void
+run(struct beatEngine *be, const vector<struct sync> &syncs, unsigned long long endUs, vector<struct beat> &beats )
+{
+	unsigned long long now;
+	unsigned long long due;
+	size_t next = 0;
+	int type;
+	int remote;
+
+	for ( now = START_US ; now <= endUs ; now += TICK_US )
+	{
+		due = 0;
+		type = beatEngineTick(be, now, &due );
+		while ( next < syncs.size() && syncs[next].atUs <= now )
+		{
+			remote = beatEngineRemote(be, syncs[next].vpc, syncs[next].atUs );
+			next++;
+			if ( remote != BEAT_NONE )
+			{
+				type = remote;
+				due = syncs[next - 1].atUs;
+				break;
+			}
+		}
+		if ( type != BEAT_NONE )
+		{
+			struct beat b = { due, type };
+			beats.push_back(b );
+			if ( verbose )
+			{
+				printf("  %8.3f %s\n", ( due - START_US ) / 1e6, type == BEAT_VPC ? "VPC" : "sinus" );
+			}
+		}
+	}
+}
+
+static void
+check(const char *test, int ok, const char *what )
+{
+	if ( ! ok )
+	{
+		printf("%s: %s\n", test, what );
+		failed++;
+	}
+}
+
+static void
+report(const char *test, struct beatEngine *be )
+{
+	char buf[512];
+
+	beatEngineReport(be, buf, sizeof(buf) );
+	printf("%s: %s\n", test, buf );
+}
+
+static void
+syncsEvery(vector<struct sync> &syncs, unsigned long long fromUs, unsigned long long toUs, long long offsetUs )
+{
+	unsigned long long t;
+
+	for ( t = fromUs ; t <= toUs ; t += RR_US )
+	{
+		struct sync s = { t + offsetUs, 0 };
+		syncs.push_back(s );
+	}
+}
+
+/*
+ * Function: testPhase
+ *
+ * The sim-mgr's pulse runs 150 ms behind the first beat. Every sync after the
+ * first must be matched to a beat already played, and the clock must pull in
+ * to within a tick of the sim-mgr.
+ */
+static void
+testPhase(void )
+{
+	struct beatEngine be;
+	vector<struct sync> syncs;
+	vector<struct beat> beats;
+	long long err;
+
+	beatEngineInit(&be, 1 );
+	beatEngineSetRate(&be, RATE );
+	syncsEvery(syncs, START_US, START_US + 30 * RR_US, 0 );
+	for ( size_t i = 1 ; i < syncs.size() ; i++ )
+	{
+		syncs[i].atUs += 150000;
+	}
+	run(&be, syncs, START_US + 30 * RR_US + 200000, beats );
+	report("phase", &be );
+	check("phase", be.stats.sinus == syncs.size(), "a beat was played twice or missed" );
+	check("phase", be.stats.matched == syncs.size() - 1, "a sync was not matched to its beat" );
+	err = (long long)( syncs.back().atUs - beats.back().atUs );
+	check("phase", err >= 0 && err <= TICK_US, "the clock did not pull in to the sim-mgr" );
+}
+
+/*
+ * Function: testHoldover
+ *
+ * The syncs stop for 10 intervals. The clock must play BEAT_HOLDOVER beats on
+ * its own, then wait, and take up again with the next sync.
+ */
+static void
+testHoldover(void )
+{
+	struct beatEngine be;
+	vector<struct sync> syncs;
+	vector<struct beat> beats;
+	unsigned long long lastSync = START_US + 5 * RR_US;
+	unsigned long long resume = lastSync + 10 * RR_US;
+	int during = 0;
+	int after = 0;
+
+	beatEngineInit(&be, 1 );
+	beatEngineSetRate(&be, RATE );
+	syncsEvery(syncs, START_US, lastSync, 0 );
+	syncsEvery(syncs, resume, resume + 5 * RR_US, 0 );
+	run(&be, syncs, resume + 5 * RR_US + 200000, beats );
+	report("holdover", &be );
+	for ( size_t i = 0 ; i < beats.size() ; i++ )
+	{
+		if ( beats[i].atUs > lastSync && beats[i].atUs < resume )
+		{
+			during++;
+		}
+		if ( beats[i].atUs >= resume )
+		{
+			after++;
+		}
+	}
+	check("holdover", during == BEAT_HOLDOVER, "wrong number of beats with no sim-mgr syncs" );
+	check("holdover", be.stats.holdovers == 1, "the clock did not stop" );
+	check("holdover", after == 6, "the beats did not take up again with the syncs" );
+}
+
+/*
+ * Function: vpcRuns
+ *
+ * Check each run of VPCs in beats: count VPCs long, and the sinus beat after it
+ * outside the refractory period of the last VPC and at a whole number of
+ * intervals (within a tick) after the sinus beat before the run. A run still
+ * open at the end is not checked.
+ *
+ * Returns: The number of VPCs in the checked runs
+ */
+static int
+vpcRuns(const char *test, const vector<struct beat> &beats, int count )
+{
+	unsigned long long sinusBefore = 0;
+	long long gap;
+	long long rem;
+	int run = 0;
+	int runs = 0;
+	int badLength = 0;
+	int badPause = 0;
+
+	for ( size_t i = 0 ; i < beats.size() ; i++ )
+	{
+		if ( beats[i].type == BEAT_VPC )
+		{
+			run++;
+			continue;
+		}
+		if ( run )
+		{
+			runs++;
+			if ( run != count )
+			{
+				badLength++;
+			}
+			gap = (long long)( beats[i].atUs - beats[i - 1].atUs );
+			rem = (long long)( beats[i].atUs - sinusBefore ) % RR_US;
+			if ( gap < RR_US * BEAT_VPC_REFRACTORY || ( rem > TICK_US && rem < RR_US - TICK_US ) )
+			{
+				badPause++;
+			}
+			run = 0;
+		}
+		sinusBefore = beats[i].atUs;
+	}
+	check(test, runs > 0, "no VPC runs" );
+	check(test, badLength == 0, "a VPC run of the wrong length" );
+	check(test, badPause == 0, "a sinus beat in the refractory period or off the sinus clock" );
+	return ( runs * count );
+}
+
+/*
+ * Function: testVpcLocal
+ *
+ * VPCs inserted here, count in a run, after every sinus beat. Every run must
+ * have the compensatory pause: the sinus beats it falls on are blocked, and
+ * the sim-mgr's pulses for them are matched, not played.
+ */
+static void
+testVpcLocal(const char *test, const char *vpc, int count, int blockedPerRun )
+{
+	struct beatEngine be;
+	vector<struct sync> syncs;
+	vector<struct beat> beats;
+	unsigned int vpcs;
+	int open = 0;
+
+	beatEngineInit(&be, 1 );
+	beatEngineSetRate(&be, RATE );
+	check(test, beatEngineSetVpc(&be, vpc, 100 ) == 0, "VPC setting not taken" );
+	syncsEvery(syncs, START_US, START_US + 20 * RR_US, 0 );
+	run(&be, syncs, START_US + 20 * RR_US + 200000, beats );
+	report(test, &be );
+	vpcs = vpcRuns(test, beats, count );
+	while ( open < (int)beats.size() && beats[beats.size() - 1 - open].type == BEAT_VPC )
+	{
+		open++;
+	}
+	check(test, be.stats.vpcs == vpcs + open, "VPCs outside a run" );
+	check(test, be.stats.blocked >= ( vpcs / count ) * blockedPerRun, "sinus beats not blocked" );
+	check(test, be.stats.sinus + be.stats.vpcs == beats.size(), "a beat counted but not played" );
+}
+
+/*
+ * Function: testVpcRemote
+ *
+ * VPCs off here; the sim-mgr sends a pulseVPC 600 ms after every third pulse.
+ * Each must play as a VPC and block the sinus beat after it.
+ */
+static void
+testVpcRemote(void )
+{
+	struct beatEngine be;
+	vector<struct sync> syncs;
+	vector<struct beat> beats;
+	unsigned long long t;
+	int n;
+
+	beatEngineInit(&be, 1 );
+	beatEngineSetRate(&be, RATE );
+	for ( t = START_US, n = 0 ; t <= START_US + 20 * RR_US ; t += RR_US, n++ )
+	{
+		struct sync s = { t, 0 };
+		syncs.push_back(s );
+		if ( n % 3 == 0 )
+		{
+			struct sync v = { t + (unsigned long long)( RR_US * BEAT_VPC_COUPLING ), 1 };
+			syncs.push_back(v );
+		}
+	}
+	run(&be, syncs, START_US + 20 * RR_US + 200000, beats );
+	report("sim-mgr VPC", &be );
+	check("sim-mgr VPC", vpcRuns("sim-mgr VPC", beats, 1 ) == (int)be.stats.vpcs, "a VPC outside a run" );
+	check("sim-mgr VPC", be.stats.vpcs == be.stats.remoteVpcs, "a pulseVPC was not played" );
+	check("sim-mgr VPC", be.stats.blocked == be.stats.vpcs, "a sinus beat after a VPC was not blocked" );
+}
+
+int
+main(int argc, char *argv[] )
+{
+	int c;
+
+	while ( ( c = getopt(argc, argv, "v" ) ) != -1 )
+	{
+		switch ( c )
+		{
+			case 'v':
+				verbose = 1;
+				break;
+			default:
+				printf("Usage: %s [-v]\n", argv[0] );
+				exit ( 1 );
+		}
+	}
+	testPhase();
+	testHoldover();
+	testVpcLocal("VPC", "1-1", 1, 1 );
+	testVpcLocal("couplet", "1-2", 2, 1 );
+	testVpcLocal("triplet", "1-3", 3, 2 );
+	testVpcRemote();
+	printf("%s: %d failed\n", failed ? "FAIL" : "PASS", failed );
+	return ( failed ? 1 : 0 );
+}
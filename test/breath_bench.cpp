@@ -0,0 +1,342 @@
+/*
+ * breath_bench.cpp
+ *
+ * Compare breath detection delay of breathDetect against the original algorithm
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Usage:
+ *	breath_bench <file> [<file> ...]	Run recordings made with "breathSense -D -r <file>"
+ *	breath_bench -s [seed]				Run a generated waveform
+ *
+ * Each detection is matched to the start of its breath, taken offline (looking
+ * at the whole recording) as the point where the smoothed signal last rose
+ * through 10% of the breath amplitude. The delay from there to the detection is
+ * reported for both algorithms.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "../respiration/breathDetect.h"
+
+using namespace std;
+
+#define SMOOTH_HALF			8		// Samples each side for the offline smoothing
+#define FOOT_WINDOW_MS		2000	// Search window for the breath start
+#define MATCH_MS			100		// Detections this close to the same start are the same breath
+
+struct sample
+{
+	unsigned int msec;
+	int ain;
+};
+
+struct breath
+{
+	unsigned int start;
+	int newDelay;		// -1 if not detected
+	int oldDelay;
+};
+
+vector<struct sample> samples;
+vector<int> smooth;
+vector<struct breath> breaths;
+
+static int
+loadFile(const char *name )
+{
+	FILE *fp;
+	unsigned int msec;
+	int ain;
+
+	fp = fopen(name, "r" );
+	if ( fp == NULL )
+	{
+		perror(name );
+		return ( -1 );
+	}
+	while ( fscanf(fp, "%u %d", &msec, &ain ) == 2 )
+	{
+		struct sample s = { msec, ain };
+		samples.push_back(s );
+	}
+	fclose(fp );
+	return ( 0 );
+}
+
+// Breaths of random size and shape on a drifting, noisy baseline, 2 ms sampling
+static void
+generate(unsigned int seed )
+{
+	unsigned int msec = 0;
+	unsigned int next = 2000;
+	int amplitude = 0;
+	int rise = 0;
+	int hold = 0;
+	int fall = 0;
+	unsigned int start = 0;
+	int base;
+	int level;
+	int t;
+	int ain;
+
+	srand(seed );
+	while ( msec < 120000 )
+	{
+		base = 1500 + (int)( ( msec / 1000 ) % 40 ) - 20;
+		if ( msec >= next && amplitude == 0 )
+		{
+			start = msec;
+			amplitude = 60 + rand() % 240;
+			rise = 250 + rand() % 450;
+			hold = 100 + rand() % 300;
+			fall = 300 + rand() % 500;
+		}
+		level = 0;
+		if ( amplitude )
+		{
+			t = msec - start;
+			if ( t < rise )
+			{
+				level = ( amplitude * t ) / rise;
+			}
+			else if ( t < rise + hold )
+			{
+				level = amplitude;
+			}
+			else if ( t < rise + hold + fall )
+			{
+				level = amplitude - ( amplitude * ( t - rise - hold ) ) / fall;
+			}
+			else
+			{
+				amplitude = 0;
+				next = msec + 1500 + rand() % 3000;
+			}
+		}
+		ain = base + level + ( rand() % 9 ) - 4;
+		struct sample s = { msec, ain };
+		samples.push_back(s );
+		msec += 2 + ( rand() % 3 == 0 ? 1 : 0 );	// read_ain jitter
+	}
+}
+
+static void
+smoothSamples(void )
+{
+	int n = samples.size();
+	int i;
+	int j;
+	int sum;
+	int cnt;
+
+	smooth.resize(n );
+	for ( i = 0 ; i < n ; i++ )
+	{
+		sum = 0;
+		cnt = 0;
+		for ( j = i - SMOOTH_HALF ; j <= i + SMOOTH_HALF ; j++ )
+		{
+			if ( j >= 0 && j < n )
+			{
+				sum += samples[j].ain;
+				cnt++;
+			}
+		}
+		smooth[i] = sum / cnt;
+	}
+}
+
+// Offline start of the breath containing sample idx
+static unsigned int
+breathStart(int idx )
+{
+	int n = samples.size();
+	int lo = idx;
+	int hi = idx;
+	int j;
+	int minVal;
+	int maxVal;
+	int level;
+
+	while ( lo > 0 && samples[idx].msec - samples[lo].msec < FOOT_WINDOW_MS )
+	{
+		lo--;
+	}
+	while ( hi < n - 1 && samples[hi].msec - samples[idx].msec < FOOT_WINDOW_MS / 2 )
+	{
+		hi++;
+	}
+	minVal = smooth[idx];
+	for ( j = lo ; j <= idx ; j++ )
+	{
+		if ( smooth[j] < minVal )
+		{
+			minVal = smooth[j];
+		}
+	}
+	maxVal = smooth[idx];
+	for ( j = idx ; j <= hi ; j++ )
+	{
+		if ( smooth[j] > maxVal )
+		{
+			maxVal = smooth[j];
+		}
+	}
+	level = minVal + ( maxVal - minVal ) / 10;
+	for ( j = idx ; j > lo ; j-- )
+	{
+		if ( smooth[j] <= level )
+		{
+			break;
+		}
+	}
+	return ( samples[j].msec );
+}
+
+static void
+addDetection(int idx, int isNew )
+{
+	unsigned int start = breathStart(idx );
+	int delay = samples[idx].msec - start;
+	unsigned int i;
+
+	for ( i = 0 ; i < breaths.size() ; i++ )
+	{
+		if ( abs((int)( breaths[i].start - start ) ) < MATCH_MS )
+		{
+			break;
+		}
+	}
+	if ( i == breaths.size() )
+	{
+		struct breath b = { start, -1, -1 };
+		breaths.push_back(b );
+	}
+	if ( isNew )
+	{
+		breaths[i].newDelay = delay;
+	}
+	else
+	{
+		breaths[i].oldDelay = delay;
+	}
+}
+
+static void
+report(void )
+{
+	unsigned int i;
+	int newCount = 0;
+	int oldCount = 0;
+	int newSum = 0;
+	int oldSum = 0;
+	int newMax = 0;
+	int oldMax = 0;
+
+	printf("%8s %8s %8s\n", "start", "new", "legacy" );
+	for ( i = 0 ; i < breaths.size() ; i++ )
+	{
+		printf("%8u ", breaths[i].start );
+		if ( breaths[i].newDelay >= 0 )
+		{
+			printf("%8d ", breaths[i].newDelay );
+			newCount++;
+			newSum += breaths[i].newDelay;
+			if ( breaths[i].newDelay > newMax )
+			{
+				newMax = breaths[i].newDelay;
+			}
+		}
+		else
+		{
+			printf("%8s ", "-" );
+		}
+		if ( breaths[i].oldDelay >= 0 )
+		{
+			printf("%8d\n", breaths[i].oldDelay );
+			oldCount++;
+			oldSum += breaths[i].oldDelay;
+			if ( breaths[i].oldDelay > oldMax )
+			{
+				oldMax = breaths[i].oldDelay;
+			}
+		}
+		else
+		{
+			printf("%8s\n", "-" );
+		}
+	}
+	printf("\nBreaths: %d\n", (int)breaths.size() );
+	printf("new:    detected %d, mean delay %d ms, max %d ms\n",
+		newCount, newCount ? newSum / newCount : 0, newMax );
+	printf("legacy: detected %d, mean delay %d ms, max %d ms\n",
+		oldCount, oldCount ? oldSum / oldCount : 0, oldMax );
+}
+
+int
+main(int argc, char *argv[] )
+{
+	breathDetect detect;
+	breathLegacy old;
+	unsigned int i;
+	int a;
+
+	if ( argc < 2 )
+	{
+		printf("Usage: %s <file> [<file> ...] | -s [seed]\n", argv[0] );
+		return ( 1 );
+	}
+	if ( strcmp(argv[1], "-s" ) == 0 )
+	{
+		generate(argc > 2 ? atoi(argv[2] ) : 1 );
+	}
+	else
+	{
+		for ( a = 1 ; a < argc ; a++ )
+		{
+			if ( loadFile(argv[a] ) < 0 )
+			{
+				return ( 1 );
+			}
+		}
+	}
+	if ( samples.size() == 0 )
+	{
+		printf("No samples\n" );
+		return ( 1 );
+	}
+	smoothSamples();
+
+	old.reset(samples[0].ain );
+	for ( i = 0 ; i < samples.size() ; i++ )
+	{
+		if ( detect.addSample(samples[i].ain, samples[i].msec ) == BREATH_ONSET )
+		{
+			addDetection(i, 1 );
+		}
+		if ( old.addSample(samples[i].ain ) == BREATH_ONSET )
+		{
+			addDetection(i, 0 );
+		}
+	}
+	report();
+	return ( 0 );
+}
@@ -0,0 +1,163 @@
+/*
+ * catalog_test.cpp
+ *
+ * Check the sound catalog parse (wav-trig/soundCatalog.cpp) on a generated soundList
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Usage:
+ *	catalog_test [-k]
+ *
+ * Writes a soundList.csv with each sound type (heartref, the longest type
+ * name, included) and the separators the simulator's lists use, builds the
+ * catalog from it, opens the catalog and checks every entry. Lines with an
+ * unknown type or too few fields must be rejected. The files are made in
+ * /tmp and removed, unless -k is given. Exits 0 if every check passed.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../wav-trig/soundCatalog.h"
+#include "../comm/shmData.h"
+
+struct shmData *shmData;
+int debug = 0;
+
+static const char testCsv[] =
+	"heart,112,normal,0,60\n"
+	"heartref,150,normal,90,0\n"
+	"heartref;151;systolic murmur;120;0\n"
+	"lung\t400\tnormal\t0\t15\n"
+	"pulse,102,pulse,0,0\n"
+	"general,5,Bark,0,0\n"
+	"\n"
+	"heartbeat,160,normal,0,60\n"		// Unknown type
+	"lung,401,normal\n";				// Too few fields
+
+static const struct sound expect[] =
+{
+	{ SOUND_TYPE_HEART, 112, "normal", 0, 60 },
+	{ SOUND_TYPE_HEART_REF, 150, "normal", 90, 0 },
+	{ SOUND_TYPE_HEART_REF, 151, "systolic_murmur", 120, 0 },
+	{ SOUND_TYPE_LUNG, 400, "normal", 0, 15 },
+	{ SOUND_TYPE_PULSE, 102, "pulse", 0, 0 },
+	{ SOUND_TYPE_GENERAL, 5, "Bark", 0, 0 },
+};
+#define EXPECT_COUNT	(int)( sizeof(expect ) / sizeof(struct sound ) )
+
+static int
+checkEntries(const char *what, const struct sound *sounds, int count )
+{
+	int failed = 0;
+	int i;
+
+	if ( count != EXPECT_COUNT )
+	{
+		printf("%s: %d entries, expected %d\n", what, count, EXPECT_COUNT );
+		failed++;
+	}
+	for ( i = 0 ; i < count && i < EXPECT_COUNT ; i++ )
+	{
+		if ( sounds[i].type != expect[i].type || sounds[i].index != expect[i].index ||
+			 strcmp(sounds[i].name, expect[i].name ) != 0 ||
+			 sounds[i].low_limit != expect[i].low_limit || sounds[i].high_limit != expect[i].high_limit )
+		{
+			printf("%s: entry %d is %s,%d,%s,%d,%d, expected %s,%d,%s,%d,%d\n", what, i,
+				sounds[i].type >= 0 && sounds[i].type < SOUND_TYPES ? soundTypeNames[sounds[i].type] : "?",
+				sounds[i].index, sounds[i].name, sounds[i].low_limit, sounds[i].high_limit,
+				soundTypeNames[expect[i].type], expect[i].index, expect[i].name,
+				expect[i].low_limit, expect[i].high_limit );
+			failed++;
+		}
+	}
+	return ( failed );
+}
+
+int
+main(int argc, char *argv[] )
+{
+	char csvName[64];
+	char binName[64];
+	struct soundCatalog cat;
+	struct sound *list = NULL;
+	FILE *fp;
+	int keep = 0;
+	int count = 0;
+	int failed = 0;
+	int c;
+	int i;
+
+	while ( ( c = getopt(argc, argv, "k" ) ) != -1 )
+	{
+		switch ( c )
+		{
+			case 'k':
+				keep = 1;
+				break;
+			default:
+				printf("Usage: %s [-k]\n", argv[0] );
+				exit ( 1 );
+		}
+	}
+	snprintf(csvName, sizeof(csvName), "/tmp/catalog_test_%d.csv", (int)getpid() );
+	snprintf(binName, sizeof(binName), "/tmp/catalog_test_%d.bin", (int)getpid() );
+	fp = fopen(csvName, "w" );
+	if ( fp == NULL || fputs(testCsv, fp ) < 0 || fclose(fp ) != 0 )
+	{
+		printf("Can't write %s\n", csvName );
+		exit ( 1 );
+	}
+
+	if ( soundCatalogBuild(csvName, binName, &list, &count ) != 0 )
+	{
+		printf("soundCatalogBuild failed\n" );
+		failed++;
+	}
+	failed += checkEntries("build", list, count );
+	free(list );
+
+	memset(&cat, 0, sizeof(cat) );
+	if ( soundCatalogOpen(&cat, csvName, binName ) != 0 )
+	{
+		printf("soundCatalogOpen failed\n" );
+		failed++;
+	}
+	else
+	{
+		failed += checkEntries("open", cat.sounds, cat.count );
+		for ( i = 0 ; i < cat.count && cat.sounds[i].type != SOUND_TYPE_HEART_REF ; i++ )
+		{
+		}
+		if ( i == cat.count )
+		{
+			printf("open: no heartref entry\n" );
+			failed++;
+		}
+		soundCatalogClose(&cat );
+	}
+
+	if ( ! keep )
+	{
+		unlink(csvName );
+		unlink(binName );
+	}
+	printf("%s: %d failed\n", failed ? "FAIL" : "PASS", failed );
+	return ( failed ? 1 : 0 );
+}
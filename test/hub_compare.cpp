@@ -0,0 +1,304 @@
+/*
+ * hub_compare.cpp
+ *
+ * Measure CPU use, context switches and module poll latency of the running
+ * sim-ctl processes, for comparing the multi-process layout against simHub
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Usage:
+ *	hub_compare [-t seconds] [-l label]
+ *
+ * Run it once with the daemons running and once with simHub (hub_compare.sh does
+ * both). The module statistics come from shmData->modules, which both layouts
+ * fill in the same way; the maxima are cleared at the start of the run.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <dirent.h>
+#include <limits.h>
+
+#include "../comm/simUtil.h"
+#include "../comm/shmData.h"
+
+struct shmData *shmData;
+int debug = 0;
+
+const char *procNames[] =
+{
+	"simController", "simHub", "soundSense", "pulse", "breathSense", "cprScan", "rfidScan"
+};
+#define PROC_NAMES	(int)(sizeof(procNames) / sizeof(const char *))
+
+// A /proc path with a pid and a directory entry name (at most NAME_MAX)
+#define PROC_PATH_LEN	( 64 + NAME_MAX )
+
+struct procSample
+{
+	int pid;
+	unsigned long long ticks;		// utime + stime, all threads
+	unsigned long long switches;	// voluntary + nonvoluntary, all threads
+};
+
+struct sysSample
+{
+	unsigned long long busy;
+	unsigned long long total;
+	unsigned long long ctxt;
+};
+
+static int
+findPid(const char *name )
+{
+	DIR *dir;
+	struct dirent *de;
+	char path[PROC_PATH_LEN];
+	char comm[64];
+	FILE *fp;
+	int pid = 0;
+
+	dir = opendir("/proc" );
+	if ( dir == NULL )
+	{
+		return ( 0 );
+	}
+	while ( pid == 0 && ( de = readdir(dir ) ) != NULL )
+	{
+		if ( de->d_name[0] < '0' || de->d_name[0] > '9' )
+		{
+			continue;
+		}
+		snprintf(path, sizeof(path), "/proc/%s/comm", de->d_name );
+		fp = fopen(path, "r" );
+		if ( fp == NULL )
+		{
+			continue;
+		}
+		if ( fgets(comm, sizeof(comm), fp ) )
+		{
+			comm[strcspn(comm, "\n" )] = 0;
+			if ( strcmp(comm, name ) == 0 )
+			{
+				pid = atoi(de->d_name );
+			}
+		}
+		fclose(fp );
+	}
+	closedir(dir );
+	return ( pid );
+}
+
+// Sum the CPU ticks and context switches of every thread of the process
+static void
+sampleProc(struct procSample *ps )
+{
+	DIR *dir;
+	struct dirent *de;
+	char path[PROC_PATH_LEN];
+	char line[512];
+	char *p;
+	FILE *fp;
+	unsigned long utime;
+	unsigned long stime;
+	unsigned long long n;
+
+	ps->ticks = 0;
+	ps->switches = 0;
+	snprintf(path, sizeof(path), "/proc/%d/task", ps->pid );
+	dir = opendir(path );
+	if ( dir == NULL )
+	{
+		return;
+	}
+	while ( ( de = readdir(dir ) ) != NULL )
+	{
+		if ( de->d_name[0] < '0' || de->d_name[0] > '9' )
+		{
+			continue;
+		}
+		snprintf(path, sizeof(path), "/proc/%d/task/%s/stat", ps->pid, de->d_name );
+		fp = fopen(path, "r" );
+		if ( fp )
+		{
+			// Fields after the command name, which may contain spaces
+			if ( fgets(line, sizeof(line), fp ) && ( p = strrchr(line, ')' ) ) != NULL )
+			{
+				if ( sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime ) == 2 )
+				{
+					ps->ticks += utime + stime;
+				}
+			}
+			fclose(fp );
+		}
+		snprintf(path, sizeof(path), "/proc/%d/task/%s/status", ps->pid, de->d_name );
+		fp = fopen(path, "r" );
+		if ( fp )
+		{
+			while ( fgets(line, sizeof(line), fp ) )
+			{
+				if ( sscanf(line, "voluntary_ctxt_switches: %llu", &n ) == 1 ||
+					 sscanf(line, "nonvoluntary_ctxt_switches: %llu", &n ) == 1 )
+				{
+					ps->switches += n;
+				}
+			}
+			fclose(fp );
+		}
+	}
+	closedir(dir );
+}
+
+static void
+sampleSys(struct sysSample *ss )
+{
+	FILE *fp;
+	char line[256];
+	unsigned long long v[8];
+
+	memset(ss, 0, sizeof(struct sysSample) );
+	fp = fopen("/proc/stat", "r" );
+	if ( fp == NULL )
+	{
+		return;
+	}
+	while ( fgets(line, sizeof(line), fp ) )
+	{
+		if ( sscanf(line, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+				&v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7] ) == 8 )
+		{
+			ss->total = v[0] + v[1] + v[2] + v[3] + v[4] + v[5] + v[6] + v[7];
+			ss->busy = ss->total - v[3] - v[4];		// Less idle and iowait
+		}
+		sscanf(line, "ctxt %llu", &ss->ctxt );
+	}
+	fclose(fp );
+}
+
+int
+main(int argc, char *argv[] )
+{
+	struct procSample before[PROC_NAMES];
+	struct procSample after[PROC_NAMES];
+	struct moduleStats start[SIM_MODULES_MAX];
+	struct sysSample sysBefore;
+	struct sysSample sysAfter;
+	const char *label = "";
+	long hz = sysconf(_SC_CLK_TCK );
+	int seconds = 60;
+	unsigned long long ticks = 0;
+	unsigned long long switches = 0;
+	unsigned int maxLatency = 0;
+	unsigned int overruns = 0;
+	int c;
+	int i;
+
+	while (( c = getopt(argc, argv, "t:l:h" ) ) != -1 )
+	{
+		switch ( c )
+		{
+			case 't':
+				seconds = atoi(optarg );
+				break;
+			case 'l':
+				label = optarg;
+				break;
+			default:
+				printf("Usage: %s [-t seconds] [-l label]\n", argv[0] );
+				return ( 1 );
+		}
+	}
+	if ( seconds < 1 )
+	{
+		seconds = 1;
+	}
+	if ( initSHM(SHM_OPEN ) )
+	{
+		printf("initSHM failed. Is simController running?\n" );
+		return ( 1 );
+	}
+
+	for ( i = 0 ; i < SIM_MODULES_MAX ; i++ )
+	{
+		shmData->modules[i].latencyMax = 0;
+		shmData->modules[i].runMax = 0;
+		start[i] = shmData->modules[i];
+	}
+	for ( i = 0 ; i < PROC_NAMES ; i++ )
+	{
+		before[i].pid = findPid(procNames[i] );
+		sampleProc(&before[i] );
+	}
+	sampleSys(&sysBefore );
+
+	sleep(seconds );
+
+	sampleSys(&sysAfter );
+	for ( i = 0 ; i < PROC_NAMES ; i++ )
+	{
+		after[i].pid = before[i].pid;
+		sampleProc(&after[i] );
+	}
+
+	printf("%s: %d seconds\n\n", label[0] ? label : "Run", seconds );
+	printf("%-14s %7s %8s %10s\n", "process", "pid", "cpu %", "switch/s" );
+	for ( i = 0 ; i < PROC_NAMES ; i++ )
+	{
+		if ( before[i].pid == 0 )
+		{
+			continue;
+		}
+		printf("%-14s %7d %8.2f %10.1f\n", procNames[i], before[i].pid,
+			( 100.0 * ( after[i].ticks - before[i].ticks ) ) / ( (double)hz * seconds ),
+			(double)( after[i].switches - before[i].switches ) / seconds );
+		ticks += after[i].ticks - before[i].ticks;
+		switches += after[i].switches - before[i].switches;
+	}
+
+	printf("\n%-12s %7s %8s %11s %11s %9s %9s\n", "module", "polls/s", "overruns",
+		"latency avg", "latency max", "run avg", "run max" );
+	for ( i = 0 ; i < SIM_MODULES_MAX ; i++ )
+	{
+		struct moduleStats *ms = &shmData->modules[i];
+
+		if ( ms->name[0] == 0 || ms->pid == 0 )
+		{
+			continue;
+		}
+		printf("%-12s %7.1f %8u %9u us %9u us %6u us %6u us\n", ms->name,
+			(double)( ms->runs - start[i].runs ) / seconds,
+			ms->overruns - start[i].overruns,
+			ms->latencyAvg, ms->latencyMax, ms->runAvg, ms->runMax );
+		overruns += ms->overruns - start[i].overruns;
+		if ( ms->latencyMax > maxLatency )
+		{
+			maxLatency = ms->latencyMax;
+		}
+	}
+
+	printf("\nsummary %s: cpu %.2f%% switches/s %.1f system cpu %.2f%% system switches/s %.1f max latency %u us overruns %u\n",
+		label[0] ? label : "-",
+		( 100.0 * ticks ) / ( (double)hz * seconds ),
+		(double)switches / seconds,
+		sysAfter.total > sysBefore.total ?
+			( 100.0 * ( sysAfter.busy - sysBefore.busy ) ) / ( sysAfter.total - sysBefore.total ) : 0.0,
+		(double)( sysAfter.ctxt - sysBefore.ctxt ) / seconds,
+		maxLatency, overruns );
+	return ( 0 );
+}
@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+# This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+# 
+# Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+# 
+# This program is free software: you can redistribute it and/or modify  
+# it under the terms of the GNU General Public License as published by  
+# the Free Software Foundation, version 3.
+#
+# This program is distributed in the hope that it will be useful, but 
+# WITHOUT ANY WARRANTY; without even the implied warranty of 
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License 
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+#
+# Run hub_compare against the multi-process layout and then simHub.
+# Usage: hub_compare.sh [seconds]
+# simHub must be installed (make hub-install). The layout in use before the
+# run is restored at the end.
+
+SECONDS_RUN=${1:-60}
+SETTLE=15
+HERE=$(dirname "$0")
+
+if [ -f /simulator/useSimHub ]; then
+	WAS_HUB=1
+else
+	WAS_HUB=0
+fi
+
+rm -f /simulator/useSimHub
+sudo /etc/init.d/simctl restart > /dev/null 2>&1
+sleep $SETTLE
+$HERE/hub_compare -t $SECONDS_RUN -l multi | tee /tmp/hub_compare_multi.txt
+
+touch /simulator/useSimHub
+sudo /etc/init.d/simctl restart > /dev/null 2>&1
+sleep $SETTLE
+$HERE/hub_compare -t $SECONDS_RUN -l hub | tee /tmp/hub_compare_hub.txt
+
+if [ $WAS_HUB -eq 0 ]; then
+	rm -f /simulator/useSimHub
+	sudo /etc/init.d/simctl restart > /dev/null 2>&1
+fi
+
+echo
+grep -h "^summary" /tmp/hub_compare_multi.txt /tmp/hub_compare_hub.txt
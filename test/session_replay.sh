@@ -0,0 +1,60 @@
+#!/bin/sh
+#
+# This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+# 
+# Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+# 
+# This program is free software: you can redistribute it and/or modify  
+# it under the terms of the GNU General Public License as published by  
+# the Free Software Foundation, version 3.
+#
+# This program is distributed in the hope that it will be useful, but 
+# WITHOUT ANY WARRANTY; without even the implied warranty of 
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License 
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+#
+# Replay a recorded session with the programs of this build tree, on the
+# simulator (simctl stopped) or any Linux machine, and save the trace.
+# Usage: session_replay.sh <session dir> [speed] [trace file]
+# Each program with a <name>.ses file in the session directory is run. The
+# trace is written as simTraceDump text; compare it with an earlier replay.
+
+SESSION=$1
+SPEED=${2:-1}
+OUT=${3:-/tmp/session_replay.txt}
+TOP=$(cd $(dirname "$0")/.. && pwd)
+
+if [ -z "$SESSION" ] || [ ! -d "$SESSION" ]; then
+	echo "Usage: $0 <session dir> [speed] [trace file]"
+	exit 1
+fi
+SIM_SESSION_REPLAY=$SESSION
+SIM_SESSION_SPEED=$SPEED
+export SIM_SESSION_REPLAY SIM_SESSION_SPEED
+
+# simController creates the shared memory, so it runs even without a recording
+$TOP/comm/simController
+sleep 2
+PROGS=""
+for prog in simHub:hub/simHub soundSense:wav-trig/soundSense pulse:pulse/pulse \
+	rfidScan:cardiac/rfidScan breathSense:respiration/breathSense cprScan:cpr/cprScan; do
+	name=${prog%%:*}
+	if [ -f $SESSION/$name.ses ]; then
+		$TOP/${prog#*:}
+		PROGS="$PROGS $name"
+	fi
+done
+
+# Each program exits at the end of its recording
+for name in $PROGS; do
+	while pgrep -x $name > /dev/null; do
+		sleep 1
+	done
+done
+$TOP/comm/simTraceDump -o $OUT.bin
+killall simController
+$TOP/comm/simTraceDump -t $OUT.bin > $OUT
+echo "Replayed:$PROGS. Trace in $OUT ($OUT.bin for simTraceDump -j)"
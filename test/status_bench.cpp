@@ -0,0 +1,577 @@
+/*
+ * status_bench.cpp
+ *
+ * Compare the status JSON serializer (comm/simStatusJson.cpp) against the
+ * ostream version ctlstatus.cgi used before it
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Usage:
+ *	status_bench [-n <iterations>] [-s]
+ *
+ * Runs on a generated shmData (not the shared memory), so it can run anywhere.
+ * With -s, the live shared memory is used instead (simController must be running).
+ * Each iteration changes a few sensor values and one metric, as a 20 ms tick
+ * would. Reports the time, size and heap allocations per snapshot for the old
+ * output, a full snapshot and a delta, and checks that every value of the old
+ * output is in the new one.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <new>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "../comm/simUtil.h"
+#include "../comm/shmData.h"
+#include "../comm/simMetrics.h"
+#include "../comm/simStatusJson.h"
+#include "../comm/version.h"
+
+using namespace std;
+
+struct shmData *shmData;
+int debug = 0;
+
+unsigned long allocations = 0;
+
+void *
+operator new(size_t size )
+{
+	void *p;
+
+	allocations++;
+	p = malloc(size ? size : 1 );
+	if ( ! p )
+	{
+		throw std::bad_alloc();
+	}
+	return ( p );
+}
+
+void
+operator delete(void *p ) noexcept
+{
+	free(p );
+}
+
+void
+operator delete(void *p, size_t size ) noexcept
+{
+	free(p );
+}
+
+
+static void legacyMetric(ostream &out, struct simMetric *m );
+
+static void makejson(ostream & output, string key, string content)
+{
+    output << "\"" << key << "\":\"" << content << "\"";
+}
+
+/*
+ * Function: legacyStatus
+ *
+ * The ostream/itoa() status JSON, as ctlstatus.cgi wrote it before the
+ * field table.
+ */
+static void
+legacyStatus(ostream &out )
+{
+	out << "{\n";
+	out << " \"auscultation\" : {\n";
+	makejson(out, "side", itoa(shmData->auscultation.side ) );
+	out << ",\n";
+	makejson(out, "row", itoa(shmData->auscultation.row ) );
+	out << ",\n";
+	makejson(out, "col", itoa(shmData->auscultation.col ) );
+	out << ",\n";
+	makejson(out, "heartStrength", itoa(shmData->auscultation.heartStrength ) );
+	out << ",\n";
+	makejson(out, "leftLungStrength", itoa(shmData->auscultation.leftLungStrength ) );
+	out << ",\n";
+	makejson(out, "rightLungStrength", itoa(shmData->auscultation.rightLungStrength ) );
+	out << ",\n";
+	makejson(out, "tag", shmData->auscultation.tag );
+	out << "\n},\n";
+
+	out << " \"pulse\" : {\n";
+	makejson(out, "right_dorsal", itoa(shmData->pulse.right_dorsal ) );
+	out << ",\n";
+	makejson(out, "RD_AIN", itoa(shmData->pulse.ain[PULSE_RIGHT_DORSAL] ) );
+	out << ",\n";
+	makejson(out, "left_dorsal", itoa(shmData->pulse.left_dorsal ) );
+	out << ",\n";
+	makejson(out, "LD_AIN", itoa(shmData->pulse.ain[PULSE_LEFT_DORSAL] ) );
+	out << ",\n";
+	makejson(out, "right_femoral", itoa(shmData->pulse.right_femoral ) );
+	out << ",\n";
+	makejson(out, "RF_AIN", itoa(shmData->pulse.ain[2] ) );
+	out << ",\n";
+	makejson(out, "left_femoral", itoa(shmData->pulse.left_femoral ) );
+	out << ",\n";
+	makejson(out, "LF_AIN", itoa(shmData->pulse.ain[4] ) );
+	out << ",\n";
+	makejson(out, "RF_latency", itoa(shmData->pulse.detectLatency[PULSE_RIGHT_FEMORAL] + shmData->pulse.gainLatency[PULSE_RIGHT_FEMORAL] ) );
+	out << ",\n";
+	makejson(out, "LF_latency", itoa(shmData->pulse.detectLatency[PULSE_LEFT_FEMORAL] + shmData->pulse.gainLatency[PULSE_LEFT_FEMORAL] ) );
+	out << ",\n";
+	makejson(out, "latency_max", itoa(shmData->pulse.latencyMax[PULSE_RIGHT_FEMORAL] > shmData->pulse.latencyMax[PULSE_LEFT_FEMORAL] ? shmData->pulse.latencyMax[PULSE_RIGHT_FEMORAL] : shmData->pulse.latencyMax[PULSE_LEFT_FEMORAL] ) );
+	out << "\n},\n";
+
+	out << " \"respiration\" : {\n";
+	makejson(out, "ain", itoa(shmData->manual_breath_ain ) );
+	out << ",\n";
+	makejson(out, "active", itoa(shmData->respiration.active ) );
+	out << ",\n";
+	makejson(out, "riseState", itoa(shmData->respiration.riseState ) );
+	out << ",\n";
+	makejson(out, "baseline", itoa(shmData->manual_breath_baseline ) );
+	out << ",\n";
+	makejson(out, "threshold", itoa(shmData->manual_breath_threshold) );
+	out << ",\n";
+	makejson(out, "count", itoa(shmData->manual_breath_count) );
+	out << ",\n";
+	makejson(out, "noise", itoa(shmData->manual_breath_noise) );
+	out << ",\n";
+	makejson(out, "latency", itoa(shmData->manual_breath_latency) );
+	out << ",\n";
+	makejson(out, "peak", itoa(shmData->manual_breath_peak) );
+	out << ",\n";
+	makejson(out, "volume", itoa(shmData->manual_breath_volume) );
+	out << ",\n";
+	makejson(out, "fallState", itoa(shmData->respiration.fallState ) );
+	out << "\n},\n";
+	
+	out << " \"cpr\" : {\n";
+	makejson(out, "last", itoa(shmData->cpr.last ) );
+	out << ",\n";
+	makejson(out, "x", itoa(shmData->cpr.x ) );
+	out << ",\n";
+	makejson(out, "y", itoa(shmData->cpr.y ) );
+	out << ",\n";
+	makejson(out, "z", itoa(shmData->cpr.z ) );
+	out << ",\n";
+	makejson(out, "tof_present", itoa(shmData->cpr.tof_present ) );
+	out << ",\n";
+	makejson(out, "distance", itoa(shmData->cpr.distance ) );
+	out << ",\n";
+	makejson(out, "maxDistance", itoa(shmData->cpr.maxDistance ) );
+	out << ",\n";
+	makejson(out, "distanceCount", itoa(shmData->cpr.distanceCount ) );
+	out << ",\n";
+	makejson(out, "count", itoa(shmData->cpr.count ) );
+	out << ",\n";
+	makejson(out, "depth", itoa(shmData->cpr.depth ) );
+	out << ",\n";
+	makejson(out, "rate", itoa(shmData->cpr.rate ) );
+	out << ",\n";
+	makejson(out, "recoil", itoa(shmData->cpr.recoil ) );
+	out << ",\n";
+	makejson(out, "dutyCycle", itoa(shmData->cpr.dutyCycle ) );
+	out << ",\n";
+	makejson(out, "handsOff", itoa(shmData->cpr.handsOff ) );
+	out << "\n},\n";
+	
+	out << " \"i2c\" : {\n";
+	makejson(out, "transactions", itoa(shmData->i2c.transactions ) );
+	out << ",\n";
+	makejson(out, "utilization", itoa(shmData->i2c.utilization ) );
+	for ( int i = 0 ; i < I2C_CLIENTS_MAX ; i++ )
+	{
+		struct i2cClient *cl = &shmData->i2c.client[i];
+		
+		if ( cl->name[0] == 0 )
+		{
+			continue;
+		}
+		out << ",\n \"" << cl->name << "\" : {\n";
+		makejson(out, "transactions", itoa(cl->transactions ) );
+		out << ",\n";
+		makejson(out, "errors", itoa(cl->errors ) );
+		out << ",\n";
+		makejson(out, "latencyAvg", itoa(cl->latencyAvg ) );
+		out << ",\n";
+		makejson(out, "latencyMax", itoa(cl->latencyMax ) );
+		out << "\n}";
+	}
+	out << "\n},\n";
+	
+	out << " \"modules\" : {\n";
+	int first = 1;
+	for ( int i = 0 ; i < SIM_MODULES_MAX ; i++ )
+	{
+		struct moduleStats *ms = &shmData->modules[i];
+		
+		if ( ms->name[0] == 0 )
+		{
+			continue;
+		}
+		if ( ! first )
+		{
+			out << ",\n";
+		}
+		first = 0;
+		out << " \"" << ms->name << "\" : {\n";
+		makejson(out, "pid", itoa(ms->pid ) );
+		out << ",\n";
+		makejson(out, "runs", itoa(ms->runs ) );
+		out << ",\n";
+		makejson(out, "overruns", itoa(ms->overruns ) );
+		out << ",\n";
+		makejson(out, "latencyAvg", itoa(ms->latencyAvg ) );
+		out << ",\n";
+		makejson(out, "latencyMax", itoa(ms->latencyMax ) );
+		out << ",\n";
+		makejson(out, "runAvg", itoa(ms->runAvg ) );
+		out << ",\n";
+		makejson(out, "runMax", itoa(ms->runMax ) );
+		out << "\n}";
+	}
+	out << "\n},\n";
+	
+	out << " \"metrics\" : {\n";
+	first = 1;
+	for ( int p = 0 ; p < SIM_METRIC_PROCS ; p++ )
+	{
+		struct simMetricsProc *mp = &shmData->metrics[p];
+		
+		if ( mp->pid == 0 )
+		{
+			continue;
+		}
+		if ( ! first )
+		{
+			out << ",\n";
+		}
+		first = 0;
+		out << " \"" << mp->name << "\" : {\n";
+		makejson(out, "pid", itoa(mp->pid ) );
+		for ( int i = 0 ; i < SIM_METRICS ; i++ )
+		{
+			if ( mp->metric[i].count == 0 && mp->metric[i].errors == 0 )
+			{
+				continue;
+			}
+			out << ",\n \"" << simMetricName(i ) << "\" : {\n";
+			legacyMetric(out, &mp->metric[i] );
+			out << "\n}";
+		}
+		out << "\n}";
+	}
+	out << "\n},\n";
+	
+	out << " \"general\" : {\n";
+	makejson(out, "simMgrIPAddr", shmData->simMgrIPAddr );
+	out << ",\n";
+	makejson(out, "simMgrStatusPort", itoa(shmData->simMgrStatusPort) );
+	out << ",\n";
+	makejson(out, "simCtlVersion", SIMCTL_VERSION );
+	out << "\n}\n";
+	
+	out << "\n}\n";
+}
+
+/*
+ * Function: legacyMetric
+ *
+ * One latency histogram. Times are usec. Percentiles are bucket lower bounds,
+ * so within 25% of the true value. "buckets" lists [lower bound, count] for
+ * the buckets in use.
+ */
+static void
+legacyMetric(ostream &out, struct simMetric *m )
+{
+	struct simMetric snap = *m;		// The writers do not stop while we read
+	int first = 1;
+	
+	makejson(out, "count", itoa(snap.count ) );
+	out << ",\n";
+	makejson(out, "errors", itoa(snap.errors ) );
+	out << ",\n";
+	makejson(out, "avg", itoa(snap.count ? (int)( snap.sum / snap.count ) : 0 ) );
+	out << ",\n";
+	makejson(out, "p50", itoa(simMetricPercentile(&snap, 50 ) ) );
+	out << ",\n";
+	makejson(out, "p90", itoa(simMetricPercentile(&snap, 90 ) ) );
+	out << ",\n";
+	makejson(out, "p99", itoa(simMetricPercentile(&snap, 99 ) ) );
+	out << ",\n";
+	makejson(out, "max", itoa(snap.max ) );
+	out << ",\n\"buckets\":[";
+	for ( int b = 0 ; b < SIM_METRIC_BUCKETS ; b++ )
+	{
+		if ( snap.buckets[b] == 0 )
+		{
+			continue;
+		}
+		if ( ! first )
+		{
+			out << ",";
+		}
+		first = 0;
+		out << "[" << simMetricBucketLow(b ) << "," << snap.buckets[b] << "]";
+	}
+	out << "]";
+}
+
+static unsigned long long
+nsec_time(void )
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts );
+	return ( (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec );
+}
+
+static void
+fillData(struct shmData *sd )
+{
+	int i;
+	int p;
+	int b;
+	static const char *modules[] = { "soundSense", "pulse", "breathSense", "cprScan", "rfidScan" };
+
+	memset(sd, 0, SIM_STATUS_SNAP_SIZE );
+	strcpy(sd->simMgrIPAddr, "192.168.1.20" );
+	sd->simMgrStatusPort = 50200;
+	strcpy(sd->cardiac.rhythm, "sinus" );
+	strcpy(sd->cardiac.vpc, "none" );
+	strcpy(sd->cardiac.heart_sound, "normal" );
+	sd->cardiac.rate = 80;
+	strcpy(sd->respiration.left_lung_sound, "normal" );
+	strcpy(sd->respiration.right_lung_sound, "normal" );
+	sd->respiration.rate = 20;
+	sd->respiration.awRR = 20;
+	strcpy(sd->auscultation.tag, "0a1b2c3d" );
+	sd->auscultation.side = 1;
+	for ( i = 1 ; i < PULSE_POINTS_MAX ; i++ )
+	{
+		sd->pulse.ain[i] = 1000 + i * 37;
+		sd->pulse.base[i] = 900 + i;
+		sd->pulse.detectLatency[i] = i * 3;
+		sd->pulse.gainLatency[i] = i;
+		sd->pulse.latencyMax[i] = i * 11;
+	}
+	sd->cpr.tof_present = 1;
+	sd->cpr.maxDistance = 180;
+	strcpy(sd->i2c.client[0].name, "cprAccel" );
+	strcpy(sd->i2c.client[1].name, "cprTof" );
+	for ( i = 0 ; i < SIM_MODULES_MAX ; i++ )
+	{
+		strcpy(sd->modules[i].name, modules[i] );
+		sd->modules[i].pid = 1000 + i;
+	}
+	for ( p = 0 ; p < SIM_METRIC_PROCS - 2 ; p++ )
+	{
+		snprintf(sd->metrics[p].name, sizeof(sd->metrics[p].name ), "proc%d", p );
+		sd->metrics[p].pid = 2000 + p;
+		for ( i = 0 ; i < SIM_METRICS ; i += 2 )
+		{
+			for ( b = 10 ; b < 30 ; b++ )
+			{
+				sd->metrics[p].metric[i].buckets[b] = b * 7 + i;
+				sd->metrics[p].metric[i].count += b * 7 + i;
+				sd->metrics[p].metric[i].sum += (unsigned long long)( b * 7 + i ) * simMetricBucketLow(b );
+			}
+			sd->metrics[p].metric[i].max = simMetricBucketLow(29 );
+		}
+	}
+}
+
+// What changes between two 20 ms ticks on a running simulator
+static void
+tick(struct shmData *sd, int n )
+{
+	sd->pulse.ain[PULSE_RIGHT_FEMORAL] = 1000 + ( n * 13 ) % 300;
+	sd->pulse.ain[PULSE_LEFT_FEMORAL] = 1000 + ( n * 7 ) % 300;
+	sd->manual_breath_ain = 300 + ( n * 3 ) % 200;
+	sd->cpr.x = ( n * 101 ) % 2000 - 1000;
+	sd->cpr.y = ( n * 53 ) % 2000 - 1000;
+	sd->cpr.z = 16000 + n % 50;
+	sd->cpr.distance = 170 + n % 10;
+	sd->cpr.distanceCount++;
+	sd->i2c.transactions += 4;
+	sd->i2c.client[1].transactions += 4;
+	sd->modules[SIM_MODULE_PULSE].runs++;
+	sd->modules[SIM_MODULE_CPR].runs++;
+	sd->metrics[SIM_MODULE_PULSE].metric[SIM_METRIC_AIN_READ].count++;
+	sd->metrics[SIM_MODULE_PULSE].metric[SIM_METRIC_AIN_READ].buckets[12]++;
+}
+
+/*
+ * Function: checkValues
+ *
+ * Each "key":"value" of the old output must be in the new one, as "key":value
+ * or "key":"value". Keys repeat between sections, so this only shows that
+ * nothing was lost, not where it went.
+ */
+static int
+checkValues(const string &legacy, const char *json )
+{
+	size_t pos = 0;
+	size_t k;
+	size_t v;
+	size_t e;
+	int missing = 0;
+	string key;
+	string value;
+
+	while ( ( k = legacy.find('"', pos ) ) != string::npos )
+	{
+		e = legacy.find('"', k + 1 );
+		if ( e == string::npos )
+		{
+			break;
+		}
+		key = legacy.substr(k + 1, e - k - 1 );
+		pos = e + 1;
+		if ( legacy.compare(pos, 2, ":\"" ) != 0 )
+		{
+			continue;
+		}
+		v = pos + 2;
+		e = legacy.find('"', v );
+		value = legacy.substr(v, e - v );
+		pos = e + 1;
+		if ( strstr(json, ( "\"" + key + "\":" + value ).c_str() ) == NULL &&
+			 strstr(json, ( "\"" + key + "\":\"" + value + "\"" ).c_str() ) == NULL )
+		{
+			printf("Missing: \"%s\":\"%s\"\n", key.c_str(), value.c_str() );
+			missing++;
+		}
+	}
+	return ( missing );
+}
+
+int
+main(int argc, char *argv[] )
+{
+	static char json[SIM_STATUS_JSON_MAX];
+	static struct simStatusSnap snap;
+	int c;
+	int i;
+	int n = 10000;
+	int live = 0;
+	int len = 0;
+	int fullLen;
+	long long deltaBytes = 0;
+	unsigned long long start;
+	unsigned long long ns;
+	unsigned long alloc;
+	string legacy;
+
+	while ( ( c = getopt(argc, argv, "n:s" ) ) != -1 )
+	{
+		switch ( c )
+		{
+			case 'n':
+				n = atoi(optarg );
+				break;
+			case 's':
+				live = 1;
+				break;
+			default:
+				printf("Usage: %s [-n <iterations>] [-s]\n", argv[0] );
+				exit ( 1 );
+		}
+	}
+	if ( n < 1 )
+	{
+		n = 1;
+	}
+	if ( live )
+	{
+		if ( initSHM(SHM_OPEN ) != 0 )
+		{
+			printf("initSHM failed\n" );
+			exit ( 1 );
+		}
+	}
+	else
+	{
+		shmData = (struct shmData *)calloc(1, sizeof(struct shmData ) );
+		fillData(shmData );
+	}
+
+	{
+		ostringstream out;
+		legacyStatus(out );
+		legacy = out.str();
+	}
+	fullLen = simStatusJson(json, sizeof(json), shmData, NULL );
+	if ( fullLen < 0 )
+	{
+		printf("Full snapshot does not fit in %d bytes\n", SIM_STATUS_JSON_MAX );
+		exit ( 1 );
+	}
+	printf("Values of the old output missing from the new: %d\n", checkValues(legacy, json ) );
+
+	alloc = allocations;
+	start = nsec_time();
+	for ( i = 0 ; i < n ; i++ )
+	{
+		ostringstream out;
+
+		if ( ! live )
+		{
+			tick(shmData, i );
+		}
+		legacyStatus(out );
+		len += out.str().size();
+	}
+	ns = nsec_time() - start;
+	printf("%-8s %10.2f usec %8d bytes %8.1f allocations\n", "ostream", ns / 1000.0 / n, len / n, (double)( allocations - alloc ) / n );
+
+	alloc = allocations;
+	len = 0;
+	start = nsec_time();
+	for ( i = 0 ; i < n ; i++ )
+	{
+		if ( ! live )
+		{
+			tick(shmData, i );
+		}
+		len += simStatusJson(json, sizeof(json), shmData, NULL );
+	}
+	ns = nsec_time() - start;
+	printf("%-8s %10.2f usec %8d bytes %8.1f allocations\n", "full", ns / 1000.0 / n, len / n, (double)( allocations - alloc ) / n );
+
+	simStatusSnapshot(&snap, shmData, json, sizeof(json), SIM_STATUS_FULL );
+	alloc = allocations;
+	start = nsec_time();
+	for ( i = 0 ; i < n ; i++ )
+	{
+		if ( ! live )
+		{
+			tick(shmData, i );
+		}
+		deltaBytes += simStatusSnapshot(&snap, shmData, json, sizeof(json), SIM_STATUS_DELTA );
+	}
+	ns = nsec_time() - start;
+	printf("%-8s %10.2f usec %8lld bytes %8.1f allocations\n", "delta", ns / 1000.0 / n, deltaBytes / n, (double)( allocations - alloc ) / n );
+	if ( ! live )
+	{
+		printf("Last delta: %s\n", json );
+	}
+	return ( 0 );
+}
@@ -33,6 +33,7 @@
 #include "../wav-trig/wavTrigger.h"
 
 #include "../comm/simUtil.h"
+#include "../comm/shmData.h"
 
 #include <sys/time.h>
 
@@ -41,6 +42,7 @@ using namespace std;
 #define MAX_BUF	255
 
 char sioName[MAX_BUF];
+struct shmData *shmData;	// Not opened. wavTrigger metrics stay local.
 
 int
 setTermios(int fd, int speed )
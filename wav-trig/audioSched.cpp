@@ -0,0 +1,757 @@
+/*
+ * audioSched.cpp
+ * Voice and output allocation for the WAV Trigger/Tsunami
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <stdio.h>
+
+#include "audioSched.h"
+#include "../comm/simUtil.h"
+
+// Channel 0 is the stethoscope; the pulse points have their own outputs
+struct audioSource audioSources[AUDIO_SOURCES] =
+{
+	{ "heart",		AUDIO_PRIO_HEART,	AUDIO_BOARD_MAIN,	0, 2, 1000 },
+	{ "pulse LF",	AUDIO_PRIO_PULSE,	AUDIO_BOARD_PULSE,	2, 1,  400 },
+	{ "pulse RF",	AUDIO_PRIO_PULSE,	AUDIO_BOARD_PULSE,	3, 1,  400 },
+	{ "lung L",		AUDIO_PRIO_LUNG,	AUDIO_BOARD_MAIN,	0, 2, 3000 },
+	{ "lung R",		AUDIO_PRIO_LUNG,	AUDIO_BOARD_MAIN,	0, 2, 3000 },
+	{ "general",	AUDIO_PRIO_GENERAL,	AUDIO_BOARD_MAIN,	0, 4, 5000 }
+};
+
+struct audioSyncStats audioSync[AUDIO_GROUPS] =
+{
+	{ "beat" },
+	{ "breath" }
+};
+
+static struct audioBoard boards[AUDIO_BOARDS];
+static int sharedBoard;			// One board for both (Tsunami)
+static unsigned int lastReport;
+static unsigned int reportedSteals;
+static unsigned int reportedDrops;
+static unsigned int reportedGroups;
+
+// The open sync group. Offsets are serial bytes of the board's tick batch
+// (batchBytes), so commands sent singly by other threads do not count.
+static int group = -1;
+static int groupTracks[AUDIO_BOARDS];
+static int groupVoice[AUDIO_BOARDS][AUDIO_VOICES_MAX];
+static long groupFirst;
+static long groupLast;
+
+static struct audioBoard *
+sourceBoard(int src )
+{
+	if ( sharedBoard || audioSources[src].board == AUDIO_BOARD_MAIN )
+	{
+		return ( &boards[AUDIO_BOARD_MAIN] );
+	}
+	return ( &boards[AUDIO_BOARD_PULSE] );
+}
+
+/*
+ * Function: audioSchedInit
+ *
+ * Set the boards and their voice counts (from getSysInfo; 0 for the default).
+ * pulseBoard may be the main board.
+ */
+void
+audioSchedInit(wavTrigger *mainBoard, int mainVoices, wavTrigger *pulseBoard, int pulseVoices )
+{
+	int i;
+
+	memset(boards, 0, sizeof(boards) );
+	boards[AUDIO_BOARD_MAIN].wav = mainBoard;
+	boards[AUDIO_BOARD_MAIN].voices = mainVoices;
+	boards[AUDIO_BOARD_PULSE].wav = pulseBoard;
+	boards[AUDIO_BOARD_PULSE].voices = pulseVoices;
+	sharedBoard = ( pulseBoard == mainBoard );
+	for ( i = 0 ; i < AUDIO_BOARDS ; i++ )
+	{
+		if ( boards[i].voices <= 0 )
+		{
+			boards[i].voices = AUDIO_VOICES_DEFAULT;
+		}
+		if ( boards[i].voices > AUDIO_VOICES_MAX )
+		{
+			boards[i].voices = AUDIO_VOICES_MAX;
+		}
+	}
+	for ( i = 0 ; i < AUDIO_SOURCES ; i++ )
+	{
+		audioSources[i].plays = 0;
+		audioSources[i].steals = 0;
+		audioSources[i].drops = 0;
+		audioSources[i].fadeTrk = 0;
+		audioSources[i].fadeIn = 0;
+		audioSources[i].fadeEnd = 0;
+	}
+	for ( i = 0 ; i < AUDIO_GROUPS ; i++ )
+	{
+		audioSync[i].groups = 0;
+		audioSync[i].tracks = 0;
+		audioSync[i].beforeSumUs = 0;
+		audioSync[i].afterSumUs = 0;
+		audioSync[i].beforeMaxUs = 0;
+		audioSync[i].afterMaxUs = 0;
+	}
+	lastReport = msec_time();
+	reportedSteals = 0;
+	reportedDrops = 0;
+	reportedGroups = 0;
+	group = -1;
+}
+
+static void
+stopVoice(struct audioBoard *bd, struct audioVoice *v )
+{
+	bd->wav->trackStop(v->chan, v->trk );
+	v->trk = 0;
+	v->loaded = 0;
+}
+
+/*
+ * Function: allocVoice
+ *
+ * Find the voice for a source's track: the voice already holding the track
+ * on the source's output, the source's oldest voice if it holds maxVoices, a
+ * free voice, or the lowest priority, oldest voice if that is not above the
+ * source's priority. A voice taken from another track is stopped.
+ *
+ * Returns: The voice, or -1 if there is none for the source
+ */
+static int
+allocVoice(struct audioBoard *bd, int src, int trk, unsigned int now )
+{
+	struct audioSource *as = &audioSources[src];
+	struct audioVoice *v;
+	int freeVoice = -1;
+	int same = -1;
+	int oldest = -1;
+	int victim = -1;
+	int held = 0;
+	int i;
+
+	for ( i = 0 ; i < bd->voices ; i++ )
+	{
+		v = &bd->voice[i];
+		if ( v->trk && ! v->loaded && (int)( now - v->end ) >= 0 )
+		{
+			v->trk = 0;		// Played out
+		}
+		if ( v->trk == 0 )
+		{
+			if ( freeVoice < 0 )
+			{
+				freeVoice = i;
+			}
+			continue;
+		}
+		if ( v->trk == trk && v->chan == as->chan )
+		{
+			same = i;
+		}
+		if ( v->src == src )
+		{
+			held++;
+			if ( oldest < 0 || (int)( v->start - bd->voice[oldest].start ) < 0 )
+			{
+				oldest = i;
+			}
+		}
+		if ( victim < 0 ||
+			 audioSources[v->src].prio < audioSources[bd->voice[victim].src].prio ||
+			 ( audioSources[v->src].prio == audioSources[bd->voice[victim].src].prio &&
+			   (int)( v->start - bd->voice[victim].start ) < 0 ) )
+		{
+			victim = i;
+		}
+	}
+	if ( same >= 0 )
+	{
+		return ( same );
+	}
+	if ( held >= as->maxVoices )
+	{
+		stopVoice(bd, &bd->voice[oldest] );
+		return ( oldest );
+	}
+	if ( freeVoice >= 0 )
+	{
+		return ( freeVoice );
+	}
+	if ( audioSources[bd->voice[victim].src].prio <= as->prio )
+	{
+		stopVoice(bd, &bd->voice[victim] );
+		as->steals++;
+		return ( victim );
+	}
+	as->drops++;
+	return ( -1 );
+}
+
+/*
+ * Function: fadeOut
+ *
+ * Fade out and stop the source's tracks still playing, other than voice keep
+ *
+ * Returns: The number of tracks faded out
+ */
+static int
+fadeOut(struct audioBoard *bd, int src, int keep, unsigned int now )
+{
+	struct audioSource *as = &audioSources[src];
+	struct audioVoice *v;
+	int n = 0;
+	int i;
+
+	for ( i = 0 ; i < bd->voices ; i++ )
+	{
+		v = &bd->voice[i];
+		if ( i == keep || v->trk == 0 || v->loaded || v->src != src || (int)( now - v->end ) >= 0 )
+		{
+			continue;
+		}
+		bd->wav->trackFade(v->trk, AUDIO_FADE_GAIN, as->fadeMs, true );
+		v->end = now + as->fadeMs;
+		n++;
+	}
+	return ( n );
+}
+
+/*
+ * Function: audioSchedPlay
+ *
+ * Play a track for a source. lengthMs is how long the track is expected to
+ * play (0 for the source's default); the voice is counted busy for that long.
+ *
+ * Returns: The voice used, or -1 if the play was dropped
+ */
+int
+audioSchedPlay(int src, int trk, int lengthMs )
+{
+	struct audioSource *as = &audioSources[src];
+	struct audioBoard *bd = sourceBoard(src );
+	struct audioVoice *v;
+	unsigned int now = msec_time();
+	int b = bd - boards;
+	int preloaded;
+	long off;
+	int i;
+
+	if ( trk <= 0 )
+	{
+		return ( -1 );
+	}
+	i = allocVoice(bd, src, trk, now );
+	if ( i < 0 )
+	{
+		return ( -1 );
+	}
+	v = &bd->voice[i];
+	preloaded = ( v->trk == trk && v->loaded );
+	if ( as->fadeTrk == trk )
+	{
+		as->fadeTrk = 0;
+		if ( fadeOut(bd, src, i, now ) > 0 )
+		{
+			bd->wav->trackGain(trk, AUDIO_FADE_GAIN );
+			as->fadeIn = trk;
+			as->fadeEnd = now + as->fadeMs;
+		}
+		else
+		{
+			bd->wav->trackGain(trk, as->fadeGain );
+		}
+	}
+	v->trk = trk;
+	v->loaded = 0;
+	v->chan = as->chan;
+	v->src = src;
+	v->start = now;
+	v->end = now + ( lengthMs > 0 ? lengthMs : as->lengthMs );
+	if ( group >= 0 )
+	{
+		if ( ! preloaded )
+		{
+			bd->wav->trackPlaySync(as->chan, trk );
+		}
+		off = bd->wav->batchBytes;
+		if ( groupTracks[0] + groupTracks[1] == 0 || off < groupFirst )
+		{
+			groupFirst = off;
+		}
+		if ( groupTracks[0] + groupTracks[1] == 0 || off > groupLast )
+		{
+			groupLast = off;
+		}
+		groupVoice[b][groupTracks[b]++] = i;
+	}
+	else if ( preloaded )
+	{
+		bd->wav->trackResume(as->chan, trk );
+	}
+	else
+	{
+		bd->wav->trackPlayPoly(as->chan, trk );
+	}
+	if ( as->fadeIn && group < 0 )
+	{
+		bd->wav->trackFade(as->fadeIn, as->fadeGain, as->fadeMs, false );
+		as->fadeIn = 0;
+	}
+	as->plays++;
+	return ( i );
+}
+
+/*
+ * Function: audioSchedCrossFade
+ *
+ * Crossfade over fadeMs to trk, at gain, if the source plays it this tick
+ */
+void
+audioSchedCrossFade(int src, int trk, int gain, int fadeMs )
+{
+	struct audioSource *as = &audioSources[src];
+
+	as->fadeTrk = trk;
+	as->fadeGain = gain;
+	as->fadeMs = fadeMs;
+}
+
+/*
+ * Function: audioSchedFading
+ *
+ * Returns: 1 while a crossfade to a source's track is in progress
+ */
+int
+audioSchedFading(int src )
+{
+	struct audioSource *as = &audioSources[src];
+
+	return ( as->fadeEnd != 0 );
+}
+
+/*
+ * Function: audioSchedPreload
+ *
+ * Load a source's next track paused, ready for audioSchedPlay. A track the
+ * source had waiting is dropped. Nothing is loaded if the track is playing
+ * already on the source's output (its play will restart it).
+ *
+ * Returns: The voice holding the track, or -1 if it was not loaded
+ */
+int
+audioSchedPreload(int src, int trk )
+{
+	struct audioSource *as = &audioSources[src];
+	struct audioBoard *bd = sourceBoard(src );
+	struct audioVoice *v;
+	unsigned int now = msec_time();
+	int i;
+
+	if ( trk <= 0 )
+	{
+		return ( -1 );
+	}
+	for ( i = 0 ; i < bd->voices ; i++ )
+	{
+		v = &bd->voice[i];
+		if ( v->trk == 0 || v->src != src )
+		{
+			continue;
+		}
+		if ( v->trk == trk && v->chan == as->chan )
+		{
+			if ( v->loaded || (int)( now - v->end ) < 0 )
+			{
+				return ( v->loaded ? i : -1 );
+			}
+		}
+		else if ( v->loaded )
+		{
+			stopVoice(bd, v );
+		}
+	}
+	i = allocVoice(bd, src, trk, now );
+	if ( i < 0 )
+	{
+		return ( -1 );
+	}
+	v = &bd->voice[i];
+	v->trk = trk;
+	v->loaded = 1;
+	v->chan = as->chan;
+	v->src = src;
+	v->start = now;
+	v->end = now;
+	bd->wav->trackPlaySync(as->chan, trk );
+	return ( i );
+}
+
+/*
+ * Function: audioSchedCancel
+ *
+ * Drop the tracks a source has waiting loaded
+ */
+void
+audioSchedCancel(int src )
+{
+	struct audioBoard *bd = sourceBoard(src );
+	int i;
+
+	for ( i = 0 ; i < bd->voices ; i++ )
+	{
+		if ( bd->voice[i].trk && bd->voice[i].loaded && bd->voice[i].src == src )
+		{
+			stopVoice(bd, &bd->voice[i] );
+		}
+	}
+}
+
+/*
+ * Function: audioSchedStop
+ *
+ * Stop every voice held by a source
+ */
+void
+audioSchedStop(int src )
+{
+	struct audioBoard *bd = sourceBoard(src );
+	int i;
+
+	for ( i = 0 ; i < bd->voices ; i++ )
+	{
+		if ( bd->voice[i].trk && bd->voice[i].src == src )
+		{
+			stopVoice(bd, &bd->voice[i] );
+		}
+	}
+}
+
+/*
+ * Function: audioSchedStopAll
+ *
+ * Stop all tracks on both boards and free every voice
+ */
+void
+audioSchedStopAll(void )
+{
+	int i;
+
+	for ( i = 0 ; i < ( sharedBoard ? 1 : AUDIO_BOARDS ) ; i++ )
+	{
+		if ( boards[i].wav )
+		{
+			boards[i].wav->stopAllTracks();
+		}
+		memset(boards[i].voice, 0, sizeof(boards[i].voice) );
+	}
+	for ( i = 0 ; i < AUDIO_SOURCES ; i++ )
+	{
+		audioSources[i].fadeTrk = 0;
+		audioSources[i].fadeIn = 0;
+		audioSources[i].fadeEnd = 0;
+	}
+}
+
+/*
+ * Function: audioSchedChannel
+ *
+ * Returns: The output channel of a source
+ */
+int
+audioSchedChannel(int src )
+{
+	return ( audioSources[src].chan );
+}
+
+/*
+ * Function: audioSchedSetChannel
+ *
+ * Move a source to another output. Its voices playing on the old output are
+ * left to finish.
+ */
+void
+audioSchedSetChannel(int src, int chan )
+{
+	audioSources[src].chan = chan;
+}
+
+/*
+ * Function: audioSchedInUse
+ *
+ * Returns: The number of voices the scheduler counts as playing on a board
+ */
+int
+audioSchedInUse(int board )
+{
+	struct audioBoard *bd = &boards[sharedBoard ? AUDIO_BOARD_MAIN : board];
+	unsigned int now = msec_time();
+	int n = 0;
+	int i;
+
+	for ( i = 0 ; i < bd->voices ; i++ )
+	{
+		if ( bd->voice[i].trk && ( bd->voice[i].loaded || (int)( now - bd->voice[i].end ) < 0 ) )
+		{
+			n++;
+		}
+	}
+	return ( n );
+}
+
+/*
+ * Function: audioSchedTick
+ *
+ * Start the tick's batch on each board, and end the crossfades that are done
+ */
+void
+audioSchedTick(void )
+{
+	unsigned int now = msec_time();
+	struct audioSource *as;
+	int i;
+
+	for ( i = 0 ; i < ( sharedBoard ? 1 : AUDIO_BOARDS ) ; i++ )
+	{
+		if ( boards[i].wav )
+		{
+			boards[i].wav->batchBegin();
+		}
+	}
+	for ( i = 0 ; i < AUDIO_SOURCES ; i++ )
+	{
+		as = &audioSources[i];
+		as->fadeTrk = 0;		// Not played in its tick
+		if ( as->fadeEnd && (int)( now - as->fadeEnd ) >= 0 )
+		{
+			as->fadeEnd = 0;
+		}
+	}
+}
+
+/*
+ * Function: audioSchedGroupBegin
+ *
+ * Open a sync group. The plays until audioSchedGroupRelease are loaded
+ * paused. Groups don't nest; a second begin is ignored.
+ */
+void
+audioSchedGroupBegin(int grp )
+{
+	if ( group >= 0 )
+	{
+		return;
+	}
+	group = grp;
+	groupTracks[0] = 0;
+	groupTracks[1] = 0;
+}
+
+static unsigned int
+bytesToUs(long bytes )
+{
+	return ( (unsigned int)( bytes * WAV_BYTE_NS / 1000 ) );
+}
+
+/*
+ * Function: audioSchedGroupRelease
+ *
+ * Start the group's tracks with resumeAllInSync on each board that has one,
+ * or a resume per track if the board has another track waiting loaded, and
+ * count the skew before and after.
+ */
+void
+audioSchedGroupRelease(void )
+{
+	struct audioSyncStats *st;
+	long resumeFirst = 0;
+	long resumeLast = 0;
+	long off;
+	unsigned int before;
+	unsigned int after;
+	int resumes = 0;
+	int waiting;
+	struct audioVoice *v;
+	int i;
+	int j;
+
+	if ( group < 0 )
+	{
+		return;
+	}
+	st = &audioSync[group];
+	group = -1;
+	for ( i = 0 ; i < AUDIO_BOARDS ; i++ )
+	{
+		if ( groupTracks[i] == 0 )
+		{
+			continue;
+		}
+		for ( j = 0, waiting = 0 ; j < boards[i].voices ; j++ )
+		{
+			if ( boards[i].voice[j].trk && boards[i].voice[j].loaded )
+			{
+				waiting = 1;
+			}
+		}
+		for ( j = 0 ; j < ( waiting ? groupTracks[i] : 1 ) ; j++ )
+		{
+			if ( waiting )
+			{
+				v = &boards[i].voice[groupVoice[i][j]];
+				boards[i].wav->trackResume(v->chan, v->trk );
+			}
+			else
+			{
+				boards[i].wav->resumeAllInSync();
+			}
+			off = boards[i].wav->batchBytes;
+			if ( resumes == 0 || off < resumeFirst )
+			{
+				resumeFirst = off;
+			}
+			if ( resumes == 0 || off > resumeLast )
+			{
+				resumeLast = off;
+			}
+			resumes++;
+		}
+	}
+	for ( i = 0 ; i < AUDIO_SOURCES ; i++ )
+	{
+		if ( audioSources[i].fadeIn )
+		{
+			sourceBoard(i )->wav->trackFade(audioSources[i].fadeIn, audioSources[i].fadeGain, audioSources[i].fadeMs, false );
+			audioSources[i].fadeIn = 0;
+		}
+	}
+	if ( groupTracks[0] + groupTracks[1] < 2 )
+	{
+		return;
+	}
+	before = bytesToUs(groupLast - groupFirst );
+	after = bytesToUs(resumeLast - resumeFirst );
+	st->groups++;
+	st->tracks += groupTracks[0] + groupTracks[1];
+	st->beforeSumUs += before;
+	st->afterSumUs += after;
+	if ( before > st->beforeMaxUs )
+	{
+		st->beforeMaxUs = before;
+	}
+	if ( after > st->afterMaxUs )
+	{
+		st->afterMaxUs = after;
+	}
+}
+
+/*
+ * Function: audioSchedSyncReport
+ *
+ * Format the sync group skew, average and max, per group type
+ *
+ * Returns: The length of the report, 0 if there have been no groups
+ */
+int
+audioSchedSyncReport(char *buf, int size )
+{
+	struct audioSyncStats *st;
+	int len = 0;
+	int i;
+
+	buf[0] = 0;
+	for ( i = 0 ; i < AUDIO_GROUPS && len < size ; i++ )
+	{
+		st = &audioSync[i];
+		if ( st->groups == 0 )
+		{
+			continue;
+		}
+		len += snprintf(&buf[len], size - len, "%s%s %u groups of %.1f tracks, skew us avg/max %llu/%u without the group, %llu/%u with it",
+			len ? "; " : "", st->name, st->groups, (double)st->tracks / st->groups,
+			st->beforeSumUs / st->groups, st->beforeMaxUs, st->afterSumUs / st->groups, st->afterMaxUs );
+	}
+	return ( len < size ? len : size - 1 );
+}
+
+/*
+ * Function: audioSchedFlush
+ *
+ * Write the tick's batch to each board. Every AUDIO_REPORT_SEC, logs the
+ * sync group skew and the steals and drops per source if there were any new
+ * ones.
+ */
+void
+audioSchedFlush(void )
+{
+	char msg[512];
+	unsigned int steals = 0;
+	unsigned int drops = 0;
+	unsigned int groups = 0;
+	unsigned int now;
+	int len;
+	int i;
+
+	for ( i = 0 ; i < ( sharedBoard ? 1 : AUDIO_BOARDS ) ; i++ )
+	{
+		if ( boards[i].wav )
+		{
+			boards[i].wav->batchFlush();
+		}
+	}
+	now = msec_time();
+	if ( now - lastReport < AUDIO_REPORT_SEC * 1000 )
+	{
+		return;
+	}
+	lastReport = now;
+	for ( i = 0 ; i < AUDIO_GROUPS ; i++ )
+	{
+		groups += audioSync[i].groups;
+	}
+	if ( groups != reportedGroups )
+	{
+		reportedGroups = groups;
+		len = snprintf(msg, sizeof(msg), "Audio sync: " );
+		audioSchedSyncReport(&msg[len], sizeof(msg) - len );
+		log_message("", msg );
+	}
+	for ( i = 0 ; i < AUDIO_SOURCES ; i++ )
+	{
+		steals += audioSources[i].steals;
+		drops += audioSources[i].drops;
+	}
+	if ( steals == reportedSteals && drops == reportedDrops )
+	{
+		return;
+	}
+	reportedSteals = steals;
+	reportedDrops = drops;
+	len = snprintf(msg, sizeof(msg), "Audio voices (plays/steals/drops):" );
+	for ( i = 0 ; i < AUDIO_SOURCES && len < (int)sizeof(msg) ; i++ )
+	{
+		len += snprintf(&msg[len], sizeof(msg) - len, " %s %u/%u/%u", audioSources[i].name,
+			audioSources[i].plays, audioSources[i].steals, audioSources[i].drops );
+	}
+	log_message("", msg );
+}
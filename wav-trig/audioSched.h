@@ -0,0 +1,162 @@
+/*
+ * audioSched.h
+ * Voice and output allocation for the WAV Trigger/Tsunami
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AUDIOSCHED_H_
+#define AUDIOSCHED_H_
+
+#include "wavTrigger.h"
+
+/*
+ * Every sound soundSense plays comes from a source. The source fixes the
+ * board (main or pulse), the output channel and the priority. The scheduler
+ * keeps its own table of the board's voices, so it never has to ask the board
+ * what is playing:
+ *
+ *	- A track already playing on the same output reuses its voice (the play
+ *	  command restarts it).
+ *	- A voice is free again once the track's expected length has passed.
+ *	- A source holding maxVoices gives up its oldest voice.
+ *	- With no voice free, the lowest priority voice is stolen, the oldest first.
+ *	  If every voice has a higher priority than the new sound, the new sound is
+ *	  dropped.
+ *
+ * Commands go out through wavTrigger batches: audioSchedTick starts a batch
+ * on each board and audioSchedFlush writes it, so each tick is one write per
+ * board. Only the soundSense loop thread calls the scheduler.
+ *
+ * Sync groups: the tracks played between audioSchedGroupBegin and
+ * audioSchedGroupRelease (in one tick) are loaded paused and started by one
+ * resumeAllInSync per board, so they start on the same sample instead of one
+ * play command (three frames, about 5 ms on a Tsunami) apart. For each group
+ * of more than one track the skew is worked out from the serial bytes between
+ * the start commands: "before" as if each track had its own play command,
+ * "after" with the group, which is only the offset between the boards' resume
+ * commands when the group spans two boards.
+ *
+ * Preload: audioSchedPreload loads a source's next track paused ahead of
+ * time, holding a voice. When the source then plays that track, no load is
+ * sent: in a group it is started by the group's resume, outside one by a
+ * resume of the track. While a track is waiting loaded, a group on that board
+ * is started by resuming each of its tracks, since resumeAllInSync would
+ * start the waiting track too.
+ *
+ * Crossfade: after audioSchedCrossFade, the source's next play of the track
+ * in the same tick fades out the source's other tracks still playing (stopped
+ * at the end of the fade) and starts the new one at AUDIO_FADE_GAIN, fading
+ * it in. The fade commands go in the tick's batch with the play, the fade-in
+ * after the group's resume. With nothing playing to fade from, the track
+ * starts at the gain given. Track gains for the source should not be set
+ * while audioSchedFading, or the fade-in is cut short.
+*/
+
+#define AUDIO_PRIO_GENERAL	0
+#define AUDIO_PRIO_LUNG		1
+#define AUDIO_PRIO_PULSE	2
+#define AUDIO_PRIO_HEART	3
+
+#define AUDIO_SRC_HEART		0
+#define AUDIO_SRC_PULSE_LF	1
+#define AUDIO_SRC_PULSE_RF	2
+#define AUDIO_SRC_LUNG_L	3
+#define AUDIO_SRC_LUNG_R	4
+#define AUDIO_SRC_GENERAL	5
+#define AUDIO_SOURCES		6
+
+#define AUDIO_BOARD_MAIN	0
+#define AUDIO_BOARD_PULSE	1
+#define AUDIO_BOARDS		2
+
+#define AUDIO_VOICES_MAX		32
+#define AUDIO_VOICES_DEFAULT	14		// WAV Trigger; the Tsunami reports 18
+#define AUDIO_REPORT_SEC		60
+#define AUDIO_FADE_GAIN			-40		// Start and end of a crossfade, as trackCrossFade
+
+struct audioSource
+{
+	const char *name;
+	int prio;
+	int board;			// AUDIO_BOARD_
+	int chan;			// Tsunami output
+	int maxVoices;
+	int lengthMs;		// Expected track length if the caller gives none
+	unsigned int plays;
+	unsigned int steals;	// Voices this source took from others
+	unsigned int drops;		// Plays dropped for want of a voice
+	int fadeTrk;			// Crossfade to this track if it plays this tick
+	int fadeGain;
+	int fadeMs;
+	int fadeIn;				// Track to fade in at the group release
+	unsigned int fadeEnd;	// msec_time the crossfade ends, 0 if none
+};
+
+struct audioVoice
+{
+	int trk;			// 0 if free
+	int loaded;			// Loaded paused by audioSchedPreload, not yet played
+	int chan;
+	int src;
+	unsigned int start;	// msec_time
+	unsigned int end;
+};
+
+struct audioBoard
+{
+	wavTrigger *wav;
+	int voices;
+	struct audioVoice voice[AUDIO_VOICES_MAX];
+};
+
+#define AUDIO_GROUP_BEAT	0	// Lub/dub and the pulse points
+#define AUDIO_GROUP_BREATH	1	// Inhalation
+#define AUDIO_GROUPS		2
+
+struct audioSyncStats
+{
+	const char *name;
+	unsigned int groups;			// Released with more than one track
+	unsigned int tracks;
+	unsigned long long beforeSumUs;	// Skew with a play command per track
+	unsigned long long afterSumUs;	// Skew with the group
+	unsigned int beforeMaxUs;
+	unsigned int afterMaxUs;
+};
+
+extern struct audioSource audioSources[AUDIO_SOURCES];
+extern struct audioSyncStats audioSync[AUDIO_GROUPS];
+
+void audioSchedInit(wavTrigger *mainBoard, int mainVoices, wavTrigger *pulseBoard, int pulseVoices );
+int audioSchedPlay(int src, int trk, int lengthMs );
+void audioSchedStop(int src );
+int audioSchedPreload(int src, int trk );
+void audioSchedCancel(int src );
+void audioSchedCrossFade(int src, int trk, int gain, int fadeMs );
+int audioSchedFading(int src );
+void audioSchedStopAll(void );
+int audioSchedChannel(int src );
+void audioSchedSetChannel(int src, int chan );
+int audioSchedInUse(int board );
+void audioSchedTick(void );
+void audioSchedFlush(void );
+void audioSchedGroupBegin(int group );
+void audioSchedGroupRelease(void );
+int audioSchedSyncReport(char *buf, int size );
+
+#endif /* AUDIOSCHED_H_ */
@@ -0,0 +1,266 @@
+/*
+ * beatEngine.cpp
+ * Local heart beat timing: sinus clock, VPC insertion and sim-mgr reconciliation
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "beatEngine.h"
+
+/*
+ * Function: beatEngineInit
+ *
+ * Clear the engine. seed is for the VPC draws.
+ */
+void
+beatEngineInit(struct beatEngine *be, unsigned int seed )
+{
+	memset(be, 0, sizeof(struct beatEngine) );
+	be->seed = seed;
+}
+
+/*
+ * Function: beatEngineSetRate
+ *
+ * Set the sinus rate. The next beat is due an interval at the new rate after
+ * the last one.
+ */
+void
+beatEngineSetRate(struct beatEngine *be, int rate )
+{
+	be->rrUs = ( rate > 0 ? 60000000LL / rate : 0 );
+	if ( be->rrUs == 0 )
+	{
+		be->nextSinusUs = 0;
+		be->nextVpcUs = 0;
+		be->vpcRun = 0;
+	}
+	else if ( be->lastSinusUs )
+	{
+		be->nextSinusUs = be->lastSinusUs + be->rrUs;
+	}
+}
+
+/*
+ * Function: beatEngineSetVpc
+ *
+ * Set the VPC morphology from cardiac.vpc ("none" or "<type>-<count>") and
+ * the frequency from cardiac.vpc_freq
+ *
+ * Returns: 0, or -1 if vpc could not be parsed (VPCs are then off)
+ */
+int
+beatEngineSetVpc(struct beatEngine *be, const char *vpc, int freq )
+{
+	int type = 0;
+	int count = 1;
+	int sts = 0;
+
+	if ( vpc[0] && strcmp(vpc, "none" ) != 0 )
+	{
+		if ( sscanf(vpc, "%d-%d", &type, &count ) < 1 || type <= 0 || count <= 0 )
+		{
+			type = 0;
+			sts = -1;
+		}
+	}
+	if ( count > BEAT_VPC_COUNT_MAX )
+	{
+		count = BEAT_VPC_COUNT_MAX;
+	}
+	be->vpcType = type;
+	be->vpcCount = count;
+	be->vpcFreq = ( freq < 0 ? 0 : ( freq > 100 ? 100 : freq ) );
+	return ( sts );
+}
+
+static int
+vpcsLocal(struct beatEngine *be )
+{
+	return ( be->vpcType > 0 && be->vpcFreq > 0 );
+}
+
+static long long
+magnitude(long long v )
+{
+	return ( v < 0 ? -v : v );
+}
+
+/*
+ * Function: playVpc
+ *
+ * Account a VPC at atUs and block the sinus beats in its refractory period
+ */
+static int
+playVpc(struct beatEngine *be, unsigned long long atUs )
+{
+	be->lastVpcUs = atUs;
+	be->refractoryUs = atUs + (long long)( be->rrUs * BEAT_VPC_REFRACTORY );
+	be->stats.vpcs++;
+	return ( BEAT_VPC );
+}
+
+/*
+ * Function: playSinus
+ *
+ * Account the sinus beat due at atUs. It is blocked if it falls in a VPC's
+ * refractory period, otherwise it may start a run of VPCs.
+ *
+ * Returns: BEAT_SINUS, or BEAT_NONE if it was blocked
+ */
+static int
+playSinus(struct beatEngine *be, unsigned long long atUs )
+{
+	be->lastSinusUs = atUs;
+	if ( atUs < be->refractoryUs )
+	{
+		be->stats.blocked++;
+		return ( BEAT_NONE );
+	}
+	be->stats.sinus++;
+	if ( vpcsLocal(be ) && be->rrUs && (int)( rand_r(&be->seed ) % 100 ) < be->vpcFreq )
+	{
+		be->vpcRun = be->vpcCount;
+		be->nextVpcUs = atUs + (long long)( be->rrUs * BEAT_VPC_COUPLING );
+	}
+	return ( BEAT_SINUS );
+}
+
+/*
+ * Function: beatEngineRemote
+ *
+ * Reconcile a sim-mgr pulse (vpc 0) or pulseVPC (vpc 1) sync received at atUs
+ *
+ * Returns: The beat to play now, BEAT_NONE if there is none
+ */
+int
+beatEngineRemote(struct beatEngine *be, int vpc, unsigned long long atUs )
+{
+	long long phase;
+
+	be->lastRemoteUs = atUs;
+	be->holdover = 0;
+	if ( vpc )
+	{
+		be->stats.remoteVpcs++;
+		if ( vpcsLocal(be ) )
+		{
+			if ( be->lastVpcUs && magnitude((long long)( atUs - be->lastVpcUs ) ) < be->rrUs / 2 )
+			{
+				be->stats.remoteVpcsMatched++;
+			}
+			return ( BEAT_NONE );
+		}
+		return ( playVpc(be, atUs ) );
+	}
+	be->stats.remote++;
+	if ( be->rrUs == 0 )
+	{
+		be->stats.sinus++;
+		return ( BEAT_SINUS );	// No rate to keep a clock at
+	}
+	phase = (long long)( atUs - be->lastSinusUs );
+	if ( be->lastSinusUs && phase < be->rrUs / 2 )
+	{
+		// Played here already
+		be->stats.matched++;
+		be->stats.phaseSumUs += phase;
+		if ( magnitude(phase ) > be->stats.phaseMaxUs )
+		{
+			be->stats.phaseMaxUs = magnitude(phase );
+		}
+		be->nextSinusUs = be->lastSinusUs + be->rrUs + phase / BEAT_PHASE_GAIN;
+		return ( BEAT_NONE );
+	}
+	be->nextSinusUs = atUs + be->rrUs;
+	return ( playSinus(be, atUs ) );
+}
+
+/*
+ * Function: beatEngineTick
+ *
+ * Play the beat due by nowUs, if any. dueUs is set to the time it was due.
+ *
+ * Returns: The beat to play now, BEAT_NONE if there is none
+ */
+int
+beatEngineTick(struct beatEngine *be, unsigned long long nowUs, unsigned long long *dueUs )
+{
+	unsigned long long due;
+
+	if ( be->rrUs == 0 || be->lastRemoteUs == 0 )
+	{
+		return ( BEAT_NONE );
+	}
+	if ( be->nextVpcUs && nowUs >= be->nextVpcUs )
+	{
+		due = be->nextVpcUs;
+		be->nextVpcUs = ( --be->vpcRun > 0 ? due + (long long)( be->rrUs * BEAT_VPC_COUPLING ) : 0 );
+		*dueUs = due;
+		return ( playVpc(be, due ) );
+	}
+	if ( be->nextSinusUs == 0 || nowUs < be->nextSinusUs )
+	{
+		return ( BEAT_NONE );
+	}
+	if ( (long long)( nowUs - be->lastRemoteUs ) > BEAT_HOLDOVER * be->rrUs )
+	{
+		if ( ! be->holdover )
+		{
+			be->holdover = 1;
+			be->stats.holdovers++;
+		}
+		return ( BEAT_NONE );
+	}
+	due = be->nextSinusUs;
+	if ( (long long)( nowUs - due ) > be->rrUs )
+	{
+		due = nowUs;		// Too far behind (a rate change); start again from now
+	}
+	be->nextSinusUs = due + be->rrUs;
+	*dueUs = due;
+	if ( playSinus(be, due ) == BEAT_NONE )
+	{
+		return ( BEAT_NONE );
+	}
+	be->stats.local++;
+	return ( BEAT_SINUS );
+}
+
+/*
+ * Function: beatEngineReport
+ *
+ * Format the beat counts and the phase to the sim-mgr
+ *
+ * Returns: The length of the report
+ */
+int
+beatEngineReport(struct beatEngine *be, char *buf, int size )
+{
+	struct beatStats *st = &be->stats;
+	int len;
+
+	len = snprintf(buf, size, "sinus %u (%u from the local clock, %u blocked), VPCs %u; sim-mgr pulse %u (%u matched, phase us avg/max %lld/%lld), pulseVPC %u (%u matched); holdovers %u",
+		st->sinus, st->local, st->blocked, st->vpcs,
+		st->remote, st->matched, st->matched ? st->phaseSumUs / st->matched : 0, st->phaseMaxUs,
+		st->remoteVpcs, st->remoteVpcsMatched, st->holdovers );
+	return ( len < size ? len : size - 1 );
+}
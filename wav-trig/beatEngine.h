@@ -0,0 +1,101 @@
+/*
+ * beatEngine.h
+ * Local heart beat timing: sinus clock, VPC insertion and sim-mgr reconciliation
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BEATENGINE_H_
+#define BEATENGINE_H_
+
+/*
+ * The engine keeps a sinus clock at cardiac.rate and decides when each beat
+ * is due, so a beat does not depend on its sim-mgr sync packet arriving:
+ *
+ *	- A sim-mgr pulse sync within half an interval of the last sinus beat is
+ *	  the same beat. It is not played again; it pulls the clock's phase a
+ *	  quarter of the way to the sim-mgr's. One arriving before the local beat
+ *	  is due plays at once and resets the phase.
+ *	- The clock runs on its own for BEAT_HOLDOVER beats after the last
+ *	  sim-mgr sync, then waits for the sim-mgr (a paused or stopped scenario).
+ *
+ * VPCs: with cardiac.vpc set ("<type>-<count>", e.g. "1-2" for a unifocal
+ * couplet) and vpc_freq above 0, each sinus beat is followed by a run of
+ * <count> VPCs with a probability of vpc_freq percent, the first at
+ * BEAT_VPC_COUPLING of the interval and the rest at the same spacing. A sinus
+ * beat due within BEAT_VPC_REFRACTORY of the interval after a VPC is blocked,
+ * which gives the full compensatory pause: the next conducted beat falls two
+ * intervals after the one before the VPC. While the engine inserts VPCs, the
+ * sim-mgr's pulseVPC syncs are only counted (matched if within half an
+ * interval of a local VPC). With VPCs off here, a pulseVPC plays as a VPC and
+ * blocks the sinus beat after it in the same way.
+ *
+ * All times are simRtNowUs microseconds. Only the soundSense loop calls the
+ * engine.
+ */
+
+#define BEAT_NONE		0
+#define BEAT_SINUS		1
+#define BEAT_VPC		2
+
+#define BEAT_HOLDOVER			4		// Sinus beats played with no sim-mgr sync
+#define BEAT_PHASE_GAIN			4		// Of the sim-mgr's phase error taken per beat
+#define BEAT_VPC_COUPLING		0.6		// Of the sinus interval, normal beat to VPC
+#define BEAT_VPC_REFRACTORY		0.5		// Of the sinus interval, after a VPC
+#define BEAT_VPC_COUNT_MAX		3
+
+struct beatStats
+{
+	unsigned int sinus;			// Sinus beats played
+	unsigned int local;			// Of those, played by the clock rather than a sim-mgr sync
+	unsigned int blocked;		// Sinus beats blocked after a VPC
+	unsigned int vpcs;			// VPCs played
+	unsigned int remote;		// sim-mgr pulse syncs
+	unsigned int matched;		// Of those, for a beat already played
+	unsigned int remoteVpcs;	// sim-mgr pulseVPC syncs
+	unsigned int remoteVpcsMatched;
+	unsigned int holdovers;		// Times the clock stopped for want of sim-mgr syncs
+	long long phaseSumUs;		// sim-mgr sync time less the local beat, matched beats
+	long long phaseMaxUs;
+};
+
+struct beatEngine
+{
+	long long rrUs;				// Sinus interval, 0 with no rate
+	unsigned long long nextSinusUs;
+	unsigned long long lastSinusUs;	// Played or blocked
+	unsigned long long lastVpcUs;
+	unsigned long long nextVpcUs;	// 0 if no VPC is due
+	unsigned long long refractoryUs;	// Sinus beats due before this are blocked
+	unsigned long long lastRemoteUs;
+	int holdover;				// 1 while stopped for want of sim-mgr syncs
+	int vpcType;				// 0 for none
+	int vpcCount;
+	int vpcFreq;
+	int vpcRun;					// VPCs left in the run
+	unsigned int seed;
+	struct beatStats stats;
+};
+
+void beatEngineInit(struct beatEngine *be, unsigned int seed );
+void beatEngineSetRate(struct beatEngine *be, int rate );
+int beatEngineSetVpc(struct beatEngine *be, const char *vpc, int freq );
+int beatEngineRemote(struct beatEngine *be, int vpc, unsigned long long atUs );
+int beatEngineTick(struct beatEngine *be, unsigned long long nowUs, unsigned long long *dueUs );
+int beatEngineReport(struct beatEngine *be, char *buf, int size );
+
+#endif /* BEATENGINE_H_ */
@@ -0,0 +1,401 @@
+/*
+ * chestControl.cpp
+ * Closed-loop chest rise: rise/fall valve control on the air pressure sensor
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "chestControl.h"
+
+/*
+ * Function: chestConfigDefaults
+ */
+void
+chestConfigDefaults(struct chestConfig *cfg )
+{
+	memset(cfg, 0, sizeof(struct chestConfig) );
+	cfg->peak = CHEST_PEAK_DEFAULT;
+	cfg->band = CHEST_BAND_DEFAULT;
+	cfg->sampleUs = CHEST_SAMPLE_US_DEFAULT;
+	cfg->minMs = RESP_VALVE_GAP_MS;
+	cfg->fallMs = CHEST_FALL_MS_DEFAULT;
+}
+
+/*
+ * Function: chestConfigLoad
+ *
+ * Read the settings file over the current settings. Values out of range are
+ * ignored.
+ *
+ * Returns: 0 if the file was read, -1 if not
+ */
+int
+chestConfigLoad(struct chestConfig *cfg, const char *file )
+{
+	FILE *fp;
+	char line[256];
+	char key[32];
+	int val;
+
+	fp = fopen(file, "r" );
+	if ( fp == NULL )
+	{
+		return ( -1 );
+	}
+	while ( fgets(line, sizeof(line), fp ) )
+	{
+		if ( line[0] == '#' || sscanf(line, "%31s %d", key, &val ) != 2 )
+		{
+			continue;
+		}
+		if ( strcmp(key, "enable" ) == 0 )
+		{
+			cfg->enable = val;
+		}
+		else if ( strcmp(key, "peak" ) == 0 && val > 0 )
+		{
+			cfg->peak = val;
+		}
+		else if ( strcmp(key, "band" ) == 0 && val >= 0 )
+		{
+			cfg->band = val;
+		}
+		else if ( strcmp(key, "sample_us" ) == 0 && val >= CHEST_SAMPLE_US_MIN )
+		{
+			cfg->sampleUs = val;
+		}
+		else if ( strcmp(key, "min_ms" ) == 0 && val >= RESP_VALVE_GAP_MS )
+		{
+			cfg->minMs = val;
+		}
+		else if ( strcmp(key, "fall_ms" ) == 0 && val > 0 )
+		{
+			cfg->fallMs = val;
+		}
+		else if ( strcmp(key, "baseline" ) == 0 && val >= 0 )
+		{
+			cfg->baseline = val;
+		}
+	}
+	fclose(fp );
+	return ( 0 );
+}
+
+/*
+ * Function: chestControlInit
+ */
+void
+chestControlInit(struct chestControl *cc, const struct chestConfig *cfg )
+{
+	memset(cc, 0, sizeof(struct chestControl) );
+	cc->cfg = *cfg;
+	cc->baseline = cfg->baseline;
+	cc->valve = CHEST_VALVE_HOLD;
+}
+
+/*
+ * Function: chestBreathBegin
+ *
+ * Set the target profile for a breath from its plan. The valves are left as
+ * the last breath had them.
+ */
+void
+chestBreathBegin(struct chestControl *cc, const struct respPlan *plan, unsigned long long startUs )
+{
+	memset(&cc->breath, 0, sizeof(struct chestBreath) );
+	cc->breath.low = -1;
+	cc->startUs = startUs;
+	cc->lastUs = 0;
+	cc->inhStartMs = plan->at[RESP_EDGE_RISE_ON];
+	cc->inhMs = plan->inhMs;
+	cc->fallStartMs = plan->at[RESP_EDGE_FALL_ON];
+	if ( plan->exhMs > 0 )
+	{
+		cc->fallMs = plan->exhMs;
+	}
+	else
+	{
+		cc->fallMs = plan->periodMs - cc->fallStartMs;
+		if ( cc->fallMs > cc->cfg.fallMs || cc->fallMs <= 0 )
+		{
+			cc->fallMs = cc->cfg.fallMs;
+		}
+	}
+}
+
+/*
+ * Function: chestTarget
+ *
+ * Returns: The target excursion at ms from the breath sync, counts
+ */
+int
+chestTarget(const struct chestControl *cc, int ms )
+{
+	double x;
+
+	if ( ms < cc->inhStartMs )
+	{
+		return ( 0 );
+	}
+	if ( ms < cc->inhStartMs + cc->inhMs )
+	{
+		x = (double)( ms - cc->inhStartMs ) / cc->inhMs;
+		return ( (int)( cc->cfg.peak * ( 1 - cos(M_PI * x ) ) / 2 ) );
+	}
+	if ( ms < cc->fallStartMs )
+	{
+		return ( cc->cfg.peak );
+	}
+	if ( ms < cc->fallStartMs + cc->fallMs )
+	{
+		x = (double)( ms - cc->fallStartMs ) / cc->fallMs;
+		return ( (int)( cc->cfg.peak * ( 1 + cos(M_PI * x ) ) / 2 ) );
+	}
+	return ( 0 );
+}
+
+/*
+ * Function: accountValve
+ *
+ * Add the time since the last sample to the open time of the valve state
+ */
+static void
+accountValve(struct chestControl *cc, unsigned long long nowUs )
+{
+	long long dt;
+
+	if ( cc->lastUs == 0 )
+	{
+		return;
+	}
+	dt = (long long)( nowUs - cc->lastUs );
+	if ( cc->valve == CHEST_VALVE_RISE )
+	{
+		cc->breath.riseUs += dt;
+	}
+	else if ( cc->valve == CHEST_VALVE_FALL )
+	{
+		cc->breath.fallUs += dt;
+	}
+}
+
+/*
+ * Function: chestSample
+ *
+ * Take a pressure sample (ain, -1 if the read failed) due at dueUs and read
+ * at nowUs, and set the valve state for it
+ *
+ * Returns: The valve state, CHEST_VALVE_. With fault set, the caller is to
+ * stop the controller.
+ */
+int
+chestSample(struct chestControl *cc, unsigned long long dueUs, unsigned long long nowUs, int ain )
+{
+	struct chestBreath *br = &cc->breath;
+	int ms;
+	int p;
+	int target;
+	int err;
+	int want;
+
+	accountValve(cc, nowUs );
+	cc->lastUs = nowUs;
+	if ( ain < 0 )
+	{
+		cc->fault = 1;
+		cc->stats.faults++;
+		cc->valve = CHEST_VALVE_HOLD;
+		return ( cc->valve );
+	}
+	if ( cc->baseline == 0 )
+	{
+		cc->baseline = ( ain > 0 ? ain : 1 );
+	}
+	if ( (int)( nowUs - dueUs ) > br->lateMaxUs )
+	{
+		br->lateMaxUs = (int)( nowUs - dueUs );
+	}
+	ms = (int)( ( nowUs - cc->startUs ) / 1000 );
+	p = ain - cc->baseline;
+	target = chestTarget(cc, ms );
+	err = target - p;
+
+	br->samples++;
+	br->errSqSum += (long long)err * err;
+	if ( ( err < 0 ? -err : err ) > br->errMax )
+	{
+		br->errMax = ( err < 0 ? -err : err );
+	}
+	if ( p > br->peak )
+	{
+		br->peak = p;
+	}
+	if ( br->low < 0 || ain < br->low )
+	{
+		br->low = ain;
+	}
+
+	if ( br->riseUs >= CHEST_NO_RESPONSE_MS * 1000LL && br->peak < CHEST_NO_RESPONSE_COUNTS )
+	{
+		cc->fault = 1;
+		cc->stats.faults++;
+		cc->valve = CHEST_VALVE_HOLD;
+		return ( cc->valve );
+	}
+
+	want = CHEST_VALVE_HOLD;
+	if ( target == 0 )
+	{
+		want = CHEST_VALVE_FALL;		// At rest: vent, so the lowest sample is the rest pressure
+	}
+	else if ( err > cc->cfg.band && ms < cc->fallStartMs )
+	{
+		want = CHEST_VALVE_RISE;
+	}
+	else if ( err < -cc->cfg.band )
+	{
+		want = CHEST_VALVE_FALL;
+	}
+	if ( want != cc->valve )
+	{
+		if ( nowUs - cc->valveSinceUs < cc->cfg.minMs * 1000ULL )
+		{
+			want = cc->valve;
+		}
+		else if ( cc->valve != CHEST_VALVE_HOLD && want != CHEST_VALVE_HOLD )
+		{
+			want = CHEST_VALVE_HOLD;		// Through both closed
+		}
+	}
+	if ( want != cc->valve )
+	{
+		cc->valve = want;
+		cc->valveSinceUs = nowUs;
+		br->switches++;
+	}
+	return ( cc->valve );
+}
+
+/*
+ * Function: chestBreathEnd
+ *
+ * Add the breath to the totals and move the rest pressure toward its lowest
+ * sample
+ */
+void
+chestBreathEnd(struct chestControl *cc, unsigned long long nowUs )
+{
+	struct chestBreath *br = &cc->breath;
+	struct chestStats *st = &cc->stats;
+
+	accountValve(cc, nowUs );
+	cc->lastUs = 0;
+	br->lenUs = (long long)( nowUs - cc->startUs );
+	if ( br->samples == 0 )
+	{
+		return;
+	}
+	if ( cc->cfg.baseline == 0 && br->low > 0 )
+	{
+		cc->baseline += ( br->low - cc->baseline ) / 4;
+	}
+	st->breaths++;
+	st->samples += br->samples;
+	st->errSqSum += br->errSqSum;
+	if ( br->errMax > st->errMax )
+	{
+		st->errMax = br->errMax;
+	}
+	st->riseUs += br->riseUs;
+	st->fallUs += br->fallUs;
+	st->lenUs += br->lenUs;
+	if ( br->lateMaxUs > st->lateMaxUs )
+	{
+		st->lateMaxUs = br->lateMaxUs;
+	}
+}
+
+/*
+ * Function: chestBreathRms
+ *
+ * Returns: The RMS tracking error of the breath, counts
+ */
+int
+chestBreathRms(const struct chestBreath *br )
+{
+	return ( br->samples ? (int)sqrt((double)br->errSqSum / br->samples ) : 0 );
+}
+
+/*
+ * Function: chestDuty
+ *
+ * Returns: The open time as a percentage of lenUs
+ */
+int
+chestDuty(long long openUs, long long lenUs )
+{
+	return ( lenUs > 0 ? (int)( openUs * 100 / lenUs ) : 0 );
+}
+
+/*
+ * Function: chestBreathFormat
+ *
+ * Format the last breath: tracking error and valve duty
+ *
+ * Returns: The length
+ */
+int
+chestBreathFormat(const struct chestControl *cc, char *buf, int size )
+{
+	const struct chestBreath *br = &cc->breath;
+	int len;
+
+	len = snprintf(buf, size, "Chest: peak %d of %d, error rms/max %d/%d, duty rise %d%% fall %d%%, %u switches, %u samples (latest %d us), baseline %d",
+		br->peak, cc->cfg.peak, chestBreathRms(br ), br->errMax,
+		chestDuty(br->riseUs, br->lenUs ), chestDuty(br->fallUs, br->lenUs ),
+		br->switches, br->samples, br->lateMaxUs, cc->baseline );
+	return ( len < size ? len : size - 1 );
+}
+
+/*
+ * Function: chestReport
+ *
+ * Format the totals
+ *
+ * Returns: The length, 0 if there have been no breaths
+ */
+int
+chestReport(const struct chestControl *cc, char *buf, int size )
+{
+	const struct chestStats *st = &cc->stats;
+	int len;
+
+	buf[0] = 0;
+	if ( st->breaths == 0 && st->faults == 0 )
+	{
+		return ( 0 );
+	}
+	len = snprintf(buf, size, "%u breaths%s; error rms/max %d/%d counts; duty rise %d%% fall %d%%; latest sample %d us",
+		st->breaths, cc->fault ? ", stopped (no pressure response)" : "",
+		st->samples ? (int)sqrt((double)st->errSqSum / st->samples ) : 0, st->errMax,
+		chestDuty(st->riseUs, st->lenUs ), chestDuty(st->fallUs, st->lenUs ), st->lateMaxUs );
+	return ( len < size ? len : size - 1 );
+}
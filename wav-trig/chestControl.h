@@ -0,0 +1,142 @@
+/*
+ * chestControl.h
+ * Closed-loop chest rise: rise/fall valve control on the air pressure sensor
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHESTCONTROL_H_
+#define CHESTCONTROL_H_
+
+#include "respTimeline.h"
+
+/*
+ * With the controller enabled, the breath thread samples the chest air
+ * pressure (AIR_PRESSURE_AIN_CHANNEL) every sample_us through the breath and
+ * sets the valves from the error to a target excursion, in AIN counts over
+ * the rest pressure:
+ *
+ *	- 0 until rise on, then up to peak over the inhalation (a half cosine)
+ *	- peak through the hold
+ *	- down to 0 over the exhalation, or fall_ms with no exhalation duration
+ *
+ * Below the target by more than band, the rise valves open (until fall on);
+ * above it by more than band, the fall valve opens; otherwise both are
+ * closed. With the target at 0 the fall valve is open, as on the open-loop
+ * timeline. A valve state is held for at least min_ms, and a change from rise
+ * to fall (or back) goes through both closed, as the open-loop timeline does.
+ *
+ * The rest pressure is the lowest sample of each breath, tracked a quarter of
+ * the way per breath, unless set with baseline. If the rise valves have been
+ * open CHEST_NO_RESPONSE_MS in a breath and the pressure has not risen
+ * CHEST_NO_RESPONSE_COUNTS, or the sensor cannot be read, the controller
+ * stops for the run and the breath thread goes back to the open-loop edges.
+ *
+ * The settings are read from CHEST_CONTROL_FILE:
+ *
+ *	enable 0|1
+ *	peak <counts>
+ *	band <counts>
+ *	sample_us <usec>
+ *	min_ms <msec>			at least RESP_VALVE_GAP_MS
+ *	fall_ms <msec>
+ *	baseline <counts>		0 to track it
+ */
+
+#define CHEST_CONTROL_FILE		"/simulator/chestControl.txt"
+
+#define CHEST_PEAK_DEFAULT		300
+#define CHEST_BAND_DEFAULT		15
+#define CHEST_SAMPLE_US_DEFAULT	2000
+#define CHEST_SAMPLE_US_MIN		500
+#define CHEST_FALL_MS_DEFAULT	800
+#define CHEST_NO_RESPONSE_MS	400
+#define CHEST_NO_RESPONSE_COUNTS	10
+#define CHEST_BREATH_LIMIT		2		// Periods a breath is run with no next sync
+
+#define CHEST_VALVE_HOLD		0		// Both closed
+#define CHEST_VALVE_RISE		1
+#define CHEST_VALVE_FALL		2
+
+struct chestConfig
+{
+	int enable;
+	int peak;				// Target excursion, counts over the rest pressure
+	int band;				// No valve is opened within this of the target
+	int sampleUs;
+	int minMs;				// Least time a valve state is held
+	int fallMs;				// Deflation with no exhalation duration
+	int baseline;			// Rest pressure, counts; 0 to track it
+};
+
+struct chestBreath
+{
+	unsigned int samples;
+	long long errSqSum;		// counts^2
+	int errMax;				// Largest error either way, counts
+	int peak;				// Highest pressure over the rest pressure
+	int low;				// Lowest sample, counts
+	long long riseUs;		// Time with the rise valves open
+	long long fallUs;		// Time with the fall valve open
+	long long lenUs;
+	unsigned int switches;	// Valve state changes
+	int lateMaxUs;			// Latest sample
+};
+
+struct chestStats
+{
+	unsigned int breaths;
+	unsigned int faults;
+	unsigned long long samples;
+	long long errSqSum;
+	int errMax;
+	long long riseUs;
+	long long fallUs;
+	long long lenUs;
+	int lateMaxUs;
+};
+
+struct chestControl
+{
+	struct chestConfig cfg;
+	int baseline;			// Rest pressure, counts, 0 until the first sample
+	int fault;				// Stopped: no pressure response, or no sensor
+	int valve;				// CHEST_VALVE_
+	unsigned long long valveSinceUs;
+	unsigned long long startUs;	// Breath sync
+	unsigned long long lastUs;	// Last sample
+	int inhStartMs;			// Target profile, ms from the breath sync
+	int inhMs;
+	int fallStartMs;
+	int fallMs;
+	struct chestBreath breath;
+	struct chestStats stats;
+};
+
+void chestConfigDefaults(struct chestConfig *cfg );
+int chestConfigLoad(struct chestConfig *cfg, const char *file );
+void chestControlInit(struct chestControl *cc, const struct chestConfig *cfg );
+void chestBreathBegin(struct chestControl *cc, const struct respPlan *plan, unsigned long long startUs );
+int chestTarget(const struct chestControl *cc, int ms );
+int chestSample(struct chestControl *cc, unsigned long long dueUs, unsigned long long nowUs, int ain );
+void chestBreathEnd(struct chestControl *cc, unsigned long long nowUs );
+int chestBreathRms(const struct chestBreath *br );
+int chestDuty(long long openUs, long long lenUs );
+int chestBreathFormat(const struct chestControl *cc, char *buf, int size );
+int chestReport(const struct chestControl *cc, char *buf, int size );
+
+#endif /* CHESTCONTROL_H_ */
@@ -0,0 +1,211 @@
+/*
+ * respTimeline.cpp
+ * Breath timeline: rise, hold and fall phases from the rate and sim-mgr durations
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <stdio.h>
+
+#include "respTimeline.h"
+
+const char *respEdgeNames[RESP_EDGES] =
+{
+	"fall off",
+	"rise on",
+	"inhale",
+	"rise off",
+	"fall on",
+	"fall end"
+};
+
+/*
+ * Function: respPlanMake
+ *
+ * Lay out a breath for the rate (breaths/min) and the sim-mgr's inhalation
+ * and exhalation durations (ms, 0 or less for none)
+ */
+void
+respPlanMake(struct respPlan *rp, int rate, int inhMs, int exhMs )
+{
+	int avail;
+	int minInh = RESP_INHALE_DELAY_MS - RESP_VALVE_GAP_MS;
+
+	memset(rp, 0, sizeof(struct respPlan) );
+	rp->periodMs = ( rate > 0 ? 60000 / rate : RESP_PERIOD_DEFAULT_MS );
+	rp->inhFromSimMgr = ( inhMs > 0 );
+	rp->exhFromSimMgr = ( exhMs > 0 );
+	if ( inhMs <= 0 )
+	{
+		inhMs = rp->periodMs * RESP_INH_PERCENT / 100;
+		if ( inhMs > RESP_INH_LIMIT_MS )
+		{
+			inhMs = RESP_INH_LIMIT_MS;
+		}
+	}
+	if ( exhMs < 0 )
+	{
+		exhMs = 0;
+	}
+	avail = rp->periodMs - 2 * RESP_VALVE_GAP_MS;
+	if ( inhMs + exhMs > avail && avail > 0 )
+	{
+		inhMs = (int)( (long long)inhMs * avail / ( inhMs + exhMs ) );
+		exhMs = ( exhMs ? avail - inhMs : 0 );
+		rp->scaled = 1;
+	}
+	if ( inhMs < minInh )
+	{
+		inhMs = minInh;		// The inhalation track starts during the rise
+	}
+	rp->inhMs = inhMs;
+	rp->holdMs = RESP_VALVE_GAP_MS;
+	rp->exhMs = exhMs;
+
+	rp->at[RESP_EDGE_FALL_OFF] = 0;
+	rp->at[RESP_EDGE_RISE_ON] = RESP_VALVE_GAP_MS;
+	rp->at[RESP_EDGE_INHALE] = RESP_INHALE_DELAY_MS;
+	rp->at[RESP_EDGE_RISE_OFF] = RESP_VALVE_GAP_MS + inhMs;
+	rp->at[RESP_EDGE_FALL_ON] = rp->at[RESP_EDGE_RISE_OFF] + rp->holdMs;
+	rp->at[RESP_EDGE_FALL_END] = ( exhMs ? rp->at[RESP_EDGE_FALL_ON] + exhMs : -1 );
+}
+
+/*
+ * Function: respBreathStart
+ *
+ * Clear the timing for a new breath
+ */
+void
+respBreathStart(struct respBreathTiming *bt, unsigned int breath )
+{
+	int e;
+
+	bt->breath = breath;
+	for ( e = 0 ; e < RESP_EDGES ; e++ )
+	{
+		bt->errUs[e] = RESP_NOT_DONE;
+	}
+}
+
+/*
+ * Function: respBreathWorst
+ *
+ * Returns: The latest edge of the breath, -1 if none was done
+ */
+int
+respBreathWorst(const struct respBreathTiming *bt )
+{
+	int worst = -1;
+	int e;
+
+	for ( e = 0 ; e < RESP_EDGES ; e++ )
+	{
+		if ( bt->errUs[e] != RESP_NOT_DONE && ( worst < 0 || bt->errUs[e] > bt->errUs[worst] ) )
+		{
+			worst = e;
+		}
+	}
+	return ( worst );
+}
+
+/*
+ * Function: respTimingAdd
+ *
+ * Add a finished breath to the totals
+ */
+void
+respTimingAdd(struct respTimingStats *st, const struct respBreathTiming *bt )
+{
+	int worst = respBreathWorst(bt );
+	int e;
+
+	st->breaths++;
+	if ( worst >= 0 && bt->errUs[worst] > RESP_EDGE_LATE_US )
+	{
+		st->late++;
+	}
+	for ( e = 0 ; e < RESP_EDGES ; e++ )
+	{
+		if ( bt->errUs[e] == RESP_NOT_DONE )
+		{
+			continue;
+		}
+		st->count[e]++;
+		st->sumUs[e] += bt->errUs[e];
+		if ( bt->errUs[e] > st->maxUs[e] )
+		{
+			st->maxUs[e] = bt->errUs[e];
+		}
+	}
+}
+
+/*
+ * Function: respBreathFormat
+ *
+ * Format one breath: its plan and the error of each edge done
+ *
+ * Returns: The length
+ */
+int
+respBreathFormat(const struct respPlan *rp, const struct respBreathTiming *bt, char *buf, int size )
+{
+	int len;
+	int e;
+
+	len = snprintf(buf, size, "Breath %u: period %d, inh %d%s, exh %d%s%s; edge error us",
+		bt->breath, rp->periodMs, rp->inhMs, rp->inhFromSimMgr ? " (sim-mgr)" : "",
+		rp->exhMs, rp->exhFromSimMgr ? " (sim-mgr)" : "", rp->scaled ? ", scaled to fit" : "" );
+	for ( e = 0 ; e < RESP_EDGES && len < size ; e++ )
+	{
+		if ( bt->errUs[e] != RESP_NOT_DONE )
+		{
+			len += snprintf(&buf[len], size - len, " %s %d", respEdgeNames[e], bt->errUs[e] );
+		}
+	}
+	return ( len < size ? len : size - 1 );
+}
+
+/*
+ * Function: respTimingReport
+ *
+ * Format the edge error, average and max, per edge
+ *
+ * Returns: The length, 0 if there have been no breaths
+ */
+int
+respTimingReport(const struct respTimingStats *st, char *buf, int size )
+{
+	int len;
+	int e;
+
+	buf[0] = 0;
+	if ( st->breaths == 0 )
+	{
+		return ( 0 );
+	}
+	len = snprintf(buf, size, "%u breaths, %u late; edge error us avg/max", st->breaths, st->late );
+	for ( e = 0 ; e < RESP_EDGES && len < size ; e++ )
+	{
+		if ( st->count[e] )
+		{
+			len += snprintf(&buf[len], size - len, " %s %lld/%d", respEdgeNames[e],
+				st->sumUs[e] / st->count[e], st->maxUs[e] );
+		}
+	}
+	return ( len < size ? len : size - 1 );
+}
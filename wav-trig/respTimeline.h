@@ -0,0 +1,95 @@
+/*
+ * respTimeline.h
+ * Breath timeline: rise, hold and fall phases from the rate and sim-mgr durations
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RESPTIMELINE_H_
+#define RESPTIMELINE_H_
+
+/*
+ * Each breath is a list of edges at fixed offsets from the breath sync:
+ *
+ *	fall off	0						end of the last exhalation
+ *	rise on		RESP_VALVE_GAP_MS		inhalation (rise phase)
+ *	inhale		RESP_INHALE_DELAY_MS	inhalation track
+ *	rise off	rise on + inhalation	hold: both valves closed for the gap
+ *	fall on		rise off + gap			exhalation (fall phase)
+ *	fall end	fall on + exhalation	only with an exhalation duration
+ *
+ * The inhalation is respiration.inhalation_duration, or RESP_INH_PERCENT of
+ * the period up to RESP_INH_LIMIT_MS if the sim-mgr gives none. The fall
+ * valve closes after respiration.exhalation_duration, or stays open until the
+ * next breath if there is none. Durations that don't fit the period (less the
+ * two gaps) are scaled down together.
+ */
+
+#define RESP_EDGE_FALL_OFF	0
+#define RESP_EDGE_RISE_ON	1
+#define RESP_EDGE_INHALE	2
+#define RESP_EDGE_RISE_OFF	3
+#define RESP_EDGE_FALL_ON	4
+#define RESP_EDGE_FALL_END	5
+#define RESP_EDGES			6
+
+#define RESP_VALVE_GAP_MS		10		// Between one valve closing and the other opening
+#define RESP_INHALE_DELAY_MS	40
+#define RESP_INH_PERCENT		30
+#define RESP_INH_LIMIT_MS		1500
+#define RESP_PERIOD_DEFAULT_MS	2000	// With no rate
+#define RESP_EDGE_LATE_US		1000	// A breath with an edge later than this is logged
+
+#define RESP_NOT_DONE			(-1000000000)
+
+struct respPlan
+{
+	int periodMs;
+	int inhMs;
+	int holdMs;
+	int exhMs;				// 0: the fall valve stays open until the next breath
+	int inhFromSimMgr;
+	int exhFromSimMgr;
+	int scaled;				// Shortened to fit the period
+	int at[RESP_EDGES];		// ms from the breath sync, -1 for none
+};
+
+struct respBreathTiming
+{
+	unsigned int breath;
+	int errUs[RESP_EDGES];	// Done less due, RESP_NOT_DONE if not done
+};
+
+struct respTimingStats
+{
+	unsigned int breaths;
+	unsigned int late;		// Breaths with an edge over RESP_EDGE_LATE_US
+	unsigned int count[RESP_EDGES];
+	long long sumUs[RESP_EDGES];
+	int maxUs[RESP_EDGES];
+};
+
+extern const char *respEdgeNames[RESP_EDGES];
+
+void respPlanMake(struct respPlan *rp, int rate, int inhMs, int exhMs );
+void respBreathStart(struct respBreathTiming *bt, unsigned int breath );
+int respBreathWorst(const struct respBreathTiming *bt );
+void respTimingAdd(struct respTimingStats *st, const struct respBreathTiming *bt );
+int respBreathFormat(const struct respPlan *rp, const struct respBreathTiming *bt, char *buf, int size );
+int respTimingReport(const struct respTimingStats *st, char *buf, int size );
+
+#endif /* RESPTIMELINE_H_ */
@@ -0,0 +1,449 @@
+/*
+ * soundCatalog.cpp
+ * Compiled sound catalog: the track list from soundList.csv as a binary file
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "soundCatalog.h"
+#include "../comm/simUtil.h"
+
+#define LINE_MAX_LEN	512
+
+const char *soundTypeNames[SOUND_TYPES] =
+{
+	"unused", "heart", "lung", "pulse", "general", "heartref"
+};
+
+static void
+catalogLog(const char *fmt, const char *arg1, const char *arg2 )
+{
+	char msg[LINE_MAX_LEN + 128];
+
+	snprintf(msg, sizeof(msg), fmt, arg1, arg2 );
+	log_message("", msg );
+}
+
+/*
+ * Function: soundTypeNameToIndex
+ *
+ * Returns: The SOUND_TYPE_ for a type name, or -1
+ */
+int
+soundTypeNameToIndex(const char *typeName )
+{
+	int i;
+
+	for ( i = 0 ; i < SOUND_TYPES ; i++ )
+	{
+		if ( strcmp(typeName, soundTypeNames[i] ) == 0 )
+		{
+			return ( i );
+		}
+	}
+	return ( -1 );
+}
+
+/*
+ * Function: soundCatalogCrc
+ *
+ * Returns: The CRC-32 (IEEE, reflected) of the data
+ */
+uint32_t
+soundCatalogCrc(const void *data, size_t len )
+{
+	const unsigned char *p = (const unsigned char *)data;
+	uint32_t crc = 0xffffffff;
+	int bit;
+
+	while ( len-- )
+	{
+		crc ^= *p++;
+		for ( bit = 0 ; bit < 8 ; bit++ )
+		{
+			crc = ( crc >> 1 ) ^ ( 0xedb88320 & -( crc & 1 ) );
+		}
+	}
+	return ( ~crc );
+}
+
+/*
+ * Function: parseLine
+ *
+ * Parse one CSV line: type, track index, name, low limit, high limit. Tabs,
+ * semicolons and commas separate the fields; spaces become underscores, so
+ * "Sinus 120" is the name Sinus_120.
+ *
+ * Returns: 0 if the line gave an entry, 1 for a blank line, -1 for an error
+ */
+static int
+parseLine(const char *line, int len, struct sound *sd )
+{
+	char clean[LINE_MAX_LEN];
+	char typeName[SOUND_TYPE_LENGTH];
+	int i;
+	int sts;
+
+	if ( len >= LINE_MAX_LEN )
+	{
+		len = LINE_MAX_LEN - 1;
+	}
+	for ( i = 0 ; i < len ; i++ )
+	{
+		switch ( line[i] )
+		{
+			case '\t': case ';': case ',':
+				clean[i] = ' ';
+				break;
+			case ' ':
+				clean[i] = '_';
+				break;
+			default:
+				clean[i] = line[i];
+				break;
+		}
+	}
+	clean[len] = 0;
+	if ( strspn(clean, " \r\n" ) == (size_t)len )
+	{
+		return ( 1 );
+	}
+	memset(sd, 0, sizeof(struct sound) );
+	sts = sscanf(clean, "%15s %d %31s %d %d",	// 15: SOUND_TYPE_LENGTH, 31: SOUND_NAME_LENGTH
+		typeName,
+		&sd->index,
+		sd->name,
+		&sd->low_limit,
+		&sd->high_limit );
+	if ( sts != 5 )
+	{
+		catalogLog("soundList: can't parse line \"%s\"%s", clean, "" );
+		return ( -1 );
+	}
+	sd->type = soundTypeNameToIndex(typeName );
+	if ( sd->type <= SOUND_TYPE_UNUSED )
+	{
+		catalogLog("soundList: unknown sound type \"%s\" for %s", typeName, sd->name );
+		return ( -1 );
+	}
+	return ( 0 );
+}
+
+/*
+ * Function: soundCatalogBuild
+ *
+ * Parse the CSV in one pass and write the catalog to fileName (through a
+ * temporary file, so a reader never sees a partial catalog). If list is not
+ * NULL, it is set to the parsed entries (malloc) and count to their number.
+ *
+ * Returns: 0 if the catalog file was written, 1 if the CSV was parsed but the
+ * file could not be written, -1 if the CSV could not be read
+ */
+int
+soundCatalogBuild(const char *csvName, const char *fileName, struct sound **list, int *count )
+{
+	struct soundCatalogHeader hdr;
+	struct stat sb;
+	struct sound *sounds;
+	char *text;
+	char *line;
+	char *end;
+	char *nl;
+	char tmpName[LINE_MAX_LEN];
+	int fd;
+	int lines;
+	int n;
+	ssize_t len;
+	int sts;
+
+	fd = open(csvName, O_RDONLY );
+	if ( fd < 0 || fstat(fd, &sb ) < 0 )
+	{
+		catalogLog("Failed to open %s %s", csvName, strerror(errno ) );
+		if ( fd >= 0 )
+		{
+			close(fd );
+		}
+		return ( -1 );
+	}
+	text = (char *)malloc(sb.st_size + 1 );
+	len = text ? read(fd, text, sb.st_size ) : -1;
+	close(fd );
+	if ( len < 0 )
+	{
+		catalogLog("Failed to read %s %s", csvName, strerror(errno ) );
+		free(text );
+		return ( -1 );
+	}
+	text[len] = 0;
+	end = text + len;
+
+	// Size the list from the newlines; the final line may not have one
+	for ( lines = 1, line = text ; ( line = (char *)memchr(line, '\n', end - line ) ) ; line++ )
+	{
+		lines++;
+	}
+	sounds = (struct sound *)calloc(lines, sizeof(struct sound) );
+	if ( sounds == NULL )
+	{
+		catalogLog("No memory for the sound list of %s%s", csvName, "" );
+		free(text );
+		return ( -1 );
+	}
+
+	memset(&hdr, 0, sizeof(hdr) );
+	for ( n = 0, line = text ; line < end ; line = nl + 1 )
+	{
+		nl = (char *)memchr(line, '\n', end - line );
+		if ( ! nl )
+		{
+			nl = end;
+		}
+		if ( parseLine(line, nl - line, &sounds[n] ) == 0 )
+		{
+			if ( sounds[n].index > (int)hdr.maxTrack )
+			{
+				hdr.maxTrack = sounds[n].index;
+			}
+			n++;
+		}
+	}
+	free(text );
+
+	hdr.magic = SOUND_CATALOG_MAGIC;
+	hdr.version = SOUND_CATALOG_VERSION;
+	hdr.entrySize = sizeof(struct sound);
+	hdr.count = n;
+	hdr.crc = soundCatalogCrc(sounds, n * sizeof(struct sound) );
+	hdr.csvSize = sb.st_size;
+	hdr.csvMtime = sb.st_mtime;
+
+	sts = 1;
+	snprintf(tmpName, sizeof(tmpName), "%s.tmp", fileName );
+	fd = open(tmpName, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+	if ( fd >= 0 )
+	{
+		if ( write(fd, &hdr, sizeof(hdr) ) == (ssize_t)sizeof(hdr) &&
+			 write(fd, sounds, n * sizeof(struct sound) ) == (ssize_t)( n * sizeof(struct sound) ) &&
+			 fsync(fd ) == 0 )
+		{
+			sts = 0;
+		}
+		close(fd );
+		if ( sts == 0 && rename(tmpName, fileName ) < 0 )
+		{
+			sts = 1;
+		}
+		if ( sts )
+		{
+			unlink(tmpName );
+		}
+	}
+	if ( sts )
+	{
+		catalogLog("Failed to write %s %s", fileName, strerror(errno ) );
+	}
+	if ( list )
+	{
+		*list = sounds;
+		*count = n;
+	}
+	else
+	{
+		free(sounds );
+	}
+	return ( sts );
+}
+
+/*
+ * Function: mapCatalog
+ *
+ * Map the catalog file and check it against the CSV. csv is NULL if there is
+ * no CSV, in which case any intact catalog is used.
+ *
+ * Returns: 0 if the catalog is usable, -1 if it is missing, damaged or stale
+ */
+static int
+mapCatalog(struct soundCatalog *cat, const char *fileName, const struct stat *csv )
+{
+	const struct soundCatalogHeader *hdr;
+	struct stat sb;
+	void *map;
+	int fd;
+	int ok;
+
+	fd = open(fileName, O_RDONLY );
+	if ( fd < 0 )
+	{
+		return ( -1 );
+	}
+	if ( fstat(fd, &sb ) < 0 || sb.st_size < (off_t)sizeof(struct soundCatalogHeader) )
+	{
+		close(fd );
+		return ( -1 );
+	}
+	map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	close(fd );
+	if ( map == MAP_FAILED )
+	{
+		return ( -1 );
+	}
+	hdr = (const struct soundCatalogHeader *)map;
+	ok = ( hdr->magic == SOUND_CATALOG_MAGIC &&
+		   hdr->version == SOUND_CATALOG_VERSION &&
+		   hdr->entrySize == sizeof(struct sound) &&
+		   (off_t)( sizeof(*hdr) + (size_t)hdr->count * sizeof(struct sound) ) == sb.st_size &&
+		   soundCatalogCrc(hdr + 1, hdr->count * sizeof(struct sound) ) == hdr->crc );
+	if ( ok && csv )
+	{
+		ok = ( hdr->csvSize == (uint64_t)csv->st_size && hdr->csvMtime == (int64_t)csv->st_mtime );
+	}
+	if ( ! ok )
+	{
+		munmap(map, sb.st_size );
+		return ( -1 );
+	}
+	cat->sounds = (const struct sound *)( hdr + 1 );
+	cat->count = hdr->count;
+	cat->maxTrack = hdr->maxTrack;
+	cat->map = map;
+	cat->mapLen = sb.st_size;
+	return ( 0 );
+}
+
+/*
+ * Function: soundCatalogOpen
+ *
+ * Map the catalog, rebuilding it from the CSV first if it is missing, damaged
+ * or older than the CSV. If the rebuilt catalog can't be written (read-only
+ * /simulator), the entries parsed from the CSV are used from memory.
+ *
+ * Returns: 0 on success, -1 if there is neither a CSV nor a usable catalog
+ */
+int
+soundCatalogOpen(struct soundCatalog *cat, const char *csvName, const char *fileName )
+{
+	struct stat csv;
+	int haveCsv;
+	int sts;
+	int i;
+
+	memset(cat, 0, sizeof(struct soundCatalog) );
+	haveCsv = ( stat(csvName, &csv ) == 0 );
+	if ( mapCatalog(cat, fileName, haveCsv ? &csv : NULL ) == 0 )
+	{
+		if ( ! haveCsv )
+		{
+			catalogLog("No %s, using %s", csvName, fileName );
+		}
+		return ( 0 );
+	}
+	if ( ! haveCsv )
+	{
+		catalogLog("Failed to open %s %s", csvName, strerror(errno ) );
+		return ( -1 );
+	}
+	cat->rebuilt = 1;
+	sts = soundCatalogBuild(csvName, fileName, &cat->heap, &cat->count );
+	if ( sts < 0 )
+	{
+		return ( -1 );
+	}
+	if ( sts == 0 && mapCatalog(cat, fileName, &csv ) == 0 )
+	{
+		free(cat->heap );
+		cat->heap = NULL;
+		return ( 0 );
+	}
+	cat->sounds = cat->heap;
+	for ( i = 0 ; i < cat->count ; i++ )
+	{
+		if ( cat->heap[i].index > cat->maxTrack )
+		{
+			cat->maxTrack = cat->heap[i].index;
+		}
+	}
+	return ( 0 );
+}
+
+/*
+ * Function: soundCatalogCheckTracks
+ *
+ * Check the entries against the board. Tracks are numbered by the file name
+ * prefix on the SD card, so the count the board reports (getSysInfo) need not
+ * reach the highest index; but an index past what the board can address is
+ * wrong, and a catalog using more distinct tracks than the board holds names
+ * tracks that are missing. Each problem is logged.
+ *
+ * Returns: The number of problems found
+ */
+int
+soundCatalogCheckTracks(const struct soundCatalog *cat, int numTracks, int maxIndex )
+{
+	static unsigned char used[SOUND_NUM_TRACKS + 1];
+	char msg[160];
+	int bad = 0;
+	int distinct = 0;
+	int i;
+	int index;
+
+	memset(used, 0, sizeof(used) );
+	for ( i = 0 ; i < cat->count ; i++ )
+	{
+		index = cat->sounds[i].index;
+		if ( index < 1 || index > maxIndex || index > SOUND_NUM_TRACKS )
+		{
+			snprintf(msg, sizeof(msg), "soundList: %s %s track %d is out of range (1-%d)",
+				soundTypeNames[cat->sounds[i].type], cat->sounds[i].name, index, maxIndex );
+			log_message("", msg );
+			bad++;
+		}
+		else if ( ! used[index] )
+		{
+			used[index] = 1;
+			distinct++;
+		}
+	}
+	if ( distinct > numTracks )
+	{
+		snprintf(msg, sizeof(msg), "soundList: uses %d tracks, the board has %d", distinct, numTracks );
+		log_message("", msg );
+		bad++;
+	}
+	return ( bad );
+}
+
+void
+soundCatalogClose(struct soundCatalog *cat )
+{
+	if ( cat->map )
+	{
+		munmap(cat->map, cat->mapLen );
+	}
+	free(cat->heap );
+	memset(cat, 0, sizeof(struct soundCatalog) );
+}
@@ -0,0 +1,97 @@
+/*
+ * soundCatalog.h
+ * Compiled sound catalog: the track list from soundList.csv as a binary file
+ *
+ * This file is part of the sim-ctl distribution (https://github.com/OpenVetSimDevelopers/sim-ctl).
+ *
+ * Copyright (c) 2026 VetSim, Cornell University College of Veterinary Medicine Ithaca, NY
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SOUNDCATALOG_H_
+#define SOUNDCATALOG_H_
+
+#include <stdint.h>
+
+/*
+ * The catalog is a header followed by an array of struct sound, in CSV order.
+ * soundSense maps it read-only and uses the entries in place. It is rebuilt
+ * from the CSV when the CSV size or modification time differs from the one
+ * recorded in the header, or when the magic, version, entry size, length or
+ * CRC does not match.
+*/
+
+#define SOUND_CATALOG_CSV		"/simulator/soundList.csv"
+#define SOUND_CATALOG_FILE		"/simulator/soundList.bin"
+#define SOUND_CATALOG_MAGIC		0x54414353		// "SCAT"
+#define SOUND_CATALOG_VERSION	1
+
+#define SOUND_TYPE_UNUSED	0
+#define SOUND_TYPE_HEART	1
+#define SOUND_TYPE_LUNG		2
+#define SOUND_TYPE_PULSE	3
+#define SOUND_TYPE_GENERAL	4
+#define SOUND_TYPE_HEART_REF	5	// Reference beat: low limit is the rate it was recorded at
+#define SOUND_TYPES			6
+
+#define SOUND_TYPE_LENGTH	16
+#define SOUND_NAME_LENGTH	32
+
+// The Tsunami is capable of supporting up to 4096 tracks, the WAV Trigger 999
+#define SOUND_NUM_TRACKS		(4096)
+#define SOUND_NUM_TRACKS_WAV	(999)
+
+struct sound
+{
+	int type;
+	int index;
+	char name[SOUND_NAME_LENGTH];
+	int low_limit;
+	int high_limit;
+};
+
+struct soundCatalogHeader
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t entrySize;		// sizeof(struct sound)
+	uint32_t count;			// Entries following the header
+	uint32_t crc;			// CRC-32 of the entries
+	uint32_t maxTrack;		// Highest track index in the entries
+	uint32_t spare;
+	uint64_t csvSize;		// soundList.csv the catalog was built from
+	int64_t csvMtime;
+};
+
+struct soundCatalog
+{
+	const struct sound *sounds;
+	int count;
+	int maxTrack;
+	int rebuilt;			// 1 if built from the CSV on this open
+	void *map;				// mmap of the catalog file, or NULL
+	size_t mapLen;
+	struct sound *heap;		// Entries parsed from the CSV when the file could not be written
+};
+
+extern const char *soundTypeNames[SOUND_TYPES];
+
+int soundTypeNameToIndex(const char *typeName );
+int soundCatalogOpen(struct soundCatalog *cat, const char *csvName, const char *fileName );
+int soundCatalogBuild(const char *csvName, const char *fileName, struct sound **list, int *count );
+int soundCatalogCheckTracks(const struct soundCatalog *cat, int numTracks, int maxIndex );
+void soundCatalogClose(struct soundCatalog *cat );
+uint32_t soundCatalogCrc(const void *data, size_t len );
+
+#endif /* SOUNDCATALOG_H_ */
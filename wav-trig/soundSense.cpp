@@ -50,19 +50,35 @@
 
 
 #include "wavTrigger.h"
+#include "soundCatalog.h"
+#include "audioSched.h"
+#include "beatEngine.h"
+#include "respTimeline.h"
+#include "chestControl.h"
 #include "../cardiac/rfidScan.h"
 
 #include "../comm/simCtlComm.h"
 #include "../comm/simUtil.h"
 #include "../comm/shmData.h"
+#include "../comm/simModule.h"
+#include "../comm/simRt.h"
+#include "../comm/simMetrics.h"
+#include "../comm/simTrace.h"
+#include "../comm/simSession.h"
+#include "../comm/simSymbols.h"
+#include "../comm/simBoot.h"
 
 wavTrigger wav;
 wavTrigger wav2;
-wavTrigger *wavPulse;
+wavTrigger *wavPulse = &wav;
 
 simCtlComm comm;
 
+#ifndef SIM_HUB
 struct shmData *shmData;
+#else
+extern struct shmData *shmData;
+#endif
 
 char msgbuf[1024];
 
@@ -81,23 +97,24 @@ pthread_t threadInfo3;
 
 /* prototype for thread routines */
 void *sync_thread ( void *ptr );
+void *pulse_thread ( void *ptr );
+void *breath_thread ( void *ptr );
+static void breathInit(void );
+static void breathSignal(void );
 void runHeart(void );
+void setHeartVolume(int force );
+void setLeftLungVolume(int force );
+void setRightLungVolume(int force );
 void lungFall(int control );
 void lungRise(int control );
 void runLung(void );
 void initialize_timers(void );
 timer_t heart_timer;
-timer_t breath_timer;
-timer_t rise_timer;
 struct sigevent heart_sev;
-struct sigevent breath_sev;
-struct sigevent rise_sev;
 	
 time_t fallStopTime = 0;
 
 #define HEART_TIMER_SIG		(SIGRTMIN+2)
-#define BREATH_TIMER_SIG	(SIGRTMIN+3)
-#define RISE_TIMER_SIG		(SIGRTMIN+4)
 
 #define SOUND_LOOP_DELAY	20000	// Delay in usec
 
@@ -107,10 +124,73 @@ using namespace std;
 
 char sioName[2][MAX_BUF];
 
+#ifndef SIM_HUB
 int debug = 0;
+#else
+extern int debug;
+#endif
 int ldebug = 0;
 int monitor = 0;
 int soundTest = 0;
+int soundListenState = FALSE;
+
+// Listen state bark, run a step per poll by barkRun()
+#define BARK_IDLE			0
+#define BARK_WAIT_QUIET		1	// Waiting for the tracks playing to end
+#define BARK_PLAYING		2
+#define BARK_WAIT_MAX_MS	5000	// Stop the tracks if they have not ended by then
+static int barkState = BARK_IDLE;
+static int barkSavedVolume;
+static unsigned int barkStart;
+
+int soundInit(void );
+void soundPoll(void );
+void soundPulseEvent(void );
+struct simModule soundModule = { "soundSense", SIM_MODULE_SOUND, soundInit, soundPoll, SOUND_LOOP_DELAY, SIM_MODULE_RT, soundPulseEvent };
+
+// Real-time profile. "loop" is the module loop, which also takes the timer signals.
+struct simRtThread soundRtThreads[] =
+{
+	{ "loop", 45 },
+	{ "sync", 46 },
+	{ "pulse", 44 },
+	{ "breath", 47 },
+};
+#define SOUND_RT_THREADS	(int)(sizeof(soundRtThreads) / sizeof(struct simRtThread))
+struct simRtProfile rtProfile;
+int rtForce = 0;
+void soundRtSetup(void );
+void soundRtThreadStart(const char *name );
+
+// Jitter mode (-j): lateness of the timing path events against their scheduled times
+#define JITTER_REPORT_SEC	10
+#define JIT_PULSE_GPIO		0	// Heart sync to pulse GPIO on
+#define JIT_LUB				1	// Lub/dub track start, LUB_DELAY after the pulse GPIO
+#define JIT_RISE_ON			2	// Breath sync (plus the 10 ms fall to rise gap) to rise GPIO on
+#define JIT_RISE_OFF		3	// Rise GPIO off at the end of the inhalation time
+#define JIT_INHALE			4	// Inhalation track start, 40 ms after the breath sync
+#define JIT_EVENTS			5
+int jitterMode = 0;
+struct simRtJitter jitter[JIT_EVENTS];
+unsigned long long breathSyncUs = 0;
+unsigned long long lubDueUs = 0;
+unsigned long long inhaleDueUs = 0;
+
+// Breath timeline (breath_thread)
+pthread_mutex_t breathMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t breathCond;
+int breathKick = 0;
+struct respBreathTiming breathTiming;
+struct respTimingStats breathStats;
+
+// Closed-loop chest rise (chestControl.h), run by the breath thread
+struct chestControl chest;
+struct ainHandle chestAin;
+void jitterReport(void );
+
+// Boot timeline (simBoot.h), logged once at the first heart sound
+int bootLogged = 0;
+void bootReport(void );
 
 void runMonitor(void );
 
@@ -160,8 +240,34 @@ setTermios(int fd, int speed )
 #define PULSE_TRACK_LEFT		104
 #define PULSE_TRACK_RIGHT		105
 
+/*
+ * Pulse outputs
+ *
+ * The pulse track is started on every beat for each point with a pulse, and the
+ * touch on the point gates it by the gain. Touch changes come from the pulse
+ * process as events (shmData->pulse.touchSeq). pulse_thread sleeps on them and
+ * kicks the module loop, and soundPulseEvent applies the new gain there, so a
+ * press is felt on the beat in progress rather than the next one. Only the loop
+ * thread talks to the board. The press-to-feel latency is recorded.
+*/
+
+struct pulseOutput
+{
+	int position;
+	int source;			// AUDIO_SRC_, which gives the Tsunami output
+	int track;			// WAV Trigger
+	int gain;			// As last sent
+};
+struct pulseOutput pulseOutputs[] =
+{
+	{ PULSE_LEFT_FEMORAL,	AUDIO_SRC_PULSE_LF, PULSE_TRACK_LEFT,	1 },
+	{ PULSE_RIGHT_FEMORAL,	AUDIO_SRC_PULSE_RF, PULSE_TRACK_RIGHT,	1 }
+};
+#define PULSE_OUTPUTS	(int)(sizeof(pulseOutputs) / sizeof(struct pulseOutput))
+
 int getPulseVolume(int pressure, int strength );
 void doPulse(void);
+static void setPulseGain(struct pulseOutput *po, int force );
 
 int heartPlaying = 0;
 int lungPlaying = 0;
@@ -173,18 +279,25 @@ struct current
 	int heart_sound_volume;
 	int heart_sound_mute;
 	int heart_rate;
-	char heart_sound[32];
+	int heart_sound_id;
+	char heart_sound[STR_SIZE];
 	
 	int left_lung_sound_volume;
 	int left_lung_sound_mute;
-	char left_lung_sound[32];
+	int left_lung_sound_id;
+	char left_lung_sound[STR_SIZE];
 	int right_lung_sound_volume;
 	int right_lung_sound_mute;
-	char right_lung_sound[32];
+	int right_lung_sound_id;
+	char right_lung_sound[STR_SIZE];
 	int respiration_rate;
 	
-	unsigned int heartCount;
+	unsigned int heartCount;		// sim-mgr pulse syncs, VPC or not
+	unsigned int heartVpcCount;		// sim-mgr pulseVPC syncs
 	unsigned int breathCount;
+	int vpc_id;
+	char vpc[STR_SIZE];
+	int vpc_freq;
 	
 	int masterGain;
 	int leftLungGain;
@@ -203,161 +316,138 @@ int lubdub = 0;
 int inhL = 0;
 int inhR = 0;
 
-#define SOUND_TYPE_UNUSED	0
-#define SOUND_TYPE_HEART	1
-#define SOUND_TYPE_LUNG		2
-#define SOUND_TYPE_PULSE	3
-#define SOUND_TYPE_GENERAL	4
+/*
+ * Track changes are not applied when the rate or sound changes but at the
+ * next beat (commitHeart) or breath (commitLung), so a sound is never cut off
+ * part way. The new track is loaded paused as soon as the change is seen, and
+ * the beat or breath starts it with the resume it sends anyway.
+ */
+int pendingLubdub = 0;
+int pendingRateMode = 0;
+int pendingRateOffset = 0;
+int heartRateOffset = 0;
+int heartPending = 0;
+int pendingInhL = 0;
+int pendingInhR = 0;
+int lungPending = 0;
+
+// A lung track change is crossfaded at the breath, over at most a third of it
+#define LUNG_FADE_MS	300
+
+// The sound list, mapped from the compiled catalog (soundCatalog.h)
+struct soundCatalog catalog;
+const struct sound *soundList;
+int maxSounds = 0;
 
-#define SOUND_TYPE_LENGTH	8
-struct soundType
-{
-	int type;
-	char typeName[SOUND_TYPE_LENGTH];
-};
-struct soundType soundTypes[] =
-{
-	{ SOUND_TYPE_UNUSED,	"unused" },
-	{ SOUND_TYPE_HEART,		"heart" },
-	{ SOUND_TYPE_LUNG,		"lung" },
-	{ SOUND_TYPE_PULSE,		"pulse" },
-	{ SOUND_TYPE_GENERAL,	"general" }
-};
+/*
+ * The sim-mgr's sound names are matched to the catalog by symbol ID
+ * (comm/simSymbols.h): soundSym[i] is the ID of soundList[i].name, resolved
+ * again for the entries without one whenever the table has grown. A name with
+ * no entry of its type is reported once per ID.
+ */
+int *soundSym = NULL;
+unsigned int soundSymGeneration = 0;
+unsigned int soundSymCount = 0;		// Symbols when soundSym was resolved
+unsigned char soundSymReported[SIM_SYMBOLS_MAX];
 
+/*
+ * Function: initSoundList
+ *
+ * Map the sound catalog, rebuilding it from /simulator/soundList.csv if that
+ * has changed. Exits if there is neither.
+ *
+ * Returns: 0
+ */
 int
-typeNameToIndex(char *typeName )
+initSoundList(void )
 {
-	int i;
-	
-	for ( i = 0 ; i < 5 ; i++ )
+	if ( soundCatalogOpen(&catalog, SOUND_CATALOG_CSV, SOUND_CATALOG_FILE ) < 0 )
 	{
-		if ( strcmp(typeName, soundTypes[i].typeName ) == 0 )
+		if ( debug )
 		{
-			return ( soundTypes[i].type );
+			fprintf(stderr, "Failed to open %s\n", SOUND_CATALOG_CSV );
 		}
+		exit ( -2 );
 	}
-	return -1;
+	soundList = catalog.sounds;
+	maxSounds = catalog.count;
+	soundSym = (int *)calloc(maxSounds > 0 ? maxSounds : 1, sizeof(int) );
+	if ( soundSym == NULL )
+	{
+		log_message("", "No memory for the sound symbol table" );
+		exit ( -2 );
+	}
+	snprintf(msgbuf, 1024, "Sound catalog: %d sounds, highest track %d%s",
+		maxSounds, catalog.maxTrack, catalog.rebuilt ? ", rebuilt from the CSV" : "" );
+	log_message("", msgbuf);
+	return ( 0 );
 }
-#define SOUND_NAME_LENGTH	32
-struct sound
-{
-	int type;
-	int index;
-	char name[SOUND_NAME_LENGTH];
-	int low_limit;
-	int high_limit;
-};
-
-// The Tsunami is capable of supporting up to 4096 tracks
-#define SOUND_NUM_TRACKS		(4096)
-int maxSounds = 0;
-struct sound *soundList;
-int soundIndex = 0;
 
-int
-addSoundToList(int type, int index, const char *name, int low_limit, int high_limit )
+/*
+ * Function: soundSymSync
+ *
+ * Resolve the catalog entries that have no symbol ID yet, if the table has
+ * grown since the last time. If simController has rebuilt the table, every ID
+ * held is dropped, and the current sounds are taken as changed.
+ */
+static void
+soundSymSync(void )
 {
-	int sts;
-	if ( soundIndex >= maxSounds )
+	unsigned int generation = shmData->symbols.generation;
+	unsigned int count = shmData->symbols.count;
+	int i;
+	
+	if ( generation != soundSymGeneration )
 	{
-		snprintf(msgbuf, 1024, "Too many tracks in sound list" );
-		log_message("", msgbuf );
-		sts = -1;
+		soundSymGeneration = generation;
+		soundSymCount = 0;
+		memset(soundSym, 0, maxSounds * sizeof(int) );
+		memset(soundSymReported, 0, sizeof(soundSymReported) );
+		current.heart_sound_id = -1;
+		current.left_lung_sound_id = -1;
+		current.right_lung_sound_id = -1;
+		current.vpc_id = -1;
 	}
-	else if ( soundList[soundIndex].type == SOUND_TYPE_UNUSED )
+	if ( count == soundSymCount )
 	{
-		soundList[soundIndex].type = type;
-		soundList[soundIndex].index = index;
-		memcpy(soundList[soundIndex].name, name, SOUND_NAME_LENGTH );
-		soundList[soundIndex].low_limit = low_limit;
-		soundList[soundIndex].high_limit = high_limit;
-		soundIndex++;
-		sts = 0;
+		return;
 	}
-	else
+	soundSymCount = count;
+	for ( i = 0 ; i < maxSounds ; i++ )
 	{
-		snprintf(msgbuf, 1024, "bad entry in sound list" );
-		log_message("", msgbuf );
-		sts = -1;
+		if ( soundSym[i] == SIM_SYMBOL_NONE )
+		{
+			soundSym[i] = simSymbolFind(soundList[i].name );
+		}
 	}
-	return ( sts );
 }
-#define LINE_MAX_LEN	512
-int
-initSoundList(void )
+
+/*
+ * Function: soundSymKnown
+ *
+ * Check that the catalog has an entry of the type for the symbol. A name
+ * without one is logged the first time only.
+ *
+ * Returns: 1 if it has, 0 if not
+ */
+static int
+soundSymKnown(int id, int type, const char *what )
 {
-	FILE *file;
-	int lines;
-	char line[LINE_MAX_LEN];
-	char *in;
-	char *out;
-	char clean[1060];
-	struct sound sd;
-	char typeName[SOUND_TYPE_LENGTH];
-	int sts;
+	int i;
 	
-	file = fopen("/simulator/soundList.csv", "r" );
-	if ( file == NULL )
+	soundSymSync();
+	for ( i = 0 ; i < maxSounds ; i++ )
 	{
-		if ( debug )
+		if ( soundSym[i] == id && soundList[i].type == type && id != SIM_SYMBOL_NONE )
 		{
-			perror("fopen" );
-			fprintf(stderr, "Failed to open /simulator/soundList.csv\n" );
+			return ( 1 );
 		}
-		else
-		{
-			snprintf(msgbuf, 1024, "Failed to open /simulator/soundList.csv %s", strerror(errno) );
-			log_message("", msgbuf);
-		}
-		exit ( -2 );
-	}
-	
-	for ( lines = 0 ; fgets(line, LINE_MAX_LEN, file ) ; lines++ )
-	{
 	}
-	printf("Found %d lines in file\n", lines );
-	maxSounds = lines + 1;
-	soundList = (struct sound *)calloc(maxSounds, sizeof(struct sound) );
-	
-	fseek(file, 0, SEEK_SET );
-	for ( lines = 0 ; fgets(line, LINE_MAX_LEN, file ) ; lines++ )
+	if ( id > SIM_SYMBOL_NONE && id < SIM_SYMBOLS_MAX && ! soundSymReported[id] )
 	{
-		in = (char *)line;
-		out = (char *)clean;
-		while ( *in )
-		{
-			switch ( *in )
-			{
-				case '\t': case ';': case ',':
-					*out = ' ';
-					break;
-				case ' ':
-					*out = '_';
-					break;
-				default:
-					*out = *in;
-					break;
-			}
-			out++;
-			in++;
-		}
-		*out = 0;
-		sts = sscanf(clean, "%s %d %s %d %d", 
-			typeName,
-			&sd.index,
-			sd.name,
-			&sd.low_limit,
-			&sd.high_limit );
-		if ( sts == 5 )
-		{
-			sd.type = typeNameToIndex(typeName );
-			addSoundToList( sd.type, sd.index, sd.name, sd.low_limit, sd.high_limit );
-		}
-		else
-		{
-			snprintf(msgbuf, 1024, "sscanf returns %d for line: \"%s\"\n", sts, line );
-			log_message("", msgbuf);
-		}
+		soundSymReported[id] = 1;
+		snprintf(msgbuf, 1024, "%s \"%s\" is not in %s", what, simSymbolName(id ), SOUND_CATALOG_CSV );
+		log_message("", msgbuf);
 	}
 	return ( 0 );
 }
@@ -372,41 +462,187 @@ showSounds(void )
 		if ( soundList[i].type != SOUND_TYPE_UNUSED )
 		{
 			printf("%s,%d,%s,%d,%d\n",
-				soundTypes[soundList[i].type].typeName, soundList[i].index, soundList[i].name, soundList[i].low_limit, soundList[i].high_limit );
+				soundTypeNames[soundList[i].type], soundList[i].index, soundList[i].name, soundList[i].low_limit, soundList[i].high_limit );
 		}
 	}
 }
 
+/*
+ * Heart rate rendering
+ *
+ * A "heartref" entry in soundList.csv gives one reference beat for a heart
+ * sound, with the rate it was recorded at as its low limit:
+ *		heartref,150,normal,90,0
+ * With one, the beat is played at the exact cardiac.rate by the Tsunami's
+ * sample-rate offset (pitch and time scaled together, an octave either way)
+ * instead of by the track for the rate range. The offset applies to a whole
+ * output, so the heart then plays on HEART_RATE_CHANNEL, which must be mixed
+ * into the stethoscope, and the lung sounds on channel 0 are not shifted. The
+ * WAV Trigger's offset is global, so it always uses the rate range tracks.
+ */
+#define HEART_RATE_CHANNEL		1
+#define HEART_RATE_OFFSET_MAX	32767	// One octave
+
+int heartRateMode = 0;
+
+/*
+ * Function: getHeartReference
+ *
+ * Look for a reference beat for the heart sound that can be scaled to the
+ * rate, and the offset for it.
+ *
+ * Returns: The track, or -1 to use the rate range tracks
+ */
+static int
+getHeartReference(int hr, int *offsetp )
+{
+	const struct sound *sound = NULL;
+	double octaves;
+	double rendered;
+	int offset;
+	int i;
+	
+	if ( wav.boardType != BOARD_TSUNAMI || hr <= 0 || current.heart_sound_id <= SIM_SYMBOL_NONE )
+	{
+		return ( -1 );
+	}
+	for ( i = 0 ;  i < maxSounds ; i++ )
+	{
+		if ( soundList[i].type == SOUND_TYPE_HEART_REF && soundSym[i] == current.heart_sound_id )
+		{
+			sound = &soundList[i];
+			break;
+		}
+	}
+	if ( sound == NULL || sound->low_limit <= 0 )
+	{
+		return ( -1 );
+	}
+	octaves = log2((double)hr / sound->low_limit );
+	if ( fabs(octaves ) > 1.0 )
+	{
+		snprintf(msgbuf, 1024, "Heart rate %d is more than an octave from the %s reference (%d), using the rate range tracks",
+			hr, sound->name, sound->low_limit );
+		log_message("", msgbuf);
+		return ( -1 );
+	}
+	offset = (int)lround(octaves * HEART_RATE_OFFSET_MAX );
+	rendered = sound->low_limit * pow(2.0, (double)offset / HEART_RATE_OFFSET_MAX );
+	*offsetp = offset;
+	snprintf(msgbuf, 1024, "Heart rate %d: %s reference track %d (%d) offset %d, renders %.2f (%+.3f%%)",
+		hr, sound->name, sound->index, sound->low_limit, offset, rendered, ( rendered - hr ) * 100.0 / hr );
+	log_message("", msgbuf);
+	return ( sound->index );
+}
+
+/*
+ * Function: setMasterGain
+ *
+ * The stethoscope gain: channel 0, and the heart's output when it has its own
+ */
+static void
+setMasterGain(int gain )
+{
+	wav.channelGain(0, gain );
+	if ( heartRateMode )
+	{
+		wav.channelGain(HEART_RATE_CHANNEL, gain );
+	}
+}
+
+/*
+ * Function: getHeartFiles
+ *
+ * Find the track for the heart sound and rate, and load it for the next beat
+ */
 void
 getHeartFiles(void )
 {
 	int hr = shmData->cardiac.rate;
 	int i;
 	int new_lubdub = -1;
-	struct sound *sound;
+	int mode = 0;
+	int offset = 0;
+	const struct sound *sound;
 	
-	for ( i = 0 ;  i < maxSounds ; i++ )
+	soundSymSync();
+	new_lubdub = getHeartReference(hr, &offset );
+	if ( new_lubdub > 0 )
 	{
-		sound = &soundList[i];
-		if ( ( sound->type == SOUND_TYPE_HEART ) && ( strcmp(sound->name, current.heart_sound ) == 0 ) && ( sound->low_limit <= hr ) && ( sound->high_limit >= hr ) )
+		mode = 1;
+	}
+	else
+	{
+		offset = 0;
+		if ( ! soundSymKnown(current.heart_sound_id, SOUND_TYPE_HEART, "Heart sound" ) )
 		{
-			new_lubdub = sound->index;
-			break;
+			return;
+		}
+		for ( i = 0 ;  i < maxSounds ; i++ )
+		{
+			sound = &soundList[i];
+			if ( ( sound->type == SOUND_TYPE_HEART ) && ( soundSym[i] == current.heart_sound_id ) && ( sound->low_limit <= hr ) && ( sound->high_limit >= hr ) )
+			{
+				new_lubdub = sound->index;
+				break;
+			}
 		}
 	}
 	if ( new_lubdub == -1 )
 	{
 		snprintf(msgbuf, 1024, "No lubdub file for %s %d", current.heart_sound, shmData->cardiac.rate );
 		log_message("", msgbuf);
+		return;
 	}
-	else
+	pendingLubdub = new_lubdub;
+	pendingRateMode = mode;
+	pendingRateOffset = offset;
+	heartPending = 1;
+	
+	// The beat now playing has its voice; the next one plays on the new output
+	audioSchedSetChannel(AUDIO_SRC_HEART, mode ? HEART_RATE_CHANNEL : 0 );
+	if ( audioSchedPreload(AUDIO_SRC_HEART, pendingLubdub ) >= 0 )
 	{
-		lubdub = new_lubdub;
+		wav.trackGain(pendingLubdub, current.heartGain );
 	}
-	snprintf(msgbuf, 1024, "Get Heart Files %s : %d", 
-		current.heart_sound, lubdub );
+	snprintf(msgbuf, 1024, "Get Heart Files %s : %d (playing %d)", 
+		current.heart_sound, pendingLubdub, lubdub );
 	log_message("", msgbuf);
 }
+
+/*
+ * Function: commitHeart
+ *
+ * Switch to the pending heart track. Called at the beat, in its batch.
+ */
+static void
+commitHeart(void )
+{
+	if ( ! heartPending )
+	{
+		return;
+	}
+	heartPending = 0;
+	if ( pendingRateOffset != heartRateOffset )
+	{
+		wav.samplerateOffset(HEART_RATE_CHANNEL, pendingRateOffset );
+		heartRateOffset = pendingRateOffset;
+	}
+	if ( pendingRateMode != heartRateMode )
+	{
+		heartRateMode = pendingRateMode;
+		setMasterGain(current.masterGain );
+	}
+	lubdub = pendingLubdub;
+	setHeartVolume(1 );
+}
+
+/*
+ * Function: getLungFiles
+ *
+ * Find the tracks for the lung sounds and rate, and load the one for the side
+ * being listened to for the next breath
+ */
 void
 getLungFiles(void )
 {
@@ -414,48 +650,282 @@ getLungFiles(void )
 	int i;
 	int new_inhL = -1;
 	int new_inhR = -1;
-	struct sound *sound;
+	const struct sound *sound;
+	int knownL;
+	int knownR;
 	
-	for ( i = 0 ;  i < maxSounds ; i++ )
+	soundSymSync();
+	knownL = soundSymKnown(current.left_lung_sound_id, SOUND_TYPE_LUNG, "Lung sound" );
+	knownR = soundSymKnown(current.right_lung_sound_id, SOUND_TYPE_LUNG, "Lung sound" );
+	for ( i = 0 ;  i < maxSounds && knownL ; i++ )
 	{
 		sound = &soundList[i];
-		if ( ( sound->type == SOUND_TYPE_LUNG ) && (strcmp(sound->name, current.left_lung_sound ) == 0 ) && ( sound->low_limit <= breathRate ) && ( sound->high_limit >= breathRate ) )
+		if ( ( sound->type == SOUND_TYPE_LUNG ) && ( soundSym[i] == current.left_lung_sound_id ) && ( sound->low_limit <= breathRate ) && ( sound->high_limit >= breathRate ) )
 		{
 			new_inhL = sound->index;
 			break;
 		}
 	}
-	for ( i = 0 ;  i < maxSounds ; i++ )
+	for ( i = 0 ;  i < maxSounds && knownR ; i++ )
 	{
 		sound = &soundList[i];
-		if ( ( sound->type == SOUND_TYPE_LUNG ) && (strcmp(sound->name, current.right_lung_sound ) == 0 ) && ( sound->low_limit <= breathRate ) && ( sound->high_limit >= breathRate ) )
+		if ( ( sound->type == SOUND_TYPE_LUNG ) && ( soundSym[i] == current.right_lung_sound_id ) && ( sound->low_limit <= breathRate ) && ( sound->high_limit >= breathRate ) )
 		{
 			new_inhR = sound->index;
 			break;
 		}
 	}
-	if ( new_inhL == -1 )
+	pendingInhL = inhL;
+	pendingInhR = inhR;
+	if ( new_inhL == -1 && knownL )	// An unknown name was reported by soundSymKnown
 	{
 		snprintf(msgbuf, 1024, "No inhL file for %s %d", current.left_lung_sound, shmData->respiration.rate );
 		log_message("", msgbuf);
 	}
-	else
+	else if ( new_inhL != -1 )
 	{
-		inhL = new_inhL;
+		pendingInhL = new_inhL;
 	}
-	if ( new_inhR == -1 )
+	if ( new_inhR == -1 && knownR )
 	{
 		snprintf(msgbuf, 1024, "No inhR file for %s %d", current.right_lung_sound, shmData->respiration.rate );
 		log_message("", msgbuf);
 	}
-	else
+	else if ( new_inhR != -1 )
+	{
+		pendingInhR = new_inhR;
+	}
+	lungPending = 1;
+	
+	if ( shmData->auscultation.side == 1 )
+	{
+		if ( audioSchedPreload(AUDIO_SRC_LUNG_L, pendingInhL ) >= 0 )
+		{
+			wav.trackGain(pendingInhL, current.leftLungGain );
+		}
+	}
+	else if ( shmData->auscultation.side > 1 && shmData->auscultation.side < 4 )
 	{
-		inhR = new_inhR;
+		if ( audioSchedPreload(AUDIO_SRC_LUNG_R, pendingInhR ) >= 0 )
+		{
+			wav.trackGain(pendingInhR, current.rightLungGain );
+		}
 	}
 	snprintf(msgbuf, 1024, "Get Lung Files %s : %d, %s : %d", 
-		current.left_lung_sound, inhL, current.right_lung_sound, inhR );
+		current.left_lung_sound, pendingInhL, current.right_lung_sound, pendingInhR );
 	log_message("", msgbuf);
 }
+
+/*
+ * Function: commitLung
+ *
+ * Switch to the pending lung tracks. Called at the breath, in its batch. The
+ * side about to be played crossfades from its old track.
+ */
+static void
+commitLung(void )
+{
+	int side = shmData->auscultation.side;
+	int fadeMs = LUNG_FADE_MS;
+	
+	if ( ! lungPending )
+	{
+		return;
+	}
+	lungPending = 0;
+	if ( shmData->respiration.rate > 0 && 20000 / shmData->respiration.rate < fadeMs )
+	{
+		fadeMs = 20000 / shmData->respiration.rate;
+	}
+	if ( side == 1 && inhL && pendingInhL != inhL )
+	{
+		audioSchedCrossFade(AUDIO_SRC_LUNG_L, pendingInhL, current.leftLungGain, fadeMs );
+	}
+	else if ( side > 1 && side < 4 && inhR && pendingInhR != inhR )
+	{
+		audioSchedCrossFade(AUDIO_SRC_LUNG_R, pendingInhR, current.rightLungGain, fadeMs );
+	}
+	inhL = pendingInhL;
+	inhR = pendingInhR;
+	setLeftLungVolume(1 );
+	setRightLungVolume(1 );
+}
+/*
+ * Beats are timed here by the beat engine (beatEngine.h), which inserts the
+ * VPCs and reconciles the sim-mgr syncs. runHeart plays beatCount.
+ *
+ * sync_thread queues each sim-mgr pulse sync with its time, and runBeats takes
+ * them off the queue in order, so none is merged with the next or read half
+ * written.
+ */
+#define BEAT_REPORT_SEC		60
+#define HEART_SYNC_QUEUE	8	// The oldest is dropped if the loop falls this far behind
+
+struct heartSync
+{
+	int vpc;
+	unsigned long long atUs;	// simRtNowUs when received
+};
+
+struct beatEngine beats;
+unsigned int beatCount = 0;
+int beatType = BEAT_NONE;
+unsigned long long beatSyncUs = 0;	// When the beat was due
+int vpcTrk = 0;
+
+pthread_mutex_t heartSyncMutex = PTHREAD_MUTEX_INITIALIZER;
+struct heartSync heartSyncQueue[HEART_SYNC_QUEUE];
+unsigned int heartSyncHead = 0;		// Next to take
+unsigned int heartSyncTail = 0;		// Next to fill
+
+/*
+ * Function: heartSyncPut
+ *
+ * Queue a sim-mgr pulse sync, from sync_thread
+ */
+static void
+heartSyncPut(int vpc, unsigned long long atUs )
+{
+	pthread_mutex_lock(&heartSyncMutex );
+	if ( heartSyncTail - heartSyncHead == HEART_SYNC_QUEUE )
+	{
+		heartSyncHead++;
+	}
+	heartSyncQueue[heartSyncTail % HEART_SYNC_QUEUE].vpc = vpc;
+	heartSyncQueue[heartSyncTail % HEART_SYNC_QUEUE].atUs = atUs;
+	heartSyncTail++;
+	current.heartCount += 1;
+	if ( vpc )
+	{
+		current.heartVpcCount += 1;
+	}
+	pthread_mutex_unlock(&heartSyncMutex );
+}
+
+/*
+ * Function: heartSyncGet
+ *
+ * Take the oldest queued sim-mgr pulse sync
+ *
+ * Returns: 1 if there was one, else 0
+ */
+static int
+heartSyncGet(struct heartSync *hs )
+{
+	int got = 0;
+	
+	pthread_mutex_lock(&heartSyncMutex );
+	if ( heartSyncHead != heartSyncTail )
+	{
+		*hs = heartSyncQueue[heartSyncHead % HEART_SYNC_QUEUE];
+		heartSyncHead++;
+		got = 1;
+	}
+	pthread_mutex_unlock(&heartSyncMutex );
+	return ( got );
+}
+
+/*
+ * Function: getVpcFile
+ *
+ * Find the VPC track: heart sound "vpc<type>", else "vpc", for the rate. With
+ * neither, VPCs play the heart track.
+ */
+static void
+getVpcFile(void )
+{
+	int hr = shmData->cardiac.rate;
+	char name[SOUND_NAME_LENGTH];
+	const struct sound *sound;
+	int pass;
+	int i;
+	
+	vpcTrk = 0;
+	for ( pass = 0 ; pass < 2 && vpcTrk == 0 ; pass++ )
+	{
+		if ( pass == 0 )
+		{
+			snprintf(name, sizeof(name), "vpc%d", beats.vpcType );
+		}
+		else
+		{
+			snprintf(name, sizeof(name), "vpc" );
+		}
+		for ( i = 0 ;  i < maxSounds ; i++ )
+		{
+			sound = &soundList[i];
+			if ( sound->type == SOUND_TYPE_HEART && strcmp(sound->name, name ) == 0 && sound->low_limit <= hr && sound->high_limit >= hr )
+			{
+				vpcTrk = sound->index;
+				break;
+			}
+		}
+	}
+	snprintf(msgbuf, 1024, "VPC %s at %d%%: track %d", current.vpc, current.vpc_freq, vpcTrk );
+	log_message("", msgbuf);
+}
+
+/*
+ * Function: runBeats
+ *
+ * Pass the sim-mgr syncs received since the last tick to the beat engine and
+ * take the beat due, if any. A sync that plays a beat ends the tick's syncs;
+ * the ones after it wait for the next tick, with their own times.
+ */
+static void
+runBeats(void )
+{
+	static unsigned int lastReport = 0;
+	static unsigned int reportedSinus = 0;
+	struct heartSync hs;
+	unsigned long long due = 0;
+	unsigned int now;
+	int beat;
+	int remoteBeat;
+	
+	if ( ( current.vpc_freq != shmData->cardiac.vpc_freq ) ||
+		 ( current.vpc_id != shmData->cardiac.vpc_id ) )
+	{
+		current.vpc_id = shmData->cardiac.vpc_id;
+		snprintf(current.vpc, STR_SIZE, "%s", simSymbolName(current.vpc_id ) );
+		current.vpc_freq = shmData->cardiac.vpc_freq;
+		if ( beatEngineSetVpc(&beats, current.vpc, current.vpc_freq ) < 0 )
+		{
+			snprintf(msgbuf, 1024, "Unknown VPC \"%s\", VPCs are off", current.vpc );
+			log_message("", msgbuf);
+		}
+		getVpcFile();
+	}
+	// The clock first, so a sync for a beat already due here is matched to it
+	beat = beatEngineTick(&beats, simRtNowUs(), &due );
+	while ( heartSyncGet(&hs ) )
+	{
+		remoteBeat = beatEngineRemote(&beats, hs.vpc, hs.atUs );
+		if ( remoteBeat != BEAT_NONE )
+		{
+			beat = remoteBeat;
+			due = hs.atUs;
+			break;
+		}
+	}
+	if ( beat != BEAT_NONE )
+	{
+		beatType = beat;
+		beatSyncUs = due;
+		beatCount++;
+	}
+	
+	now = msec_time();
+	if ( now - lastReport >= BEAT_REPORT_SEC * 1000 && beats.stats.sinus != reportedSinus )
+	{
+		lastReport = now;
+		reportedSinus = beats.stats.sinus;
+		snprintf(msgbuf, 1024, "Beats: " );
+		beatEngineReport(&beats, &msgbuf[7], 1024 - 7 );
+		log_message("", msgbuf);
+	}
+}
+
 unsigned int heartLast = 0;
 int heartState = 0;
 unsigned int lungLast = 0;
@@ -547,24 +1017,61 @@ void ss_signal_handler(int sig )
 }
 
 
+/*
+ * Function: findSioNames
+ *
+ * Set the default WAV Trigger/Tsunami serial port names.
+ */
+void
+findSioNames(void )
+{
+	// detect if TTY files are name tttOn or ttySn
+	// In earlier debian releases, ttyOn was used.
+	// In debian 10, the default name switched to ttySn, and symlinks allowed using ttyOn
+	// In debian 11, the symlinks are gone. 
+	struct stat sb;
+	
+	sprintf(sioName[0], "%s", SIM_UART_SOUND_OLD );
+	sprintf(sioName[1], "%s", SIM_UART_SOUND2_OLD );
+	printf("Checking %s\n", sioName[0] );
+	if (lstat(sioName[0], &sb) == -1)
+	{
+        // File not found, try ttsS2
+		sprintf(sioName[0], "%s", SIM_UART_SOUND );
+		sprintf(sioName[1], "%s", SIM_UART_SOUND2 );
+		if (lstat(sioName[0], &sb) == -1)
+		{
+			// No tty files
+		}
+		else
+		{
+			// Found ttyS2
+		}
+    }
+	else
+	{
+		// Found tty O2
+	}
+}
+
+#ifndef SIM_HUB
 int
 main(int argc, char *argv[] )
 {
-	int sfd;
-	int sfd2;
-	char buffer[MAX_BUF+1];
-	int i;
 	int c;
-	int val;
 	int sts;
-	struct sigaction new_action;
-	int changed;
-	int listenState = FALSE;
 	
-	while (( c = getopt(argc, argv, "smdth" ) ) != -1 )
+	while (( c = getopt(argc, argv, "smdthrjc" ) ) != -1 )
 	{
 		switch ( c )
 		{
+			case 'r':
+				rtForce = 1;
+				break;
+			case 'j':
+				jitterMode = 1;
+				debug = 1;
+				break;
 			case 'd':
 				debug = 1;
 				break;
@@ -580,64 +1087,309 @@ main(int argc, char *argv[] )
 				monitor = 0;
 				debug = 3;
 				break;
+			case 'c':
+				if ( soundCatalogBuild(SOUND_CATALOG_CSV, SOUND_CATALOG_FILE, NULL, NULL ) != 0 )
+				{
+					return ( -1 );
+				}
+				debug = 1;
+				initSoundList();
+				showSounds();
+				return ( 0 );
 			case 'h':
 				cout << "Usage:\n";
-				cout << argv[ 0 ] << " [-d] [-m][-t] [tty port 1] [tty port 2]\n";
+				cout << argv[ 0 ] << " [-d] [-m][-t] [-r] [-j] [-c] [tty port 1] [tty port 2]\n";
+				cout << "  -r  Use the real-time profile (" << SIM_RT_PROFILE_FILE << ") even if not enabled there\n";
+				cout << "  -j  Jitter mode: run in the foreground and report timing histograms\n";
+				cout << "  -c  Compile " << SOUND_CATALOG_CSV << " to " << SOUND_CATALOG_FILE << " and list it\n";
 				cout << "eg: " << argv[ 0 ] << " ttyO2 ttyO4\n";
 				return (0 );
 		}
 	}
-	// detect if TTY files are name tttOn or ttySn
-	// In earlier debian releases, ttyOn was used.
-	// In debian 10, the default name switched to ttySn, and symlinks allowed using ttyOn
-	// In debian 11, the symlinks are gone. 
-	struct stat sb;
-	sprintf(sioName[0], "/dev/ttyO2" );
-	sprintf(sioName[1], "/dev/ttyO4" );
-	printf("Checking %s\n", sioName[0] );
-	if (lstat(sioName[0], &sb) == -1)
+	findSioNames();
+	
+	if ( monitor == 0 )
 	{
-        // File not found, try ttsS2
-		sprintf(sioName[0], "/dev/ttyS2" );
-		sprintf(sioName[1], "/dev/ttyS4" );
-		if (lstat(sioName[0], &sb) == -1)
+		if ( optind < argc )
 		{
-			// No tty files
+			snprintf(sioName[0], MAX_BUF, "/dev/%s", argv[optind] );
+			optind++;
+			if ( optind < argc )
+			{
+				snprintf(sioName[1], MAX_BUF, "/dev/%s", argv[optind] );
+			}
 		}
-		else
+	}
+	printf("Debug %d, Monitor %d, sio '%s' '%s'\n", debug, monitor, sioName[0], sioName[1] );
+	if ( monitor )
+	{
+		sts = initSHM(SHM_OPEN );
+		if ( sts  )
 		{
-			// Found ttyS2
+			perror("initSHM" );
+			return (-1 );
 		}
-    }
+		runMonitor();
+	}
+	if ( ( debug < 1 ) && ( ldebug == 0 ) )
+	{
+		if ( debug > 0 )
+		{
+			printf("Calling daemonize\n" );
+		}
+		daemonize();
+	}
+	else
+	{
+		printf("Skip daemonize\n" );
+	}
+	if ( debug > 0 )
+	{
+		printf("ldebug is %d\n", ldebug );
+	}
+	if ( !ldebug )
+	{
+		if ( debug > 0 )
+		{
+			printf("Calling initSHM\n" );
+		}
+		sts = initSHM(SHM_OPEN );
+		if ( debug > 0 )
+		{
+			printf("initSHM returned\n" );
+		}
+		if ( sts  )
+		{
+			perror("initSHM");
+			return (-1 );
+		}
+	}
+	
+	soundRtSetup();
+	struct simModule *modules[] = { &soundModule };
+	simModuleRun(modules, 1, rtProfile.enabled ? simRtPriority(&rtProfile, "loop" ) : 0 );
+	allAirOff(0 );
+	return ( -1 );
+}
+#endif
+
+/*
+ * Function: soundRtSetup
+ *
+ * Load the real-time profile and apply the process wide part of it. The loop
+ * priority is applied by simModuleRun; under simHub the hub sets it instead.
+ */
+void
+soundRtSetup(void )
+{
+	int i;
+	
+	simRtDefaults(&rtProfile, soundRtThreads, SOUND_RT_THREADS );
+	simRtLoad(&rtProfile, SIM_RT_PROFILE_FILE );
+	if ( rtForce )
+	{
+		rtProfile.enabled = 1;
+	}
+	if ( rtProfile.enabled )
+	{
+		snprintf(msgbuf, 1024, "RT profile: lock %d stack %d prefault %d slack %d",
+			rtProfile.lockMemory, rtProfile.stackSize, rtProfile.prefault, rtProfile.timerSlackNs );
+		log_message("", msgbuf );
+		for ( i = 0 ; i < rtProfile.threadCount ; i++ )
+		{
+			snprintf(msgbuf, 1024, "RT profile: %s priority %d", rtProfile.threads[i].name, rtProfile.threads[i].priority );
+			log_message("", msgbuf );
+		}
+	}
+	simRtProcess(&rtProfile );
+	for ( i = 0 ; i < JIT_EVENTS ; i++ )
+	{
+		simRtJitterReset(&jitter[i], "" );
+	}
+	jitter[JIT_PULSE_GPIO].name = "pulse gpio";
+	jitter[JIT_LUB].name = "lub";
+	jitter[JIT_RISE_ON].name = "rise on";
+	jitter[JIT_RISE_OFF].name = "rise off";
+	jitter[JIT_INHALE].name = "inhale";
+}
+
+/*
+ * Function: soundRtThreadStart
+ *
+ * Start of the sync, pulse and breath threads. With the profile enabled the
+ * heart timer signal is blocked here, so its handler runs on the loop thread
+ * at the loop priority rather than interrupting whichever thread is running.
+ */
+void
+soundRtThreadStart(const char *name )
+{
+	sigset_t mask;
+	
+	simRtThreadStart(&rtProfile, name );
+	if ( rtProfile.enabled )
+	{
+		sigemptyset(&mask );
+		sigaddset(&mask, HEART_TIMER_SIG );
+		pthread_sigmask(SIG_BLOCK, &mask, NULL );
+	}
+}
+
+/*
+ * Function: jitterReport
+ *
+ * Print the jitter histograms, every JITTER_REPORT_SEC in jitter mode.
+ */
+void
+jitterReport(void )
+{
+	static unsigned int lastReport = 0;
+	unsigned int now = msec_time();
+	char buf[512];
+	int i;
+	
+	if ( lastReport == 0 )
+	{
+		lastReport = now;
+	}
+	if ( now - lastReport < JITTER_REPORT_SEC * 1000 )
+	{
+		return;
+	}
+	lastReport = now;
+	printf("\nJitter, late against scheduled time (RT profile %s):\n", rtProfile.enabled ? "on" : "off" );
+	for ( i = 0 ; i < JIT_EVENTS ; i++ )
+	{
+		simRtJitterPrint(&jitter[i] );
+	}
+	if ( audioSchedSyncReport(buf, sizeof(buf) ) > 0 )
+	{
+		printf("Sync groups: %s\n", buf );
+	}
+	beatEngineReport(&beats, buf, sizeof(buf) );
+	printf("Beats: %s\n", buf );
+	if ( respTimingReport(&breathStats, buf, sizeof(buf) ) > 0 )
+	{
+		printf("Breath timing: %s\n", buf );
+	}
+	if ( chestReport(&chest, buf, sizeof(buf) ) > 0 )
+	{
+		printf("Chest control: %s\n", buf );
+	}
+	fflush(stdout );
+}
+
+/*
+ * Startup to ready to play heart. The wait for the serial port to appear (at
+ * boot) is reported but not held against the budget; the rest is ours. The
+ * port is tried every SOUND_PORT_POLL_MS, and once it is open the board is
+ * asked for its version every SOUND_PROBE_MS until it answers, rather than
+ * given a fixed time to settle.
+ */
+#define SOUND_READY_BUDGET_MS	800
+#define SOUND_BOARD_SETTLE_US	500000	// Longest wait for the board to answer after opening the port
+#define SOUND_PORT_WAIT_MS		20000	// At boot the port may not be there yet
+#define SOUND_PORT_POLL_MS		50
+#define SOUND_PROBE_MS			50
+
+struct soundStartup
+{
+	unsigned int start;
+	unsigned int catalog;	// Sound catalog mapped
+	unsigned int port;		// Serial port open
+	unsigned int settle;	// Board answered, or SOUND_BOARD_SETTLE_US passed
+	unsigned int board;		// Board probed, gains set, tracks stopped
+	unsigned int ready;		// Threads running, ready to play heart
+};
+
+void
+startupReport(struct soundStartup *su )
+{
+	unsigned int total = su->ready - su->port + su->catalog - su->start;
+	
+	snprintf(msgbuf, 1024, "Ready to play heart in %u ms (budget %d ms%s): catalog %u, settle %u, board %u, threads %u; port wait %u ms",
+		total, SOUND_READY_BUDGET_MS, total > SOUND_READY_BUDGET_MS ? ", OVER" : "",
+		su->catalog - su->start, su->settle - su->port, su->board - su->settle, su->ready - su->board,
+		su->port - su->catalog );
+	if ( debug > 1 )
+	{
+		printf("%s\n", msgbuf );
+	}
 	else
 	{
-		// Found tty O2
+		log_message("", msgbuf);
+	}
+}
+
+/*
+ * Function: bootReport
+ *
+ * Log the boot timeline, once, after the first heart sound: the time to it
+ * from simController's start (or soundSense's, if simController has not
+ * marked it) and the stages in order
+ */
+void
+bootReport(void )
+{
+	char buf[768];
+	unsigned int heart = shmData->boot.ms[SIM_BOOT_FIRST_HEART];
+	unsigned int from = shmData->boot.ms[SIM_BOOT_CONTROLLER];
+	const char *fromName = "simController";
+
+	bootLogged = 1;
+	if ( from == 0 || from > heart )
+	{
+		from = shmData->boot.ms[SIM_BOOT_SOUND_START];
+		fromName = "soundSense";
 	}
-	
-	if ( monitor == 0 )
+	simBootFormat(buf, sizeof(buf) );
+	snprintf(msgbuf, 1024, "Boot: first heart sound %u ms after %s start, %u ms after kernel boot; %s",
+		from ? heart - from : 0, fromName, heart, buf );
+	if ( debug > 1 )
 	{
-		if ( optind < argc )
-		{
-			snprintf(sioName[0], MAX_BUF, "/dev/%s", argv[optind] );
-			optind++;
-			if ( optind < argc )
-			{
-				snprintf(sioName[1], MAX_BUF, "/dev/%s", argv[optind] );
-			}
-		}
+		printf("%s\n", msgbuf );
 	}
-	printf("Debug %d, Monitor %d, sio '%s' '%s'\n", debug, monitor, sioName[0], sioName[1] );
-	if ( monitor )
+	else
 	{
-		sts = initSHM(SHM_OPEN );
-		if ( sts  )
-		{
-			perror("initSHM" );
-			return (-1 );
-		}
-		runMonitor();
+		log_message("", msgbuf);
+	}
+}
+
+/*
+ * Function: soundInit
+ *
+ * Module init. Maps the sound catalog, opens the GPIO and the WAV
+ * Trigger/Tsunami, checks the catalog against the board's tracks, sets the
+ * initial gains, and starts the sync and pulse threads. Logs the time taken
+ * against SOUND_READY_BUDGET_MS.
+ *
+ * Returns: 0
+ */
+int
+soundInit(void )
+{
+	int sfd;
+	int sfd2 = 0;
+	char buffer[MAX_BUF+1];
+	int i;
+	int val;
+	int tracks;
+	int voices = 0;
+	int pulseVoices = 0;
+	struct sigaction new_action;
+	pthread_attr_t attr;
+	struct soundStartup startup;
+	
+	startup.start = msec_time();
+	simBootMark(SIM_BOOT_SOUND_START );
+#ifdef SIM_HUB
+	soundRtSetup();
+#endif
+	if ( sioName[0][0] == 0 )
+	{
+		findSioNames();
 	}
 	initSoundList();
+	startup.catalog = msec_time();
 	if ( debug && debug < 3 )
 	{
 		printf("Show Sounds:\n" );
@@ -645,24 +1397,12 @@ main(int argc, char *argv[] )
 	}
 
 	// Controls for Chest Rise/Fall
-	riseLPin = gpioPinOpen(23, GPIO_OUTPUT );	// P8_13
-	riseRPin = gpioPinOpen(67, GPIO_OUTPUT );	// P8_8
-	fallPin = gpioPinOpen(68, GPIO_OUTPUT );	// P8_10
-	pulsePin = gpioPinOpen(66, GPIO_OUTPUT );	// P8_7
+	riseLPin = gpioPinOpen(GPIO_PIN_RISE_L, GPIO_OUTPUT );
+	riseRPin = gpioPinOpen(GPIO_PIN_RISE_R, GPIO_OUTPUT );
+	fallPin = gpioPinOpen(GPIO_PIN_FALL, GPIO_OUTPUT );
+	pulsePin = gpioPinOpen(GPIO_PIN_PULSE, GPIO_OUTPUT );
 
 	allAirOff(1 );
-	if ( ( debug < 1 ) && ( ldebug == 0 ) )
-	{
-		if ( debug > 0 )
-		{
-			printf("Calling daemonize\n" );
-		}
-		daemonize();
-	}
-	else
-	{
-		printf("Skip daemonize\n" );
-	}
 	if ( debug > 1 )
 	{
 		printf("Starting Timer\n" );
@@ -673,57 +1413,45 @@ main(int argc, char *argv[] )
 	sigaction (SIGPIPE, &new_action, NULL);
 	signal(SIGHUP,ss_signal_handler); /* catch hangup signal */
 	signal(SIGTERM,ss_signal_handler); /* catch kill signal */
-	if ( debug > 0 )
-	{
-		printf("ldebug is %d\n", ldebug );
-	}
-	if ( !ldebug )
-	{
-		if ( debug > 0 )
-		{
-			printf("Calling initSHM\n" );
-		}
-		sts = initSHM(SHM_OPEN );
-		if ( debug > 0 )
-		{
-			printf("initSHM returned\n" );
-		}
-		if ( sts  )
-		{
-			perror("initSHM");
-			allAirOff(1);
-			return (-1 );
-		}
-	}
-	
 	if ( debug > 1 )
 	{
 		printf("Looking for WAV Trigger\n" );
 	}	
-	// When booted, the SIO port may not yet be available. Try every 1 second for 20 sec.
-	for ( i = 0 ; i <  20 ; i++ )
+	// When booted, the SIO port may not yet be available. Try every
+	// SOUND_PORT_POLL_MS for SOUND_PORT_WAIT_MS.
+	sfd = -1;
+	for ( i = 0 ; i < SOUND_PORT_WAIT_MS / SOUND_PORT_POLL_MS && simSessionMode != SIM_SESSION_REPLAYING ; i++ )
 	{
 		sfd = open(sioName[0], O_RDWR | O_NOCTTY | O_SYNC );
 		if ( sfd < 0 )
 		{
-			if ( debug > 1 )
+			if ( debug > 1 && i % ( 1000 / SOUND_PORT_POLL_MS ) == 0 )
 			{
 				perror("open" );
 				printf("Try %d\n", i );
 			}
-			sleep(1 );
+			usleep(SOUND_PORT_POLL_MS * 1000 );
 		}
 		else
 		{
 			break;
 		}
 	}
+	startup.port = msec_time();
+	if ( sfd >= 0 )
+	{
+		simBootMark(SIM_BOOT_SOUND_PORT );
+	}
 	if ( debug > 1 )
 	{
 		printf("Shut Off air\n" );
 	}
 	allAirOff(0);
-	if ( sfd < 0 )
+	if ( simSessionMode == SIM_SESSION_REPLAYING )
+	{
+		log_message("", "Session replay. Using the stub sound board" );
+	}
+	else if ( sfd < 0 )
 	{
 		snprintf(msgbuf, 1024, "No SIO Port. Running Silent" );
 		log_message("", msgbuf);
@@ -741,8 +1469,20 @@ main(int argc, char *argv[] )
 			printf("Start Wav\n" );
 		}
 	}
-	wav.start(sfd, 0 );
-	usleep(500000);
+	if ( simSessionMode == SIM_SESSION_REPLAYING )
+	{
+		wav.startStub(0 );
+		sfd = 0;	// Not a port, but go on as with a board
+	}
+	else
+	{
+		wav.start(sfd, 0 );
+		if ( sfd >= 0 && wav.probe(SOUND_BOARD_SETTLE_US / 1000, SOUND_PROBE_MS ) < 0 )
+		{
+			log_message("", "No answer from the sound board in the settle time" );
+		}
+	}
+	startup.settle = msec_time();
 	
 	if ( debug < 4 )
 	{
@@ -773,13 +1513,23 @@ main(int argc, char *argv[] )
 			log_message("", msgbuf);
 		}
 		val = wav.getSysInfo(buffer, MAX_BUF );
+		tracks = ( val >= 4 ) ? ( (unsigned char)buffer[2] | ( (unsigned char)buffer[3] << 8 ) ) : -1;
+		voices = ( val >= 2 ) ? (unsigned char)buffer[1] : 0;
 		if ( debug > 0 )
 		{
-			printf("Sys Info: Len %d Voices %d Tracks %d\n", val, buffer[1], buffer[2] );
+			printf("Sys Info: Len %d Voices %d Tracks %d\n", val, buffer[1], tracks );
 		}
 		else
 		{
-			snprintf(msgbuf, 1024, "Sys Info: Len %d Voices %d Tracks %d", val, buffer[1], buffer[2] );
+			snprintf(msgbuf, 1024, "Sys Info: Len %d Voices %d Tracks %d", val, buffer[1], tracks );
+			log_message("", msgbuf);
+		}
+		if ( tracks > 0 )
+		{
+			val = soundCatalogCheckTracks(&catalog, tracks,
+				wav.boardType == BOARD_WAV_TRIGGER ? SOUND_NUM_TRACKS_WAV : SOUND_NUM_TRACKS );
+			snprintf(msgbuf, 1024, "Sound catalog: %s against the board's %d tracks",
+				val ? "problems found checking" : "checked", tracks );
 			log_message("", msgbuf);
 		}
 		if ( wav.boardType == BOARD_WAV_TRIGGER )
@@ -800,13 +1550,14 @@ main(int argc, char *argv[] )
 				{
 					setTermios(sfd2, B57600); // WAV Trigger defaults to 57600
 					wav2.start(sfd2, 1 );
-					usleep(500000);
+					wav2.probe(SOUND_BOARD_SETTLE_US / 1000, SOUND_PROBE_MS );
 					val = wav2.getVersion(buffer, MAX_BUF );
 					snprintf(msgbuf, 1024, "WAV2 Trigger Version: Len %d String %.*s", val, val-1, &buffer[1] );
 					log_message("", msgbuf);
 					val = wav2.getSysInfo(buffer, MAX_BUF );
 					snprintf(msgbuf, 1024, "Sys Info: Len %d Voices %d Tracks %d", val, buffer[1], buffer[2] );
 					log_message("", msgbuf);
+					pulseVoices = ( val >= 2 ) ? (unsigned char)buffer[1] : 0;
 				}
 			}
 		}
@@ -829,6 +1580,7 @@ main(int argc, char *argv[] )
 		}
 	}
 	//wav.show();
+	audioSchedInit(&wav, voices, wavPulse, pulseVoices );
 	wav.ampPower(0 );
 	wav.stopAllTracks();
 	wav.masterGain(0);
@@ -852,14 +1604,17 @@ main(int argc, char *argv[] )
 	wav.trackGain(5, 0 );  // Track 5 is Bark
 	wav.stopAllTracks();
 	wavPulse->stopAllTracks();
+	startup.board = msec_time();
+	if ( sfd >= 0 )
+	{
+		simBootMark(SIM_BOOT_SOUND_BOARD );
+	}
 
+	// The bark is only to hear that the board is up. Heart sounds play on
+	// other voices, so there is no need to wait for it to finish.
 	snprintf(msgbuf, 1024, "Initial Bark");
 	log_message("", msgbuf);	
 	wav.trackPlaySolo(0, 5);	// Bark
-	while ( wav.getTracksPlaying() > 0 )
-	{
-		usleep(10000);
-	}
 	if ( debug == 3 )
 	{
 		wav.trackPlaySolo(0, 1);	// Play Cassiopeia
@@ -920,13 +1675,27 @@ main(int argc, char *argv[] )
 	//wav.masterGain(MIN_VOLUME);
 	//current.masterGain = MIN_VOLUME;
 	current.heartCount = 0;
+	current.heartVpcCount = 0;
 	current.breathCount = 0;
+	beatEngineInit(&beats, (unsigned int)time(NULL ) );
 	current.leftLungGain = -65;
 	current.rightLungGain = -65;
 	current.heartGain = -65;
 	
 	wavPulse->trackGain(PULSE_TRACK, MAX_MAX_VOLUME );
-	pthread_create (&threadInfo1, NULL, &sync_thread,(void *) NULL );
+	for ( i = 0 ; i < PULSE_OUTPUTS ; i++ )
+	{
+		setPulseGain(&pulseOutputs[i], 1 );
+	}
+	simRtThreadAttr(&rtProfile, &attr );
+	breathInit();
+	pthread_create (&threadInfo1, &attr, &sync_thread,(void *) NULL );
+	pthread_create (&threadInfo2, &attr, &pulse_thread,(void *) NULL );
+	pthread_create (&threadInfo3, &attr, &breath_thread,(void *) NULL );
+	pthread_attr_destroy(&attr );
+	startup.ready = msec_time();
+	simBootMark(SIM_BOOT_SOUND_READY );
+	startupReport(&startup );
 	
 	// Main loop monitors the volumes and keeps them set
 	// Also gets the track info updated
@@ -943,120 +1712,173 @@ main(int argc, char *argv[] )
 			log_message("", msgbuf);
 		}
 	}
+	return ( 0 );
+}
 
-	while ( 1 )
+/*
+ * Function: barkRun
+ *
+ * One step of the listen state bark, from soundPoll: wait for the tracks
+ * playing to end, play the bark, then wait for it to end and restore the
+ * master gain. The board is asked once per poll, so the loop is never held up.
+ *
+ * Returns: 1 while the bark is still in progress, else 0
+ */
+static int
+barkRun(void )
+{
+	if ( wav.getTracksPlaying() > 0 )
 	{
-		// Master off based on active auscultation
-		if ( soundTest )
+		if ( barkState == BARK_PLAYING || msec_time() - barkStart < BARK_WAIT_MAX_MS )
 		{
-			if ( current.masterGain != MAX_VOLUME )
-			{
-				wav.channelGain(0, MAX_VOLUME);
-				current.masterGain = MAX_VOLUME;
-			}
-			shmData->auscultation.col  = 1;
-			shmData->auscultation.row  = 1;
-			shmData->auscultation.side = 1;
-			shmData->auscultation.heartStrength = 10;
-			shmData->auscultation.leftLungStrength = 10;
-			shmData->auscultation.rightLungStrength = 0;
+			return ( 1 );
 		}
-		else
+	}
+	if ( barkState == BARK_WAIT_QUIET )
+	{
+		//wav.trackGain(5, 0 );
+		audioSchedStopAll();
+		snprintf(msgbuf, 1024, "Enter Listen State Bark");
+		log_message("", msgbuf);
+		audioSchedPlay(AUDIO_SRC_GENERAL, 5, 0 );	// Bark
+		barkState = BARK_PLAYING;
+		return ( 1 );
+	}
+	setMasterGain(barkSavedVolume );
+	barkState = BARK_IDLE;
+	return ( 0 );
+}
+
+/*
+ * Function: soundPoll
+ *
+ * Module poll, every SOUND_LOOP_DELAY. Keeps the volumes set and follows the
+ * heart and lung sound changes.
+ */
+void
+soundPoll(void )
+{
+	int changed;
+	
+	audioSchedTick();
+	// Master off based on active auscultation
+	if ( soundTest )
+	{
+		if ( current.masterGain != MAX_VOLUME )
 		{
-			if ( listenState != comm.barkState )
-			{
-				// listenState has changed. If new barkState is TRUE then bark
-				listenState = comm.barkState;
-				if ( listenState == TRUE )
-				{
-					int savedVolume = current.masterGain;
-					wav.channelGain(0, 0);
-					current.masterGain = 0;
-					while ( wav.getTracksPlaying() > 0 )
-					{
-						usleep(10000);
-					}
-					//wav.trackGain(5, 0 );
-					wav.stopAllTracks();
-					snprintf(msgbuf, 1024, "Enter Listen State Bark");
-					log_message("", msgbuf);
-					wav.trackPlaySolo(0, 5);	// Bark
-					while ( wav.getTracksPlaying() > 0 )
-					{
-						usleep(10000);
-					}
-					wav.channelGain(0, savedVolume);
-				}
-			}
-			if ( ( shmData->auscultation.side == 0 ) && ( current.masterGain != MIN_VOLUME ) )
-			{
-				wav.channelGain(0, MIN_VOLUME);
-				current.masterGain = MIN_VOLUME;
-				if ( debug )
-				{
-					printf("Master Off\n" );
-				}
-				snprintf(msgbuf, 1024, "Set Off: %d, %d, Heart Gain %d, Lung Gains %d / %d, Master Gain %d", 
-					current.heartCount, current.breathCount, current.heartGain, current.rightLungGain, current.leftLungGain, current.masterGain );
-				log_message("", msgbuf);
-			}
-			else if ( ( shmData->auscultation.side != 0 ) && ( current.masterGain != MAX_VOLUME ) )
+			setMasterGain(MAX_VOLUME );
+			current.masterGain = MAX_VOLUME;
+		}
+		shmData->auscultation.col  = 1;
+		shmData->auscultation.row  = 1;
+		shmData->auscultation.side = 1;
+		shmData->auscultation.heartStrength = 10;
+		shmData->auscultation.leftLungStrength = 10;
+		shmData->auscultation.rightLungStrength = 0;
+	}
+	else
+	{
+		if ( soundListenState != comm.barkState )
+		{
+			// soundListenState has changed. If new barkState is TRUE then bark
+			soundListenState = comm.barkState;
+			if ( soundListenState == TRUE && barkState == BARK_IDLE )
 			{
-				wav.channelGain(0, MAX_VOLUME);
-				current.masterGain = MAX_VOLUME;
-				if ( debug  )
-				{
-					printf("Master On\n" );
-				}
-				snprintf(msgbuf, 1024, "Set On: %d, %d, Heart Gain %d, Lung Gains %d / %d (%d), Master Gain %d", 
-					current.heartCount, current.breathCount, current.heartGain, current.rightLungGain, current.leftLungGain, shmData->respiration.left_lung_sound_volume, current.masterGain );
-				log_message("", msgbuf);
+				barkSavedVolume = current.masterGain;
+				setMasterGain(0 );
+				current.masterGain = 0;
+				barkState = BARK_WAIT_QUIET;
+				barkStart = msec_time();
 			}
 		}
-		
-		changed = 0;
-		// Check for heart/lung changes
-		if ( ( current.heart_rate != shmData->cardiac.rate ) || 
-			 ( strcmp(current.heart_sound, shmData->cardiac.heart_sound) != 0 ) )
+		if ( barkState != BARK_IDLE && barkRun() )
 		{
-			snprintf(msgbuf, 1024, "Cardiac %d:%d, %s, %s", 
-				 current.heart_rate, shmData->cardiac.rate,
-				 current.heart_sound, shmData->cardiac.heart_sound	 );
-			log_message("", msgbuf);		
-			current.heart_rate = shmData->cardiac.rate;
-			memcpy(current.heart_sound, shmData->cardiac.heart_sound, 32 );
-			changed = 1;
+			audioSchedFlush();
+			return;
 		}
-		if ( changed )
+		if ( ( shmData->auscultation.side == 0 ) && ( current.masterGain != MIN_VOLUME ) )
 		{
-			getHeartFiles();
-			doReport();
-		}
-		
-		changed = 0;
-		if ( ( current.respiration_rate != shmData->respiration.rate ) ||
-			 ( strcmp(current.left_lung_sound, shmData->respiration.left_lung_sound) != 0 ) ||
-			 ( strcmp(current.right_lung_sound, shmData->respiration.right_lung_sound) != 0 ) )
-		{
-			snprintf(msgbuf, 1024, "Resp %d:%d, %s, %s, %s, %s", 
-				 current.respiration_rate, shmData->respiration.rate,
-				 current.left_lung_sound, shmData->respiration.left_lung_sound,
-				 current.right_lung_sound, shmData->respiration.right_lung_sound );
+			setMasterGain(MIN_VOLUME );
+			current.masterGain = MIN_VOLUME;
+			if ( debug )
+			{
+				printf("Master Off\n" );
+			}
+			snprintf(msgbuf, 1024, "Set Off: %d, %d, Heart Gain %d, Lung Gains %d / %d, Master Gain %d", 
+				current.heartCount, current.breathCount, current.heartGain, current.rightLungGain, current.leftLungGain, current.masterGain );
 			log_message("", msgbuf);
-			current.respiration_rate = shmData->respiration.rate;
-			memcpy(current.left_lung_sound, shmData->respiration.left_lung_sound, 32 );
-			memcpy(current.right_lung_sound, shmData->respiration.right_lung_sound, 32 );
-			changed = 1;
 		}
-		if ( changed )
+		else if ( ( shmData->auscultation.side != 0 ) && ( current.masterGain != MAX_VOLUME ) )
 		{
-			getLungFiles();
-			doReport();
+			setMasterGain(MAX_VOLUME );
+			current.masterGain = MAX_VOLUME;
+			if ( debug  )
+			{
+				printf("Master On\n" );
+			}
+			snprintf(msgbuf, 1024, "Set On: %d, %d, Heart Gain %d, Lung Gains %d / %d (%d), Master Gain %d", 
+				current.heartCount, current.breathCount, current.heartGain, current.rightLungGain, current.leftLungGain, shmData->respiration.left_lung_sound_volume, current.masterGain );
+			log_message("", msgbuf);
 		}
-		
-		runLung();
-		runHeart();
-		usleep(SOUND_LOOP_DELAY );
+	}
+	
+	changed = 0;
+	// Check for heart/lung changes
+	soundSymSync();
+	if ( ( current.heart_rate != shmData->cardiac.rate ) || 
+		 ( current.heart_sound_id != shmData->cardiac.heart_sound_id ) )
+	{
+		snprintf(msgbuf, 1024, "Cardiac %d:%d, %s, %s", 
+			 current.heart_rate, shmData->cardiac.rate,
+			 current.heart_sound, simSymbolName(shmData->cardiac.heart_sound_id ) );
+		log_message("", msgbuf);		
+		current.heart_rate = shmData->cardiac.rate;
+		current.heart_sound_id = shmData->cardiac.heart_sound_id;
+		snprintf(current.heart_sound, STR_SIZE, "%s", simSymbolName(current.heart_sound_id ) );
+		changed = 1;
+	}
+	if ( changed )
+	{
+		getHeartFiles();
+		beatEngineSetRate(&beats, current.heart_rate );
+		getVpcFile();
+		doReport();
+	}
+	
+	changed = 0;
+	if ( ( current.respiration_rate != shmData->respiration.rate ) ||
+		 ( current.left_lung_sound_id != shmData->respiration.left_lung_sound_id ) ||
+		 ( current.right_lung_sound_id != shmData->respiration.right_lung_sound_id ) )
+	{
+		snprintf(msgbuf, 1024, "Resp %d:%d, %s, %s, %s, %s", 
+			 current.respiration_rate, shmData->respiration.rate,
+			 current.left_lung_sound, simSymbolName(shmData->respiration.left_lung_sound_id ),
+			 current.right_lung_sound, simSymbolName(shmData->respiration.right_lung_sound_id ) );
+		log_message("", msgbuf);
+		current.respiration_rate = shmData->respiration.rate;
+		current.left_lung_sound_id = shmData->respiration.left_lung_sound_id;
+		current.right_lung_sound_id = shmData->respiration.right_lung_sound_id;
+		snprintf(current.left_lung_sound, STR_SIZE, "%s", simSymbolName(current.left_lung_sound_id ) );
+		snprintf(current.right_lung_sound, STR_SIZE, "%s", simSymbolName(current.right_lung_sound_id ) );
+		changed = 1;
+	}
+	if ( changed )
+	{
+		getLungFiles();
+		doReport();
+	}
+	
+	runLung();
+	runBeats();
+	runHeart();
+	audioSchedFlush();
+	if ( ! bootLogged && shmData->boot.ms[SIM_BOOT_FIRST_HEART] )
+	{
+		bootReport();
+	}
+	if ( jitterMode )
+	{
+		jitterReport();
 	}
 }
 
@@ -1065,6 +1887,7 @@ sync_thread ( void *ptr )
 {
 	int sts;
 	
+	soundRtThreadStart("sync" );
 	sts = comm.openListen(LISTEN_ACTIVE );
 	if ( sts != 0 )
 	{
@@ -1079,12 +1902,16 @@ sync_thread ( void *ptr )
 		sts = comm.wait();
 		if ( sts & (SYNC_PULSE | SYNC_PULSE_VPC ) )
 		{
-			current.heartCount += 1;
+			heartSyncPut(( sts & SYNC_PULSE_VPC ) ? 1 : 0, simRtNowUs() );
+			simTrace(SIM_TRACE_SYNC_HEART, ( sts & SYNC_PULSE_VPC ) ? 1 : 0, current.heartCount );
 		}
 		if ( sts & SYNC_BREATH )
 		{
+			breathSyncUs = simRtNowUs();
 			current.breathCount += 1;
+			simTrace(SIM_TRACE_SYNC_BREATH, 0, current.breathCount );
 			allAirOff(0 );
+			breathSignal();
 		}
 		if( sts & SYNC_STATUS_PORT )
 		{
@@ -1153,7 +1980,7 @@ setLeftLungVolume(int force )
 	
 	if ( force || ( gain != current.leftLungGain ) )
 	{
-		if ( shmData->auscultation.side != 2 )
+		if ( shmData->auscultation.side != 2 && ! audioSchedFading(AUDIO_SRC_LUNG_L ) )
 		{
 			wav.trackGain(inhL, current.leftLungGain );
 		}
@@ -1183,7 +2010,7 @@ setRightLungVolume(int force )
 	}
 	if ( force || ( gain != current.rightLungGain ) )
 	{
-		if ( shmData->auscultation.side != 1 )
+		if ( shmData->auscultation.side != 1 && ! audioSchedFading(AUDIO_SRC_LUNG_R ) )
 		{
 			wav.trackGain(inhR, current.rightLungGain );
 		}
@@ -1206,10 +2033,16 @@ runHeart ( void )
 	switch ( heartState )
 	{
 		case 0:
-			if ( heartLast != current.heartCount )
+			if ( heartLast != beatCount )
 			{
-				heartLast = current.heartCount;
+				heartLast = beatCount;
 				gpioPinSet(pulsePin, TURN_ON );
+				if ( jitterMode )
+				{
+					lubDueUs = simRtNowUs();
+					simRtJitterAdd(&jitter[JIT_PULSE_GPIO], beatSyncUs, lubDueUs );
+					lubDueUs += LUB_DELAY / 1000;
+				}
 				//if ( shmData->auscultation.side != 0 )
 				//{
 					its.it_interval.tv_sec = 0;
@@ -1235,7 +2068,22 @@ runHeart ( void )
 				//if ( shmData->auscultation.side != 0 )
 				//{
 					// gpioPinSet(pulsePin, TURN_OFF );
-					wav.trackPlayPoly(0, lubdub);
+					// Lub/dub and the pulse points start together
+					commitHeart();
+					audioSchedGroupBegin(AUDIO_GROUP_BEAT );
+					if ( beatType == BEAT_VPC && vpcTrk > 0 )
+					{
+						wav.trackGain(vpcTrk, current.heartGain );
+						audioSchedPlay(AUDIO_SRC_HEART, vpcTrk, shmData->cardiac.rate > 0 ? 60000 / shmData->cardiac.rate : 0 );
+					}
+					else
+					{
+						audioSchedPlay(AUDIO_SRC_HEART, lubdub, shmData->cardiac.rate > 0 ? 60000 / shmData->cardiac.rate : 0 );
+					}
+					if ( lubdub > 0 )
+					{
+						simBootMark(SIM_BOOT_FIRST_HEART );
+					}
 					//snprintf(msgbuf, 1024, "runHeart: lub (%d) Gain is %d", lub, heartGain );
 					//log_message("", msgbuf );
 					heartState = 0;
@@ -1247,8 +2095,17 @@ runHeart ( void )
 				//	heartPlaying = 0;
 				//}
 				
-				// Check pulse palpation
-				doPulse();
+				// Check pulse palpation. A VPC is too early to fill the ventricle: no pulse.
+				if ( beatType != BEAT_VPC )
+				{
+					doPulse();
+				}
+				audioSchedGroupRelease();
+				simSpanEnd(SIM_METRIC_SYNC_HEART, beatSyncUs );
+				if ( jitterMode )
+				{
+					simRtJitterAdd(&jitter[JIT_LUB], lubDueUs, simRtNowUs() );
+				}
 			}
 			break;
 			
@@ -1258,55 +2115,355 @@ runHeart ( void )
 }
 
 static void
-delay_handler(int sig, siginfo_t *si, void *uc)
+delay_handler(int sig, siginfo_t *si, void *uc)
+{
+	simTrace(SIM_TRACE_TIMER, sig - SIGRTMIN, 0 );
+	if ( sig == HEART_TIMER_SIG )
+	{
+		if ( heartState == 0 )
+		{
+			heartState = 1;
+		}
+		else if ( heartState == 2 )
+		{
+			heartState = 3;
+		}
+	}
+}
+#define EXH_LIMIT 400
+int exhLimit = EXH_LIMIT;
+
+/*
+ * Breath timeline
+ *
+ * The breath thread runs each breath's edges (respTimeline.h) at their times
+ * from the breath sync, sleeping on a CLOCK_MONOTONIC condition so the next
+ * sync wakes it at once and cuts the rest of the breath short. The inhalation
+ * track is played by the loop when the inhale edge sets lungState, as the
+ * scheduler is only called from the loop; its error is taken at the play.
+ * With the chest controller enabled, the valves are set from the chest
+ * pressure instead of the valve edges (chestBreath).
+ */
+
+static void
+breathInit(void )
+{
+	pthread_condattr_t condAttr;
+	struct chestConfig cfg;
+	
+	pthread_condattr_init(&condAttr );
+	pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC );
+	pthread_cond_init(&breathCond, &condAttr );
+	pthread_condattr_destroy(&condAttr );
+	
+	chestConfigDefaults(&cfg );
+	chestConfigLoad(&cfg, CHEST_CONTROL_FILE );
+	if ( cfg.enable && ainOpen(&chestAin, AIR_PRESSURE_AIN_CHANNEL ) != 0 )
+	{
+		snprintf(msgbuf, 1024, "Chest control: cannot open AIN%d, chest rise is open-loop", AIR_PRESSURE_AIN_CHANNEL );
+		log_message("", msgbuf );
+		cfg.enable = 0;
+	}
+	chestControlInit(&chest, &cfg );
+	shmData->chest_control = cfg.enable;
+	if ( cfg.enable )
+	{
+		snprintf(msgbuf, 1024, "Chest control: closed-loop on AIN%d, peak %d, band %d, sample %d us",
+			AIR_PRESSURE_AIN_CHANNEL, cfg.peak, cfg.band, cfg.sampleUs );
+		log_message("", msgbuf );
+	}
+}
+
+static void
+breathSignal(void )
+{
+	pthread_mutex_lock(&breathMutex );
+	breathKick = 1;
+	pthread_cond_signal(&breathCond );
+	pthread_mutex_unlock(&breathMutex );
+}
+
+/*
+ * Function: breathWaitUntil
+ *
+ * Sleep until dueUs (simRtNowUs)
+ *
+ * Returns: 1 if woken by the next breath sync, 0 at the time
+ */
+static int
+breathWaitUntil(unsigned long long dueUs )
+{
+	struct timespec ts;
+	int kicked;
+	
+	ts.tv_sec = dueUs / 1000000;
+	ts.tv_nsec = ( dueUs % 1000000 ) * 1000;
+	pthread_mutex_lock(&breathMutex );
+	while ( ! breathKick && simRtNowUs() < dueUs )
+	{
+		pthread_cond_timedwait(&breathCond, &breathMutex, &ts );
+	}
+	kicked = breathKick;
+	pthread_mutex_unlock(&breathMutex );
+	return ( kicked );
+}
+
+/*
+ * Function: breathEdge
+ *
+ * Do one edge of the breath
+ */
+static void
+breathEdge(int edge )
+{
+	switch ( edge )
+	{
+		case RESP_EDGE_FALL_OFF:
+		case RESP_EDGE_FALL_END:
+			lungFall(TURN_OFF );
+			fallOnOff = 0;
+			break;
+		case RESP_EDGE_RISE_ON:
+			if ( shmData->respiration.chest_movement )
+			{
+				if ( debug ) printf("ON\n" );
+				lungRise(TURN_ON );
+				riseOnOff = 1;
+			}
+			break;
+		case RESP_EDGE_INHALE:
+			if ( lungState == 0 )
+			{
+				lungState = 1;
+			}
+			break;
+		case RESP_EDGE_RISE_OFF:
+			lungRise(TURN_OFF );
+			riseOnOff = 0;
+			exhLimit = EXH_LIMIT;
+			break;
+		case RESP_EDGE_FALL_ON:
+			if ( shmData->respiration.chest_movement )
+			{
+				lungFall(TURN_ON );
+				fallOnOff = 1;
+			}
+			break;
+	}
+}
+
+/*
+ * Function: chestValves
+ *
+ * Set the valves for a CHEST_VALVE_ state, closing before opening
+ */
+static void
+chestValves(int valve )
+{
+	if ( valve != CHEST_VALVE_RISE )
+	{
+		lungRise(TURN_OFF );
+		riseOnOff = 0;
+	}
+	if ( valve != CHEST_VALVE_FALL )
+	{
+		lungFall(TURN_OFF );
+		fallOnOff = 0;
+	}
+	if ( valve == CHEST_VALVE_RISE )
+	{
+		lungRise(TURN_ON );
+		riseOnOff = 1;
+	}
+	else if ( valve == CHEST_VALVE_FALL )
+	{
+		lungFall(TURN_ON );
+		fallOnOff = 1;
+	}
+}
+
+/*
+ * Function: chestBreath
+ *
+ * Run a breath closed-loop: sample the chest pressure every sample_us until
+ * the next breath sync and let the controller set the valves. The inhale edge
+ * is done at its time as on the open-loop timeline. A breath with no next
+ * sync is run for CHEST_BREATH_LIMIT periods, then the chest is left to
+ * deflate as the open-loop fall does.
+ */
+static void
+chestBreath(const struct respPlan *plan, unsigned long long t0 )
 {
-	if ( sig == HEART_TIMER_SIG )
+	unsigned long long inhaleDue = t0 + plan->at[RESP_EDGE_INHALE] * 1000ULL;
+	unsigned long long endUs = t0 + plan->periodMs * CHEST_BREATH_LIMIT * 1000ULL;
+	unsigned long long due = t0;
+	unsigned long long now = t0;
+	int applied = -1;
+	int inhaled = 0;
+	int valve;
+	char buf[512];
+	
+	chestBreathBegin(&chest, plan, t0 );
+	while ( ! breathWaitUntil(due ) )
 	{
-		if ( heartState == 0 )
+		now = simRtNowUs();
+		if ( shmData->respiration.active || ! shmData->respiration.chest_movement )
 		{
-			heartState = 1;
+			break;		// Manual breath, or chest movement off; runLung has the valves
 		}
-		else if ( heartState == 2 )
+		if ( now >= endUs )
 		{
-			heartState = 3;
+			chestValves(CHEST_VALVE_FALL );
+			chest.valve = CHEST_VALVE_FALL;
+			break;
 		}
-	}
-	else if ( sig == BREATH_TIMER_SIG )
-	{
-		if ( lungState == 0 )
+		if ( ! inhaled && now >= inhaleDue )
 		{
-			lungState = 1;
+			breathEdge(RESP_EDGE_INHALE );
+			inhaled = 1;
 		}
-	}	
+		valve = chestSample(&chest, due, now, ainRead(&chestAin ) );
+		if ( chest.fault )
+		{
+			chestValves(CHEST_VALVE_FALL );
+			snprintf(msgbuf, 1024, "Chest control: no pressure response or read on AIN%d, chest rise is open-loop", AIR_PRESSURE_AIN_CHANNEL );
+			log_message("", msgbuf );
+			shmData->chest_control = 0;
+			break;
+		}
+		if ( valve != applied )
+		{
+			chestValves(valve );
+			applied = valve;
+		}
+		while ( due <= now )
+		{
+			due += chest.cfg.sampleUs;		// Late samples are skipped, not caught up
+		}
+	}
+	if ( applied < 0 )
+	{
+		chest.valve = CHEST_VALVE_HOLD;		// Valves not set this breath
+	}
+	chestBreathEnd(&chest, simRtNowUs() );
+	if ( chest.breath.samples == 0 )
+	{
+		return;
+	}
+	shmData->chest_peak = chest.breath.peak;
+	shmData->chest_error = chestBreathRms(&chest.breath );
+	shmData->chest_error_max = chest.breath.errMax;
+	shmData->chest_rise_duty = chestDuty(chest.breath.riseUs, chest.breath.lenUs );
+	shmData->chest_fall_duty = chestDuty(chest.breath.fallUs, chest.breath.lenUs );
+	simTrace(SIM_TRACE_CHEST, shmData->chest_error, shmData->chest_rise_duty );
+	if ( debug )
+	{
+		chestBreathFormat(&chest, buf, sizeof(buf) );
+		log_message("", buf );
+	}
 }
-#define EXH_LIMIT 400
-int exhLimit = EXH_LIMIT;
-#define INH_LIMIT 1.5
-double inhLimit = INH_LIMIT;
+
+/*
+ * Function: breathEnd
+ *
+ * Account a breath. It is logged if an edge was late, or with debug; the
+ * totals are logged every BREATH_REPORT_SEC.
+ */
+#define BREATH_REPORT_SEC	60
 
 static void
-rise_handler(int sig, siginfo_t *si, void *uc)
+breathEnd(const struct respPlan *plan )
 {
-	if ( shmData->respiration.chest_movement )
+	static unsigned int lastReport = 0;
+	char buf[512];
+	unsigned int now = msec_time();
+	int worst;
+	
+	worst = respBreathWorst(&breathTiming );
+	respTimingAdd(&breathStats, &breathTiming );
+	simTrace(SIM_TRACE_BREATH_TIMING, worst >= 0 ? breathTiming.errUs[worst] : 0, breathTiming.breath );
+	if ( debug || ( worst >= 0 && breathTiming.errUs[worst] > RESP_EDGE_LATE_US ) )
 	{
-		// Stop rise
-		lungRise(TURN_OFF );
-		riseOnOff = 0;
-		usleep(10000);	// Delay 10 MSEC before fall
-		lungFall(TURN_ON );
-		fallOnOff = 1;
+		respBreathFormat(plan, &breathTiming, buf, sizeof(buf) );
+		log_message("", buf );
 	}
-	else
+	if ( now - lastReport >= BREATH_REPORT_SEC * 1000 )
 	{
-		// When chest movement is disabled, 
-		lungRise(TURN_OFF );
-		lungFall(TURN_ON);
-		usleep(10000);
-		lungFall(TURN_OFF );
-		riseOnOff = 0;
-		fallOnOff = 0;
+		lastReport = now;
+		if ( respTimingReport(&breathStats, buf, sizeof(buf) ) > 0 )
+		{
+			snprintf(msgbuf, 1024, "Breath timing: %s", buf );
+			log_message("", msgbuf );
+		}
+		if ( chestReport(&chest, buf, sizeof(buf) ) > 0 )
+		{
+			snprintf(msgbuf, 1024, "Chest control: %s", buf );
+			log_message("", msgbuf );
+		}
+	}
+}
+
+void *
+breath_thread(void *ptr )
+{
+	struct respPlan plan;
+	unsigned long long t0;
+	unsigned long long due;
+	int e;
+	
+	soundRtThreadStart("breath" );
+	while ( 1 )
+	{
+		pthread_mutex_lock(&breathMutex );
+		while ( ! breathKick )
+		{
+			pthread_cond_wait(&breathCond, &breathMutex );
+		}
+		breathKick = 0;
+		pthread_mutex_unlock(&breathMutex );
+		
+		t0 = breathSyncUs;
+		if ( shmData->respiration.active )
+		{
+			continue;	// Manual respiration; runLung holds the valves
+		}
+		respPlanMake(&plan, shmData->respiration.rate,
+			shmData->respiration.inhalation_duration, shmData->respiration.exhalation_duration );
+		respBreathStart(&breathTiming, current.breathCount );
+		inhaleDueUs = t0 + plan.at[RESP_EDGE_INHALE] * 1000ULL;
+		if ( chest.cfg.enable && ! chest.fault && shmData->respiration.chest_movement )
+		{
+			chestBreath(&plan, t0 );
+			breathEnd(&plan );
+			continue;
+		}
+		for ( e = 0 ; e < RESP_EDGES ; e++ )
+		{
+			if ( plan.at[e] < 0 )
+			{
+				continue;
+			}
+			due = t0 + plan.at[e] * 1000ULL;
+			if ( breathWaitUntil(due ) )
+			{
+				break;
+			}
+			breathEdge(e );
+			if ( e != RESP_EDGE_INHALE )
+			{
+				breathTiming.errUs[e] = (int)( simRtNowUs() - due );
+			}
+			if ( jitterMode && e == RESP_EDGE_RISE_ON )
+			{
+				simRtJitterAdd(&jitter[JIT_RISE_ON], due, simRtNowUs() );
+			}
+			else if ( jitterMode && e == RESP_EDGE_RISE_OFF )
+			{
+				simRtJitterAdd(&jitter[JIT_RISE_OFF], due, simRtNowUs() );
+			}
+		}
+		breathEnd(&plan );
 	}
-	exhLimit = EXH_LIMIT;
 }
 
 void
@@ -1357,89 +2514,6 @@ initialize_timers(void )
 		exit ( -1 );
 	}
 	
-	// Breath Timer Setup
-	new_action.sa_flags = SA_SIGINFO;
-	new_action.sa_sigaction = delay_handler;
-	sigemptyset(&new_action.sa_mask);
-	if (sigaction(BREATH_TIMER_SIG, &new_action, NULL) == -1)
-	{
-		perror("sigaction");
-		snprintf(msgbuf, 1024, "sigaction() fails for Breath Timer %s", strerror(errno) );
-		log_message("", msgbuf );
-		exit(-1 );
-	}
-	// Block timer signal temporarily
-	sigemptyset(&mask);
-	sigaddset(&mask, BREATH_TIMER_SIG);
-	if (sigprocmask(SIG_SETMASK, &mask, NULL) == -1)
-	{
-		perror("sigprocmask");
-		snprintf(msgbuf, 1024, "sigprocmask() fails for Breath Timer %s", strerror(errno) );
-		log_message("", msgbuf );
-		exit ( -1 );
-	}
-	// Create the Timer
-	breath_sev.sigev_notify = SIGEV_SIGNAL;
-	breath_sev.sigev_signo = BREATH_TIMER_SIG;
-	breath_sev.sigev_value.sival_ptr = &breath_timer;
-	
-	if ( timer_create(CLOCK_MONOTONIC, &breath_sev, &breath_timer ) == -1 )
-	{
-		perror("timer_create" );
-		snprintf(msgbuf, 1024, "timer_create() fails for Breath Timer %s", strerror(errno) );
-		log_message("", msgbuf );
-		exit (-1);
-	}
-	
-    if (sigprocmask(SIG_UNBLOCK, &mask, NULL) == -1)
-    {
-		perror("sigprocmask");
-		snprintf(msgbuf, 1024, "sigprocmask() fails for Breath Timer %s", strerror(errno) );
-		log_message("", msgbuf );
-		exit ( -1 );
-	}
-	
-	// Rise Timer Setup
-	new_action.sa_flags = SA_SIGINFO;
-	new_action.sa_sigaction = rise_handler;
-	sigemptyset(&new_action.sa_mask);
-	if (sigaction(RISE_TIMER_SIG, &new_action, NULL) == -1)
-	{
-		perror("sigaction");
-		snprintf(msgbuf, 1024, "sigaction() fails for Rise Timer %s", strerror(errno) );
-		log_message("", msgbuf );
-		exit(-1 );
-	}
-	// Block timer signal temporarily
-	sigemptyset(&mask);
-	sigaddset(&mask, RISE_TIMER_SIG);
-	if (sigprocmask(SIG_SETMASK, &mask, NULL) == -1)
-	{
-		perror("sigprocmask");
-		snprintf(msgbuf, 1024, "sigprocmask() fails for Rise Timer %s", strerror(errno) );
-		log_message("", msgbuf );
-		exit ( -1 );
-	}
-	// Create the Timer
-	rise_sev.sigev_notify = SIGEV_SIGNAL;
-	rise_sev.sigev_signo = RISE_TIMER_SIG;
-	rise_sev.sigev_value.sival_ptr = &rise_timer;
-	
-	if ( timer_create(CLOCK_MONOTONIC, &rise_sev, &rise_timer ) == -1 )
-	{
-		perror("timer_create" );
-		snprintf(msgbuf, 1024, "timer_create() fails for Rise Timer %s", strerror(errno) );
-		log_message("", msgbuf );
-		exit (-1);
-	}
-	
-    if (sigprocmask(SIG_UNBLOCK, &mask, NULL) == -1)
-    {
-		perror("sigprocmask");
-		snprintf(msgbuf, 1024, "sigprocmask() fails for Rise Timer %s", strerror(errno) );
-		log_message("", msgbuf );
-		exit ( -1 );
-	}
 }
 
 void
@@ -1483,13 +2557,8 @@ lungRise(int control )
 void 
 runLung( void )
 {
-	struct itimerspec its;
-	long int delayTime;	// Delay in ns
-	double periodSeconds;
-	double inhTime;
-	double fractional;
-	double integer;
 	time_t now;
+	int breathMs;
 	
 	if ( ! shmData->respiration.chest_movement )
 	{
@@ -1532,81 +2601,7 @@ runLung( void )
 				}
 				if ( lungLast != current.breathCount )
 				{
-					lungLast = current.breathCount;
-				// Breath Timer
-					// Clear the interval, run single execution
-					its.it_interval.tv_sec = 0;
-					its.it_interval.tv_nsec = 0;
-					
-					// Set First expiration as the interval plus the delay
-					its.it_value.tv_sec = 0;
-					delayTime = 40000000;	// Delay in ns
-					its.it_value.tv_nsec = delayTime;
-					if (timer_settime(breath_timer, 0, &its, NULL) == -1)
-					{
-						perror("runLung: timer_settime");
-						snprintf(msgbuf, 1024, "runLung: timer_settime: %s", strerror(errno) );
-						log_message("", msgbuf );
-						exit ( -1 );
-					}
-					lungFall(TURN_OFF );
-					fallOnOff = 0;
-					usleep(10000);
-
-					if ( shmData->respiration.chest_movement )
-					{
-						if ( debug ) printf("ON\n" );
-						lungRise(TURN_ON );
-					}
-					riseOnOff = 1;
-				// Rise Timer
-					// Clear the interval, run single execution
-					its.it_interval.tv_sec = 0;
-					its.it_interval.tv_nsec = 0;
-					
-					// The duration should be 30% of the respiration period
-#define INH_PERCENT		(0.30)
-					if ( shmData->respiration.rate > 0 )
-					{
-						periodSeconds = ( 1 / (double)shmData->respiration.rate ) * 60;
-					}
-					else
-					{
-						periodSeconds = 2;
-					}
-					inhTime = periodSeconds * INH_PERCENT;
-					if ( inhTime > inhLimit )
-					{
-						inhTime = inhLimit;
-					}
-					
-					if ( inhTime < 0 )
-					{
-						snprintf(msgbuf, 1024, "runLung: rise inhTime (%f) is negative. period %f rate %d", inhTime, periodSeconds, shmData->respiration.rate );
-						inhTime = inhLimit;
-						log_message("", msgbuf );
-					}
-					fractional = modf(inhTime, &integer );
-					its.it_value.tv_sec = (int)integer;
-					delayTime = fractional * 1000000000; //Seconds to nanoseconds
-
-					if ( delayTime < 0 )
-					{
-						snprintf(msgbuf, 1024, "runLung: rise delayTime is negative for inhTime %f rate %d", inhTime, shmData->respiration.rate );
-						delayTime = 0;
-						log_message("", msgbuf );
-					}
-					its.it_value.tv_nsec = delayTime;
-					
-					if (timer_settime(rise_timer, 0, &its, NULL) == -1)
-					{
-						//perror("runLung: rise timer_settime");
-						snprintf(msgbuf, 1024, "runLung: rise timer_settime: %s", strerror(errno) );
-						log_message("", msgbuf );
-						snprintf(msgbuf, 1024, "runLung: periodSeconds %f, (%ld : %ld)", periodSeconds, its.it_value.tv_sec, its.it_value.tv_nsec );
-						log_message("", msgbuf );
-						exit ( -1 );
-					}
+					lungLast = current.breathCount;		// Run by the breath thread
 				}
 				else if ( current.respiration_rate == 0 )
 				{
@@ -1622,15 +2617,27 @@ runLung( void )
 				}
 				break;
 			case 1:
+				commitLung();
 				if ( shmData->auscultation.side > 0 &&  shmData->auscultation.side < 4 )
 				{
+					breathMs = shmData->respiration.rate > 0 ? 60000 / shmData->respiration.rate : 0;
+					audioSchedGroupBegin(AUDIO_GROUP_BREATH );
 					if ( shmData->auscultation.side == 1 )
 					{
-						wav.trackPlayPoly(0, inhL);
+						audioSchedPlay(AUDIO_SRC_LUNG_L, inhL, breathMs );
+						audioSchedCancel(AUDIO_SRC_LUNG_R );	// Loaded for a side no longer listened to
 					}
 					else
 					{
-						wav.trackPlayPoly(0, inhR);
+						audioSchedPlay(AUDIO_SRC_LUNG_R, inhR, breathMs );
+						audioSchedCancel(AUDIO_SRC_LUNG_L );
+					}
+					audioSchedGroupRelease();
+					simSpanEnd(SIM_METRIC_SYNC_BREATH, breathSyncUs );
+					breathTiming.errUs[RESP_EDGE_INHALE] = (int)( simRtNowUs() - inhaleDueUs );
+					if ( jitterMode )
+					{
+						simRtJitterAdd(&jitter[JIT_INHALE], inhaleDueUs, simRtNowUs() );
 					}
 
 					if ( debug > 1 )
@@ -1715,70 +2722,132 @@ int getPulseVolume(int pressure, int strength )
 	return ( pulseVolume );
 }
 
-void doPulse(void )
+static int
+pulseStrength(int position )
+{
+	switch ( position )
+	{
+		case PULSE_LEFT_FEMORAL:
+			return ( shmData->cardiac.left_femoral_pulse_strength );
+		case PULSE_RIGHT_FEMORAL:
+			return ( shmData->cardiac.right_femoral_pulse_strength );
+		case PULSE_LEFT_DORSAL:
+			return ( shmData->cardiac.left_dorsal_pulse_strength );
+		case PULSE_RIGHT_DORSAL:
+			return ( shmData->cardiac.right_dorsal_pulse_strength );
+		default:
+			return ( 0 );
+	}
+}
+
+/*
+ * Function: setPulseGain
+ *
+ * Set the gain for one pulse output from the current touch and pulse strength.
+ * The command is only sent if the gain has changed, unless force is set.
+ */
+static void
+setPulseGain(struct pulseOutput *po, int force )
 {
+	int touch = shmData->pulse.touch[po->position];
+	int strength = pulseStrength(po->position );
 	int pulseVolume;
 	
-	if ( shmData->cardiac.pea )
+	if ( touch && strength > 0 && ! shmData->cardiac.pea )
 	{
-		return;
+		pulseVolume = getPulseVolume(touch, strength ) - 25;
 	}
-	if ( wavPulse->boardType == BOARD_TSUNAMI )
+	else
 	{
-		if ( shmData->pulse.right_femoral && shmData->cardiac.right_femoral_pulse_strength > 0 )
-		{
-			pulseVolume = getPulseVolume(shmData->pulse.right_femoral, shmData->cardiac.right_femoral_pulse_strength );
-			pulseVolume = pulseVolume - 25;
-			shmData->pulse.volume[PULSE_RIGHT_FEMORAL] = pulseVolume;
-			wavPulse->channelGain(3, pulseVolume );
-			wavPulse->trackPlayPoly(3, PULSE_TRACK);
-		}
-		else
-		{
-			wavPulse->channelGain(3, PULSE_VOLUME_OFF );
-			shmData->pulse.volume[PULSE_RIGHT_FEMORAL] = PULSE_VOLUME_OFF;
-		}
-		if ( shmData->pulse.left_femoral && shmData->cardiac.left_femoral_pulse_strength > 0 )
+		pulseVolume = PULSE_VOLUME_OFF;
+	}
+	if ( force || pulseVolume != po->gain )
+	{
+		if ( wavPulse->boardType == BOARD_TSUNAMI )
 		{
-			pulseVolume = getPulseVolume(shmData->pulse.left_femoral, shmData->cardiac.left_femoral_pulse_strength );
-			pulseVolume = pulseVolume - 25;
-			shmData->pulse.volume[PULSE_LEFT_FEMORAL] = pulseVolume;
-			wavPulse->channelGain(2, pulseVolume );
-			wavPulse->trackPlayPoly(2, PULSE_TRACK);
+			wavPulse->channelGain(audioSchedChannel(po->source ), pulseVolume );
 		}
 		else
 		{
-			wavPulse->channelGain(2, PULSE_VOLUME_OFF );
-			shmData->pulse.volume[PULSE_LEFT_FEMORAL] = PULSE_VOLUME_OFF;
+			wavPulse->trackGain(po->track, pulseVolume );
 		}
+		po->gain = pulseVolume;
 	}
-	else
+	shmData->pulse.volume[po->position] = pulseVolume;
+}
+
+void *
+pulse_thread(void *ptr )
+{
+	unsigned int seq;
+	
+	soundRtThreadStart("pulse" );
+	seq = shmData->pulse.touchSeq;
+	while ( 1 )
 	{
-		// For WAV Trigger board.
-		if ( shmData->pulse.right_femoral && shmData->cardiac.right_femoral_pulse_strength > 0 ) 
-		{
-			pulseVolume = getPulseVolume(shmData->pulse.right_femoral, shmData->cardiac.right_femoral_pulse_strength );
-			pulseVolume = pulseVolume - 25;
-			shmData->pulse.volume[PULSE_RIGHT_FEMORAL] = pulseVolume;
-			wavPulse->trackGain(PULSE_TRACK_RIGHT, pulseVolume );
-			wavPulse->trackPlayPoly(0, PULSE_TRACK_RIGHT);
-		}
-		else
+		seq = simEventWait(&shmData->pulse.touchSeq, seq );
+		simModuleKick(SIM_MODULE_SOUND );
+	}
+	return ( NULL );
+}
+
+/*
+ * Function: soundPulseEvent
+ *
+ * Module event, on the loop thread after pulse_thread saw a touch event. Sets
+ * the gain of each output whose touch changed and records the latency.
+ */
+void
+soundPulseEvent(void )
+{
+	static unsigned int lastTouch[PULSE_POINTS_MAX] = { 0, };
+	struct pulseOutput *po;
+	unsigned int now;
+	int total;
+	int i;
+	
+	__sync_synchronize();
+	for ( i = 0 ; i < PULSE_OUTPUTS ; i++ )
+	{
+		po = &pulseOutputs[i];
+		if ( shmData->pulse.touchTime[po->position] == lastTouch[po->position] )
 		{
-			wavPulse->trackGain(PULSE_TRACK_RIGHT, PULSE_VOLUME_OFF );
+			continue;
 		}
-		if ( shmData->pulse.left_femoral && shmData->cardiac.left_femoral_pulse_strength > 0 )
+		lastTouch[po->position] = shmData->pulse.touchTime[po->position];
+		setPulseGain(po, 0 );
+		now = msec_time();
+		shmData->pulse.gainTime[po->position] = now;
+		shmData->pulse.gainLatency[po->position] = (int)( now - shmData->pulse.touchTime[po->position] );
+		total = (int)( now - shmData->pulse.pressTime[po->position] );
+		if ( total > shmData->pulse.latencyMax[po->position] )
 		{
-			pulseVolume = getPulseVolume(shmData->pulse.left_femoral, shmData->cardiac.left_femoral_pulse_strength );
-			pulseVolume = pulseVolume - 25;
-			shmData->pulse.volume[PULSE_LEFT_FEMORAL] = pulseVolume;
-			wavPulse->trackGain(PULSE_TRACK_LEFT, pulseVolume );
-			wavPulse->trackPlayPoly(0, PULSE_TRACK_LEFT);
+			shmData->pulse.latencyMax[po->position] = total;
 		}
-		else
+	}
+}
+
+void doPulse(void )
+{
+	struct pulseOutput *po;
+	int i;
+	
+	if ( shmData->cardiac.pea )
+	{
+		return;
+	}
+	for ( i = 0 ; i < PULSE_OUTPUTS ; i++ )
+	{
+		po = &pulseOutputs[i];
+		// Catch strength changes. Touch changes are handled by soundPulseEvent.
+		setPulseGain(po, 0 );
+		if ( pulseStrength(po->position ) > 0 )
 		{
-			wavPulse->trackGain(PULSE_TRACK_LEFT, PULSE_VOLUME_OFF );
+			audioSchedPlay(po->source, wavPulse->boardType == BOARD_TSUNAMI ? PULSE_TRACK : po->track, 0 );
 		}
+	}
+	if ( wavPulse->boardType != BOARD_TSUNAMI )
+	{
 		wavPulse->masterGain(PULSE_VOLUME_ON );
 	}
 	/*
@@ -1865,12 +2934,40 @@ void doPulse(void )
 
 char lastTag[STR_SIZE];
 
+static const char *pulseNames[PULSE_POINTS_MAX] = { "", "RD", "RF", "LD", "LF" };
+
 void
 runMonitor(void )
 {
+	unsigned int lastGain[PULSE_POINTS_MAX];
+	int loops = 0;
+	int pos;
 	
+	for ( pos = 0 ; pos < PULSE_POINTS_MAX ; pos++ )
+	{
+		lastGain[pos] = shmData->pulse.gainTime[pos];
+	}
 	while ( 1 )
 	{
+		// Press-to-feel latency, for each touch event handled by soundSense
+		for ( pos = 1 ; pos < PULSE_POINTS_MAX ; pos++ )
+		{
+			if ( shmData->pulse.gainTime[pos] != lastGain[pos] )
+			{
+				lastGain[pos] = shmData->pulse.gainTime[pos];
+				printf("pulse %s: touch %d volume %d  press-to-feel %d ms (detect %d + gain %d), max %d ms\n",
+					pulseNames[pos], shmData->pulse.touch[pos], shmData->pulse.volume[pos],
+					(int)( shmData->pulse.gainTime[pos] - shmData->pulse.pressTime[pos] ),
+					shmData->pulse.detectLatency[pos], shmData->pulse.gainLatency[pos],
+					shmData->pulse.latencyMax[pos] );
+			}
+		}
+		if ( loops++ < 10 )
+		{
+			usleep(50000 );
+			continue;
+		}
+		loops = 0;
 		if ( debug > 1 )
 		{
 			if ( strcmp(shmData->auscultation.tag, lastTag ) != 0 )
@@ -1889,6 +2986,5 @@ runMonitor(void )
 					shmData->auscultation.tag, 
 					shmData->manual_breath_ain, shmData->manual_breath_baseline, shmData->respiration.manual_breath ? " - Breath" : "" );
 		}
-		usleep(500000 );
 	}
 }
@@ -35,9 +35,15 @@
 // **************************************************************
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
 #include "wavTrigger.h"
+#include "../comm/simMetrics.h"
+#include "../comm/simTrace.h"
 
 #include <syslog.h>
 
@@ -46,6 +52,91 @@ wavTrigger::wavTrigger(void)
 	sioPort = -1;
 	wavIndex = -1;
 	boardType = BOARD_UNKNOWN;
+	stub = 0;
+	stubReplyLen = 0;
+	stubReplyPos = 0;
+	stubLoopedCount = 0;
+	batching = 0;
+	batchLen = 0;
+	batchBytes = 0;
+}
+
+// **************************************************************
+// Every command is one write, timed as SIM_METRIC_WAV_CMD, unless it is
+// held in a batch
+void wavTrigger::sendCommand(char *txbuf, int len) {
+
+unsigned long long start;
+
+  if ( batching && pthread_equal(batchThread, pthread_self() ) )
+  {
+	  batchBytes += len;
+  }
+  if ( stub )
+  {
+	  stubCommand(txbuf, len);
+	  return;
+  }
+  if ( batching && pthread_equal(batchThread, pthread_self() ) )
+  {
+	  if ( batchLen + len > WAV_BATCH_MAX )
+	  {
+		  batchWrite();
+	  }
+	  memcpy(&batchBuf[batchLen], txbuf, len );
+	  batchLen += len;
+	  return;
+  }
+  start = simSpanStart();
+  if ( write(sioPort, txbuf, len ) != len )
+  {
+	  simMetricError(SIM_METRIC_WAV_CMD );
+  }
+  simSpanEnd(SIM_METRIC_WAV_CMD, start );
+}
+
+// **************************************************************
+// Commands sent from this thread from now on are held and written together
+// by batchFlush, as one write timed as SIM_METRIC_WAV_CMD. A query
+// (getStatus etc.) writes the held commands first.
+void wavTrigger::batchBegin(void) {
+
+  if ( batching && ! pthread_equal(batchThread, pthread_self() ) )
+  {
+	  return;	// Another thread's batch; this thread's commands go out singly
+  }
+  batchThread = pthread_self();
+  batching = 1;
+  batchBytes = 0;
+}
+
+// **************************************************************
+void wavTrigger::batchFlush(void) {
+
+  if ( ! batching || ! pthread_equal(batchThread, pthread_self() ) )
+  {
+	  return;
+  }
+  batchWrite();
+  batching = 0;
+}
+
+// **************************************************************
+void wavTrigger::batchWrite(void) {
+
+unsigned long long start;
+
+  if ( batchLen == 0 )
+  {
+	  return;
+  }
+  start = simSpanStart();
+  if ( write(sioPort, batchBuf, batchLen ) != batchLen )
+  {
+	  simMetricError(SIM_METRIC_WAV_CMD );
+  }
+  simSpanEnd(SIM_METRIC_WAV_CMD, start );
+  batchLen = 0;
 }
 
 // **************************************************************
@@ -55,6 +146,98 @@ void wavTrigger::start(int port, int index ) {
   boardType = BOARD_UNKNOWN;
 }
 
+// **************************************************************
+// Used for session replay on a machine without the board. The port is
+// /dev/null so nothing that bypasses the stub can reach a real device.
+void wavTrigger::startStub(int index) {
+  sioPort = open("/dev/null", O_RDWR );
+  wavIndex = index;
+  boardType = BOARD_UNKNOWN;
+  stub = 1;
+  stubReplyLen = 0;
+  stubReplyPos = 0;
+  stubLoopedCount = 0;
+}
+
+// **************************************************************
+// Follow a command frame, and queue the answer to a query
+void wavTrigger::stubCommand(char *txbuf, int len) {
+
+static const char version[] = "Tsunami v1.10m (c)2019";
+int trk;
+int i;
+int n = 0;
+
+  stubReplyLen = 0;
+  stubReplyPos = 0;
+  switch ( txbuf[3] )
+  {
+	case CMD_TRACK_CONTROL:
+	  trk = (unsigned char)txbuf[5] | ( (unsigned char)txbuf[6] << 8 );
+	  for ( i = 0 ; i < stubLoopedCount ; i++ )
+	  {
+		  if ( stubLooped[i] == trk )
+		  {
+			  break;
+		  }
+	  }
+	  if ( txbuf[4] == TRK_LOOP_ON && i == stubLoopedCount && i < WAV_STUB_TRACKS )
+	  {
+		  stubLooped[stubLoopedCount++] = trk;
+	  }
+	  else if ( ( txbuf[4] == TRK_LOOP_OFF || txbuf[4] == TRK_STOP ) && i < stubLoopedCount )
+	  {
+		  stubLooped[i] = stubLooped[--stubLoopedCount];
+	  }
+	  break;
+	case CMD_STOP_ALL:
+	  stubLoopedCount = 0;
+	  break;
+	case CMD_GET_VERSION:
+	  stubReply[n++] = CMD_VERSION_STRING;
+	  memcpy(&stubReply[n], version, strlen(version) );
+	  n += strlen(version);
+	  break;
+	case CMD_GET_SYS_INFO:
+	  stubReply[n++] = CMD_SYS_INFO;
+	  stubReply[n++] = 18;		// Voices
+	  stubReply[n++] = 0x00;	// Tracks, 4096
+	  stubReply[n++] = 0x10;
+	  break;
+	case CMD_GET_STATUS:
+	  stubReply[n++] = CMD_STATUS;
+	  for ( i = 0 ; i < stubLoopedCount ; i++ )
+	  {
+		  stubReply[n++] = (unsigned char)stubLooped[i];
+		  stubReply[n++] = (unsigned char)( stubLooped[i] >> 8 );
+	  }
+	  break;
+	default:
+	  break;
+  }
+  if ( n > 0 )
+  {
+	  // Frame it as the board does: start, length, data, stop
+	  memmove(&stubReply[3], stubReply, n );
+	  stubReply[0] = 0xf0;
+	  stubReply[1] = 0xaa;
+	  stubReply[2] = n + 4;
+	  stubReply[n + 3] = 0x55;
+	  stubReplyLen = n + 4;
+  }
+}
+
+// **************************************************************
+int wavTrigger::stubRead(char *buf) {
+
+  if ( stubReplyPos >= stubReplyLen )
+  {
+	  return ( 0 );
+  }
+  *buf = stubReply[stubReplyPos++];
+  return ( 1 );
+}
+
 // **************************************************************
 // For Tsunami, this will set the Volume for Channel 0
 void wavTrigger::masterGain(int gain) {
@@ -81,7 +264,8 @@ int len;
   txbuf[6] = 0x55;
   len = 7;
   
-  write(sioPort, txbuf, len );
+  sendCommand(txbuf, len);
+  simTrace(SIM_TRACE_GAIN, -1, gain );
 }
 
 // **************************************************************
@@ -107,7 +291,8 @@ int len;
   txbuf[7] = 0x55;
   len = 8;
   
-  write(sioPort, txbuf, len );
+  sendCommand(txbuf, len);
+  simTrace(SIM_TRACE_GAIN, chan, gain );
 }
 // **************************************************************
 void wavTrigger::trackPlaySolo(int chan, int trk) {
@@ -135,6 +320,16 @@ void wavTrigger::trackLoad(int chan, int trk) {
   trackControl(chan, trk, TRK_LOAD);
 }
 
+// **************************************************************
+// Start the track as trackPlayPoly does, but paused. Every track loaded
+// this way starts on the same sample with the next resumeAllInSync.
+void wavTrigger::trackPlaySync(int chan, int trk) {
+  
+  trackControl(chan, trk, TRK_LOOP_OFF);
+  trackControl(chan, trk, TRK_STOP);
+  trackControl(chan, trk, TRK_LOAD);
+}
+
 // **************************************************************
 void wavTrigger::trackStop(int chan, int trk) {
 
@@ -204,7 +399,8 @@ int i;
 	// }
 	// printf("\n" );
 	
-  write(sioPort, txbuf, len);
+  sendCommand(txbuf, len);
+  simTrace(SIM_TRACE_TRACK, trk, code );
 }
 
 // **************************************************************
@@ -221,7 +417,7 @@ char txbuf[10];
   txbuf[2] = 0x05;
   txbuf[3] = CMD_STOP_ALL;
   txbuf[4] = 0x55;
-  write(sioPort, txbuf, 5);
+  sendCommand(txbuf, 5);
 }
 
 // **************************************************************
@@ -238,7 +434,7 @@ char txbuf[10];
   txbuf[2] = 0x05;
   txbuf[3] = CMD_RESUME_ALL_SYNC;
   txbuf[4] = 0x55;
-  write(sioPort, txbuf, 5);
+  sendCommand(txbuf, 5);
 }
 
 // **************************************************************
@@ -261,7 +457,8 @@ unsigned short vol;
   txbuf[6] = (char)vol;
   txbuf[7] = (char)(vol >> 8);
   txbuf[8] = 0x55;
-  write(sioPort, txbuf, 9);
+  sendCommand(txbuf, 9);
+  simTrace(SIM_TRACE_GAIN, 1000 + trk, gain );
 }
 
 // **************************************************************
@@ -287,7 +484,7 @@ unsigned short vol;
   txbuf[9] = (char)(time >> 8);
   txbuf[10] = stopFlag;
   txbuf[11] = 0x55;
-  write(sioPort, txbuf, 12);
+  sendCommand(txbuf, 12);
 }
 
 // **************************************************************
@@ -318,7 +515,7 @@ unsigned short vol;
   txbuf[9] = (char)(time >> 8);
   txbuf[10] = 0x00;
   txbuf[11] = 0x55;
-  write(sioPort, txbuf, 12);
+  sendCommand(txbuf, 12);
 
   // Start a fade-out on the From track
   txbuf[0] = 0xf0;
@@ -334,7 +531,7 @@ unsigned short vol;
   txbuf[9] = (char)(time >> 8);
   txbuf[10] = 0x01;
   txbuf[11] = 0x55;
-  write(sioPort, txbuf, 12);
+  sendCommand(txbuf, 12);
 }
 
 // **************************************************************
@@ -355,7 +552,36 @@ unsigned short off;
   txbuf[4] = (char)off;
   txbuf[5] = (char)(off >> 8);
   txbuf[6] = 0x55;
-  write(sioPort, txbuf, 7);
+  sendCommand(txbuf, 7);
+}
+
+// **************************************************************
+// The Tsunami has an offset per output. -32767 to 32767 is -1 to +1 octave.
+// The WAV Trigger has only the global one.
+void wavTrigger::samplerateOffset(int chan, int offset) {
+
+char txbuf[10];
+unsigned short off;
+  if ( sioPort < 0 )
+  {
+	  return;
+  }
+  if ( boardType != BOARD_TSUNAMI )
+  {
+	  samplerateOffset(offset );
+	  return;
+  }
+
+  txbuf[0] = 0xf0;
+  txbuf[1] = 0xaa;
+  txbuf[2] = 0x08;
+  txbuf[3] = CMD_SAMPLERATE_OFFSET;
+  txbuf[4] = (char)chan;
+  off = (unsigned short)offset;
+  txbuf[5] = (char)off;
+  txbuf[6] = (char)(off >> 8);
+  txbuf[7] = 0x55;
+  sendCommand(txbuf, 8);
 }
 
 // **************************************************************
@@ -374,7 +600,56 @@ unsigned short off;
   txbuf[3] = CMD_AMP_POWER;
   txbuf[4] = on;
   txbuf[5] = 0x55;
-  write(sioPort, txbuf, 6);
+  sendCommand(txbuf, 6);
+}
+
+// **************************************************************
+// Ask for the version every stepMs until the board answers, for at most
+// waitMs, in place of a fixed wait for it to settle after power-up. The
+// answer is dropped; getVersion asks again.
+// Returns the ms until the board answered, or -1 if it did not
+int wavTrigger::probe(int waitMs, int stepMs) {
+char txbuf[10];
+char rxbuf[64];
+struct pollfd pfd;
+struct timespec t0;
+struct timespec now;
+int waited = 0;
+
+  if ( sioPort < 0 )
+  {
+	  return ( -1 );
+  }
+  if ( stub )
+  {
+	  return ( 0 );
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t0 );
+  while ( waited < waitMs )
+  {
+	  txbuf[0] = 0xf0;
+	  txbuf[1] = 0xaa;
+	  txbuf[2] = 0x05;
+	  txbuf[3] = CMD_GET_VERSION;
+	  txbuf[4] = 0x55;
+	  sendCommand(txbuf, 5);
+	  pfd.fd = sioPort;
+	  pfd.events = POLLIN;
+	  pfd.revents = 0;
+	  if ( poll(&pfd, 1, stepMs ) > 0 && ( pfd.revents & POLLIN ) )
+	  {
+		  getReturnData(rxbuf, sizeof(rxbuf) );
+		  clock_gettime(CLOCK_MONOTONIC, &now );
+		  // An answer to an earlier query may still be on the way
+		  usleep(WAV_PROBE_DRAIN_MS * 1000 );
+		  tcflush(sioPort, TCIFLUSH );
+		  return ( (int)( ( now.tv_sec - t0.tv_sec ) * 1000 + ( now.tv_nsec - t0.tv_nsec ) / 1000000 ) );
+	  }
+	  clock_gettime(CLOCK_MONOTONIC, &now );
+	  waited = (int)( ( now.tv_sec - t0.tv_sec ) * 1000 + ( now.tv_nsec - t0.tv_nsec ) / 1000000 );
+  }
+  tcflush(sioPort, TCIFLUSH );
+  return ( -1 );
 }
 
 // **************************************************************
@@ -395,7 +670,7 @@ int year;
   txbuf[2] = 0x05;
   txbuf[3] = CMD_GET_VERSION;
   txbuf[4] = 0x55;
-  write(sioPort, txbuf, 6);
+  sendCommand(txbuf, 6);
   len = getReturnData(buf, maxLen );
   
   if ( len == 0x19 || len == 21)
@@ -439,7 +714,7 @@ unsigned short off;
   txbuf[2] = 0x05;
   txbuf[3] = CMD_GET_SYS_INFO;
   txbuf[4] = 0x55;
-  write(sioPort, txbuf, 6);
+  sendCommand(txbuf, 6);
   return(getReturnData(buf, maxLen ) );
 }
 
@@ -457,7 +732,7 @@ unsigned short off;
   txbuf[2] = 0x05;
   txbuf[3] = CMD_GET_STATUS;
   txbuf[4] = 0x55;
-  write(sioPort, txbuf, 6);
+  sendCommand(txbuf, 6);
   return(getReturnData(buf, maxLen ) );
 }
 
@@ -474,24 +749,28 @@ int wavTrigger::getReturnData(char *buf, int maxLen) {
 	{
 	  return ( -1 );
 	}
+	if ( batching && pthread_equal(batchThread, pthread_self() ) )
+	{
+	  batchWrite();	// The query is the last command held
+	}
 	memset(buf, 0, maxLen );
 	// Read input until we get a Start (0xF0, 0xAA)
 	for ( i = 0 ; i < ( maxLen + 4 ) ;  loops++ )
 	{
-		sts = read(sioPort, &buf[i], 1 );
+		sts = stub ? stubRead(&buf[i] ) : read(sioPort, &buf[i], 1 );
 		if ( sts > 0 )
 		{
 			switch ( state )
 			{
 				case 0:  // Read Start Byte 0
-					if ( buf[i] == 0xF0 )
+					if ( (unsigned char)buf[i] == 0xF0 )
 					{
 						state++;
 						//printf ("F0 " );
 					}
 					break;
 				case 1: // Read Start Byte 1
-					if ( buf[i] == 0xAA )
+					if ( (unsigned char)buf[i] == 0xAA )
 					{
 						state++;
 						//printf ("AA " );
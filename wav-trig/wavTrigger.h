@@ -55,6 +55,8 @@
 #ifndef WAVTRIGGER_H
 #define WAVTRIGGER_H
 
+#include <pthread.h>
+
 // Board Types
 #define BOARD_UNKNOWN			-1
 #define BOARD_WAV_TRIGGER		0
@@ -104,6 +106,19 @@
 #define TRK_LOOP_OFF	6
 #define TRK_LOAD		7
 
+#define WAV_STUB_TRACKS	16
+
+// Commands held between batchBegin and batchFlush go out in one write. At
+// 57600 baud this is about 90 ms of commands.
+#define WAV_BATCH_MAX	512
+
+// Serial time per byte (8N1 at 57600), for the skew between commands
+#define WAV_BAUD			57600
+#define WAV_BYTE_NS			( 10 * 1000000000LL / WAV_BAUD )
+
+// After the probe is answered, time for a late answer to arrive to be dropped
+#define WAV_PROBE_DRAIN_MS	20
+
 
 class wavTrigger
 {
@@ -112,6 +127,7 @@ public:
 	virtual ~wavTrigger();
 	
 	void start(int sioPort, int index);
+	void startStub(int index);	// No board: commands are only traced, a Tsunami (mono) answers queries
 	void masterGain(int gain);
 	void channelGain(int chan, int gain);
 	void stopAllTracks(void);
@@ -119,6 +135,7 @@ public:
 	void trackPlaySolo(int chan, int trk);
 	void trackPlayPoly(int chan, int trk);
 	void trackLoad(int chan, int trk);
+	void trackPlaySync(int chan, int trk);	// trackPlayPoly, but loaded paused for resumeAllInSync
 	void trackStop(int chan, int trk);
 	void trackPause(int chan, int trk);
 	void trackResume(int chan, int trk);
@@ -127,7 +144,9 @@ public:
 	void trackFade(int trk, int gain, int time, bool stopFlag);
 	void trackCrossFade(int chan, int trkFrom, int trkTo, int gain, int time);
 	void samplerateOffset(int offset);
+	void samplerateOffset(int chan, int offset);	// Tsunami: one output
 	void ampPower(int on);
+	int probe(int waitMs, int stepMs );	// Wait for the board to answer; ms taken, -1 if none
 	int getVersion(char *buf, int maxLen );
 	int getSysInfo(char *buf, int maxLen );
 	int getStatus(char *buf, int maxLen );
@@ -136,17 +155,40 @@ public:
 	int getTrackStatus(int trk); // Returns 1 if the track is playing, else 0. Gathers track status and returns the status of the indicated track
 	int checkTrack(int trk ); // Checks the already gathered status and returns the status for the track
 	void show(void );
+	void batchBegin(void );	// Hold commands from this thread until batchFlush
+	void batchFlush(void );	// Write the held commands and stop holding
 	int wavIndex;
+	unsigned long batchBytes;	// Bytes of commands from the batch thread since batchBegin
 	
 	int boardType;
 	char boardFWVersion[32];
 	int tsunamiMode;
 	
 private:
+	void sendCommand(char *txbuf, int len);
+	void stubCommand(char *txbuf, int len);
+	int stubRead(char *buf);
 	void trackControl(int chan, int trk, int code);
 	int getReturnData(char *buf, int maxLen );
+	void batchWrite(void );
 	int	sioPort;	// The current port
 
+	// Batch. Only the thread that began it adds to it; commands from other
+	// threads (the pulse gains) are written at once.
+	int batching;
+	pthread_t batchThread;
+	char batchBuf[WAV_BATCH_MAX];
+	int batchLen;
+
+	// Stub board. Tracks are only reported as playing while looped, as their
+	// lengths are not known.
+	int stub;
+	unsigned char stubReply[64];
+	int stubReplyLen;
+	int stubReplyPos;
+	int stubLooped[WAV_STUB_TRACKS];
+	int stubLoopedCount;
+
 };
 
 #endif